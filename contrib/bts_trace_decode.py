@@ -0,0 +1,73 @@
+#!/usr/bin/env python
+
+"""
+Decode a trace file written by the 'trace dump FILE' VTY command, see
+include/osmo-bts/trace.h for the format.  Records of all threads are
+merged and printed in time order.
+"""
+
+import struct, sys
+
+FILE_HDR = struct.Struct('<IHHI')
+RING_HDR = struct.Struct('<II16sQI')
+REC = struct.Struct('<QIIHBBB3x')
+
+FILE_MAGIC = 0x4254524b
+RING_MAGIC = 0x42545247
+
+# enum bts_trace_event
+EVENTS = [ 'NONE', 'PH-RTS.ind', 'PH-DATA.req', 'PH-DATA.ind',
+	'TCH-RTS.ind', 'TCH.req', 'TCH.ind', 'PH-RA.ind',
+	'DL-burst', 'UL-burst' ]
+SCHED_EVENTS = ( 8, 9 )
+
+# enum trx_chan_type
+CHANS = [ 'IDLE', 'FCCH', 'SCH', 'BCCH', 'RACH', 'CCCH', 'TCH/F',
+	'TCH/H(0)', 'TCH/H(1)' ] + \
+	[ 'SDCCH/4(%d)' % i for i in range(4) ] + \
+	[ 'SDCCH/8(%d)' % i for i in range(8) ] + \
+	[ 'SACCH/TF', 'SACCH/TH(0)', 'SACCH/TH(1)' ] + \
+	[ 'SACCH/4(%d)' % i for i in range(4) ] + \
+	[ 'SACCH/8(%d)' % i for i in range(8) ] + \
+	[ 'PDTCH', 'PTCCH' ]
+
+def read(f, s):
+	buf = f.read(s.size)
+	if len(buf) != s.size:
+		raise IOError("truncated trace file")
+	return s.unpack(buf)
+
+def decode(path):
+	recs = []
+	with open(path, 'rb') as f:
+		magic, version, rec_size, num_rings = read(f, FILE_HDR)
+		if magic != FILE_MAGIC or rec_size != REC.size:
+			raise IOError("not a trace file, or unknown version %u" % version)
+		for i in range(num_rings):
+			magic, tid, name, lost, num = read(f, RING_HDR)
+			if magic != RING_MAGIC:
+				raise IOError("bad ring header")
+			name = name.split(b'\0')[0].decode('ascii', 'replace')
+			if lost:
+				sys.stderr.write("thread %u (%s): %u records lost\n"
+						% (tid, name, lost))
+			for j in range(num):
+				recs.append(read(f, REC) + (tid,))
+
+	recs.sort(key=lambda r: r[0])
+	t0 = recs[0][0] if recs else 0
+	for time_ns, fn, arg, ev, trx, tn, chan, tid in recs:
+		evname = EVENTS[ev] if ev < len(EVENTS) else 'event-%u' % ev
+		if ev in SCHED_EVENTS:
+			what = "%s bid=%u" % (CHANS[chan] if chan < len(CHANS)
+					      else 'chan-%u' % chan, arg)
+		else:
+			what = "chan_nr=0x%02x arg=%u" % (chan, arg)
+		print("%12.6f tid=%-6u fn=%-7u trx=%u ts=%u %-12s %s"
+			% ((time_ns - t0) / 1e9, tid, fn, trx, tn, evname, what))
+
+if __name__ == '__main__':
+	if len(sys.argv) != 2:
+		sys.stderr.write("usage: %s TRACE-FILE\n" % sys.argv[0])
+		sys.exit(1)
+	decode(sys.argv[1])
@@ -0,0 +1,100 @@
+#ifndef OSMO_BTS_DL_TCH_RING_H
+#define OSMO_BTS_DL_TCH_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+struct msgb;
+
+/* downlink TCH frames received via RTP, waiting for a TCH-RTS.ind.  The
+ * ring is the playout (jitter) buffer of the BTS: frames are stored in
+ * the slot of their RTP sequence number and played out in order. */
+#define DL_TCH_RING_LEN		16	/* power of 2, 320 ms */
+#define DL_TCH_FRAME_MAXLEN	64
+
+/* msgbs of a ring, handed to the PHY and returned when it frees them */
+#define DL_TCH_POOL_LEN		8
+
+/* relative arrival delay, in steps of 20 ms */
+#define DL_TCH_DELAY_HIST_LEN	8
+/* lateness of frames arriving after their playout, in frames */
+#define DL_TCH_LATE_HIST_LEN	4
+
+struct dl_tch_frame {
+	uint32_t timestamp;
+	uint16_t seq;
+	uint8_t len;
+	bool marker;
+	bool valid;
+	uint8_t data[DL_TCH_FRAME_MAXLEN];
+};
+
+struct dl_tch_ring_stats {
+	/* frames received via RTP */
+	uint32_t received;
+	/* frames handed to the PHY */
+	uint32_t played;
+	/* frames missing at their playout, concealed */
+	uint32_t concealed;
+	/* frames arriving after their playout, dropped */
+	uint32_t late;
+	/* frames received more than once */
+	uint32_t duplicate;
+	/* frames dropped to catch up with the sender, lost */
+	uint32_t skipped;
+	/* playout stopped because the buffer ran empty */
+	uint32_t underrun;
+	/* started over on a discontinuity of the RTP stream */
+	uint32_t resync;
+	/* interarrival jitter (RFC 3550), in 1/16 RTP timestamp units */
+	uint32_t jitter;
+	uint32_t delay_hist[DL_TCH_DELAY_HIST_LEN];
+	uint32_t late_hist[DL_TCH_LATE_HIST_LEN];
+};
+
+struct dl_tch_pool;
+
+struct dl_tch_ring {
+	struct dl_tch_frame frame[DL_TCH_RING_LEN];
+	/* msgbs for the PHY, allocated on first use and kept across
+	 * dl_tch_ring_init(), as some may still be in the PHY */
+	struct dl_tch_pool *pool;
+	/* number of frames buffered before playout starts */
+	unsigned int depth;
+	unsigned int max_depth;
+	/* adapt depth to the measured jitter, up to max_depth */
+	bool adaptive;
+	/* playout is running, next_seq is the next frame to be played */
+	bool started;
+	uint16_t next_seq;
+	/* next_seq is valid, also while playout is stopped after an
+	 * underrun, to drop frames older than those played already */
+	bool have_seq;
+	/* SSRC of the stream, valid with have_seq */
+	uint32_t ssrc;
+	/* transit time of the last frame and the smallest one seen, in
+	 * RTP timestamp units */
+	bool have_transit;
+	int32_t transit;
+	int32_t min_transit;
+	struct dl_tch_ring_stats stats;
+};
+
+void dl_tch_ring_init(struct dl_tch_ring *ring, unsigned int max_depth, bool adaptive);
+void dl_tch_ring_set_max_depth(struct dl_tch_ring *ring, unsigned int max_depth);
+void dl_tch_ring_flush(struct dl_tch_ring *ring);
+void dl_tch_ring_resync(struct dl_tch_ring *ring);
+int dl_tch_ring_put(struct dl_tch_ring *ring, const uint8_t *data, unsigned int len,
+		    uint32_t ssrc, uint16_t seq, uint32_t timestamp, bool marker,
+		    const struct timespec *now);
+struct msgb *dl_tch_ring_get(struct dl_tch_ring *ring);
+
+/* interarrival jitter in ms */
+static inline unsigned int dl_tch_ring_jitter_ms(const struct dl_tch_ring *ring)
+{
+	/* 8 timestamp units per ms */
+	return ring->stats.jitter / 16 / 8;
+}
+
+#endif /* OSMO_BTS_DL_TCH_RING_H */
@@ -6,6 +6,7 @@
 #include <osmocom/gsm/lapdm.h>
 
 #include <osmo-bts/paging.h>
+#include <osmo-bts/rach_admission.h>
 #include <osmo-bts/tx_power.h>
 
 #define GSM_FR_BITS	260
@@ -30,7 +31,6 @@ struct gsm_network {
 	struct llist_head bts_list;
 	unsigned int num_bts;
 	uint16_t mcc, mnc;
-	struct pcu_sock_state *pcu_state;
 };
 
 /* data structure for BTS related data specific to the BTS role */
@@ -61,14 +61,19 @@ struct gsm_bts_role_bts {
 			unsigned int total;	/* total nr */
 			unsigned int busy;	/* above busy_thresh */
 			unsigned int access;	/* access bursts */
+			unsigned int percent;	/* busy, last load period */
 		} rach;
 	} load;
 	uint8_t ny1;
 	uint8_t max_ta;
 
 	/* AGCH queuing */
-	struct llist_head agch_queue;
-	int agch_queue_length;
+	struct llist_head agch_queue;		/* IMM.ASS and others */
+	struct llist_head agch_rej_queue;	/* IMM.ASS.REJ */
+	struct msgb *agch_rej_pending;		/* IMM.ASS.REJ being merged */
+	int agch_queue_length;			/* all of the above */
+	int agch_rej_length;			/* IMM.ASS.REJ, pending one included */
+	int agch_rej_wait;			/* main lane msgs sent while a reject waits */
 	int agch_max_queue_length;
 
 	int agch_queue_thresh_level;	/* Cleanup threshold in percent of max len */
@@ -76,17 +81,23 @@ struct gsm_bts_role_bts {
 	int agch_queue_high_level;	/* High water mark in percent of max len */
 
 	/* TODO: Use a rate counter group instead */
-	uint64_t agch_queue_dropped_msgs;
+	uint64_t agch_queue_dropped_msgs;	/* request refs of IMM.ASS.REJ */
 	uint64_t agch_queue_merged_msgs;
 	uint64_t agch_queue_rejected_msgs;
 	uint64_t agch_queue_agch_msgs;
 	uint64_t agch_queue_pch_msgs;
 
+	struct rach_adm rach_adm;
+
 	struct paging_state *paging_state;
 	char *bsc_oml_host;
 	struct llist_head oml_queue;
 	unsigned int rtp_jitter_buf_ms;
 	bool rtp_jitter_adaptive;
+	/* playout buffer in the BTS instead of the RTP library */
+	bool rtp_jitter_bts;
+	/* send uplink RTP frames of all lchans in batches */
+	bool rtp_egress_batch;
 	struct {
 		uint8_t ciphers;	/* flags A5/1==0x1, A5/2==0x2, A5/3==0x4 */
 	} support;
@@ -113,6 +124,10 @@ struct gsm_bts_role_bts {
 
 	struct {
 		char *sock_path;
+		/* listen socket and connection, see pcu_sock_init() */
+		struct pcu_sock_state *state;
+		/* queue watermarks in messages, see pcu_sock_send() */
+		unsigned int queue_low, queue_high;
 	} pcu;
 
 	struct {
@@ -21,6 +21,9 @@
 #include <osmocom/abis/e1_input.h>
 #include <osmocom/gsm/lapdm.h>
 
+#include <osmo-bts/dl_tch_ring.h>
+#include <osmo-bts/rtp_egress.h>
+
 /* 16 is the max. number of SI2quater messages according to 3GPP TS 44.018 Table 10.5.2.33b.1:
    4-bit index is used (2#1111 = 10#15) */
 #define SI2Q_MAX_NUM 16
@@ -259,6 +262,7 @@ struct gsm_lchan {
 		uint8_t rtp_payload2;
 		uint8_t speech_mode;
 		struct osmo_rtp_socket *rtp_socket;
+		struct rtp_egress_lchan egress;
 	} abis_ip;
 
 	uint8_t rqd_ta;
@@ -271,7 +275,10 @@ struct gsm_lchan {
 	uint8_t sapis_dl[23];
 	uint8_t sapis_ul[23];
 	struct lapdm_channel lapdm_ch;
+	/* looped back frames (loopback mode only) */
 	struct llist_head dl_tch_queue;
+	/* frames received via RTP, playout buffer */
+	struct dl_tch_ring dl_tch_ring;
 	struct {
 		/* bitmask of all SI that are present/valid in si_buf */
 		uint32_t valid;
@@ -435,6 +442,9 @@ struct gsm_bts_trx {
 		void *l1h;
 	} role_bts;
 
+	/* lchan addressed by each RSL channel number, for the L1SAP */
+	struct gsm_lchan *lchan_by_chan_nr[256];
+
 	union {
 		struct {
 			struct {
@@ -74,6 +74,9 @@ void l1sap_rtp_rx_cb(struct osmo_rtp_socket *rs, const uint8_t *rtp_pl,
 		     unsigned int rtp_pl_len, uint16_t seq_number,
 		     uint32_t timestamp, bool marker);
 
+/* drop all downlink TCH frames queued for transmission */
+void l1sap_dl_tch_flush(struct gsm_lchan *lchan);
+
 /* channel control */
 int l1sap_chan_act(struct gsm_bts_trx *trx, uint8_t chan_nr, struct tlv_parsed *tp);
 int l1sap_chan_rel(struct gsm_bts_trx *trx, uint8_t chan_nr);
@@ -8,8 +8,24 @@
 struct paging_state;
 struct gsm_bts_role_bts;
 
+struct paging_group_stats {
+	/* paging records currently queued */
+	unsigned int queued;
+	/* paging records removed at the end of their lifetime */
+	uint64_t expired;
+};
+
+struct paging_pack_stats {
+	/* PCH blocks carrying at least one identity */
+	uint64_t blocks;
+	/* identities paged in those blocks */
+	uint64_t identities;
+	/* blocks sent as Paging Request Type 1, 2 and 3 */
+	uint64_t type[3];
+};
+
 /* initialize paging code */
-struct paging_state *paging_init(struct gsm_bts_role_bts *btsb, 
+struct paging_state *paging_init(struct gsm_bts *bts,
 				 unsigned int num_paging_max,
 				 unsigned int paging_lifetime);
 
@@ -48,5 +64,8 @@ int paging_gen_msg(struct paging_state *ps, uint8_t *out_buf, struct gsm_time *g
 int paging_group_queue_empty(struct paging_state *ps, uint8_t group);
 int paging_queue_length(struct paging_state *ps);
 int paging_buffer_space(struct paging_state *ps);
+unsigned int paging_num_groups(struct paging_state *ps);
+const struct paging_pack_stats *paging_get_pack_stats(struct paging_state *ps);
+const struct paging_group_stats *paging_get_group_stats(struct paging_state *ps, uint8_t grp);
 
 #endif
@@ -3,9 +3,41 @@
 
 #define PCU_SOCK_DEFAULT	"/tmp/pcu_bts"
 
+/* watermarks of the queue to the PCU, in messages */
+#define PCU_QUEUE_LOW_DEFAULT	256
+#define PCU_QUEUE_HIGH_DEFAULT	1024
+
 extern int pcu_direct;
 
-int pcu_tx_info_ind(void);
+struct rate_ctr_group;
+
+/* counters of a PCU connection, on both transports */
+enum pcu_sock_ctr {
+	PCU_SOCK_CTR_TX_MSGS,
+	PCU_SOCK_CTR_TX_BYTES,
+	PCU_SOCK_CTR_RX_MSGS,
+	PCU_SOCK_CTR_CONGESTED,
+	PCU_SOCK_CTR_DROP_CONGESTED,
+	PCU_SOCK_CTR_DROP_STALE,
+	PCU_SOCK_CTR_DROP_OVERFLOW,
+};
+
+/* per PCU connection */
+struct pcu_sock_stats {
+	/* see enum pcu_sock_ctr */
+	struct rate_ctr_group *ctrs;
+	/* messages the PCU has not read yet, on the socket, on the
+	 * shared memory ring and waiting for room on it, and the most
+	 * there ever were */
+	unsigned int queue_len, queue_max;
+	/* above the high watermark and not yet back to the low one */
+	bool congested;
+	/* time from queueing to writing to the socket */
+	uint32_t lat_max_us;
+	uint64_t lat_sum_us, lat_num;
+};
+
+int pcu_tx_info_ind(struct gsm_bts *bts);
 int pcu_tx_si13(const struct gsm_bts *bts, bool enable);
 int pcu_tx_rts_req(struct gsm_bts_trx_ts *ts, uint8_t is_ptcch, uint32_t fn,
 	uint16_t arfcn, uint8_t block_nr);
@@ -14,13 +46,16 @@ int pcu_tx_data_ind(struct gsm_bts_trx_ts *ts, uint8_t is_ptcch, uint32_t fn,
 		    int8_t rssi, uint16_t ber10k, int16_t bto, int16_t lqual);
 int pcu_tx_rach_ind(struct gsm_bts *bts, int16_t qta, uint16_t ra, uint32_t fn,
 	uint8_t is_11bit, enum ph_burst_type burst_type);
-int pcu_tx_time_ind(uint32_t fn);
-int pcu_tx_pag_req(const uint8_t *identity_lv, uint8_t chan_needed);
-int pcu_tx_pch_data_cnf(uint32_t fn, uint8_t *data, uint8_t len);
+int pcu_tx_time_ind(struct gsm_bts *bts, uint32_t fn);
+int pcu_tx_pag_req(struct gsm_bts *bts, const uint8_t *identity_lv,
+		   uint8_t chan_needed);
+int pcu_tx_pch_data_cnf(struct gsm_bts *bts, uint32_t fn, uint8_t *data,
+			uint8_t len);
 
-int pcu_sock_init(const char *path);
-void pcu_sock_exit(void);
+int pcu_sock_init(struct gsm_bts *bts, const char *path);
+void pcu_sock_exit(struct gsm_bts *bts);
+const struct pcu_sock_stats *pcu_sock_get_stats(const struct gsm_bts *bts);
 
-bool pcu_connected(void);
+bool pcu_connected(const struct gsm_bts *bts);
 
 #endif /* _PCU_IF_H */
@@ -0,0 +1,37 @@
+#ifndef _PCU_SHM_H
+#define _PCU_SHM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <osmocom/core/select.h>
+
+#include <osmo-bts/pcuif_proto.h>
+
+/* BTS side of the shared memory transport to the PCU */
+struct pcu_shm {
+	struct gsm_pcu_if_shm *map;
+	int mem_fd;
+	/* doorbell rung by us */
+	int tx_efd;
+	/* doorbell rung by the PCU */
+	struct osmo_fd rx_bfd;
+	/* the PCU has received the SHM.cnf */
+	bool active;
+	/* called for each primitive received */
+	int (*rx_cb)(void *data, struct gsm_pcu_if *pcu_prim);
+	void *data;
+
+	uint64_t tx, rx, tx_full, doorbells;
+};
+
+bool pcu_shm_supported(void);
+int pcu_shm_open(struct pcu_shm *shm,
+		 int (*rx_cb)(void *data, struct gsm_pcu_if *pcu_prim), void *data);
+void pcu_shm_close(struct pcu_shm *shm);
+struct gsm_pcu_if *pcu_shm_claim(struct pcu_shm *shm);
+void pcu_shm_commit(struct pcu_shm *shm);
+unsigned int pcu_shm_tx_pending(const struct pcu_shm *shm);
+int pcu_shm_rx(struct pcu_shm *shm);
+
+#endif /* _PCU_SHM_H */
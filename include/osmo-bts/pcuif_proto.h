@@ -15,8 +15,12 @@
 #define PCU_IF_MSG_INFO_IND	0x32	/* retrieve BTS info */
 #define PCU_IF_MSG_ACT_REQ	0x40	/* activate/deactivate PDCH */
 #define PCU_IF_MSG_TIME_IND	0x52	/* GSM time indication */
+#define PCU_IF_MSG_TIME_RTS_IND	0x53	/* coalesced TIME.ind and RTS.req */
 #define PCU_IF_MSG_PAG_REQ	0x60	/* paging request */
 #define PCU_IF_MSG_TXT_IND	0x70	/* Text indication for BTS */
+#define PCU_IF_MSG_CAPS_IND	0x71	/* PCU capabilities for BTS */
+#define PCU_IF_MSG_SHM_REQ	0x80	/* request shared memory transport */
+#define PCU_IF_MSG_SHM_CNF	0x81	/* shared memory transport set up */
 
 /* sapi */
 #define PCU_IF_SAPI_RACH	0x01	/* channel request on CCCH */
@@ -30,6 +34,8 @@
 /* flags */
 #define PCU_IF_FLAG_ACTIVE	(1 << 0)/* BTS is active */
 #define PCU_IF_FLAG_SYSMO	(1 << 1)/* access PDCH of sysmoBTS directly */
+#define PCU_IF_FLAG_SHM		(1 << 2)/* shared memory transport available */
+#define PCU_IF_FLAG_TIME_RTS	(1 << 3)/* TIME.ind/RTS.req can be coalesced */
 #define PCU_IF_FLAG_CS1		(1 << 16)
 #define PCU_IF_FLAG_CS2		(1 << 17)
 #define PCU_IF_FLAG_CS3		(1 << 18)
@@ -144,12 +150,36 @@ struct gsm_pcu_if_time_ind {
 	uint32_t	fn;
 } __attribute__ ((packed));
 
+/* TIME_RTS.ind replaces the TIME.ind and RTS.req of one main loop
+ * iteration of the BTS, once the PCU has set PCU_IF_FLAG_TIME_RTS in a
+ * CAPS.ind.  It is followed by num_rts struct gsm_pcu_if_rts_req, so
+ * its length is variable and usually shorter than struct gsm_pcu_if. */
+#define PCU_IF_TIME_RTS_MAX	128	/* PDTCH and PTCCH of 8 TRX */
+
+struct gsm_pcu_if_time_rts_ind {
+	uint32_t	fn;		/* TIME.ind, if has_time is set */
+	uint8_t		has_time;
+	uint8_t		num_rts;
+	uint8_t		spare[2];
+} __attribute__ ((packed));
+
+/* capabilities of the PCU, answering those offered in the INFO.ind */
+struct gsm_pcu_if_caps_ind {
+	uint32_t	flags;		/* PCU_IF_FLAG_* */
+} __attribute__ ((packed));
+
 struct gsm_pcu_if_pag_req {
 	uint8_t		sapi;
 	uint8_t		chan_needed;
 	uint8_t		identity_lv[9];
 } __attribute__ ((packed));
 
+struct gsm_pcu_if_shm_cnf {
+	uint32_t	size;		/* size of struct gsm_pcu_if_shm */
+	uint32_t	num_slots;	/* slots per ring */
+	uint32_t	slot_size;	/* sizeof(struct gsm_pcu_if) */
+} __attribute__ ((packed));
+
 struct gsm_pcu_if {
 	/* context based information */
 	uint8_t		msg_type;	/* message type */
@@ -167,7 +197,43 @@ struct gsm_pcu_if {
 		struct gsm_pcu_if_act_req	act_req;
 		struct gsm_pcu_if_time_ind	time_ind;
 		struct gsm_pcu_if_pag_req	pag_req;
+		struct gsm_pcu_if_shm_cnf	shm_cnf;
+		struct gsm_pcu_if_time_rts_ind	time_rts_ind;
+		struct gsm_pcu_if_caps_ind	caps_ind;
 	} u;
 } __attribute__ ((packed));
 
+/*
+ * Shared memory transport
+ *
+ * If the BTS sets PCU_IF_FLAG_SHM in the INFO.ind, the PCU may send a
+ * SHM.req.  The BTS answers with a SHM.cnf carrying three file
+ * descriptors (SCM_RIGHTS): the shared memory holding a struct
+ * gsm_pcu_if_shm, an eventfd rung by the BTS and one rung by the PCU.
+ * From then on, all primitives are passed as struct gsm_pcu_if in the
+ * slots of the two single-producer/single-consumer rings.  Either side
+ * may still send over the socket, which also signals the loss of the
+ * connection.
+ *
+ * The producer fills slot[head % num_slots], stores head + 1 (release)
+ * and rings the doorbell if the ring was empty, i.e. if tail equalled
+ * the old head after a full memory barrier.  The consumer stores tail
+ * after each slot and, before going back to sleep, checks head once
+ * more after a full memory barrier.
+ */
+#define PCU_IF_SHM_SLOTS	1024	/* power of 2 */
+
+struct gsm_pcu_if_shm_ring {
+	/* next slot to be written, only stored by the producer */
+	uint32_t	head __attribute__ ((aligned(64)));
+	/* next slot to be read, only stored by the consumer */
+	uint32_t	tail __attribute__ ((aligned(64)));
+	struct gsm_pcu_if slot[PCU_IF_SHM_SLOTS] __attribute__ ((aligned(64)));
+};
+
+struct gsm_pcu_if_shm {
+	struct gsm_pcu_if_shm_ring	to_pcu;
+	struct gsm_pcu_if_shm_ring	to_bts;
+};
+
 #endif /* _PCUIF_PROTO_H */
@@ -50,6 +50,12 @@ struct phy_link {
 			uint32_t clock_advance;
 			uint32_t rts_advance;
 			bool use_legacy_setbsic;
+			bool burst_batching;
+			unsigned int rx_batch_max;
+			bool worker_threads;
+			bool clock_thread;
+			int clock_thread_prio;	/* SCHED_FIFO, 0 = normal */
+			int clock_thread_cpu;	/* -1 = any */
 		} osmotrx;
 		struct {
 			char *mcast_dev;		/* Network device for multicast */
@@ -0,0 +1,65 @@
+#ifndef OSMO_BTS_RACH_ADMISSION_H
+#define OSMO_BTS_RACH_ADMISSION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <osmocom/core/utils.h>
+
+struct gsm_bts;
+struct rate_ctr_group;
+
+/* establishment causes the RACH admission distinguishes */
+enum rach_adm_cause {
+	RACH_CAUSE_EMERG,	/* emergency call */
+	RACH_CAUSE_CALL,	/* originating call, call re-establishment */
+	RACH_CAUSE_PAGING,	/* answer to paging */
+	RACH_CAUSE_LU,		/* location updating */
+	RACH_CAUSE_DATA,	/* data call, other SDCCH procedures (SMS, SS) */
+	_NUM_RACH_CAUSE
+};
+
+extern const struct value_string rach_adm_cause_names[];
+
+enum rach_adm_ctr {
+	RACH_ADM_CTR_ADMITTED,
+	RACH_ADM_CTR_REJ_EMERG,
+	RACH_ADM_CTR_REJ_CALL,
+	RACH_ADM_CTR_REJ_PAGING,
+	RACH_ADM_CTR_REJ_LU,
+	RACH_ADM_CTR_REJ_DATA,
+	RACH_ADM_CTR_IMM_ASS_REJ_FAIL,
+};
+
+/* default wait indication of locally generated IMM.ASS.REJ, in s */
+#define RACH_ADM_WAIT_IND_DEFAULT	10
+
+/* token bucket of one establishment cause */
+struct rach_adm_bucket {
+	/* admitted RACH per second, 0 = unlimited */
+	unsigned int rate;
+	/* number of RACH admitted back to back */
+	unsigned int burst;
+	/* available tokens, in 1/1000 */
+	uint32_t tokens;
+};
+
+struct rach_adm {
+	struct rach_adm_bucket bucket[_NUM_RACH_CAUSE];
+	/* limit only while the RACH load is at or above this percentage */
+	uint8_t load_thresh;
+	/* wait indication (T3122 in s) of locally generated IMM.ASS.REJ */
+	uint8_t wait_ind;
+	/* FN of the last RACH, the buckets are refilled on the frame clock */
+	uint32_t last_fn;
+	bool running;
+	struct rate_ctr_group *ctrs;
+};
+
+int rach_adm_init(struct gsm_bts *bts);
+enum rach_adm_cause rach_adm_get_cause(uint8_t ra, bool neci);
+void rach_adm_set_bucket(struct gsm_bts *bts, enum rach_adm_cause cause,
+			 unsigned int rate, unsigned int burst);
+int rach_adm_check(struct gsm_bts *bts, uint8_t ra, uint32_t fn);
+
+#endif /* OSMO_BTS_RACH_ADMISSION_H */
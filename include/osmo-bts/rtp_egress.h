@@ -0,0 +1,51 @@
+#ifndef OSMO_BTS_RTP_EGRESS_H
+#define OSMO_BTS_RTP_EGRESS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct gsm_lchan;
+
+/* longest frame sent by the egress stage */
+#define RTP_EGRESS_MAXLEN	64
+/* IP, UDP and RTP headers */
+#define RTP_EGRESS_HDR_LEN	(20 + 8 + 12)
+
+/* RTP state of an lchan whose uplink frames are sent by the egress stage
+ * instead of the RTP library */
+struct rtp_egress_lchan {
+	bool active;
+	uint8_t payload_type;
+	uint16_t seq;
+	uint32_t timestamp;
+	uint32_t ssrc;
+	/* sent by the egress stage, for the connection statistics */
+	uint32_t packets_sent;
+	uint32_t octets_sent;
+};
+
+struct rtp_egress_stats {
+	/* RTP frames sent */
+	uint64_t frames;
+	/* flushes of the collected frames */
+	uint64_t batches;
+	/* sendmmsg() calls */
+	uint64_t syscalls;
+	/* frames the kernel refused */
+	uint64_t errors;
+	/* time from collecting a frame to sending it, in us */
+	uint64_t latency_us_total;
+	uint64_t latency_us_max;
+};
+
+void rtp_egress_lchan_init(struct gsm_lchan *lchan, bool active);
+unsigned int rtp_egress_build(const struct gsm_lchan *lchan, uint8_t *buf,
+			      const uint8_t *data, unsigned int len, bool marker);
+int rtp_egress_send(struct gsm_lchan *lchan, const uint8_t *data, unsigned int len,
+		    uint32_t duration, bool marker);
+void rtp_egress_skipped(struct gsm_lchan *lchan, uint32_t duration);
+void rtp_egress_flush(void);
+const struct rtp_egress_stats *rtp_egress_get_stats(void);
+bool rtp_egress_unavailable(void);
+
+#endif /* OSMO_BTS_RTP_EGRESS_H */
@@ -61,13 +61,58 @@ enum trx_burst_type {
 	TRX_BURST_8PSK,
 };
 
+/* size of the burst buffer of a logical channel, in bits: four bursts of
+ * 116 for xCCH, eight for TCH/F and six for TCH/H interleaving, four bursts
+ * of 348 for EGPRS */
+#define L1SCHED_BURSTS_XCCH	464
+#define L1SCHED_BURSTS_TCHF	928
+#define L1SCHED_BURSTS_TCHH	696
+#define L1SCHED_BURSTS_PDTCH	1392
+
+/* burst buffers of all channels of one timeslot, the largest combination
+ * is SDCCH/8 + SACCH/8 */
+#define L1SCHED_BURST_POOL_SIZE	(16 * L1SCHED_BURSTS_XCCH)
+
+/* number of FN for which UL A5 keystream is kept, must exceed the clock
+ * advance between DL burst generation and UL burst reception plus the
+ * latency of the UL bursts (power of 2) */
+#define L1SCHED_A5_CACHE_SIZE	64
+
+struct l1sched_a5_cache_entry {
+	uint32_t		fn;
+	uint8_t			valid;
+	ubit_t			ks[114];
+};
+
+/* A5 algorithm and key of one direction */
+struct l1sched_a5_cache_key {
+	int			algo;
+	uint8_t			key[MAX_A5_KEY_LEN];
+};
+
+/* A5 keystream cache of a logical channel.  The UL keystream of an FN is
+ * generated along with its DL keystream and kept until the UL burst of
+ * that FN arrives, if both directions use the same algo and key. */
+struct l1sched_a5_cache {
+	struct l1sched_a5_cache_key dl_key, ul_key;
+	/* last DL keystream */
+	struct l1sched_a5_cache_entry dl;
+	/* UL keystream, indexed by FN */
+	struct l1sched_a5_cache_entry ul[L1SCHED_A5_CACHE_SIZE];
+	unsigned int		hits;
+	unsigned int		misses;
+};
+
 /* States each channel on a multiframe */
 struct l1sched_chan_state {
 	/* scheduler */
 	uint8_t			active;		/* Channel is active */
-	ubit_t			*dl_bursts;	/* burst buffer for TX */
+	ubit_t			*dl_bursts;	/* burst buffer for TX, if in use */
 	enum trx_burst_type	dl_burst_type;  /* GMSK or 8PSK burst type */
-	sbit_t			*ul_bursts;	/* burst buffer for RX */
+	sbit_t			*ul_bursts;	/* burst buffer for RX, if in use */
+	ubit_t			*dl_burst_buf;	/* storage in TS burst pool */
+	sbit_t			*ul_burst_buf;	/* storage in TS burst pool */
+	uint16_t		burst_buf_len;	/* size of storage */
 	uint32_t		ul_first_fn;	/* fn of first burst */
 	uint8_t			ul_mask;	/* mask of received bursts */
 
@@ -105,6 +150,7 @@ struct l1sched_chan_state {
 	int			dl_encr_key_len;
 	uint8_t			ul_encr_key[MAX_A5_KEY_LEN];
 	uint8_t			dl_encr_key[MAX_A5_KEY_LEN];
+	struct l1sched_a5_cache	*a5_cache;	/* allocated if ciphering */
 
 	/* measurements */
 	struct {
@@ -121,16 +167,70 @@ struct l1sched_chan_state {
 	uint8_t			ho_rach_detect;	/* if rach detection is on */
 };
 
+struct l1sched_trx;
+
+typedef int trx_sched_rts_func(struct l1sched_trx *l1t, uint8_t tn,
+			       uint32_t fn, enum trx_chan_type chan);
+
+typedef ubit_t *trx_sched_dl_func(struct l1sched_trx *l1t, uint8_t tn,
+				  uint32_t fn, enum trx_chan_type chan,
+				  uint8_t bid, uint16_t *nbits);
+
+typedef int trx_sched_ul_func(struct l1sched_trx *l1t, uint8_t tn,
+			      uint32_t fn, enum trx_chan_type chan,
+			      uint8_t bid, sbit_t *bits, uint16_t nbits,
+			      int8_t rssi, float toa);
+
+/* longest multiframe period (TCH and PDCH) */
+#define L1SCHED_MF_MAX_PERIOD	104
+
+/* One frame of the multiframe with channel description and channel state
+ * already resolved, so that the per-burst path needs a single lookup.
+ * Entries are rebuilt whenever pchan or channel activation changes. */
+struct l1sched_mf_entry {
+	/* downlink */
+	trx_sched_rts_func	*rts_fn;	/* only set on bid == 0 */
+	trx_sched_dl_func	*dl_fn;
+	struct l1sched_chan_state *dl_cs;
+	enum trx_chan_type	dl_chan;
+	uint8_t			dl_bid;
+	uint8_t			dl_active;
+	/* uplink */
+	trx_sched_ul_func	*ul_fn;
+	struct l1sched_chan_state *ul_cs;
+	enum trx_chan_type	ul_chan;
+	uint8_t			ul_bid;
+	uint8_t			ul_active;
+};
+
+/* number of FN for which DL primitives can be queued in advance, must be
+ * a power of two */
+#define L1SCHED_DL_PRIM_WINDOW	128
+
 struct l1sched_ts {
 	uint8_t 		mf_index;	/* selected multiframe index */
 	uint32_t 		mf_last_fn;	/* last received frame number */
 	uint8_t			mf_period;	/* period of multiframe */
 	const struct trx_sched_frame *mf_frames; /* pointer to frame layout */
+	/* dispatch table, indexed by FN % mf_period */
+	struct l1sched_mf_entry	mf_table[L1SCHED_MF_MAX_PERIOD];
 
-	struct llist_head	dl_prims;	/* Queue primitives for TX */
+	/* Queue primitives for TX, indexed by FN % L1SCHED_DL_PRIM_WINDOW */
+	struct llist_head	dl_prims[L1SCHED_DL_PRIM_WINDOW];
+	uint32_t		dl_last_fn;	/* last FN of DL burst */
+	uint8_t			dl_last_fn_valid;
+	struct {
+		unsigned int	late;		/* FN already passed */
+		unsigned int	out_of_window;	/* FN too far in future */
+		unsigned int	expired;	/* never requested by L1 */
+	} dl_prim_stats;
 
 	/* Channel states for all logical channels */
 	struct l1sched_chan_state chan_state[_TRX_CHAN_MAX];
+
+	/* Burst buffers of the channels of the multiframe */
+	ubit_t			dl_burst_pool[L1SCHED_BURST_POOL_SIZE];
+	sbit_t			ul_burst_pool[L1SCHED_BURST_POOL_SIZE];
 };
 
 struct l1sched_trx {
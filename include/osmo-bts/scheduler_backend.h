@@ -1,22 +1,24 @@
 #pragma once
 
+#include <string.h>
+
 #define LOGL1S(subsys, level, l1t, tn, chan, fn, fmt, args ...)	\
 		LOGP(subsys, level, "%s %s %s: " fmt,		\
 			gsm_fn_as_gsmtime_str(fn),		\
 			gsm_ts_name(&(l1t)->trx->ts[tn]),	\
 			chan >=0 ? trx_chan_desc[chan].name : "", ## args)
 
-typedef int trx_sched_rts_func(struct l1sched_trx *l1t, uint8_t tn,
-			       uint32_t fn, enum trx_chan_type chan);
-
-typedef ubit_t *trx_sched_dl_func(struct l1sched_trx *l1t, uint8_t tn,
-				  uint32_t fn, enum trx_chan_type chan,
-				  uint8_t bid, uint16_t *nbits);
-
-typedef int trx_sched_ul_func(struct l1sched_trx *l1t, uint8_t tn,
-			      uint32_t fn, enum trx_chan_type chan,
-			      uint8_t bid, sbit_t *bits, uint16_t nbits,
-			      int8_t rssi, float toa);
+/* frame structures */
+struct trx_sched_frame {
+	/*! \brief downlink TRX channel type */
+	enum trx_chan_type		dl_chan;
+	/*! \brief downlink block ID */
+	uint8_t				dl_bid;
+	/*! \brief uplink TRX channel type */
+	enum trx_chan_type		ul_chan;
+	/*! \brief uplink block ID */
+	uint8_t				ul_bid;
+};
 
 struct trx_chan_desc {
 	/*! \brief Is this on a PDCH (PS) ? */
@@ -88,6 +90,31 @@ int rx_tchh_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	enum trx_chan_type chan, uint8_t bid, sbit_t *bits, uint16_t nbits,
 	int8_t rssi, float toa);
 
+void _sched_a5_encrypt(ubit_t *bits, const ubit_t *ks);
+void _sched_a5_decrypt(sbit_t *bits, const ubit_t *ks);
+void _sched_a5_set_key(struct l1sched_a5_cache *cache, int downlink,
+		       int algo, const uint8_t *key);
+const ubit_t *_sched_a5_keystream(struct l1sched_a5_cache *cache,
+				  int downlink, uint32_t fn);
+
+/*! \brief start using the DL burst buffer of a channel
+ *  \param[in] cs channel state
+ *  \returns zeroed burst buffer, to be stored in cs->dl_bursts */
+static inline ubit_t *_sched_dl_bursts_claim(struct l1sched_chan_state *cs)
+{
+	memset(cs->dl_burst_buf, 0, cs->burst_buf_len);
+	return cs->dl_burst_buf;
+}
+
+/*! \brief start using the UL burst buffer of a channel
+ *  \param[in] cs channel state
+ *  \returns zeroed burst buffer, to be stored in cs->ul_bursts */
+static inline sbit_t *_sched_ul_bursts_claim(struct l1sched_chan_state *cs)
+{
+	memset(cs->ul_burst_buf, 0, cs->burst_buf_len);
+	return cs->ul_burst_buf;
+}
+
 const ubit_t *_sched_dl_burst(struct l1sched_trx *l1t, uint8_t tn,
 			      uint32_t fn, uint16_t *nbits);
 int _sched_rts(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn);
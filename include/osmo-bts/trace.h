@@ -0,0 +1,91 @@
+#ifndef OSMO_BTS_TRACE_H
+#define OSMO_BTS_TRACE_H
+
+#include <stdint.h>
+
+#include "btsconfig.h"
+
+/* Binary tracing of the L1SAP and scheduler hot paths.  A trace point
+ * costs one test of a global mask when its class is disabled, and
+ * nothing at all when built with --disable-bts-trace.  Enabled trace
+ * points store a fixed size record in a ring buffer of the calling
+ * thread, without formatting anything; the rings are written to a file
+ * on request and decoded offline by contrib/bts_trace_decode.py. */
+
+enum bts_trace_class {
+	BTS_TRACE_L1SAP,
+	BTS_TRACE_SCHED,
+	_NUM_BTS_TRACE_CLASS
+};
+
+enum bts_trace_event {
+	BTS_TRACE_EV_NONE,
+	/* L1SAP, arg: link_id or payload length */
+	BTS_TRACE_EV_PH_RTS_IND,
+	BTS_TRACE_EV_PH_DATA_REQ,
+	BTS_TRACE_EV_PH_DATA_IND,
+	BTS_TRACE_EV_TCH_RTS_IND,
+	BTS_TRACE_EV_TCH_REQ,
+	BTS_TRACE_EV_TCH_IND,
+	BTS_TRACE_EV_PH_RACH_IND,
+	/* scheduler, chan is the enum trx_chan_type, arg the burst ID */
+	BTS_TRACE_EV_DL_BURST,
+	BTS_TRACE_EV_UL_BURST,
+	_NUM_BTS_TRACE_EV
+};
+
+/* one trace record, as stored in the ring and written to the file */
+struct bts_trace_rec {
+	/* CLOCK_MONOTONIC */
+	uint64_t time_ns;
+	uint32_t fn;
+	uint32_t arg;
+	uint16_t event;
+	uint8_t trx;
+	uint8_t tn;
+	/* chan_nr for L1SAP, enum trx_chan_type for the scheduler */
+	uint8_t chan;
+	uint8_t pad[3];
+} __attribute__((packed));
+
+/* trace file: one bts_trace_file_hdr, then for each thread one
+ * bts_trace_ring_hdr followed by its records, oldest first */
+#define BTS_TRACE_FILE_MAGIC	0x4254524b	/* "BTRK" */
+#define BTS_TRACE_RING_MAGIC	0x42545247	/* "BTRG" */
+#define BTS_TRACE_VERSION	1
+
+struct bts_trace_file_hdr {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t rec_size;
+	uint32_t num_rings;
+} __attribute__((packed));
+
+struct bts_trace_ring_hdr {
+	uint32_t magic;
+	uint32_t tid;
+	char name[16];
+	/* records lost because the ring wrapped before the dump */
+	uint64_t overwritten;
+	uint32_t num_recs;
+} __attribute__((packed));
+
+/* bit mask of enabled enum bts_trace_class */
+extern uint32_t bts_trace_mask;
+
+void bts_trace(enum bts_trace_event event, uint32_t fn, uint8_t trx,
+	       uint8_t tn, uint8_t chan, uint32_t arg);
+int bts_trace_dump(const char *path);
+
+#ifdef HAVE_BTS_TRACE
+#define BTS_TRACE(cls, event, fn, trx, tn, chan, arg)			\
+	do {								\
+		if (bts_trace_mask & (1 << (cls)))			\
+			bts_trace(event, fn, trx, tn, chan, arg);	\
+	} while (0)
+#else
+#define BTS_TRACE(cls, event, fn, trx, tn, chan, arg)			\
+	do { } while (0)
+#endif
+
+#endif /* OSMO_BTS_TRACE_H */
@@ -97,6 +97,7 @@ int bts_init(struct gsm_bts *bts)
 	bts->role = btsb = talloc_zero(bts, struct gsm_bts_role_bts);
 
 	INIT_LLIST_HEAD(&btsb->agch_queue);
+	INIT_LLIST_HEAD(&btsb->agch_rej_queue);
 	btsb->agch_queue_length = 0;
 
 	/* enable management with default levels,
@@ -108,7 +109,12 @@ int bts_init(struct gsm_bts *bts)
 	btsb->agch_queue_thresh_level = GSM_BTS_AGCH_QUEUE_THRESH_LEVEL_DEFAULT;
 
 	/* configurable via VTY */
-	btsb->paging_state = paging_init(btsb, 200, 0);
+	btsb->paging_state = paging_init(bts, 200, 0);
+	rc = rach_adm_init(bts);
+	if (rc < 0) {
+		llist_del(&bts->list);
+		return rc;
+	}
 	btsb->ul_power_target = -75;	/* dBm default */
 	btsb->rtp_jitter_adaptive = false;
 
@@ -122,6 +128,8 @@ int bts_init(struct gsm_bts *bts)
 	btsb->min_qual_rach = MIN_QUAL_RACH;
 	btsb->min_qual_norm = MIN_QUAL_NORM;
 	btsb->pcu.sock_path = talloc_strdup(btsb, PCU_SOCK_DEFAULT);
+	btsb->pcu.queue_low = PCU_QUEUE_LOW_DEFAULT;
+	btsb->pcu.queue_high = PCU_QUEUE_HIGH_DEFAULT;
 	for (i = 0; i < ARRAY_SIZE(btsb->t200_ms); i++)
 		btsb->t200_ms[i] = oml_default_t200_ms[i];
 
@@ -159,9 +167,11 @@ int bts_init(struct gsm_bts *bts)
 	}
 
 	/* allocate a talloc pool for ORTP to ensure it doesn't have to go back
-	 * to the libc malloc all the time */
-	tall_rtp_ctx = talloc_pool(tall_bts_ctx, 262144);
-	osmo_rtp_init(tall_rtp_ctx);
+	 * to the libc malloc all the time, once for all BTS */
+	if (!initialized) {
+		tall_rtp_ctx = talloc_pool(tall_bts_ctx, 262144);
+		osmo_rtp_init(tall_rtp_ctx);
+	}
 
 	rc = bts_model_init(bts);
 	if (rc < 0) {
@@ -173,17 +183,16 @@ int bts_init(struct gsm_bts *bts)
 
 	if (!initialized) {
 		osmo_signal_register_handler(SS_GLOBAL, bts_signal_cbfn, NULL);
+		/* register DTX DL FSM */
+		rc = osmo_fsm_register(&dtx_dl_amr_fsm);
+		OSMO_ASSERT(rc == 0);
 		initialized = 1;
 	}
 
 	INIT_LLIST_HEAD(&btsb->smscb_state.queue);
 	INIT_LLIST_HEAD(&btsb->oml_queue);
 
-	/* register DTX DL FSM */
-	rc = osmo_fsm_register(&dtx_dl_amr_fsm);
-	OSMO_ASSERT(rc == 0);
-
-	return rc;
+	return 0;
 }
 
 static void shutdown_timer_cb(void *data)
@@ -214,6 +223,9 @@ void bts_shutdown(struct gsm_bts *bts, const char *reason)
 		bts_model_trx_close(trx);
 	}
 
+	/* nothing is going to be sent on the AGCH anymore */
+	bts_agch_flush(bts);
+
 	/* shedule a timer to make sure select loop logic can run again
 	 * to dispatch any pending primitives */
 	osmo_timer_schedule(&shutdown_timer, 3, 0);
@@ -377,6 +389,8 @@ static void bts_update_agch_max_queue_length(struct gsm_bts *bts)
 }
 
 #define REQ_REFS_PER_IMM_ASS_REJ 4
+/* max. number of main lane messages sent while an IMM.ASS.REJ is waiting */
+#define AGCH_REJ_MAX_WAIT 4
 static int store_imm_ass_rej_refs(struct gsm48_imm_ass_rej *rej,
 				    struct gsm48_req_ref *req_refs,
 				    uint8_t *wait_inds,
@@ -503,6 +517,165 @@ static int try_merge_imm_ass_rej(struct gsm48_imm_ass_rej *old_rej,
 	return 0;
 }
 
+/*
+ * Decide whether an IMM.ASS.REJ is to be dropped, as the reject lane has
+ * grown too long.  Assignments are never dropped, so they do not count.
+ * This is done once per arriving message, so the work per CCCH block does
+ * not depend on the queue length.
+ *
+ * p^
+ * 1+      /'''''
+ *  |     /
+ *  |    /
+ * 0+---/--+----+--> Q length
+ *    low high max_len
+ */
+static int agch_rej_drop(struct gsm_bts_role_bts *btsb)
+{
+	int max_len, slope, offs, p_drop;
+	int level_low = btsb->agch_queue_low_level;
+	int level_high = btsb->agch_queue_high_level;
+	int level_thres = btsb->agch_queue_thresh_level;
+
+	max_len = btsb->agch_max_queue_length;
+
+	if (max_len == 0)
+		max_len = 1;
+
+	if (btsb->agch_rej_length < max_len * level_thres / 100)
+		return 0;
+
+	offs = max_len * level_low / 100;
+	if (level_high > level_low)
+		slope = 0x10000 * 100 / (level_high - level_low);
+	else
+		slope = 0x10000 * max_len; /* p_drop >= 1 if len > offs */
+
+	p_drop = (btsb->agch_rej_length - offs) * slope / max_len;
+
+	return (random() & 0xffff) < p_drop;
+}
+
+/* drop the oldest request reference waiting in the reject lane, rather
+ * than the new one: the MS that sent the oldest RACH is the least likely
+ * to still be listening.  Returns 0 if there is none. */
+static int agch_rej_drop_oldest(struct gsm_bts_role_bts *btsb)
+{
+	struct gsm48_req_ref req_refs[REQ_REFS_PER_IMM_ASS_REJ];
+	uint8_t wait_inds[REQ_REFS_PER_IMM_ASS_REJ];
+	struct msgb *msg;
+	int count;
+
+	if (!llist_empty(&btsb->agch_rej_queue))
+		msg = llist_entry(btsb->agch_rej_queue.next, struct msgb, list);
+	else if (btsb->agch_rej_pending)
+		msg = btsb->agch_rej_pending;
+	else
+		return 0;
+
+	count = extract_imm_ass_rej_refs(msgb_l3(msg), req_refs, wait_inds);
+	if (count > 1) {
+		/* keep the other references of a merged reject */
+		store_imm_ass_rej_refs(msgb_l3(msg), &req_refs[1],
+				       &wait_inds[1], count - 1);
+	} else {
+		if (msg == btsb->agch_rej_pending)
+			btsb->agch_rej_pending = NULL;
+		else
+			llist_del(&msg->list);
+		msgb_free(msg);
+		btsb->agch_rej_length--;
+		btsb->agch_queue_length--;
+	}
+	btsb->agch_queue_dropped_msgs++;
+
+	return 1;
+}
+
+/* move the IMM.ASS.REJ accumulated so far to the reject lane */
+static void agch_rej_flush(struct gsm_bts_role_bts *btsb)
+{
+	msgb_enqueue(&btsb->agch_rej_queue, btsb->agch_rej_pending);
+	btsb->agch_rej_pending = NULL;
+}
+
+static int agch_rej_waiting(struct gsm_bts_role_bts *btsb)
+{
+	return btsb->agch_rej_pending || !llist_empty(&btsb->agch_rej_queue);
+}
+
+/* take the next IMM.ASS.REJ to be sent, if any */
+static struct msgb *agch_rej_dequeue(struct gsm_bts_role_bts *btsb)
+{
+	struct msgb *msg;
+
+	btsb->agch_rej_wait = 0;
+
+	msg = msgb_dequeue(&btsb->agch_rej_queue);
+	if (!msg) {
+		/* better send a reject that is not full than nothing */
+		msg = btsb->agch_rej_pending;
+		btsb->agch_rej_pending = NULL;
+	}
+	if (msg)
+		btsb->agch_rej_length--;
+	return msg;
+}
+
+static int agch_enqueue_rej(struct gsm_bts_role_bts *btsb, struct msgb *msg)
+{
+	struct gsm48_req_ref req_refs[REQ_REFS_PER_IMM_ASS_REJ];
+	uint8_t wait_inds[REQ_REFS_PER_IMM_ASS_REJ];
+	struct gsm48_imm_ass_rej *pending;
+	int i, count;
+
+	if (agch_rej_drop(btsb)) {
+		/* make room for as many references as arrive */
+		count = extract_imm_ass_rej_refs(msgb_l3(msg), req_refs,
+						 wait_inds);
+		for (i = 0; i < count; i++) {
+			if (!agch_rej_drop_oldest(btsb)) {
+				btsb->agch_queue_dropped_msgs += count - i;
+				msgb_free(msg);
+				return 0;
+			}
+		}
+	}
+
+	if (!btsb->agch_rej_pending) {
+		btsb->agch_rej_pending = msg;
+		btsb->agch_rej_length++;
+		btsb->agch_queue_length++;
+		return 0;
+	}
+
+	pending = msgb_l3(btsb->agch_rej_pending);
+	if (try_merge_imm_ass_rej(pending, msgb_l3(msg))) {
+		btsb->agch_queue_merged_msgs++;
+		msgb_free(msg);
+		/* nothing more to be merged into a full message */
+		if (extract_imm_ass_rej_refs(pending, req_refs, wait_inds)
+						== REQ_REFS_PER_IMM_ASS_REJ)
+			agch_rej_flush(btsb);
+		return 0;
+	}
+
+	/* the pending message is full, the new one holds what is left */
+	agch_rej_flush(btsb);
+	btsb->agch_rej_pending = msg;
+	btsb->agch_rej_length++;
+	btsb->agch_queue_length++;
+
+	return 0;
+}
+
+/*! \brief queue a message for transmission on the AGCH
+ *
+ *  IMM.ASS.REJ are merged into a pending reject until it holds four
+ *  request references, and are then queued to a lane of their own.
+ *  All other messages (assignments) are queued to the main lane, which
+ *  is served first, but for at most AGCH_REJ_MAX_WAIT messages in a row
+ *  while a reject is waiting. */
 int bts_agch_enqueue(struct gsm_bts *bts, struct msgb *msg)
 {
 	struct gsm_bts_role_bts *btsb = bts_role_bts(bts);
@@ -520,17 +693,8 @@ int bts_agch_enqueue(struct gsm_bts *bts, struct msgb *msg)
 		return -ENOMEM;
 	}
 
-	if (btsb->agch_queue_length > 0) {
-		struct msgb *last_msg =
-			llist_entry(btsb->agch_queue.prev, struct msgb, list);
-		struct gsm48_imm_ass_rej *last_imm_ass_rej = msgb_l3(last_msg);
-
-		if (try_merge_imm_ass_rej(last_imm_ass_rej, imm_ass_cmd)) {
-			btsb->agch_queue_merged_msgs++;
-			msgb_free(msg);
-			return 0;
-		}
-	}
+	if (imm_ass_cmd->msg_type == GSM48_MT_RR_IMM_ASS_REJ)
+		return agch_enqueue_rej(btsb, msg);
 
 	msgb_enqueue(&btsb->agch_queue, msg);
 	btsb->agch_queue_length++;
@@ -541,72 +705,36 @@ int bts_agch_enqueue(struct gsm_bts *bts, struct msgb *msg)
 struct msgb *bts_agch_dequeue(struct gsm_bts *bts)
 {
 	struct gsm_bts_role_bts *btsb = bts_role_bts(bts);
-	struct msgb *msg = msgb_dequeue(&btsb->agch_queue);
+	struct msgb *msg;
+
+	if (btsb->agch_rej_wait < AGCH_REJ_MAX_WAIT) {
+		msg = msgb_dequeue(&btsb->agch_queue);
+		if (msg) {
+			if (agch_rej_waiting(btsb))
+				btsb->agch_rej_wait++;
+			goto out;
+		}
+	}
+
+	msg = agch_rej_dequeue(btsb);
+	if (!msg)
+		msg = msgb_dequeue(&btsb->agch_queue);
 	if (!msg)
 		return NULL;
-
+out:
 	btsb->agch_queue_length--;
 	return msg;
 }
 
-/*
- * Remove lower prio messages if the queue has grown too long.
- *
- * \return 0 iff the number of messages in the queue would fit into the AGCH
- *         reserved part of the CCCH.
- */
-static void compact_agch_queue(struct gsm_bts *bts)
+/*! \brief free all messages queued for the AGCH */
+void bts_agch_flush(struct gsm_bts *bts)
 {
 	struct gsm_bts_role_bts *btsb = bts_role_bts(bts);
-	struct msgb *msg, *msg2;
-	int max_len, slope, offs;
-	int level_low = btsb->agch_queue_low_level;
-	int level_high = btsb->agch_queue_high_level;
-	int level_thres = btsb->agch_queue_thresh_level;
-
-	max_len = btsb->agch_max_queue_length;
-
-	if (max_len == 0)
-		max_len = 1;
-
-	if (btsb->agch_queue_length < max_len * level_thres / 100)
-		return;
-
-	/* p^
-	 * 1+      /'''''
-	 *  |     /
-	 *  |    /
-	 * 0+---/--+----+--> Q length
-	 *    low high max_len
-	 */
-
-	offs = max_len * level_low / 100;
-	if (level_high > level_low)
-		slope = 0x10000 * 100 / (level_high - level_low);
-	else
-		slope = 0x10000 * max_len; /* p_drop >= 1 if len > offs */
-
-	llist_for_each_entry_safe(msg, msg2, &btsb->agch_queue, list) {
-		struct gsm48_imm_ass *imm_ass_cmd = msgb_l3(msg);
-		int p_drop;
-
-		if (imm_ass_cmd->msg_type != GSM48_MT_RR_IMM_ASS_REJ)
-			return;
-
-		/* IMMEDIATE ASSIGN REJECT */
+	struct msgb *msg;
 
-		p_drop = (btsb->agch_queue_length - offs) * slope / max_len;
-
-		if ((random() & 0xffff) >= p_drop)
-			return;
-
-		llist_del(&msg->list);
-		btsb->agch_queue_length--;
+	while ((msg = bts_agch_dequeue(bts)))
 		msgb_free(msg);
-
-		btsb->agch_queue_dropped_msgs++;
-	}
-	return;
+	btsb->agch_rej_wait = 0;
 }
 
 int bts_ccch_copy_msg(struct gsm_bts *bts, uint8_t *out_buf, struct gsm_time *gt,
@@ -617,13 +745,6 @@ int bts_ccch_copy_msg(struct gsm_bts *bts, uint8_t *out_buf, struct gsm_time *gt
 	int rc = 0;
 	int is_empty = 1;
 
-	/* Do queue house keeping.
-	 * This needs to be done every time a CCCH message is requested, since
-	 * the queue max length is calculated based on the CCCH block rate and
-	 * PCH messages also reduce the drain of the AGCH queue.
-	 */
-	compact_agch_queue(bts);
-
 	/* Check for paging messages first if this is PCH */
 	if (!is_ag_res)
 		rc = paging_gen_msg(btsb->paging_state, out_buf, gt, &is_empty);
@@ -0,0 +1,354 @@
+/* Playout buffer for downlink TCH frames received via RTP */
+
+/* All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * The RTP callback writes each frame into the slot of its sequence
+ * number, the TCH-RTS.ind takes one frame per 20 ms in sequence order.
+ * Playout starts once 'depth' frames are buffered, and stops when the
+ * buffer runs empty (end of talkspurt, DTX, underrun), so that the next
+ * talkspurt is buffered again.  A frame that is missing while later ones
+ * are buffered is lost: nothing is handed to the PHY, which then sends a
+ * BFI or repeats the last SID.
+ *
+ * A new SSRC, a sequence number outside of the ring in either direction,
+ * or a marked frame older than those played is a new stream: the ring
+ * starts over with it, as after a new connection.
+ *
+ * In adaptive mode, depth follows the interarrival jitter estimated as
+ * in RFC 3550, A.8.  It only takes effect when playout (re)starts.
+ *
+ * The frames are handed to the PHY in msgbs of a small pool per ring.
+ * The PHY frees them as any other msgb, a talloc destructor puts them
+ * back into the pool instead.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/gsm/l1sap.h>
+
+#include <osmo-bts/dl_tch_ring.h>
+#include <osmo-bts/l1sap.h>
+#include <osmo-bts/msg_utils.h>
+
+extern void *tall_bts_ctx;
+
+/* RTP timestamp units per TCH frame */
+#define FRAME_TS	160
+
+/* headroom of the msgbs, as in l1sap_msgb_alloc() */
+#define POOL_HEADROOM	128
+
+/* talloc parent of the msgbs of a ring */
+struct dl_tch_pool {
+	/* msgbs allocated, in the PHY or free */
+	unsigned int num;
+	unsigned int num_free;
+	struct msgb *free[DL_TCH_POOL_LEN];
+};
+
+/* msgb_free() of a msgb of the pool: keep it */
+static int dl_tch_pool_put(struct msgb *msg)
+{
+	struct dl_tch_pool *pool = talloc_parent(msg);
+
+	pool->free[pool->num_free++] = msg;
+	return -1;
+}
+
+/* a msgb for the PHY, with the headroom and L1SAP header of
+ * l1sap_msgb_alloc() and room for any frame */
+static struct msgb *dl_tch_pool_get(struct dl_tch_ring *ring)
+{
+	struct dl_tch_pool *pool = ring->pool;
+	struct msgb *msg;
+
+	if (!pool) {
+		pool = ring->pool = talloc_zero(tall_bts_ctx, struct dl_tch_pool);
+		if (!pool)
+			return l1sap_msgb_alloc(DL_TCH_FRAME_MAXLEN);
+	}
+
+	if (pool->num_free) {
+		msg = pool->free[--pool->num_free];
+		msgb_reset(msg);
+		memset(msg->cb, 0, sizeof(msg->cb));
+		msgb_reserve(msg, POOL_HEADROOM);
+		msg->l1h = msgb_put(msg, sizeof(struct osmo_phsap_prim));
+		return msg;
+	}
+
+	msg = l1sap_msgb_alloc(DL_TCH_FRAME_MAXLEN);
+	/* all of the pool are in the PHY, this one is freed normally */
+	if (!msg || pool->num == DL_TCH_POOL_LEN)
+		return msg;
+
+	talloc_steal(pool, msg);
+	talloc_set_destructor(msg, dl_tch_pool_put);
+	pool->num++;
+
+	return msg;
+}
+
+/*! \brief set up an empty playout buffer for a new RTP connection
+ *
+ *  The ring must be zeroed before it is set up the first time, as it is
+ *  as part of an lchan.
+ *  \param[in] max_depth maximum number of frames buffered before playout
+ *  \param[in] adaptive adapt the number of frames to the jitter */
+void dl_tch_ring_init(struct dl_tch_ring *ring, unsigned int max_depth, bool adaptive)
+{
+	struct dl_tch_pool *pool = ring->pool;
+
+	memset(ring, 0, sizeof(*ring));
+	ring->pool = pool;
+
+	ring->adaptive = adaptive;
+	ring->depth = 1;
+	dl_tch_ring_set_max_depth(ring, max_depth);
+}
+
+/*! \brief change the maximum number of frames buffered before playout */
+void dl_tch_ring_set_max_depth(struct dl_tch_ring *ring, unsigned int max_depth)
+{
+	ring->max_depth = OSMO_MAX(1, OSMO_MIN(max_depth, DL_TCH_RING_LEN - 2));
+	if (!ring->adaptive || ring->depth > ring->max_depth)
+		ring->depth = ring->max_depth;
+}
+
+/*! \brief drop all buffered frames and start over with the next frame
+ *  received, keeping the statistics */
+void dl_tch_ring_flush(struct dl_tch_ring *ring)
+{
+	unsigned int i;
+
+	for (i = 0; i < DL_TCH_RING_LEN; i++)
+		ring->frame[i].valid = false;
+	ring->started = false;
+	ring->have_seq = false;
+}
+
+/*! \brief start over with a new RTP stream: drop all buffered frames and
+ *  restart the jitter estimation, keeping the statistics */
+void dl_tch_ring_resync(struct dl_tch_ring *ring)
+{
+	dl_tch_ring_flush(ring);
+	ring->have_transit = false;
+}
+
+static unsigned int dl_tch_ring_count(const struct dl_tch_ring *ring)
+{
+	unsigned int i, count = 0;
+
+	for (i = 0; i < DL_TCH_RING_LEN; i++)
+		count += ring->frame[i].valid;
+
+	return count;
+}
+
+/* estimate the jitter from the arrival time, and count the arrival delay
+ * relative to the fastest frame seen */
+static void dl_tch_ring_arrival(struct dl_tch_ring *ring, uint32_t timestamp,
+				const struct timespec *now)
+{
+	struct dl_tch_ring_stats *st = &ring->stats;
+	uint32_t arrival;
+	int32_t transit, d;
+	unsigned int bucket;
+
+	/* arrival time in RTP timestamp units, i.e. 8 kHz */
+	arrival = (uint32_t) now->tv_sec * 8000 + now->tv_nsec / 125000;
+	transit = arrival - timestamp;
+
+	if (!ring->have_transit) {
+		ring->have_transit = true;
+		ring->min_transit = transit;
+	} else {
+		d = transit - ring->transit;
+		if (d < 0)
+			d = -d;
+		st->jitter += d - ((st->jitter + 8) >> 4);
+		if (transit - ring->min_transit < 0)
+			ring->min_transit = transit;
+	}
+	ring->transit = transit;
+
+	bucket = (transit - ring->min_transit) / FRAME_TS;
+	if (bucket >= DL_TCH_DELAY_HIST_LEN)
+		bucket = DL_TCH_DELAY_HIST_LEN - 1;
+	st->delay_hist[bucket]++;
+
+	if (ring->adaptive) {
+		/* twice the jitter, rounded up to frames, plus the frame
+		 * that is due now */
+		unsigned int depth = 1 + (2 * (st->jitter >> 4) + FRAME_TS - 1) / FRAME_TS;
+		ring->depth = OSMO_MIN(depth, ring->max_depth);
+	}
+}
+
+/* whether a frame belongs to another stream than the frames played */
+static bool dl_tch_ring_discont(const struct dl_tch_ring *ring, uint32_t ssrc,
+				int16_t off, bool marker)
+{
+	if (!ring->have_seq)
+		return false;
+	if (ssrc != ring->ssrc)
+		return true;
+	/* sequence number jump, in either direction */
+	if (off < -DL_TCH_RING_LEN || off >= DL_TCH_RING_LEN)
+		return true;
+	/* a new talkspurt starting behind the playout */
+	return marker && off < 0;
+}
+
+/*! \brief store a frame received via RTP
+ *  \param[in] ssrc synchronization source of the frame
+ *  \param[in] now arrival time (CLOCK_MONOTONIC)
+ *  \returns 0 if stored; negative if dropped */
+int dl_tch_ring_put(struct dl_tch_ring *ring, const uint8_t *data, unsigned int len,
+		    uint32_t ssrc, uint16_t seq, uint32_t timestamp, bool marker,
+		    const struct timespec *now)
+{
+	struct dl_tch_ring_stats *st = &ring->stats;
+	struct dl_tch_frame *f;
+	int16_t off;
+
+	if (len > DL_TCH_FRAME_MAXLEN)
+		return -EMSGSIZE;
+
+	st->received++;
+
+	off = seq - ring->next_seq;
+	if (dl_tch_ring_discont(ring, ssrc, off, marker)) {
+		/* the timestamps start over as well */
+		dl_tch_ring_resync(ring);
+		st->resync++;
+	}
+	ring->ssrc = ssrc;
+
+	dl_tch_ring_arrival(ring, timestamp, now);
+
+	if (ring->have_seq && off < 0) {
+		/* also after an underrun: the frames after it were played */
+		st->late++;
+		st->late_hist[OSMO_MIN(-off - 1, DL_TCH_LATE_HIST_LEN - 1)]++;
+		return -ETIME;
+	}
+
+	if (ring->started && off > ring->max_depth) {
+		/* the sender is ahead of our playout, skip frames to keep
+		 * the delay bounded */
+		while (ring->next_seq != (uint16_t)(seq - ring->max_depth)) {
+			f = &ring->frame[ring->next_seq % DL_TCH_RING_LEN];
+			if (f->valid && f->seq == ring->next_seq)
+				st->skipped++;
+			f->valid = false;
+			ring->next_seq++;
+		}
+	}
+
+	f = &ring->frame[seq % DL_TCH_RING_LEN];
+	if (f->valid && f->seq == seq) {
+		st->duplicate++;
+		return -EEXIST;
+	}
+
+	memcpy(f->data, data, len);
+	f->len = len;
+	f->seq = seq;
+	f->timestamp = timestamp;
+	f->marker = marker;
+	f->valid = true;
+
+	return 0;
+}
+
+/* start playout with the oldest buffered frame, once there are enough */
+static bool dl_tch_ring_start(struct dl_tch_ring *ring)
+{
+	struct dl_tch_frame *oldest = NULL;
+	unsigned int i;
+
+	if (dl_tch_ring_count(ring) < ring->depth)
+		return false;
+
+	for (i = 0; i < DL_TCH_RING_LEN; i++) {
+		struct dl_tch_frame *f = &ring->frame[i];
+
+		if (!f->valid)
+			continue;
+		if (!oldest || (int16_t)(f->seq - oldest->seq) < 0)
+			oldest = f;
+	}
+
+	ring->next_seq = oldest->seq;
+	ring->started = true;
+	ring->have_seq = true;
+
+	return true;
+}
+
+/*! \brief take the frame due for the next TCH-RTS.ind
+ *
+ *  The msgb is handed to the bts model, which frees it, and is then
+ *  reused for another frame of this ring.
+ *  \returns msgb with the frame in its data, RTP header fields in the
+ *  control buffer; NULL if there is no frame to be sent */
+struct msgb *dl_tch_ring_get(struct dl_tch_ring *ring)
+{
+	struct dl_tch_ring_stats *st = &ring->stats;
+	struct dl_tch_frame *f;
+	struct msgb *msg;
+
+	if (!ring->started && !dl_tch_ring_start(ring))
+		return NULL;
+
+	f = &ring->frame[ring->next_seq % DL_TCH_RING_LEN];
+	if (!f->valid || f->seq != ring->next_seq) {
+		if (!dl_tch_ring_count(ring)) {
+			/* buffer ran empty, buffer again before playout */
+			ring->started = false;
+			st->underrun++;
+			return NULL;
+		}
+		/* lost or still on its way, later frames are buffered */
+		st->concealed++;
+		ring->next_seq++;
+		return NULL;
+	}
+	f->valid = false;
+	ring->next_seq++;
+	st->played++;
+
+	msg = dl_tch_pool_get(ring);
+	if (!msg)
+		return NULL;
+	memcpy(msgb_put(msg, f->len), f->data, f->len);
+	msgb_pull(msg, sizeof(struct osmo_phsap_prim));
+
+	rtpmsg_marker_bit(msg) = f->marker;
+	rtpmsg_seq(msg) = f->seq;
+	rtpmsg_ts(msg) = f->timestamp;
+
+	return msg;
+}
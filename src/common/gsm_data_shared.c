@@ -33,6 +33,7 @@
 #include <osmocom/core/statistics.h>
 
 #include <osmo-bts/gsm_data.h>
+#include <osmo-bts/l1sap.h>
 
 void gsm_abis_mo_reset(struct gsm_abis_mo *mo)
 {
@@ -227,7 +228,7 @@ struct gsm_bts *gsm_bts_num(struct gsm_network *net, int num)
 struct gsm_bts_trx *gsm_bts_trx_alloc(struct gsm_bts *bts)
 {
 	struct gsm_bts_trx *trx = talloc_zero(bts, struct gsm_bts_trx);
-	int k;
+	int k, chan_nr;
 
 	if (!trx)
 		return NULL;
@@ -275,6 +276,13 @@ struct gsm_bts_trx *gsm_bts_trx_alloc(struct gsm_bts *bts)
 		}
 	}
 
+	/* Decoding the chan_nr only depends on the chan_nr itself, not
+	 * on the channel combination of the timeslot, so the table
+	 * doesn't need to change when a (dynamic) timeslot does. */
+	for (chan_nr = 0; chan_nr < ARRAY_SIZE(trx->lchan_by_chan_nr); chan_nr++)
+		trx->lchan_by_chan_nr[chan_nr] =
+			&trx->ts[L1SAP_CHAN2TS(chan_nr)].lchan[l1sap_chan2ss(chan_nr)];
+
 	if (trx->nr != 0)
 		trx->nominal_power = bts->c0->nominal_power;
 
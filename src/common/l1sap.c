@@ -28,6 +28,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <inttypes.h>
+#include <time.h>
 
 #include <osmocom/core/msgb.h>
 #include <osmocom/gsm/l1sap.h>
@@ -38,6 +39,8 @@
 
 #include <osmocom/trau/osmo_ortp.h>
 
+#include <ortp/ortp.h>
+
 #include <osmo-bts/logging.h>
 #include <osmo-bts/gsm_data.h>
 #include <osmo-bts/l1sap.h>
@@ -53,11 +56,14 @@
 #include <osmo-bts/power_control.h>
 #include <osmo-bts/msg_utils.h>
 #include <osmo-bts/pcuif_proto.h>
+#include <osmo-bts/dl_tch_ring.h>
+#include <osmo-bts/rtp_egress.h>
+#include <osmo-bts/trace.h>
 
 struct gsm_lchan *get_lchan_by_chan_nr(struct gsm_bts_trx *trx,
 				       unsigned int chan_nr)
 {
-	return &trx->ts[L1SAP_CHAN2TS(chan_nr)].lchan[l1sap_chan2ss(chan_nr)];
+	return trx->lchan_by_chan_nr[chan_nr & 0xff];
 }
 
 static struct gsm_lchan *
@@ -112,6 +118,12 @@ static void queue_limit_to(const char *prefix, struct llist_head *queue, unsigne
 	}
 }
 
+void l1sap_dl_tch_flush(struct gsm_lchan *lchan)
+{
+	msgb_queue_flush(&lchan->dl_tch_queue);
+	dl_tch_ring_flush(&lchan->dl_tch_ring);
+}
+
 /* allocate a msgb containing a osmo_phsap_prim + optional l2 data
  * in order to wrap femtobts header arround l2 data, there must be enough space
  * in front and behind data pointer */
@@ -466,7 +478,7 @@ static int l1sap_info_time_ind(struct gsm_bts *bts,
 	gsm_fn2gsmtime(&btsb->gsm_time, info_time_ind->fn);
 
 	/* Update time on PCU interface */
-	pcu_tx_time_ind(info_time_ind->fn);
+	pcu_tx_time_ind(bts, info_time_ind->fn);
 
 	/* increment number of RACH slots that have passed by since the
 	 * last time indication */
@@ -695,6 +707,8 @@ static int l1sap_ph_rts_ind(struct gsm_bts_trx *trx,
 
 	DEBUGP(DL1P, "Rx PH-RTS.ind %s chan_nr=0x%02x link_id=0x%02xd\n",
 		osmo_dump_gsmtime(&g_time), chan_nr, link_id);
+	BTS_TRACE(BTS_TRACE_L1SAP, BTS_TRACE_EV_PH_RTS_IND, fn, trx->nr, tn,
+		  chan_nr, link_id);
 
 	/* reuse PH-RTS.ind for PH-DATA.req */
 	if (!msg) {
@@ -791,6 +805,8 @@ static int l1sap_ph_rts_ind(struct gsm_bts_trx *trx,
 
 	DEBUGP(DL1P, "Tx PH-DATA.req %s chan_nr=0x%02x link_id=0x%02x\n",
 		osmo_dump_gsmtime(&g_time), chan_nr, link_id);
+	BTS_TRACE(BTS_TRACE_L1SAP, BTS_TRACE_EV_PH_DATA_REQ, fn, trx->nr, tn,
+		  chan_nr, link_id);
 
 	l1sap_down(trx, l1sap);
 
@@ -838,6 +854,8 @@ static int l1sap_tch_rts_ind(struct gsm_bts_trx *trx,
 	gsm_fn2gsmtime(&g_time, fn);
 
 	DEBUGP(DL1P, "Rx TCH-RTS.ind %s chan_nr=0x%02x\n", osmo_dump_gsmtime(&g_time), chan_nr);
+	BTS_TRACE(BTS_TRACE_L1SAP, BTS_TRACE_EV_TCH_RTS_IND, fn, trx->nr,
+		  L1SAP_CHAN2TS(chan_nr), chan_nr, 0);
 
 	lchan = get_active_lchan_by_chan_nr(trx, chan_nr);
 	if (!lchan) {
@@ -845,7 +863,8 @@ static int l1sap_tch_rts_ind(struct gsm_bts_trx *trx,
 		return 0;
 	}
 
-	if (!lchan->loopback && lchan->abis_ip.rtp_socket) {
+	if (!lchan->loopback && lchan->abis_ip.rtp_socket &&
+	    (lchan->abis_ip.rtp_socket->flags & OSMO_RTP_F_POLL)) {
 		osmo_rtp_socket_poll(lchan->abis_ip.rtp_socket);
 		/* FIXME: we _assume_ that we never miss TDMA
 		 * frames and that we always get to this point
@@ -855,8 +874,10 @@ static int l1sap_tch_rts_ind(struct gsm_bts_trx *trx,
 		 * elapsed since the last call */
 		lchan->abis_ip.rtp_socket->rx_user_ts += GSM_RTP_DURATION;
 	}
-	/* get a msgb from the dl_tx_queue */
+	/* get a msgb from the dl_tx_queue (loopback) or the RTP frame ring */
 	resp_msg = msgb_dequeue(&lchan->dl_tch_queue);
+	if (!resp_msg)
+		resp_msg = dl_tch_ring_get(&lchan->dl_tch_ring);
 	if (!resp_msg) {
 		LOGP(DL1P, LOGL_DEBUG, "%s DL TCH Tx queue underrun\n",
 			gsm_lchan_name(lchan));
@@ -893,6 +914,9 @@ static int l1sap_tch_rts_ind(struct gsm_bts_trx *trx,
 	resp_l1sap->u.tch.marker = marker;
 
 	DEBUGP(DL1P, "Tx TCH.req %s chan_nr=0x%02x\n", osmo_dump_gsmtime(&g_time), chan_nr);
+	BTS_TRACE(BTS_TRACE_L1SAP, BTS_TRACE_EV_TCH_REQ, fn, trx->nr,
+		  L1SAP_CHAN2TS(chan_nr), chan_nr,
+		  resp_msg ? msgb_l2len(resp_msg) : 0);
 
 	l1sap_down(trx, resp_l1sap);
 
@@ -996,6 +1020,8 @@ static int l1sap_ph_data_ind(struct gsm_bts_trx *trx,
 
 	DEBUGP(DL1P, "Rx PH-DATA.ind %s chan_nr=0x%02x link_id=0x%02x len=%d\n",
 		osmo_dump_gsmtime(&g_time), chan_nr, link_id, len);
+	BTS_TRACE(BTS_TRACE_L1SAP, BTS_TRACE_EV_PH_DATA_IND, fn, trx->nr, tn,
+		  chan_nr, len);
 
 	if (ts_is_pdch(&trx->ts[tn])) {
 		lchan = get_lchan_by_chan_nr(trx, chan_nr);
@@ -1102,6 +1128,8 @@ static int l1sap_tch_ind(struct gsm_bts_trx *trx, struct osmo_phsap_prim *l1sap,
 	gsm_fn2gsmtime(&g_time, fn);
 
 	LOGP(DL1P, LOGL_INFO, "Rx TCH.ind %s chan_nr=0x%02x\n", osmo_dump_gsmtime(&g_time), chan_nr);
+	BTS_TRACE(BTS_TRACE_L1SAP, BTS_TRACE_EV_TCH_IND, fn, trx->nr,
+		  L1SAP_CHAN2TS(chan_nr), chan_nr, msgb_l2len(msg));
 
 	lchan = get_active_lchan_by_chan_nr(trx, chan_nr);
 	if (!lchan) {
@@ -1117,7 +1145,10 @@ static int l1sap_tch_ind(struct gsm_bts_trx *trx, struct osmo_phsap_prim *l1sap,
 	 * good enough. */
 	if (msg->len && tch_ind->lqual_cb / 10 >= btsb->min_qual_norm) {
 		/* hand msg to RTP code for transmission */
-		if (lchan->abis_ip.rtp_socket)
+		if (lchan->abis_ip.egress.active)
+			rtp_egress_send(lchan, msg->data, msg->len,
+				fn_ms_adj(fn, lchan), lchan->rtp_tx_marker);
+		else if (lchan->abis_ip.rtp_socket)
 			osmo_rtp_send_frame_ext(lchan->abis_ip.rtp_socket,
 				msg->data, msg->len, fn_ms_adj(fn, lchan), lchan->rtp_tx_marker);
 		/* if loopback is enabled, also queue received RTP data */
@@ -1133,7 +1164,9 @@ static int l1sap_tch_ind(struct gsm_bts_trx *trx, struct osmo_phsap_prim *l1sap,
 		lchan->rtp_tx_marker = false;
 	} else {
 		DEBUGP(DRTP, "Skipping RTP frame with lost payload\n");
-		if (lchan->abis_ip.rtp_socket)
+		if (lchan->abis_ip.egress.active)
+			rtp_egress_skipped(lchan, fn_ms_adj(fn, lchan));
+		else if (lchan->abis_ip.rtp_socket)
 			osmo_rtp_skipped_frame(lchan->abis_ip.rtp_socket, fn_ms_adj(fn, lchan));
 		lchan->rtp_tx_marker = true;
 	}
@@ -1152,6 +1185,8 @@ static int l1sap_ph_rach_ind(struct gsm_bts_trx *trx,
 	uint8_t acc_delay;
 
 	DEBUGP(DL1P, "Rx PH-RA.ind");
+	BTS_TRACE(BTS_TRACE_L1SAP, BTS_TRACE_EV_PH_RACH_IND, rach_ind->fn, trx->nr,
+		  L1SAP_CHAN2TS(rach_ind->chan_nr), rach_ind->chan_nr, rach_ind->ra);
 
 	lc = &trx->ts[0].lchan[CCCH_LCHAN].lapdm_ch;
 
@@ -1184,6 +1219,11 @@ static int l1sap_ph_rach_ind(struct gsm_bts_trx *trx,
 
 	LOGP(DL1P, LOGL_INFO, "RACH for RR access (toa=%d, ra=%d)\n",
 		rach_ind->acc_delay, rach_ind->ra);
+
+	/* shed load locally instead of passing everything to the BSC */
+	if (rach_adm_check(bts, rach_ind->ra, rach_ind->fn) < 0)
+		return 0;
+
 	lapdm_phsap_up(&l1sap->oph, &lc->lapdm_dcch);
 
 	return 0;
@@ -1277,31 +1317,26 @@ void l1sap_rtp_rx_cb(struct osmo_rtp_socket *rs, const uint8_t *rtp_pl,
 		     uint32_t timestamp, bool marker)
 {
 	struct gsm_lchan *lchan = rs->priv;
-	struct msgb *msg;
-	struct osmo_phsap_prim *l1sap;
+	struct timespec now;
 
 	/* if we're in loopback mode, we don't accept frames from the
 	 * RTP socket anymore */
 	if (lchan->loopback)
 		return;
 
-	msg = l1sap_msgb_alloc(rtp_pl_len);
-	if (!msg)
-		return;
-	memcpy(msgb_put(msg, rtp_pl_len), rtp_pl, rtp_pl_len);
-	msgb_pull(msg, sizeof(*l1sap));
-
-	/* Store RTP header Marker bit in control buffer */
-	rtpmsg_marker_bit(msg) = marker;
-	/* Store RTP header Sequence Number in control buffer */
-	rtpmsg_seq(msg) = seq_number;
-	/* Store RTP header Timestamp in control buffer */
-	rtpmsg_ts(msg) = timestamp;
-
-	/* make sure the queue doesn't get too long */
-	queue_limit_to(gsm_lchan_name(lchan), &lchan->dl_tch_queue, 1);
-
-	msgb_enqueue(&lchan->dl_tch_queue, msg);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	switch (dl_tch_ring_put(&lchan->dl_tch_ring, rtp_pl, rtp_pl_len,
+				rtp_session_get_recv_ssrc(rs->sess),
+				seq_number, timestamp, marker, &now)) {
+	case -EMSGSIZE:
+		LOGP(DRTP, LOGL_NOTICE, "%s: dropping RTP frame of %u bytes\n",
+		     gsm_lchan_name(lchan), rtp_pl_len);
+		break;
+	case -ETIME:
+		LOGP(DRTP, LOGL_DEBUG, "%s: dropping late RTP frame (seq=%u)\n",
+		     gsm_lchan_name(lchan), seq_number);
+		break;
+	}
 }
 
 static int l1sap_chan_act_dact_modify(struct gsm_bts_trx *trx, uint8_t chan_nr,
@@ -66,6 +66,7 @@ static void load_timer_cb(void *data)
 	else
 		rach_percent = (btsb->load.rach.busy * 100) /
 					btsb->load.rach.total;
+	btsb->load.rach.percent = rach_percent;
 
 	if (rach_percent >= btsb->load.ccch.load_ind_thresh) {
 		/* send RSL load indication message to BSC */
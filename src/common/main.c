@@ -319,7 +319,7 @@ int bts_main(int argc, char **argv)
 		exit(1);
 	}
 
-	if (pcu_sock_init(btsb->pcu.sock_path)) {
+	if (pcu_sock_init(bts, btsb->pcu.sock_path)) {
 		fprintf(stderr, "PCU L1 socket failed\n");
 		exit(1);
 	}
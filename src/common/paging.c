@@ -28,7 +28,6 @@
 #include <stdint.h>
 #include <errno.h>
 #include <string.h>
-#include <time.h>
 
 #include <osmocom/core/talloc.h>
 #include <osmocom/core/linuxlist.h>
@@ -46,17 +45,47 @@
 #define MAX_PAGING_BLOCKS_CCCH	9
 #define MAX_BS_PA_MFRMS		9
 
+/* number of paging records allocated at once */
+#define PAGING_SLAB_SIZE	256
+/* initial number of hash buckets, must be a power of two */
+#define PAGING_HASH_MIN		256
+
+/* The paging records expire on a two-level timing wheel, which advances
+ * by one tick per 51-multiframe (~235ms) of the GSM frame clock.  Level 0
+ * holds everything expiring within the next 64 ticks (~15s), level 1
+ * everything up to 64*64 ticks (~16min), far more than the maximum paging
+ * lifetime of 60s. */
+#define PAGING_WHEEL_BITS	6
+#define PAGING_WHEEL_SLOTS	(1 << PAGING_WHEEL_BITS)
+#define PAGING_WHEEL_MASK	(PAGING_WHEEL_SLOTS - 1)
+#define PAGING_TICK_FN		51
+
+/* number of records at the head of a group queue considered for packing */
+#define PAGING_PACK_WINDOW	8
+
 enum paging_record_type {
 	PAGING_RECORD_PAGING,
 	PAGING_RECORD_IMM_ASS
 };
 
 struct paging_record {
+	/* entry in the group queue, or in the list of free records */
 	struct llist_head list;
+	/* entry in the identity hash (PAGING_RECORD_PAGING only) */
+	struct llist_head hash_list;
+	uint32_t hash;
+	uint8_t group;
 	enum paging_record_type type;
 	union {
 		struct {
-			time_t expiration_time;
+			/* entry in a slot of the timing wheel */
+			struct llist_head timer_list;
+			/* wheel tick at which the record expires */
+			uint32_t expire_tick;
+			/* lifetime is over, remove once transmitted */
+			uint8_t expired:1,
+			/* transmitted at least once */
+				sent:1;
 			uint8_t chan_needed;
 			uint8_t identity_lv[9];
 		} paging;
@@ -67,6 +96,7 @@ struct paging_record {
 };
 
 struct paging_state {
+	struct gsm_bts *bts;
 	struct gsm_bts_role_bts *btsb;
 
 	/* parameters taken / interpreted from BCCH/CCCH configuration */
@@ -79,6 +109,28 @@ struct paging_state {
 	/* total number of currently active paging records in queue */
 	unsigned int num_paging;
 	struct llist_head paging_queue[MAX_PAGING_BLOCKS_CCCH*MAX_BS_PA_MFRMS];
+
+	/* records are taken from slabs of PAGING_SLAB_SIZE, never freed */
+	struct llist_head free_records;
+	unsigned int num_records;
+
+	/* paging records by (group, identity), hash_mask + 1 buckets */
+	struct llist_head *hash;
+	unsigned int hash_mask;
+
+	/* expiry of paging records, driven by paging_gen_msg() */
+	struct {
+		struct llist_head slot[2][PAGING_WHEEL_SLOTS];
+		/* current tick */
+		uint32_t now;
+		/* last FN we have seen, frames not yet making up a tick */
+		uint32_t last_fn;
+		uint32_t fn_rest;
+		int running;
+	} wheel;
+
+	struct paging_group_stats group_stats[MAX_PAGING_BLOCKS_CCCH*MAX_BS_PA_MFRMS];
+	struct paging_pack_stats pack_stats;
 };
 
 unsigned int paging_get_lifetime(struct paging_state *ps)
@@ -164,6 +216,195 @@ static int get_pag_subch_nr(struct paging_state *ps, struct gsm_time *gt)
 	return pag_idx + mfrm_part;
 }
 
+static struct paging_record *paging_record_alloc(struct paging_state *ps)
+{
+	struct paging_record *pr;
+
+	if (llist_empty(&ps->free_records)) {
+		struct paging_record *slab;
+		unsigned int i;
+
+		slab = talloc_array(ps, struct paging_record, PAGING_SLAB_SIZE);
+		if (!slab)
+			return NULL;
+		for (i = 0; i < PAGING_SLAB_SIZE; i++)
+			llist_add_tail(&slab[i].list, &ps->free_records);
+		ps->num_records += PAGING_SLAB_SIZE;
+	}
+
+	pr = llist_entry(ps->free_records.next, struct paging_record, list);
+	llist_del(&pr->list);
+	memset(pr, 0, sizeof(*pr));
+
+	return pr;
+}
+
+/* release a record which is no longer part of a group queue */
+static void paging_record_free(struct paging_state *ps, struct paging_record *pr)
+{
+	if (pr->type == PAGING_RECORD_PAGING)
+		llist_del(&pr->hash_list);
+	llist_add(&pr->list, &ps->free_records);
+}
+
+/* FNV-1a over paging group and identity */
+static uint32_t paging_hash(uint8_t group, const uint8_t *identity_lv)
+{
+	uint32_t hash = 2166136261u;
+	unsigned int i;
+
+	hash = (hash ^ group) * 16777619;
+	for (i = 0; i <= identity_lv[0]; i++)
+		hash = (hash ^ identity_lv[i]) * 16777619;
+
+	return hash;
+}
+
+static struct paging_record *paging_lookup(struct paging_state *ps, uint8_t group,
+					   const uint8_t *identity_lv, uint32_t hash)
+{
+	struct llist_head *bucket = &ps->hash[hash & ps->hash_mask];
+	struct paging_record *pr;
+
+	llist_for_each_entry(pr, bucket, hash_list) {
+		if (pr->hash != hash || pr->group != group)
+			continue;
+		if (identity_lv[0] == pr->u.paging.identity_lv[0] &&
+		    !memcmp(identity_lv+1, pr->u.paging.identity_lv+1,
+							identity_lv[0]))
+			return pr;
+	}
+
+	return NULL;
+}
+
+/* double the number of hash buckets, keeping the chains short */
+static int paging_hash_grow(struct paging_state *ps)
+{
+	unsigned int i, num = (ps->hash_mask + 1) * 2;
+	struct llist_head *hash;
+	struct paging_record *pr, *pr2;
+
+	hash = talloc_array(ps, struct llist_head, num);
+	if (!hash)
+		return -ENOMEM;
+	for (i = 0; i < num; i++)
+		INIT_LLIST_HEAD(&hash[i]);
+
+	for (i = 0; i <= ps->hash_mask; i++) {
+		llist_for_each_entry_safe(pr, pr2, &ps->hash[i], hash_list)
+			llist_add(&pr->hash_list, &hash[pr->hash & (num - 1)]);
+	}
+
+	talloc_free(ps->hash);
+	ps->hash = hash;
+	ps->hash_mask = num - 1;
+
+	return 0;
+}
+
+/* lifetime in seconds to wheel ticks, rounded up (1 tick = 51*120/26 ms) */
+static uint32_t paging_lifetime_ticks(unsigned int lifetime)
+{
+	return (lifetime * 26000 + PAGING_TICK_FN * 120 - 1) / (PAGING_TICK_FN * 120);
+}
+
+static void paging_timer_add(struct paging_state *ps, struct paging_record *pr)
+{
+	uint32_t expire = pr->u.paging.expire_tick;
+	int32_t delta = expire - ps->wheel.now;
+
+	if (delta <= 0) {
+		/* no need to wait, but it must still be paged once */
+		pr->u.paging.expired = 1;
+		return;
+	}
+
+	if (delta < PAGING_WHEEL_SLOTS)
+		llist_add_tail(&pr->u.paging.timer_list,
+			       &ps->wheel.slot[0][expire & PAGING_WHEEL_MASK]);
+	else
+		llist_add_tail(&pr->u.paging.timer_list,
+			       &ps->wheel.slot[1][(expire >> PAGING_WHEEL_BITS) & PAGING_WHEEL_MASK]);
+}
+
+/* (re)start the lifetime of a paging record */
+static void paging_timer_start(struct paging_state *ps, struct paging_record *pr)
+{
+	if (!pr->u.paging.expired)
+		llist_del(&pr->u.paging.timer_list);
+	pr->u.paging.expired = 0;
+	pr->u.paging.expire_tick = ps->wheel.now + paging_lifetime_ticks(ps->paging_lifetime);
+	paging_timer_add(ps, pr);
+}
+
+/* remove a paging record from its group queue and release it */
+static void paging_record_remove(struct paging_state *ps, struct paging_record *pr)
+{
+	if (!pr->u.paging.expired)
+		llist_del(&pr->u.paging.timer_list);
+	ps->num_paging--;
+	ps->group_stats[pr->group].queued--;
+	paging_record_free(ps, pr);
+}
+
+/* advance the timing wheel by a single tick */
+static void paging_wheel_tick(struct paging_state *ps)
+{
+	struct paging_record *pr, *pr2;
+	struct llist_head *slot;
+	uint32_t now = ++ps->wheel.now;
+
+	/* move the records of the next level 1 slot down to level 0 */
+	if (!(now & PAGING_WHEEL_MASK)) {
+		slot = &ps->wheel.slot[1][(now >> PAGING_WHEEL_BITS) & PAGING_WHEEL_MASK];
+		llist_for_each_entry_safe(pr, pr2, slot, u.paging.timer_list) {
+			llist_del(&pr->u.paging.timer_list);
+			llist_add_tail(&pr->u.paging.timer_list,
+				       &ps->wheel.slot[0][pr->u.paging.expire_tick & PAGING_WHEEL_MASK]);
+		}
+	}
+
+	slot = &ps->wheel.slot[0][now & PAGING_WHEEL_MASK];
+	llist_for_each_entry_safe(pr, pr2, slot, u.paging.timer_list) {
+		llist_del(&pr->u.paging.timer_list);
+		pr->u.paging.expired = 1;
+		/* only drop records that have been paged at least once */
+		if (!pr->u.paging.sent)
+			continue;
+		llist_del(&pr->list);
+		ps->group_stats[pr->group].expired++;
+		paging_record_remove(ps, pr);
+		LOGP(DPAG, LOGL_INFO, "Expired paging record, queue_len=%u\n",
+			ps->num_paging);
+	}
+}
+
+/* advance the timing wheel to frame number \a fn */
+static void paging_wheel_advance(struct paging_state *ps, uint32_t fn)
+{
+	uint32_t frames;
+
+	if (!ps->wheel.running) {
+		ps->wheel.last_fn = fn;
+		ps->wheel.running = 1;
+		return;
+	}
+
+	frames = (fn + GSM_HYPERFRAME - ps->wheel.last_fn) % GSM_HYPERFRAME;
+	ps->wheel.last_fn = fn;
+
+	/* after a jump of the clock, expiring everything is good enough */
+	if (frames > PAGING_TICK_FN * PAGING_WHEEL_SLOTS * PAGING_WHEEL_SLOTS)
+		frames = PAGING_TICK_FN * PAGING_WHEEL_SLOTS * PAGING_WHEEL_SLOTS;
+
+	ps->wheel.fn_rest += frames;
+	while (ps->wheel.fn_rest >= PAGING_TICK_FN) {
+		ps->wheel.fn_rest -= PAGING_TICK_FN;
+		paging_wheel_tick(ps);
+	}
+}
+
 int paging_buffer_space(struct paging_state *ps)
 {
 	if (ps->num_paging >= ps->num_paging_max)
@@ -178,6 +419,7 @@ int paging_add_identity(struct paging_state *ps, uint8_t paging_group,
 {
 	struct llist_head *group_q = &ps->paging_queue[paging_group];
 	struct paging_record *pr;
+	uint32_t hash;
 
 	if (ps->num_paging >= ps->num_paging_max) {
 		LOGP(DPAG, LOGL_NOTICE, "Dropping paging, queue full (%u)\n",
@@ -185,41 +427,43 @@ int paging_add_identity(struct paging_state *ps, uint8_t paging_group,
 		return -ENOSPC;
 	}
 
+	if (*identity_lv + 1 > sizeof(pr->u.paging.identity_lv))
+		return -E2BIG;
+
 	/* Check if we already have this identity */
-	llist_for_each_entry(pr, group_q, list) {
-		if (pr->type != PAGING_RECORD_PAGING)
-			continue;
-		if (identity_lv[0] == pr->u.paging.identity_lv[0] &&
-		    !memcmp(identity_lv+1, pr->u.paging.identity_lv+1,
-							identity_lv[0])) {
-			LOGP(DPAG, LOGL_INFO, "Ignoring duplicate paging\n");
-			pr->u.paging.expiration_time =
-					time(NULL) + ps->paging_lifetime;
-			return -EEXIST;
-		}
+	hash = paging_hash(paging_group, identity_lv);
+	pr = paging_lookup(ps, paging_group, identity_lv, hash);
+	if (pr) {
+		LOGP(DPAG, LOGL_INFO, "Ignoring duplicate paging\n");
+		paging_timer_start(ps, pr);
+		return -EEXIST;
 	}
 
-	pr = talloc_zero(ps, struct paging_record);
+	/* a failure to grow only makes the chains longer */
+	if (ps->num_paging >= 2 * (ps->hash_mask + 1))
+		paging_hash_grow(ps);
+
+	pr = paging_record_alloc(ps);
 	if (!pr)
 		return -ENOMEM;
 	pr->type = PAGING_RECORD_PAGING;
-
-	if (*identity_lv + 1 > sizeof(pr->u.paging.identity_lv)) {
-		talloc_free(pr);
-		return -E2BIG;
-	}
+	pr->hash = hash;
+	pr->group = paging_group;
 
 	LOGP(DPAG, LOGL_INFO, "Add paging to queue (group=%u, queue_len=%u)\n",
 		paging_group, ps->num_paging+1);
 
-	pr->u.paging.expiration_time = time(NULL) + ps->paging_lifetime;
+	pr->u.paging.expired = 1;
+	paging_timer_start(ps, pr);
 	pr->u.paging.chan_needed = chan_needed;
 	memcpy(&pr->u.paging.identity_lv, identity_lv, identity_lv[0]+1);
+	llist_add(&pr->hash_list, &ps->hash[hash & ps->hash_mask]);
 
 	/* enqueue the new identity to the HEAD of the queue,
 	 * to ensure it will be paged quickly at least once.  */
 	llist_add(&pr->list, group_q);
 	ps->num_paging++;
+	ps->group_stats[paging_group].queued++;
 
 	return 0;
 }
@@ -245,10 +489,11 @@ int paging_add_imm_ass(struct paging_state *ps, const uint8_t *data,
 
 	group_q = &ps->paging_queue[paging_group];
 
-	pr = talloc_zero(ps, struct paging_record);
+	pr = paging_record_alloc(ps);
 	if (!pr)
 		return -ENOMEM;
 	pr->type = PAGING_RECORD_IMM_ASS;
+	pr->group = paging_group;
 
 	LOGP(DPAG, LOGL_INFO, "Add IMM.ASS to queue (group=%u)\n",
 		paging_group);
@@ -338,42 +583,57 @@ static int fill_paging_type_3(uint8_t *out_buf, const uint8_t *tmsi1_lv,
 
 static const uint8_t empty_id_lv[] = { 0x01, 0xF0 };
 
-static struct paging_record *dequeue_pr(struct llist_head *group_q)
+static int pr_is_tmsi(struct paging_record *pr)
 {
-	struct paging_record *pr;
-
-	pr = llist_entry(group_q->next, struct paging_record, list);
-	llist_del(&pr->list);
-
-	return pr;
-}
-
-static int pr_is_imsi(struct paging_record *pr)
-{
-	if ((pr->u.paging.identity_lv[1] & 7) == GSM_MI_TYPE_IMSI)
+	if ((pr->u.paging.identity_lv[1] & 7) == GSM_MI_TYPE_TMSI)
 		return 1;
 	else
 		return 0;
 }
 
-static void sort_pr_tmsi_imsi(struct paging_record *pr[], unsigned int n)
+/* Pick the paging records for one PCH block out of the first \a num_win
+ * records of a group queue, so that as many identities as possible are
+ * paged.  Type 3 needs four TMSIs, Type 2 two TMSIs plus any identity,
+ * Type 1 takes any two.  For fairness, the record at the head of the queue
+ * is always part of the block, so no record has to wait for more blocks
+ * than there are records ahead of it.
+ * \returns number of records picked into \a pr, TMSIs first */
+static unsigned int paging_pack(struct paging_record *win[], unsigned int num_win,
+				struct paging_record *pr[4])
 {
-	int i, j;
-	struct paging_record *t;
+	unsigned int i, num_tmsi = 0, num_pr = 0;
+	struct paging_record *tmsi[4];
 
-	if (n < 2)
-		return;
+	for (i = 0; i < num_win && num_tmsi < ARRAY_SIZE(tmsi); i++) {
+		if (pr_is_tmsi(win[i]))
+			tmsi[num_tmsi++] = win[i];
+	}
+
+	/* Type 3: the head must be one of the four TMSIs */
+	if (num_tmsi == 4 && tmsi[0] == win[0]) {
+		for (i = 0; i < 4; i++)
+			pr[i] = tmsi[i];
+		return 4;
+	}
 
-	/* simple bubble sort */
-	for (i = n-2; i >= 0; i--) {
-		for (j=0; j<=i ; j++) {
-			if (pr_is_imsi(pr[j]) > pr_is_imsi(pr[j+1])) {
-				t = pr[j];
-				pr[j] = pr[j+1];
-				pr[j+1] = t;
+	/* Type 2: two TMSIs, plus the head or the oldest other record */
+	if (num_tmsi >= 2 && num_win >= 3) {
+		pr[num_pr++] = tmsi[0];
+		pr[num_pr++] = tmsi[1];
+		for (i = 0; i < num_win; i++) {
+			if (win[i] != tmsi[0] && win[i] != tmsi[1]) {
+				pr[num_pr++] = win[i];
+				break;
 			}
 		}
+		return num_pr;
 	}
+
+	/* Type 1: the first two */
+	for (i = 0; i < num_win && i < 2; i++)
+		pr[num_pr++] = win[i];
+
+	return num_pr;
 }
 
 /* generate paging message for given gsm time */
@@ -387,6 +647,8 @@ int paging_gen_msg(struct paging_state *ps, uint8_t *out_buf, struct gsm_time *g
 	*is_empty = 0;
 	ps->btsb->load.ccch.pch_total += 1;
 
+	paging_wheel_advance(ps, gt->fn);
+
 	group = get_pag_subch_nr(ps, gt);
 	if (group < 0) {
 		LOGP(DPAG, LOGL_ERROR,
@@ -404,52 +666,35 @@ int paging_gen_msg(struct paging_state *ps, uint8_t *out_buf, struct gsm_time *g
 					 NULL, 0);
 		*is_empty = 1;
 	} else {
-		struct paging_record *pr[4];
-		unsigned int num_pr = 0, imm_ass = 0;
-		time_t now = time(NULL);
-		unsigned int i, num_imsi = 0;
+		struct paging_record *win[PAGING_PACK_WINDOW];
+		struct paging_record *pr[4], *cur;
+		unsigned int num_win = 0, num_pr, i;
 
 		ps->btsb->load.ccch.pch_used += 1;
 
-		/* get (if we have) up to four paging records */
-		for (i = 0; i < ARRAY_SIZE(pr); i++) {
-			if (llist_empty(group_q))
-				break;
-			pr[i] = dequeue_pr(group_q);
-
-			/* check for IMM.ASS */
-			if (pr[i]->type == PAGING_RECORD_IMM_ASS) {
-				imm_ass = 1;
-				break;
-			}
-
-			num_pr++;
-
-			/* count how many IMSIs are among them */
-			if (pr_is_imsi(pr[i]))
-				num_imsi++;
-		}
-
-		/* if we have an IMMEDIATE ASSIGNMENT */
-		if (imm_ass) {
-			/* re-add paging records */
-			for (i = 0; i < num_pr; i++)
-				llist_add(&pr[i]->list, group_q);
-
-			/* get message and free record */
-			memcpy(out_buf, pr[num_pr]->u.imm_ass.msg,
+		/* look at (up to) the first records of the queue */
+		llist_for_each_entry(cur, group_q, list) {
+			/* an IMMEDIATE ASSIGNMENT among the first four is sent
+			 * right away, we don't look past it otherwise */
+			if (cur->type == PAGING_RECORD_IMM_ASS) {
+				if (num_win >= 4)
+					break;
+				llist_del(&cur->list);
+				memcpy(out_buf, cur->u.imm_ass.msg,
 							GSM_MACBLOCK_LEN);
-			pcu_tx_pch_data_cnf(gt->fn, pr[num_pr]->u.imm_ass.msg,
+				pcu_tx_pch_data_cnf(ps->bts, gt->fn, cur->u.imm_ass.msg,
 							GSM_MACBLOCK_LEN);
-			talloc_free(pr[num_pr]);
-			return GSM_MACBLOCK_LEN;
+				paging_record_free(ps, cur);
+				return GSM_MACBLOCK_LEN;
+			}
+			win[num_win++] = cur;
+			if (num_win == ARRAY_SIZE(win))
+				break;
 		}
 
-		/* make sure the TMSIs are ahead of the IMSIs in the array */
-		sort_pr_tmsi_imsi(pr, num_pr);
+		num_pr = paging_pack(win, num_win, pr);
 
-		if (num_pr == 4 && num_imsi == 0) {
-			/* No IMSI: easy case, can use TYPE 3 */
+		if (num_pr == 4) {
 			DEBUGP(DPAG, "Tx PAGING TYPE 3 (4 TMSI)\n");
 			len = fill_paging_type_3(out_buf,
 						 pr[0]->u.paging.identity_lv,
@@ -458,8 +703,8 @@ int paging_gen_msg(struct paging_state *ps, uint8_t *out_buf, struct gsm_time *g
 						 pr[1]->u.paging.chan_needed,
 						 pr[2]->u.paging.identity_lv,
 						 pr[3]->u.paging.identity_lv);
-		} else if (num_pr >= 3 && num_imsi <= 1) {
-			/* 3 or 4, of which only up to 1 is IMSI */
+			ps->pack_stats.type[2]++;
+		} else if (num_pr == 3) {
 			DEBUGP(DPAG, "Tx PAGING TYPE 2 (2 TMSI,1 xMSI)\n");
 			len = fill_paging_type_2(out_buf,
 						 pr[0]->u.paging.identity_lv,
@@ -467,47 +712,34 @@ int paging_gen_msg(struct paging_state *ps, uint8_t *out_buf, struct gsm_time *g
 						 pr[1]->u.paging.identity_lv,
 						 pr[1]->u.paging.chan_needed,
 						 pr[2]->u.paging.identity_lv);
-			if (num_pr == 4) {
-				/* re-add #4 for next time */
-				llist_add(&pr[3]->list, group_q);
-				pr[3] = NULL;
-			}
-		} else if (num_pr == 1) {
-			DEBUGP(DPAG, "Tx PAGING TYPE 1 (1 xMSI,1 empty)\n");
+			ps->pack_stats.type[1]++;
+		} else if (num_pr == 2) {
+			DEBUGP(DPAG, "Tx PAGING TYPE 1 (2 xMSI)\n");
 			len = fill_paging_type_1(out_buf,
 						 pr[0]->u.paging.identity_lv,
 						 pr[0]->u.paging.chan_needed,
-						 NULL, 0);
+						 pr[1]->u.paging.identity_lv,
+						 pr[1]->u.paging.chan_needed);
+			ps->pack_stats.type[0]++;
 		} else {
-			/* 2 (any type) or
-			 * 3 or 4, of which only 2 will be sent */
-			DEBUGP(DPAG, "Tx PAGING TYPE 1 (2 xMSI)\n");
+			DEBUGP(DPAG, "Tx PAGING TYPE 1 (1 xMSI,1 empty)\n");
 			len = fill_paging_type_1(out_buf,
 						 pr[0]->u.paging.identity_lv,
 						 pr[0]->u.paging.chan_needed,
-						 pr[1]->u.paging.identity_lv,
-						 pr[1]->u.paging.chan_needed);
-			if (num_pr >= 3) {
-				/* re-add #4 for next time */
-				llist_add(&pr[2]->list, group_q);
-				pr[2] = NULL;
-			}
-			if (num_pr == 4) {
-				/* re-add #4 for next time */
-				llist_add(&pr[3]->list, group_q);
-				pr[3] = NULL;
-			}
+						 NULL, 0);
+			ps->pack_stats.type[0]++;
 		}
+		ps->pack_stats.blocks++;
+		ps->pack_stats.identities += num_pr;
 
 		for (i = 0; i < num_pr; i++) {
-			/* skip those that we might have re-added above */
-			if (pr[i] == NULL)
-				continue;
+			llist_del(&pr[i]->list);
+			pr[i]->u.paging.sent = 1;
 			/* check if we can expire the paging record,
 			 * or if we need to re-queue it */
-			if (pr[i]->u.paging.expiration_time <= now) {
-				talloc_free(pr[i]);
-				ps->num_paging--;
+			if (pr[i]->u.paging.expired) {
+				ps->group_stats[pr[i]->group].expired++;
+				paging_record_remove(ps, pr[i]);
 				LOGP(DPAG, LOGL_INFO, "Removed paging record, queue_len=%u\n",
 					ps->num_paging);
 			} else
@@ -545,10 +777,11 @@ static int paging_signal_cbfn(unsigned int subsys, unsigned int signal, void *hd
 
 static int initialized = 0;
 
-struct paging_state *paging_init(struct gsm_bts_role_bts *btsb,
+struct paging_state *paging_init(struct gsm_bts *bts,
 				 unsigned int num_paging_max,
 				 unsigned int paging_lifetime)
 {
+	struct gsm_bts_role_bts *btsb = bts->role;
 	struct paging_state *ps;
 	unsigned int i;
 
@@ -556,12 +789,27 @@ struct paging_state *paging_init(struct gsm_bts_role_bts *btsb,
 	if (!ps)
 		return NULL;
 
+	ps->bts = bts;
 	ps->btsb = btsb;
 	ps->paging_lifetime = paging_lifetime;
 	ps->num_paging_max = num_paging_max;
 
 	for (i = 0; i < ARRAY_SIZE(ps->paging_queue); i++)
 		INIT_LLIST_HEAD(&ps->paging_queue[i]);
+	INIT_LLIST_HEAD(&ps->free_records);
+	for (i = 0; i < PAGING_WHEEL_SLOTS; i++) {
+		INIT_LLIST_HEAD(&ps->wheel.slot[0][i]);
+		INIT_LLIST_HEAD(&ps->wheel.slot[1][i]);
+	}
+
+	ps->hash = talloc_array(ps, struct llist_head, PAGING_HASH_MIN);
+	if (!ps->hash) {
+		talloc_free(ps);
+		return NULL;
+	}
+	for (i = 0; i < PAGING_HASH_MIN; i++)
+		INIT_LLIST_HEAD(&ps->hash[i]);
+	ps->hash_mask = PAGING_HASH_MIN - 1;
 
 	if (!initialized) {
 		osmo_signal_register_handler(SS_GLOBAL, paging_signal_cbfn, NULL);
@@ -587,8 +835,10 @@ void paging_reset(struct paging_state *ps)
 		struct paging_record *pr, *pr2;
 		llist_for_each_entry_safe(pr, pr2, queue, list) {
 			llist_del(&pr->list);
-			talloc_free(pr);
-			ps->num_paging--;
+			if (pr->type == PAGING_RECORD_PAGING)
+				paging_record_remove(ps, pr);
+			else
+				paging_record_free(ps, pr);
 		}
 	}
 
@@ -612,3 +862,23 @@ int paging_queue_length(struct paging_state *ps)
 {
 	return ps->num_paging;
 }
+
+/*! \brief number of paging groups of the current CCCH configuration */
+unsigned int paging_num_groups(struct paging_state *ps)
+{
+	return gsm0502_get_n_pag_blocks(&ps->chan_desc) * (ps->chan_desc.bs_pa_mfrms + 2);
+}
+
+/*! \brief statistics of the packing of paging records into PCH blocks */
+const struct paging_pack_stats *paging_get_pack_stats(struct paging_state *ps)
+{
+	return &ps->pack_stats;
+}
+
+/*! \brief occupancy and expiry statistics of paging group \a grp */
+const struct paging_group_stats *paging_get_group_stats(struct paging_state *ps, uint8_t grp)
+{
+	if (grp >= ARRAY_SIZE(ps->group_stats))
+		return NULL;
+	return &ps->group_stats[grp];
+}
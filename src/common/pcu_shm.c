@@ -0,0 +1,219 @@
+/* Shared memory transport to the PCU */
+
+/* All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Primitives are built in place in a slot of the ring to the PCU, and
+ * copied out of the slot of the ring to the BTS before pcu_rx() parses
+ * them, so neither a msgb nor a system call is needed per primitive.  The
+ * eventfd doorbells are only rung when a ring goes from empty to non
+ * empty, i.e. once per burst of primitives.  See pcuif_proto.h for the
+ * protocol.
+ */
+
+#define _GNU_SOURCE	/* memfd_create() */
+#include "btsconfig.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+
+#include <osmocom/core/select.h>
+
+#include <osmo-bts/logging.h>
+#include <osmo-bts/pcuif_proto.h>
+#include <osmo-bts/pcu_shm.h>
+
+/*! \brief can the shared memory transport be offered to the PCU? */
+bool pcu_shm_supported(void)
+{
+#ifdef HAVE_MEMFD_CREATE
+	return true;
+#else
+	return false;
+#endif
+}
+
+static int pcu_shm_doorbell_cb(struct osmo_fd *bfd, unsigned int flags)
+{
+	struct pcu_shm *shm = bfd->data;
+	uint64_t cnt;
+
+	if (read(bfd->fd, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN)
+		return -errno;
+
+	return pcu_shm_rx(shm);
+}
+
+/*! \brief set up the rings and doorbells for a SHM.cnf
+ *  \param[in] rx_cb called for each primitive the PCU sends on the ring
+ *  \returns 0 on success; negative on error */
+int pcu_shm_open(struct pcu_shm *shm,
+		 int (*rx_cb)(void *data, struct gsm_pcu_if *pcu_prim), void *data)
+{
+	size_t size = sizeof(struct gsm_pcu_if_shm);
+	int rc;
+
+	memset(shm, 0, sizeof(*shm));
+	shm->mem_fd = shm->tx_efd = shm->rx_bfd.fd = -1;
+	shm->rx_cb = rx_cb;
+	shm->data = data;
+
+#ifdef HAVE_MEMFD_CREATE
+	shm->mem_fd = memfd_create("osmo-bts-pcu", MFD_CLOEXEC);
+#else
+	errno = ENOSYS;
+#endif
+	if (shm->mem_fd < 0)
+		goto err;
+	if (ftruncate(shm->mem_fd, size) < 0)
+		goto err;
+	shm->map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			shm->mem_fd, 0);
+	if (shm->map == MAP_FAILED) {
+		shm->map = NULL;
+		goto err;
+	}
+
+	shm->tx_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (shm->tx_efd < 0)
+		goto err;
+	shm->rx_bfd.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (shm->rx_bfd.fd < 0)
+		goto err;
+	shm->rx_bfd.when = BSC_FD_READ;
+	shm->rx_bfd.cb = pcu_shm_doorbell_cb;
+	shm->rx_bfd.data = shm;
+	if (osmo_fd_register(&shm->rx_bfd) < 0) {
+		/* tells pcu_shm_close() it is not registered */
+		shm->rx_bfd.cb = NULL;
+		errno = EIO;
+		goto err;
+	}
+
+	return 0;
+
+err:
+	rc = -errno;
+	LOGP(DPCU, LOGL_ERROR, "Cannot set up shared memory for the PCU: %s\n",
+	     strerror(errno));
+	pcu_shm_close(shm);
+	return rc;
+}
+
+/*! \brief release the rings and doorbells, e.g. when the PCU disconnects */
+void pcu_shm_close(struct pcu_shm *shm)
+{
+	if (shm->rx_bfd.fd >= 0) {
+		if (shm->rx_bfd.cb)
+			osmo_fd_unregister(&shm->rx_bfd);
+		close(shm->rx_bfd.fd);
+		shm->rx_bfd.fd = -1;
+	}
+	if (shm->tx_efd >= 0) {
+		close(shm->tx_efd);
+		shm->tx_efd = -1;
+	}
+	if (shm->map) {
+		munmap(shm->map, sizeof(struct gsm_pcu_if_shm));
+		shm->map = NULL;
+	}
+	if (shm->mem_fd >= 0) {
+		close(shm->mem_fd);
+		shm->mem_fd = -1;
+	}
+	shm->active = false;
+}
+
+/*! \brief get the slot for the next primitive to the PCU
+ *  \returns slot to be filled and passed to pcu_shm_commit(); NULL if the
+ *  ring is full */
+struct gsm_pcu_if *pcu_shm_claim(struct pcu_shm *shm)
+{
+	struct gsm_pcu_if_shm_ring *r = &shm->map->to_pcu;
+	uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+
+	if (r->head - tail >= PCU_IF_SHM_SLOTS) {
+		shm->tx_full++;
+		return NULL;
+	}
+
+	return &r->slot[r->head % PCU_IF_SHM_SLOTS];
+}
+
+/*! \brief pass the slot returned by pcu_shm_claim() to the PCU */
+void pcu_shm_commit(struct pcu_shm *shm)
+{
+	struct gsm_pcu_if_shm_ring *r = &shm->map->to_pcu;
+	uint32_t head = r->head;
+	uint64_t one = 1;
+
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+	shm->tx++;
+
+	/* the PCU may have gone to sleep after emptying the ring */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&r->tail, __ATOMIC_RELAXED) != head)
+		return;
+	if (write(shm->tx_efd, &one, sizeof(one)) == sizeof(one))
+		shm->doorbells++;
+}
+
+/*! \brief number of primitives on the ring not yet read by the PCU */
+unsigned int pcu_shm_tx_pending(const struct pcu_shm *shm)
+{
+	const struct gsm_pcu_if_shm_ring *r = &shm->map->to_pcu;
+
+	return r->head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
+
+/*! \brief hand all primitives on the ring from the PCU to rx_cb
+ *  \returns 0 on success; negative if the ring is corrupt */
+int pcu_shm_rx(struct pcu_shm *shm)
+{
+	struct gsm_pcu_if_shm_ring *r = &shm->map->to_bts;
+	struct gsm_pcu_if pcu_prim;
+	uint32_t head, tail = r->tail;
+
+	do {
+		head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+		if (head - tail > PCU_IF_SHM_SLOTS) {
+			LOGP(DPCU, LOGL_ERROR, "Shared memory ring from PCU "
+			     "is corrupt (head=%u tail=%u)\n", head, tail);
+			__atomic_store_n(&r->tail, head, __ATOMIC_RELEASE);
+			return -EIO;
+		}
+		while (tail != head) {
+			/* the PCU may reuse the slot once tail is stored, and
+			 * must not change what we are parsing in any case */
+			memcpy(&pcu_prim, &r->slot[tail % PCU_IF_SHM_SLOTS],
+			       sizeof(pcu_prim));
+			tail++;
+			__atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+			shm->rx_cb(shm->data, &pcu_prim);
+			shm->rx++;
+		}
+		/* the PCU skips the doorbell if it saw a non-empty ring */
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	} while (__atomic_load_n(&r->head, __ATOMIC_RELAXED) != tail);
+
+	return 0;
+}
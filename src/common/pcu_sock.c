@@ -22,22 +22,30 @@
  */
 
 #include <stdio.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <assert.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/uio.h>
 #include <inttypes.h>
+#include <sys/time.h>
 
 #include <osmocom/core/talloc.h>
+#include <osmocom/core/rate_ctr.h>
+#include <osmocom/core/stats.h>
 #include <osmocom/core/select.h>
 #include <osmocom/core/socket.h>
+#include <osmocom/core/timer.h>
 #include <osmo-bts/logging.h>
 #include <osmo-bts/gsm_data.h>
 #include <osmo-bts/pcu_if.h>
 #include <osmo-bts/pcuif_proto.h>
+#include <osmo-bts/pcu_shm.h>
 #include <osmo-bts/bts.h>
 #include <osmo-bts/rsl.h>
 #include <osmo-bts/signal.h>
@@ -47,7 +55,6 @@ uint32_t trx_get_hlayer1(struct gsm_bts_trx *trx);
 
 extern struct gsm_network bts_gsmnet;
 int pcu_direct = 0;
-static int avail_lai = 0, avail_nse = 0, avail_cell = 0, avail_nsvc[2] = {0, 0};
 
 static const char *sapi_string[] = {
 	[PCU_IF_SAPI_RACH] =	"RACH",
@@ -59,7 +66,99 @@ static const char *sapi_string[] = {
 	[PCU_IF_SAPI_PTCCH] = 	"PTCCH",
 };
 
-static int pcu_sock_send(struct gsm_network *net, struct msgb *msg);
+/*
+ * Each PCU has a queue of its own, so a stalled PCU does not delay the
+ * others.  The queue is everything the PCU has not read yet, on the
+ * socket and on the shared memory ring.  Once it reaches the high
+ * watermark, the PCU is congested until the queue is drained to the low
+ * watermark again.  Meanwhile, lossy messages are dropped: a TIME.ind
+ * is superseded by the next one, and the PCU could not answer a late
+ * RTS.req in time anyway.  For the same reason, lossy messages that
+ * waited on the socket longer than a radio block are dropped rather
+ * than sent.  Other messages are only refused at the hard limit, where
+ * the PCU is not keeping up at all, except for the DATA.ind: they carry
+ * the uplink blocks, which the MS does not send again, and there are
+ * no more of them than the radio interface receives.
+ */
+#define PCU_QUEUE_HARD_LIMIT(high)	(4 * (high))
+#define PCU_QUEUE_STALE_US		(4 * 4615)
+/* how often to retry moving the backlog onto a full shared memory ring */
+#define PCU_SHM_RETRY_US		1000
+
+static const struct rate_ctr_desc pcu_sock_ctr_desc[] = {
+	[PCU_SOCK_CTR_TX_MSGS] =	{ "pcu:tx:msgs", "Messages sent to the PCU" },
+	[PCU_SOCK_CTR_TX_BYTES] =	{ "pcu:tx:bytes", "Bytes sent to the PCU" },
+	[PCU_SOCK_CTR_RX_MSGS] =	{ "pcu:rx:msgs", "Messages received from the PCU" },
+	[PCU_SOCK_CTR_CONGESTED] =	{ "pcu:congested", "Queue to the PCU reached the high watermark" },
+	[PCU_SOCK_CTR_DROP_CONGESTED] =	{ "pcu:dropped:congested", "TIME.ind and RTS.req dropped while congested" },
+	[PCU_SOCK_CTR_DROP_STALE] =	{ "pcu:dropped:stale", "TIME.ind and RTS.req dropped after waiting too long" },
+	[PCU_SOCK_CTR_DROP_OVERFLOW] =	{ "pcu:dropped:overflow", "Other messages refused at the hard queue limit" },
+};
+
+static const struct rate_ctr_group_desc pcu_sock_ctrg_desc = {
+	.group_name_prefix = "bts:pcu_sock",
+	.group_description = "Connection to the PCU",
+	.class_id = OSMO_STATS_CLASS_GLOBAL,
+	.num_ctr = ARRAY_SIZE(pcu_sock_ctr_desc),
+	.ctr_desc = pcu_sock_ctr_desc,
+};
+
+/* listen socket and connection of one BTS to its PCU */
+struct pcu_sock_state {
+	struct gsm_network *net;
+	struct gsm_bts *bts;
+	struct osmo_fd listen_bfd;	/* fd for listen socket */
+	struct osmo_fd conn_bfd;	/* fd for connection to lcr */
+	struct llist_head upqueue;	/* queue for sending messages */
+	unsigned int upqueue_len;	/* messages in upqueue */
+	struct pcu_shm shm;		/* shared memory transport */
+	/* messages waiting for room on the shared memory ring */
+	struct llist_head shm_backlog;
+	unsigned int shm_backlog_len;
+	struct osmo_timer_list shm_timer;
+
+	/* info received for the INFO.ind */
+	int avail_lai, avail_nse, avail_cell, avail_nsvc[2];
+
+	/* TIME.ind and RTS.req coalesced into one TIME_RTS.ind */
+	bool time_rts;
+	struct gsm_pcu_if time_rts_prim;
+	struct gsm_pcu_if_rts_req time_rts_req[PCU_IF_TIME_RTS_MAX];
+	struct osmo_timer_list time_rts_timer;
+
+	struct pcu_sock_stats stats;
+};
+
+static int pcu_sock_send(struct pcu_sock_state *state, struct msgb *msg);
+static struct gsm_pcu_if *pcu_prim_alloc(struct pcu_sock_state *state,
+					 uint8_t msg_type, uint8_t bts_nr,
+					 struct msgb **msg);
+static int pcu_prim_send(struct pcu_sock_state *state, struct gsm_pcu_if *pcu_prim,
+			 struct msgb *msg);
+static int pcu_rx_shm_req(struct pcu_sock_state *state);
+static int pcu_shm_queue(struct pcu_sock_state *state, struct msgb *msg);
+static void pcu_shm_drain(struct pcu_sock_state *state);
+static bool pcu_msg_lossy(uint8_t msg_type);
+static unsigned long pcu_now_us(void);
+static int pcu_queue_admit(struct pcu_sock_state *state, uint8_t msg_type);
+static void pcu_queue_update(struct pcu_sock_state *state);
+static struct gsm_pcu_if_rts_req *pcu_time_rts_claim(struct pcu_sock_state *state,
+						     uint8_t bts_nr);
+static bool pcu_time_rts_time(struct pcu_sock_state *state, uint32_t fn);
+static void pcu_time_rts_enable(struct pcu_sock_state *state, bool enable);
+
+/* the PCU connection of a BTS, NULL if pcu_sock_init() was not called */
+static struct pcu_sock_state *pcu_bts_state(const struct gsm_bts *bts)
+{
+	return bts_role_bts(bts)->pcu.state;
+}
+
+/* have all infos for the INFO.ind been received? */
+static bool pcu_bts_active(const struct pcu_sock_state *state)
+{
+	return state && state->avail_lai && state->avail_nse &&
+		state->avail_cell && state->avail_nsvc[0];
+}
 
 /*
  * PCU messages
@@ -107,33 +206,30 @@ static bool ts_should_be_pdch(struct gsm_bts_trx_ts *ts) {
 	return false;
 }
 
-int pcu_tx_info_ind(void)
+int pcu_tx_info_ind(struct gsm_bts *bts)
 {
 	struct gsm_network *net = &bts_gsmnet;
+	struct pcu_sock_state *state = pcu_bts_state(bts);
 	struct msgb *msg;
 	struct gsm_pcu_if *pcu_prim;
 	struct gsm_pcu_if_info_ind *info_ind;
-	struct gsm_bts *bts;
 	struct gprs_rlc_cfg *rlcc;
 	struct gsm_bts_gprs_nsvc *nsvc;
 	struct gsm_bts_trx *trx;
 	struct gsm_bts_trx_ts *ts;
 	int i, j;
 
-	LOGP(DPCU, LOGL_INFO, "Sending info\n");
+	LOGP(DPCU, LOGL_INFO, "Sending info for BTS %u\n", bts->nr);
 
-	/* FIXME: allow multiple BTS */
-	bts = llist_entry(net->bts_list.next, struct gsm_bts, list);
 	rlcc = &bts->gprs.cell.rlc_cfg;
 
-	msg = pcu_msgb_alloc(PCU_IF_MSG_INFO_IND, bts->nr);
-	if (!msg)
+	pcu_prim = pcu_prim_alloc(state, PCU_IF_MSG_INFO_IND, bts->nr, &msg);
+	if (!pcu_prim)
 		return -ENOMEM;
-	pcu_prim = (struct gsm_pcu_if *) msg->data;
 	info_ind = &pcu_prim->u.info_ind;
 	info_ind->version = PCU_IF_VERSION;
 
-	if (avail_lai && avail_nse && avail_cell && avail_nsvc[0]) {
+	if (pcu_bts_active(state)) {
 		info_ind->flags |= PCU_IF_FLAG_ACTIVE;
 		LOGP(DPCU, LOGL_INFO, "BTS is up\n");
 	} else
@@ -141,6 +237,9 @@ int pcu_tx_info_ind(void)
 
 	if (pcu_direct)
 		info_ind->flags |= PCU_IF_FLAG_SYSMO;
+	if (pcu_shm_supported())
+		info_ind->flags |= PCU_IF_FLAG_SHM;
+	info_ind->flags |= PCU_IF_FLAG_TIME_RTS;
 
 	/* RAI */
 	info_ind->mcc = net->mcc;
@@ -232,12 +331,14 @@ int pcu_tx_info_ind(void)
 		}
 	}
 
-	return pcu_sock_send(net, msg);
+	return pcu_prim_send(state, pcu_prim, msg);
 }
 
+/* registered for each BTS, with its pcu_sock_state as hdlr_data */
 static int pcu_if_signal_cb(unsigned int subsys, unsigned int signal,
 	void *hdlr_data, void *signal_data)
 {
+	struct pcu_sock_state *state = hdlr_data;
 	struct gsm_network *net = &bts_gsmnet;
 	struct gsm_bts_gprs_nsvc *nsvc;
 	struct gsm_bts *bts;
@@ -250,6 +351,8 @@ static int pcu_if_signal_cb(unsigned int subsys, unsigned int signal,
 	switch(signal) {
 	case S_NEW_SYSINFO:
 		bts = signal_data;
+		if (bts != state->bts)
+			return 0;
 		if (!(bts->si_valid & (1 << SYSINFO_TYPE_3)))
 			break;
 		si3 = (struct gsm48_system_information_type_3 *)
@@ -264,22 +367,28 @@ static int pcu_if_signal_cb(unsigned int subsys, unsigned int signal,
 			net->mnc >>= 4;
 		bts->location_area_code = ntohs(si3->lai.lac);
 		bts->cell_identity = si3->cell_identity;
-		avail_lai = 1;
+		state->avail_lai = 1;
 		break;
 	case S_NEW_NSE_ATTR:
 		bts = signal_data;
-		avail_nse = 1;
+		if (bts != state->bts)
+			return 0;
+		state->avail_nse = 1;
 		break;
 	case S_NEW_CELL_ATTR:
 		bts = signal_data;
-		avail_cell = 1;
+		if (bts != state->bts)
+			return 0;
+		state->avail_cell = 1;
 		break;
 	case S_NEW_NSVC_ATTR:
 		nsvc = signal_data;
+		if (nsvc->bts != state->bts)
+			return 0;
 		id = nsvc->id;
 		if (id < 0 || id > 1)
 			return -EINVAL;
-		avail_nsvc[id] = 1;
+		state->avail_nsvc[id] = 1;
 		break;
 	case S_NEW_OP_STATE:
 		break;
@@ -289,8 +398,8 @@ static int pcu_if_signal_cb(unsigned int subsys, unsigned int signal,
 
 	/* If all infos have been received, of if one info is updated after
 	 * all infos have been received, transmit info update. */
-	if (avail_lai && avail_nse && avail_cell && avail_nsvc[0])
-		pcu_tx_info_ind();
+	if (pcu_bts_active(state))
+		pcu_tx_info_ind(state->bts);
 	return 0;
 }
 
@@ -298,19 +407,23 @@ static int pcu_if_signal_cb(unsigned int subsys, unsigned int signal,
 int pcu_tx_rts_req(struct gsm_bts_trx_ts *ts, uint8_t is_ptcch, uint32_t fn,
 	uint16_t arfcn, uint8_t block_nr)
 {
-	struct msgb *msg;
-	struct gsm_pcu_if *pcu_prim;
+	struct msgb *msg = NULL;
+	struct gsm_pcu_if *pcu_prim = NULL;
 	struct gsm_pcu_if_rts_req *rts_req;
 	struct gsm_bts *bts = ts->trx->bts;
+	struct pcu_sock_state *state = pcu_bts_state(bts);
 
 	LOGP(DPCU, LOGL_DEBUG, "Sending rts request: is_ptcch=%d arfcn=%d "
 		"block=%d\n", is_ptcch, arfcn, block_nr);
 
-	msg = pcu_msgb_alloc(PCU_IF_MSG_RTS_REQ, bts->nr);
-	if (!msg)
-		return -ENOMEM;
-	pcu_prim = (struct gsm_pcu_if *) msg->data;
-	rts_req = &pcu_prim->u.rts_req;
+	/* in the next TIME_RTS.ind, if the PCU supports it */
+	rts_req = pcu_time_rts_claim(state, bts->nr);
+	if (!rts_req) {
+		pcu_prim = pcu_prim_alloc(state, PCU_IF_MSG_RTS_REQ, bts->nr, &msg);
+		if (!pcu_prim)
+			return -ENOMEM;
+		rts_req = &pcu_prim->u.rts_req;
+	}
 
 	rts_req->sapi = (is_ptcch) ? PCU_IF_SAPI_PTCCH : PCU_IF_SAPI_PDTCH;
 	rts_req->fn = fn;
@@ -319,7 +432,9 @@ int pcu_tx_rts_req(struct gsm_bts_trx_ts *ts, uint8_t is_ptcch, uint32_t fn,
 	rts_req->ts_nr = ts->nr;
 	rts_req->block_nr = block_nr;
 
-	return pcu_sock_send(&bts_gsmnet, msg);
+	if (!pcu_prim)
+		return 0;
+	return pcu_prim_send(state, pcu_prim, msg);
 }
 
 int pcu_tx_data_ind(struct gsm_bts_trx_ts *ts, uint8_t sapi, uint32_t fn,
@@ -331,6 +446,7 @@ int pcu_tx_data_ind(struct gsm_bts_trx_ts *ts, uint8_t sapi, uint32_t fn,
 	struct gsm_pcu_if_data *data_ind;
 	struct gsm_bts *bts = ts->trx->bts;
 	struct gsm_bts_role_bts *btsb = bts_role_bts(bts);
+	struct pcu_sock_state *state = pcu_bts_state(bts);
 
 	LOGP(DPCU, LOGL_DEBUG, "Sending data indication: sapi=%s arfcn=%d block=%d data=%s\n",
 	     sapi_string[sapi], arfcn, block_nr, osmo_hexdump(data, len));
@@ -341,10 +457,9 @@ int pcu_tx_data_ind(struct gsm_bts_trx_ts *ts, uint8_t sapi, uint32_t fn,
 		return 0;
 	}
 
-	msg = pcu_msgb_alloc(PCU_IF_MSG_DATA_IND, bts->nr);
-	if (!msg)
+	pcu_prim = pcu_prim_alloc(state, PCU_IF_MSG_DATA_IND, bts->nr, &msg);
+	if (!pcu_prim)
 		return -ENOMEM;
-	pcu_prim = (struct gsm_pcu_if *) msg->data;
 	data_ind = &pcu_prim->u.data_ind;
 
 	data_ind->sapi = sapi;
@@ -361,7 +476,7 @@ int pcu_tx_data_ind(struct gsm_bts_trx_ts *ts, uint8_t sapi, uint32_t fn,
 	memcpy(data_ind->data, data, len);
 	data_ind->len = len;
 
-	return pcu_sock_send(&bts_gsmnet, msg);
+	return pcu_prim_send(state, pcu_prim, msg);
 }
 
 int pcu_tx_rach_ind(struct gsm_bts *bts, int16_t qta, uint16_t ra, uint32_t fn,
@@ -370,14 +485,14 @@ int pcu_tx_rach_ind(struct gsm_bts *bts, int16_t qta, uint16_t ra, uint32_t fn,
 	struct msgb *msg;
 	struct gsm_pcu_if *pcu_prim;
 	struct gsm_pcu_if_rach_ind *rach_ind;
+	struct pcu_sock_state *state = pcu_bts_state(bts);
 
 	LOGP(DPCU, LOGL_INFO, "Sending RACH indication: qta=%d, ra=%d, "
 		"fn=%d\n", qta, ra, fn);
 
-	msg = pcu_msgb_alloc(PCU_IF_MSG_RACH_IND, bts->nr);
-	if (!msg)
+	pcu_prim = pcu_prim_alloc(state, PCU_IF_MSG_RACH_IND, bts->nr, &msg);
+	if (!pcu_prim)
 		return -ENOMEM;
-	pcu_prim = (struct gsm_pcu_if *) msg->data;
 	rach_ind = &pcu_prim->u.rach_ind;
 
 	rach_ind->sapi = PCU_IF_SAPI_RACH;
@@ -387,11 +502,12 @@ int pcu_tx_rach_ind(struct gsm_bts *bts, int16_t qta, uint16_t ra, uint32_t fn,
 	rach_ind->is_11bit = is_11bit;
 	rach_ind->burst_type = burst_type;
 
-	return pcu_sock_send(&bts_gsmnet, msg);
+	return pcu_prim_send(state, pcu_prim, msg);
 }
 
-int pcu_tx_time_ind(uint32_t fn)
+int pcu_tx_time_ind(struct gsm_bts *bts, uint32_t fn)
 {
+	struct pcu_sock_state *state = pcu_bts_state(bts);
 	struct msgb *msg;
 	struct gsm_pcu_if *pcu_prim;
 	struct gsm_pcu_if_time_ind *time_ind;
@@ -401,20 +517,23 @@ int pcu_tx_time_ind(uint32_t fn)
 	if (fn13 != 0 && fn13 != 4 && fn13 != 8)
 		return 0;
 
-	msg = pcu_msgb_alloc(PCU_IF_MSG_TIME_IND, 0);
-	if (!msg)
+	if (pcu_time_rts_time(state, fn))
+		return 0;
+
+	pcu_prim = pcu_prim_alloc(state, PCU_IF_MSG_TIME_IND, bts->nr, &msg);
+	if (!pcu_prim)
 		return -ENOMEM;
-	pcu_prim = (struct gsm_pcu_if *) msg->data;
 	time_ind = &pcu_prim->u.time_ind;
 
 	time_ind->fn = fn;
 
-	return pcu_sock_send(&bts_gsmnet, msg);
+	return pcu_prim_send(state, pcu_prim, msg);
 }
 
-int pcu_tx_pag_req(const uint8_t *identity_lv, uint8_t chan_needed)
+int pcu_tx_pag_req(struct gsm_bts *bts, const uint8_t *identity_lv,
+		   uint8_t chan_needed)
 {
-	struct pcu_sock_state *state = bts_gsmnet.pcu_state;
+	struct pcu_sock_state *state = pcu_bts_state(bts);
 	struct msgb *msg;
 	struct gsm_pcu_if *pcu_prim;
 	struct gsm_pcu_if_pag_req *pag_req;
@@ -433,35 +552,30 @@ int pcu_tx_pag_req(const uint8_t *identity_lv, uint8_t chan_needed)
 		return 0;
 	}
 
-	msg = pcu_msgb_alloc(PCU_IF_MSG_PAG_REQ, 0);
-	if (!msg)
+	pcu_prim = pcu_prim_alloc(state, PCU_IF_MSG_PAG_REQ, bts->nr, &msg);
+	if (!pcu_prim)
 		return -ENOMEM;
-	pcu_prim = (struct gsm_pcu_if *) msg->data;
 	pag_req = &pcu_prim->u.pag_req;
 
 	pag_req->chan_needed = chan_needed;
 	memcpy(pag_req->identity_lv, identity_lv, identity_lv[0] + 1);
 
-	return pcu_sock_send(&bts_gsmnet, msg);
+	return pcu_prim_send(state, pcu_prim, msg);
 }
 
-int pcu_tx_pch_data_cnf(uint32_t fn, uint8_t *data, uint8_t len)
+int pcu_tx_pch_data_cnf(struct gsm_bts *bts, uint32_t fn, uint8_t *data,
+			uint8_t len)
 {
-	struct gsm_network *net = &bts_gsmnet;
-	struct gsm_bts *bts;
+	struct pcu_sock_state *state = pcu_bts_state(bts);
 	struct msgb *msg;
 	struct gsm_pcu_if *pcu_prim;
 	struct gsm_pcu_if_data *data_cnf;
 
-	/* FIXME: allow multiple BTS */
-	bts = llist_entry(net->bts_list.next, struct gsm_bts, list);
-
 	LOGP(DPCU, LOGL_INFO, "Sending PCH confirm\n");
 
-	msg = pcu_msgb_alloc(PCU_IF_MSG_DATA_CNF, bts->nr);
-	if (!msg)
+	pcu_prim = pcu_prim_alloc(state, PCU_IF_MSG_DATA_CNF, bts->nr, &msg);
+	if (!pcu_prim)
 		return -ENOMEM;
-	pcu_prim = (struct gsm_pcu_if *) msg->data;
 	data_cnf = &pcu_prim->u.data_cnf;
 
 	data_cnf->sapi = PCU_IF_SAPI_PCH;
@@ -469,7 +583,7 @@ int pcu_tx_pch_data_cnf(uint32_t fn, uint8_t *data, uint8_t len)
 	memcpy(data_cnf->data, data, len);
 	data_cnf->len = len;
 
-	return pcu_sock_send(&bts_gsmnet, msg);
+	return pcu_prim_send(state, pcu_prim, msg);
 }
 
 static int pcu_rx_data_req(struct gsm_bts *bts, uint8_t msg_type,
@@ -608,14 +722,25 @@ static int pcu_rx_act_req(struct gsm_bts *bts,
 	return 0;
 }
 
-static int pcu_rx(struct gsm_network *net, uint8_t msg_type,
+static int pcu_rx_caps_ind(struct pcu_sock_state *state,
+			   struct gsm_pcu_if_caps_ind *caps_ind)
+{
+	LOGP(DPCU, LOGL_INFO, "PCU capabilities received: flags=0x%08x\n",
+		caps_ind->flags);
+
+	pcu_time_rts_enable(state, caps_ind->flags & PCU_IF_FLAG_TIME_RTS);
+
+	return 0;
+}
+
+static int pcu_rx(struct pcu_sock_state *state, uint8_t msg_type,
 	struct gsm_pcu_if *pcu_prim)
 {
 	int rc = 0;
-	struct gsm_bts *bts;
+	struct gsm_bts *bts = state->bts;
 
-	/* FIXME: allow multiple BTS */
-	bts = llist_entry(net->bts_list.next, struct gsm_bts, list);
+	/* the BTS is given by the socket, whatever bts_nr says */
+	rate_ctr_inc(&state->stats.ctrs->ctr[PCU_SOCK_CTR_RX_MSGS]);
 
 	switch (msg_type) {
 	case PCU_IF_MSG_DATA_REQ:
@@ -628,6 +753,12 @@ static int pcu_rx(struct gsm_network *net, uint8_t msg_type,
 	case PCU_IF_MSG_TXT_IND:
 		rc = pcu_rx_txt_ind(bts, &pcu_prim->u.txt_ind);
 		break;
+	case PCU_IF_MSG_SHM_REQ:
+		rc = pcu_rx_shm_req(state);
+		break;
+	case PCU_IF_MSG_CAPS_IND:
+		rc = pcu_rx_caps_ind(state, &pcu_prim->u.caps_ind);
+		break;
 	default:
 		LOGP(DPCU, LOGL_ERROR, "Received unknwon PCU msg type %d\n",
 			msg_type);
@@ -641,18 +772,411 @@ static int pcu_rx(struct gsm_network *net, uint8_t msg_type,
  * PCU socket interface
  */
 
-struct pcu_sock_state {
-	struct gsm_network *net;
-	struct osmo_fd listen_bfd;	/* fd for listen socket */
-	struct osmo_fd conn_bfd;	/* fd for connection to lcr */
-	struct llist_head upqueue;	/* queue for sending messages */
-};
+static bool pcu_time_rts_pending(struct pcu_sock_state *state)
+{
+	struct gsm_pcu_if_time_rts_ind *tri = &state->time_rts_prim.u.time_rts_ind;
+
+	return tri->has_time || tri->num_rts;
+}
+
+/* send the collected TIME.ind and RTS.req.  The common case is a single
+ * writev() on an idle socket; otherwise the message goes to the upqueue
+ * like any other. */
+static void pcu_time_rts_flush(struct pcu_sock_state *state)
+{
+	struct gsm_pcu_if_time_rts_ind *tri = &state->time_rts_prim.u.time_rts_ind;
+	size_t hdr_len = offsetof(struct gsm_pcu_if, u) + sizeof(*tri);
+	size_t rts_len = tri->num_rts * sizeof(state->time_rts_req[0]);
+	struct iovec iov[2] = {
+		{ .iov_base = &state->time_rts_prim, .iov_len = hdr_len },
+		{ .iov_base = state->time_rts_req, .iov_len = rts_len },
+	};
+	struct osmo_fd *conn_bfd = &state->conn_bfd;
+	struct msgb *msg;
+	ssize_t rc;
+
+	osmo_timer_del(&state->time_rts_timer);
+	if (!pcu_time_rts_pending(state))
+		return;
+
+	if (conn_bfd->fd >= 0 && llist_empty(&state->upqueue)) {
+		rc = writev(conn_bfd->fd, iov, 2);
+		if (rc == (ssize_t) (hdr_len + rts_len)) {
+			rate_ctr_inc(&state->stats.ctrs->ctr[PCU_SOCK_CTR_TX_MSGS]);
+			rate_ctr_add(&state->stats.ctrs->ctr[PCU_SOCK_CTR_TX_BYTES], rc);
+			goto out;
+		}
+		if (rc >= 0) {
+			/* the PCU got a truncated message, sending it once
+			 * more would not make it whole */
+			LOGP(DPCU, LOGL_ERROR, "Short write of TIME_RTS.ind to "
+				"the PCU of BTS %u (%zd of %zu bytes)\n",
+				state->bts->nr, rc, hdr_len + rts_len);
+			goto out;
+		}
+		/* not sent at all, queue it and let pcu_sock_write() retry
+		 * or deal with the error */
+	}
+
+	msg = msgb_alloc(hdr_len + rts_len, "pcu_time_rts");
+	if (msg) {
+		memcpy(msgb_put(msg, hdr_len), iov[0].iov_base, hdr_len);
+		memcpy(msgb_put(msg, rts_len), iov[1].iov_base, rts_len);
+		pcu_sock_send(state, msg);
+	}
+
+out:
+	tri->has_time = 0;
+	tri->num_rts = 0;
+}
+
+static void pcu_time_rts_timer_cb(void *data)
+{
+	pcu_time_rts_flush(data);
+}
+
+static void pcu_time_rts_enable(struct pcu_sock_state *state, bool enable)
+{
+	pcu_time_rts_flush(state);
+	memset(&state->time_rts_prim, 0, sizeof(state->time_rts_prim));
+	state->time_rts_prim.msg_type = PCU_IF_MSG_TIME_RTS_IND;
+	state->time_rts = enable;
+}
+
+static struct pcu_sock_state *pcu_time_rts_state(struct pcu_sock_state *state)
+{
+	/* no need to save system calls on the shared memory transport */
+	if (!state || !state->time_rts || state->shm.active)
+		return NULL;
+
+	return state;
+}
+
+/* the RTS.req to be filled in, NULL if not coalescing */
+static struct gsm_pcu_if_rts_req *pcu_time_rts_claim(struct pcu_sock_state *state,
+						     uint8_t bts_nr)
+{
+	struct gsm_pcu_if_time_rts_ind *tri;
+	struct gsm_pcu_if_rts_req *rts_req;
+
+	if (!pcu_time_rts_state(state))
+		return NULL;
+	tri = &state->time_rts_prim.u.time_rts_ind;
+	if (tri->num_rts == PCU_IF_TIME_RTS_MAX)
+		pcu_time_rts_flush(state);
+
+	state->time_rts_prim.bts_nr = bts_nr;
+	rts_req = &state->time_rts_req[tri->num_rts++];
+	memset(rts_req, 0, sizeof(*rts_req));
+	osmo_timer_schedule(&state->time_rts_timer, 0, 0);
+
+	return rts_req;
+}
+
+/* store the TIME.ind, false if not coalescing */
+static bool pcu_time_rts_time(struct pcu_sock_state *state, uint32_t fn)
+{
+	struct gsm_pcu_if_time_rts_ind *tri;
+
+	if (!pcu_time_rts_state(state))
+		return false;
+	tri = &state->time_rts_prim.u.time_rts_ind;
+	if (tri->has_time)
+		pcu_time_rts_flush(state);
+
+	tri->fn = fn;
+	tri->has_time = 1;
+	osmo_timer_schedule(&state->time_rts_timer, 0, 0);
+
+	return true;
+}
+
+/* the shared memory ring takes the messages, rather than the socket */
+static bool pcu_shm_tx(const struct pcu_sock_state *state)
+{
+	return state && state->shm.active && llist_empty(&state->upqueue);
+}
+
+/* build primitives in place in the shared memory ring, once the PCU uses
+ * it and everything queued for the socket before has been sent.  If the
+ * ring is full, they wait in a backlog that goes onto the ring as the
+ * PCU makes room, so the order is kept: the socket could overtake the
+ * messages on the ring. */
+static struct gsm_pcu_if *pcu_prim_alloc(struct pcu_sock_state *state,
+					 uint8_t msg_type, uint8_t bts_nr,
+					 struct msgb **msg)
+{
+	struct gsm_pcu_if *pcu_prim;
+
+	/* keep the order of the primitives */
+	if (state && pcu_time_rts_pending(state))
+		pcu_time_rts_flush(state);
+
+	*msg = NULL;
+	if (pcu_shm_tx(state)) {
+		pcu_shm_drain(state);
+		if (llist_empty(&state->shm_backlog)) {
+			pcu_prim = pcu_shm_claim(&state->shm);
+			if (pcu_prim) {
+				memset(pcu_prim, 0, sizeof(*pcu_prim));
+				pcu_prim->msg_type = msg_type;
+				pcu_prim->bts_nr = bts_nr;
+				return pcu_prim;
+			}
+			LOGP(DPCU, LOGL_INFO, "PCU shared memory ring of BTS %u "
+				"full, queueing behind it\n", state->bts->nr);
+		}
+	}
+
+	*msg = pcu_msgb_alloc(msg_type, bts_nr);
+	if (!*msg)
+		return NULL;
+	return (struct gsm_pcu_if *) (*msg)->data;
+}
+
+static int pcu_prim_send(struct pcu_sock_state *state, struct gsm_pcu_if *pcu_prim,
+			 struct msgb *msg)
+{
+	int rc;
+
+	if (msg && pcu_shm_tx(state))
+		return pcu_shm_queue(state, msg);
+	if (msg)
+		return pcu_sock_send(state, msg);
+
+	/* a slot not committed is claimed again by the next message */
+	rc = pcu_queue_admit(state, pcu_prim->msg_type);
+	if (rc < 0)
+		return rc;
+	pcu_shm_commit(&state->shm);
+	rate_ctr_inc(&state->stats.ctrs->ctr[PCU_SOCK_CTR_TX_MSGS]);
+	rate_ctr_add(&state->stats.ctrs->ctr[PCU_SOCK_CTR_TX_BYTES],
+		     sizeof(*pcu_prim));
+	pcu_queue_update(state);
+	return 0;
+}
+
+/* queue a message behind the full shared memory ring */
+static int pcu_shm_queue(struct pcu_sock_state *state, struct msgb *msg)
+{
+	struct gsm_pcu_if *pcu_prim = (struct gsm_pcu_if *) msg->data;
+	int rc;
+
+	rc = pcu_queue_admit(state, pcu_prim->msg_type);
+	if (rc < 0) {
+		msgb_free(msg);
+		return rc;
+	}
+
+	/* to tell stale messages */
+	msg->cb[0] = pcu_now_us();
+	msgb_enqueue(&state->shm_backlog, msg);
+	state->shm_backlog_len++;
+	pcu_queue_update(state);
+	if (!osmo_timer_pending(&state->shm_timer))
+		osmo_timer_schedule(&state->shm_timer, 0, PCU_SHM_RETRY_US);
+
+	return 0;
+}
+
+/* move the backlog onto the shared memory ring, as far as there is room */
+static void pcu_shm_drain(struct pcu_sock_state *state)
+{
+	struct pcu_sock_stats *stats = &state->stats;
+	unsigned long now;
+
+	if (llist_empty(&state->shm_backlog))
+		return;
+
+	now = pcu_now_us();
+	while (!llist_empty(&state->shm_backlog)) {
+		struct msgb *msg;
+		struct gsm_pcu_if *pcu_prim, *slot;
+
+		msg = llist_entry(state->shm_backlog.next, struct msgb, list);
+		pcu_prim = (struct gsm_pcu_if *) msg->data;
+
+		if (pcu_msg_lossy(pcu_prim->msg_type) &&
+		    now - msg->cb[0] > PCU_QUEUE_STALE_US) {
+			rate_ctr_inc(&stats->ctrs->ctr[PCU_SOCK_CTR_DROP_STALE]);
+		} else {
+			slot = pcu_shm_claim(&state->shm);
+			if (!slot)
+				break;
+			memcpy(slot, pcu_prim, sizeof(*slot));
+			pcu_shm_commit(&state->shm);
+			rate_ctr_inc(&stats->ctrs->ctr[PCU_SOCK_CTR_TX_MSGS]);
+			rate_ctr_add(&stats->ctrs->ctr[PCU_SOCK_CTR_TX_BYTES],
+				     sizeof(*slot));
+		}
+
+		llist_del(&msg->list);
+		state->shm_backlog_len--;
+		msgb_free(msg);
+	}
+	pcu_queue_update(state);
+
+	if (llist_empty(&state->shm_backlog))
+		osmo_timer_del(&state->shm_timer);
+	else if (!osmo_timer_pending(&state->shm_timer))
+		osmo_timer_schedule(&state->shm_timer, 0, PCU_SHM_RETRY_US);
+}
+
+static void pcu_shm_timer_cb(void *data)
+{
+	pcu_shm_drain(data);
+}
+
+static int pcu_shm_rx_cb(void *data, struct gsm_pcu_if *pcu_prim)
+{
+	struct pcu_sock_state *state = data;
+
+	return pcu_rx(state, pcu_prim->msg_type, pcu_prim);
+}
+
+static int pcu_rx_shm_req(struct pcu_sock_state *state)
+{
+	struct gsm_pcu_if *pcu_prim;
+	struct msgb *msg;
+	int rc;
+
+	if (!pcu_shm_supported()) {
+		LOGP(DPCU, LOGL_ERROR, "PCU requests shared memory transport, "
+			"but it is not supported\n");
+		return -ENOTSUP;
+	}
+	if (state->shm.map) {
+		LOGP(DPCU, LOGL_ERROR, "PCU requests shared memory transport "
+			"twice\n");
+		return -EBUSY;
+	}
+
+	pcu_time_rts_flush(state);
+	rc = pcu_shm_open(&state->shm, pcu_shm_rx_cb, state);
+	if (rc < 0)
+		return rc;
+
+	/* sent with the file descriptors by pcu_sock_write() */
+	msg = pcu_msgb_alloc(PCU_IF_MSG_SHM_CNF, state->bts->nr);
+	if (!msg) {
+		pcu_shm_close(&state->shm);
+		return -ENOMEM;
+	}
+	pcu_prim = (struct gsm_pcu_if *) msg->data;
+	pcu_prim->u.shm_cnf.size = sizeof(struct gsm_pcu_if_shm);
+	pcu_prim->u.shm_cnf.num_slots = PCU_IF_SHM_SLOTS;
+	pcu_prim->u.shm_cnf.slot_size = sizeof(struct gsm_pcu_if);
+
+	return pcu_sock_send(state, msg);
+}
+
+/* send the SHM.cnf, passing the shared memory and the doorbells */
+static int pcu_sock_write_shm_cnf(struct pcu_sock_state *state, int fd,
+				  struct msgb *msg)
+{
+	int fds[3] = { state->shm.mem_fd, state->shm.tx_efd, state->shm.rx_bfd.fd };
+	union {
+		char buf[CMSG_SPACE(sizeof(fds))];
+		struct cmsghdr align;
+	} u;
+	struct iovec iov = {
+		.iov_base = msgb_data(msg),
+		.iov_len = msgb_length(msg),
+	};
+	struct msghdr mh = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = u.buf,
+		.msg_controllen = sizeof(u.buf),
+	};
+	struct cmsghdr *cmsg;
+
+	memset(&u, 0, sizeof(u));
+	cmsg = CMSG_FIRSTHDR(&mh);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	return sendmsg(fd, &mh, 0);
+}
+
+static bool pcu_msg_lossy(uint8_t msg_type)
+{
+	switch (msg_type) {
+	case PCU_IF_MSG_TIME_IND:
+	case PCU_IF_MSG_RTS_REQ:
+	case PCU_IF_MSG_TIME_RTS_IND:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* the clock of the timers, which tests can set */
+static unsigned long pcu_now_us(void)
+{
+	struct timeval tv;
+
+	osmo_gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000UL + tv.tv_usec;
+}
+
+/* update the queue length and the congestion state.  The PCU takes
+ * messages off the ring without telling us, so this is done whenever a
+ * message is queued, not only when one is sent. */
+static void pcu_queue_update(struct pcu_sock_state *state)
+{
+	struct gsm_bts_role_bts *btsb = bts_role_bts(state->bts);
+	struct pcu_sock_stats *stats = &state->stats;
+
+	stats->queue_len = state->upqueue_len + state->shm_backlog_len;
+	if (state->shm.active)
+		stats->queue_len += pcu_shm_tx_pending(&state->shm);
+	if (stats->queue_len > stats->queue_max)
+		stats->queue_max = stats->queue_len;
+
+	if (!stats->congested && stats->queue_len >= btsb->pcu.queue_high) {
+		LOGP(DPCU, LOGL_NOTICE, "PCU of BTS %u is congested, %u "
+			"messages queued\n", state->bts->nr, stats->queue_len);
+		stats->congested = true;
+		rate_ctr_inc(&stats->ctrs->ctr[PCU_SOCK_CTR_CONGESTED]);
+	} else if (stats->congested && stats->queue_len <= btsb->pcu.queue_low) {
+		LOGP(DPCU, LOGL_NOTICE, "PCU of BTS %u is no longer "
+			"congested\n", state->bts->nr);
+		stats->congested = false;
+	}
+}
+
+/* apply the drop policy to a message for either transport, 0 if it may
+ * be queued */
+static int pcu_queue_admit(struct pcu_sock_state *state, uint8_t msg_type)
+{
+	struct gsm_bts_role_bts *btsb = bts_role_bts(state->bts);
+	struct pcu_sock_stats *stats = &state->stats;
+
+	pcu_queue_update(state);
+	if (pcu_msg_lossy(msg_type)) {
+		if (stats->congested) {
+			rate_ctr_inc(&stats->ctrs->ctr[PCU_SOCK_CTR_DROP_CONGESTED]);
+			return -ENOBUFS;
+		}
+	} else if (msg_type != PCU_IF_MSG_DATA_IND &&
+		   stats->queue_len >= PCU_QUEUE_HARD_LIMIT(btsb->pcu.queue_high)) {
+		LOGP(DPCU, LOGL_ERROR, "PCU of BTS %u does not keep up, "
+			"refusing message type %d\n", state->bts->nr, msg_type);
+		rate_ctr_inc(&stats->ctrs->ctr[PCU_SOCK_CTR_DROP_OVERFLOW]);
+		return -ENOBUFS;
+	}
+
+	return 0;
+}
 
-static int pcu_sock_send(struct gsm_network *net, struct msgb *msg)
+static int pcu_sock_send(struct pcu_sock_state *state, struct msgb *msg)
 {
-	struct pcu_sock_state *state = net->pcu_state;
 	struct osmo_fd *conn_bfd;
 	struct gsm_pcu_if *pcu_prim = (struct gsm_pcu_if *) msg->data;
+	int rc;
 
 	if (!state) {
 		if (pcu_prim->msg_type != PCU_IF_MSG_TIME_IND)
@@ -669,7 +1193,17 @@ static int pcu_sock_send(struct gsm_network *net, struct msgb *msg)
 		msgb_free(msg);
 		return -EIO;
 	}
+	rc = pcu_queue_admit(state, pcu_prim->msg_type);
+	if (rc < 0) {
+		msgb_free(msg);
+		return rc;
+	}
+
+	/* for the write latency and to tell stale messages */
+	msg->cb[0] = pcu_now_us();
 	msgb_enqueue(&state->upqueue, msg);
+	state->upqueue_len++;
+	pcu_queue_update(state);
 	conn_bfd->when |= BSC_FD_WRITE;
 
 	return 0;
@@ -678,15 +1212,13 @@ static int pcu_sock_send(struct gsm_network *net, struct msgb *msg)
 static void pcu_sock_close(struct pcu_sock_state *state)
 {
 	struct osmo_fd *bfd = &state->conn_bfd;
-	struct gsm_bts *bts;
+	struct gsm_bts *bts = state->bts;
 	struct gsm_bts_trx *trx;
 	struct gsm_bts_trx_ts *ts;
 	int i, j;
 
-	/* FIXME: allow multiple BTS */
-	bts = llist_entry(state->net->bts_list.next, struct gsm_bts, list);
-
-	LOGP(DPCU, LOGL_NOTICE, "PCU socket has LOST connection\n");
+	LOGP(DPCU, LOGL_NOTICE, "PCU socket of BTS %u has LOST connection\n",
+		bts->nr);
 	osmo_signal_dispatch(SS_FAIL, OSMO_EVT_PCU_VERS, NULL);
 	bts->pcu_version[0] = '\0';
 
@@ -724,6 +1256,24 @@ static void pcu_sock_close(struct pcu_sock_state *state)
 		struct msgb *msg = msgb_dequeue(&state->upqueue);
 		msgb_free(msg);
 	}
+	state->upqueue_len = 0;
+	osmo_timer_del(&state->shm_timer);
+	while (!llist_empty(&state->shm_backlog)) {
+		struct msgb *msg = msgb_dequeue(&state->shm_backlog);
+		msgb_free(msg);
+	}
+	state->shm_backlog_len = 0;
+	state->stats.queue_len = 0;
+	state->stats.congested = false;
+
+	if (state->shm.map)
+		pcu_shm_close(&state->shm);
+
+	/* a new PCU has to announce its capabilities again */
+	osmo_timer_del(&state->time_rts_timer);
+	state->time_rts_prim.u.time_rts_ind.has_time = 0;
+	state->time_rts_prim.u.time_rts_ind.num_rts = 0;
+	state->time_rts = false;
 }
 
 static int pcu_sock_read(struct osmo_fd *bfd)
@@ -749,7 +1299,7 @@ static int pcu_sock_read(struct osmo_fd *bfd)
 		goto close;
 	}
 
-	rc = pcu_rx(state->net, pcu_prim->msg_type, pcu_prim);
+	rc = pcu_rx(state, pcu_prim->msg_type, pcu_prim);
 
 	/* as we always synchronously process the message in pcu_rx() and
 	 * its callbacks, we can free the message here. */
@@ -766,11 +1316,14 @@ close:
 static int pcu_sock_write(struct osmo_fd *bfd)
 {
 	struct pcu_sock_state *state = bfd->data;
+	struct pcu_sock_stats *stats = &state->stats;
+	unsigned long now = pcu_now_us();
 	int rc;
 
 	while (!llist_empty(&state->upqueue)) {
 		struct msgb *msg, *msg2;
 		struct gsm_pcu_if *pcu_prim;
+		unsigned long lat;
 
 		/* peek at the beginning of the queue */
 		msg = llist_entry(state->upqueue.next, struct msgb, list);
@@ -785,8 +1338,17 @@ static int pcu_sock_write(struct osmo_fd *bfd)
 			goto dontsend;
 		}
 
+		lat = now - msg->cb[0];
+		if (pcu_msg_lossy(pcu_prim->msg_type) && lat > PCU_QUEUE_STALE_US) {
+			rate_ctr_inc(&stats->ctrs->ctr[PCU_SOCK_CTR_DROP_STALE]);
+			goto dontsend;
+		}
+
 		/* try to send it over the socket */
-		rc = write(bfd->fd, msgb_data(msg), msgb_length(msg));
+		if (pcu_prim->msg_type == PCU_IF_MSG_SHM_CNF)
+			rc = pcu_sock_write_shm_cnf(state, bfd->fd, msg);
+		else
+			rc = write(bfd->fd, msgb_data(msg), msgb_length(msg));
 		if (rc == 0)
 			goto close;
 		if (rc < 0) {
@@ -796,11 +1358,24 @@ static int pcu_sock_write(struct osmo_fd *bfd)
 			}
 			goto close;
 		}
+		rate_ctr_inc(&stats->ctrs->ctr[PCU_SOCK_CTR_TX_MSGS]);
+		rate_ctr_add(&stats->ctrs->ctr[PCU_SOCK_CTR_TX_BYTES], rc);
+		if (lat > stats->lat_max_us)
+			stats->lat_max_us = lat;
+		stats->lat_sum_us += lat;
+		stats->lat_num++;
 
 dontsend:
 		/* _after_ we send it, we can deueue */
 		msg2 = msgb_dequeue(&state->upqueue);
 		assert(msg == msg2);
+		state->upqueue_len--;
+		pcu_queue_update(state);
+		if (pcu_prim->msg_type == PCU_IF_MSG_SHM_CNF && state->shm.map) {
+			LOGP(DPCU, LOGL_NOTICE, "PCU uses shared memory "
+				"transport\n");
+			state->shm.active = true;
+		}
 		msgb_free(msg);
 	}
 	return 0;
@@ -851,6 +1426,9 @@ static int pcu_sock_accept(struct osmo_fd *bfd, unsigned int flags)
 		return 0;
 	}
 
+	/* a stalled PCU must not block the BTS, its messages are queued */
+	fcntl(rc, F_SETFL, fcntl(rc, F_GETFL) | O_NONBLOCK);
+
 	conn_bfd->fd = rc;
 	conn_bfd->when = BSC_FD_READ;
 	conn_bfd->cb = pcu_sock_cb;
@@ -864,27 +1442,48 @@ static int pcu_sock_accept(struct osmo_fd *bfd, unsigned int flags)
 		return -1;
 	}
 
-	LOGP(DPCU, LOGL_NOTICE, "PCU socket connected to external PCU\n");
+	LOGP(DPCU, LOGL_NOTICE, "PCU socket of BTS %u connected to external "
+		"PCU\n", state->bts->nr);
 
 	/* send current info */
-	pcu_tx_info_ind();
+	pcu_tx_info_ind(state->bts);
 
 	return 0;
 }
 
-int pcu_sock_init(const char *path)
+/*! \brief open the socket for the PCU of a BTS
+ *  \param[in] bts BTS served by the PCU
+ *  \param[in] path of the unix domain socket, unique per BTS
+ *  \returns 0 on success; negative on error */
+int pcu_sock_init(struct gsm_bts *bts, const char *path)
 {
+	struct gsm_bts_role_bts *btsb = bts_role_bts(bts);
 	struct pcu_sock_state *state;
 	struct osmo_fd *bfd;
 	int rc;
 
-	state = talloc_zero(NULL, struct pcu_sock_state);
+	if (btsb->pcu.state)
+		return -EEXIST;
+
+	state = talloc_zero(bts, struct pcu_sock_state);
 	if (!state)
 		return -ENOMEM;
 
 	INIT_LLIST_HEAD(&state->upqueue);
+	INIT_LLIST_HEAD(&state->shm_backlog);
 	state->net = &bts_gsmnet;
+	state->bts = bts;
+	state->stats.ctrs = rate_ctr_group_alloc(state, &pcu_sock_ctrg_desc,
+						 bts->nr);
+	if (!state->stats.ctrs) {
+		talloc_free(state);
+		return -ENOMEM;
+	}
 	state->conn_bfd.fd = -1;
+	state->time_rts_timer.cb = pcu_time_rts_timer_cb;
+	state->time_rts_timer.data = state;
+	state->shm_timer.cb = pcu_shm_timer_cb;
+	state->shm_timer.data = state;
 
 	bfd = &state->listen_bfd;
 
@@ -893,6 +1492,7 @@ int pcu_sock_init(const char *path)
 	if (bfd->fd < 0) {
 		LOGP(DPCU, LOGL_ERROR, "Could not create %s unix socket: %s\n",
 		     path, strerror(errno));
+		rate_ctr_group_free(state->stats.ctrs);
 		talloc_free(state);
 		return -1;
 	}
@@ -906,39 +1506,41 @@ int pcu_sock_init(const char *path)
 		LOGP(DPCU, LOGL_ERROR, "Could not register listen fd: %d\n",
 			rc);
 		close(bfd->fd);
+		rate_ctr_group_free(state->stats.ctrs);
 		talloc_free(state);
 		return rc;
 	}
 
-	osmo_signal_register_handler(SS_GLOBAL, pcu_if_signal_cb, NULL);
+	osmo_signal_register_handler(SS_GLOBAL, pcu_if_signal_cb, state);
 
-	bts_gsmnet.pcu_state = state;
+	btsb->pcu.state = state;
 
 	return 0;
 }
 
-void pcu_sock_exit(void)
+void pcu_sock_exit(struct gsm_bts *bts)
 {
-	struct pcu_sock_state *state = bts_gsmnet.pcu_state;
+	struct gsm_bts_role_bts *btsb = bts_role_bts(bts);
+	struct pcu_sock_state *state = btsb->pcu.state;
 	struct osmo_fd *bfd, *conn_bfd;
 
 	if (!state)
 		return;
 
-	osmo_signal_unregister_handler(SS_GLOBAL, pcu_if_signal_cb, NULL);
+	osmo_signal_unregister_handler(SS_GLOBAL, pcu_if_signal_cb, state);
 	conn_bfd = &state->conn_bfd;
 	if (conn_bfd->fd > 0)
 		pcu_sock_close(state);
 	bfd = &state->listen_bfd;
 	close(bfd->fd);
 	osmo_fd_unregister(bfd);
+	rate_ctr_group_free(state->stats.ctrs);
 	talloc_free(state);
-	bts_gsmnet.pcu_state = NULL;
+	btsb->pcu.state = NULL;
 }
 
-bool pcu_connected(void) {
-	struct gsm_network *net = &bts_gsmnet;
-	struct pcu_sock_state *state = net->pcu_state;
+bool pcu_connected(const struct gsm_bts *bts) {
+	struct pcu_sock_state *state = pcu_bts_state(bts);
 
 	if (!state)
 		return false;
@@ -946,3 +1548,14 @@ bool pcu_connected(void) {
 		return false;
 	return true;
 }
+
+/*! \brief statistics of the PCU connection of a BTS
+ *  \returns NULL if there is no PCU socket for the BTS */
+const struct pcu_sock_stats *pcu_sock_get_stats(const struct gsm_bts *bts)
+{
+	struct pcu_sock_state *state = pcu_bts_state(bts);
+
+	if (!state)
+		return NULL;
+	return &state->stats;
+}
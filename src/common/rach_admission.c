@@ -0,0 +1,248 @@
+/* Admission control of RACH requests by establishment cause */
+
+/* All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * During RACH floods, every RR access burst would otherwise end up as a
+ * CHANNEL REQUIRED at the BSC.  Each establishment cause can be limited by
+ * a token bucket here; RACH exceeding it are answered locally with an
+ * IMMEDIATE ASSIGNMENT REJECT on the AGCH.  The limits only apply while
+ * the RACH load computed for the CCCH LOAD INDICATION is at or above a
+ * configurable threshold.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/rate_ctr.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/gsm/gsm_utils.h>
+#include <osmocom/gsm/protocol/gsm_04_08.h>
+
+#include <osmo-bts/bts.h>
+#include <osmo-bts/gsm_data.h>
+#include <osmo-bts/logging.h>
+#include <osmo-bts/rach_admission.h>
+
+const struct value_string rach_adm_cause_names[] = {
+	{ RACH_CAUSE_EMERG,	"emergency" },
+	{ RACH_CAUSE_CALL,	"call" },
+	{ RACH_CAUSE_PAGING,	"paging" },
+	{ RACH_CAUSE_LU,	"lu" },
+	{ RACH_CAUSE_DATA,	"data" },
+	{ 0, NULL }
+};
+
+static const struct rate_ctr_desc rach_adm_ctr_desc[] = {
+	[RACH_ADM_CTR_ADMITTED] =	{ "rach:admitted", "RR access requests passed on to the BSC" },
+	[RACH_ADM_CTR_REJ_EMERG] =	{ "rach:rejected:emergency", "Emergency calls rejected locally" },
+	[RACH_ADM_CTR_REJ_CALL] =	{ "rach:rejected:call", "Originating calls rejected locally" },
+	[RACH_ADM_CTR_REJ_PAGING] =	{ "rach:rejected:paging", "Paging responses rejected locally" },
+	[RACH_ADM_CTR_REJ_LU] =		{ "rach:rejected:lu", "Location updates rejected locally" },
+	[RACH_ADM_CTR_REJ_DATA] =	{ "rach:rejected:data", "Data calls and other procedures rejected locally" },
+	[RACH_ADM_CTR_IMM_ASS_REJ_FAIL] = { "rach:imm_ass_rej:failed", "IMM.ASS.REJ not queued to the AGCH" },
+};
+
+static const struct rate_ctr_group_desc rach_adm_ctrg_desc = {
+	.group_name_prefix = "bts:rach_admission",
+	.group_description = "RACH admission control",
+	.class_id = OSMO_STATS_CLASS_GLOBAL,
+	.num_ctr = ARRAY_SIZE(rach_adm_ctr_desc),
+	.ctr_desc = rach_adm_ctr_desc,
+};
+
+int rach_adm_init(struct gsm_bts *bts)
+{
+	struct gsm_bts_role_bts *btsb = bts_role_bts(bts);
+	struct rach_adm *adm = &btsb->rach_adm;
+
+	memset(adm, 0, sizeof(*adm));
+	adm->wait_ind = RACH_ADM_WAIT_IND_DEFAULT;
+
+	adm->ctrs = rate_ctr_group_alloc(btsb, &rach_adm_ctrg_desc, bts->nr);
+	if (!adm->ctrs)
+		return -ENOMEM;
+
+	return 0;
+}
+
+/*! \brief determine the establishment cause of an RR access request
+ *  \param[in] ra 8 bit random access reference
+ *  \param[in] neci value of the NECI bit broadcast in SI3
+ *  \returns establishment cause (3GPP TS 44.018, Table 9.1.8.1) */
+enum rach_adm_cause rach_adm_get_cause(uint8_t ra, bool neci)
+{
+	if ((ra & 0xe0) == 0xa0)
+		return RACH_CAUSE_EMERG;
+	if ((ra & 0xe0) == 0x80 || (ra & 0xe0) == 0x20)
+		return RACH_CAUSE_PAGING;
+	if ((ra & 0xe0) == 0xc0 || (ra & 0xe0) == 0xe0)
+		return RACH_CAUSE_CALL;
+
+	if (neci) {
+		if ((ra & 0xf8) == 0x68)	/* re-establishment, TCH/H */
+			return RACH_CAUSE_CALL;
+		if ((ra & 0xf0) == 0x40)
+			return RACH_CAUSE_CALL;
+		if ((ra & 0xf0) == 0x50)
+			return RACH_CAUSE_DATA;
+		if ((ra & 0xf0) == 0x10)
+			return RACH_CAUSE_DATA;
+		if ((ra & 0xf0) == 0x00)
+			return RACH_CAUSE_LU;
+	} else {
+		/* answer to paging, SDCCH needed */
+		if ((ra & 0xf0) == 0x10)
+			return RACH_CAUSE_PAGING;
+		if ((ra & 0xe0) == 0x00)
+			return RACH_CAUSE_LU;
+	}
+
+	return RACH_CAUSE_DATA;
+}
+
+/*! \brief configure the token bucket of establishment cause \a cause
+ *  \param[in] rate admitted RACH per second, 0 for no limit
+ *  \param[in] burst number of RACH admitted back to back */
+void rach_adm_set_bucket(struct gsm_bts *bts, enum rach_adm_cause cause,
+			 unsigned int rate, unsigned int burst)
+{
+	struct rach_adm_bucket *b = &bts_role_bts(bts)->rach_adm.bucket[cause];
+
+	b->rate = rate;
+	b->burst = burst;
+	b->tokens = burst * 1000;
+}
+
+/* add the tokens of the frames elapsed since the last RACH */
+static void rach_adm_refill(struct rach_adm *adm, uint32_t fn)
+{
+	uint32_t elapsed_fn;
+	unsigned int i;
+
+	if (!adm->running) {
+		adm->last_fn = fn;
+		adm->running = true;
+		return;
+	}
+
+	elapsed_fn = (fn + GSM_HYPERFRAME - adm->last_fn) % GSM_HYPERFRAME;
+	adm->last_fn = fn;
+	/* RACH of an earlier frame reported late, or the frame clock jumped:
+	 * restart counting from here, without a refill */
+	if (elapsed_fn > GSM_HYPERFRAME / 2)
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(adm->bucket); i++) {
+		struct rach_adm_bucket *b = &adm->bucket[i];
+		/* rate per second * frames * 120/26 ms */
+		uint64_t tokens = (uint64_t) b->rate * elapsed_fn * 120 / 26;
+
+		if (!b->rate)
+			continue;
+		tokens += b->tokens;
+		if (tokens > b->burst * 1000)
+			tokens = b->burst * 1000;
+		b->tokens = tokens;
+	}
+}
+
+static int rach_adm_tx_imm_ass_rej(struct gsm_bts *bts, uint8_t ra, uint32_t fn,
+				   uint8_t wait_ind)
+{
+	struct gsm48_imm_ass_rej *rej;
+	struct gsm48_req_ref ref;
+	struct gsm_time gt;
+	struct msgb *msg;
+	int rc;
+
+	msg = msgb_alloc(GSM_MACBLOCK_LEN, "IMM.ASS.REJ");
+	if (!msg)
+		return -ENOMEM;
+	msg->l3h = msgb_put(msg, GSM_MACBLOCK_LEN);
+	memset(msg->l3h, 0x2b, GSM_MACBLOCK_LEN);
+
+	gsm_fn2gsmtime(&gt, fn);
+	memset(&ref, 0, sizeof(ref));
+	ref.ra = ra;
+	ref.t1 = gt.t1;
+	ref.t2 = gt.t2;
+	ref.t3_high = gt.t3 >> 3;
+	ref.t3_low = gt.t3 & 7;
+
+	/* all four references are the same, so it can be merged with others */
+	rej = (struct gsm48_imm_ass_rej *) msg->l3h;
+	rej->l2_plen = (offsetof(struct gsm48_imm_ass_rej, rest) - 1) << 2 | 0x01;
+	rej->proto_discr = GSM48_PDISC_RR;
+	rej->msg_type = GSM48_MT_RR_IMM_ASS_REJ;
+	rej->page_mode = GSM48_PM_SAME;
+	rej->req_ref1 = rej->req_ref2 = rej->req_ref3 = rej->req_ref4 = ref;
+	rej->wait_ind1 = rej->wait_ind2 = rej->wait_ind3 = rej->wait_ind4 = wait_ind;
+
+	rc = bts_agch_enqueue(bts, msg);
+	if (rc < 0)
+		msgb_free(msg);
+
+	return rc;
+}
+
+/*! \brief decide whether an RR access request is passed on to the BSC
+ *  \param[in] ra 8 bit random access reference
+ *  \param[in] fn frame number the RACH was received in
+ *  \returns 0 if admitted; -EBUSY if rejected (IMM.ASS.REJ queued) */
+int rach_adm_check(struct gsm_bts *bts, uint8_t ra, uint32_t fn)
+{
+	struct gsm_bts_role_bts *btsb = bts_role_bts(bts);
+	struct rach_adm *adm = &btsb->rach_adm;
+	struct gsm48_system_information_type_3 *si3;
+	struct rach_adm_bucket *b;
+	enum rach_adm_cause cause;
+	bool neci = false;
+
+	if (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_3)) {
+		si3 = GSM_BTS_SI(bts, SYSINFO_TYPE_3);
+		neci = si3->cell_sel_par.neci;
+	}
+	cause = rach_adm_get_cause(ra, neci);
+
+	rach_adm_refill(adm, fn);
+
+	b = &adm->bucket[cause];
+	if (!b->rate || btsb->load.rach.percent < adm->load_thresh)
+		goto admit;
+
+	if (b->tokens >= 1000) {
+		b->tokens -= 1000;
+		goto admit;
+	}
+
+	LOGP(DL1P, LOGL_INFO, "RACH for RR access rejected (ra=0x%02x, cause %s)\n",
+		ra, get_value_string(rach_adm_cause_names, cause));
+	rate_ctr_inc(&adm->ctrs->ctr[RACH_ADM_CTR_REJ_EMERG + cause]);
+	if (rach_adm_tx_imm_ass_rej(bts, ra, fn, adm->wait_ind) < 0)
+		rate_ctr_inc(&adm->ctrs->ctr[RACH_ADM_CTR_IMM_ASS_REJ_FAIL]);
+
+	return -EBUSY;
+
+admit:
+	rate_ctr_inc(&adm->ctrs->ctr[RACH_ADM_CTR_ADMITTED]);
+	return 0;
+}
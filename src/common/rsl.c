@@ -57,6 +57,7 @@
 //#define FAKE_CIPH_MODE_COMPL
 
 static int rsl_tx_error_report(struct gsm_bts_trx *trx, uint8_t cause);
+static void rsl_log_playout_stats(struct gsm_lchan *lchan, const char *pfx);
 
 /* list of RSL SI types that can occur on the SACCH */
 static const unsigned int rsl_sacch_sitypes[] = {
@@ -434,7 +435,7 @@ static int rsl_rx_paging_cmd(struct gsm_bts_trx *trx, struct msgb *msg)
 				     "BTS paging table is full");
 	}
 
-	pcu_tx_pag_req(identity_lv, chan_needed);
+	pcu_tx_pag_req(trx->bts, identity_lv, chan_needed);
 
 	return 0;
 }
@@ -1005,9 +1006,9 @@ static int rsl_rx_chan_activ(struct msgb *msg)
 		 * the PCU is not connected yet, ignore for now; the PCU will
 		 * catch up (and send the RSL ack) once it connects.
 		 */
-		if (pcu_connected()) {
+		if (pcu_connected(ts->trx->bts)) {
 			DEBUGP(DRSL, "%s Activate via PCU\n", gsm_ts_and_pchan_name(ts));
-			rc = pcu_tx_info_ind();
+			rc = pcu_tx_info_ind(ts->trx->bts);
 		}
 		else {
 			DEBUGP(DRSL, "%s Activate via PCU when PCU connects\n",
@@ -1047,14 +1048,14 @@ static int dyn_ts_pdch_release(struct gsm_lchan *lchan)
 	 */
 	ts->dyn.pchan_want = GSM_PCHAN_NONE;
 
-	if (!pcu_connected()) {
+	if (!pcu_connected(ts->trx->bts)) {
 		/* PCU not connected yet. Just record the new type and done,
 		 * the PCU will pick it up once connected. */
 		ts->dyn.pchan_is = GSM_PCHAN_NONE;
 		return 1;
 	}
 
-	return pcu_tx_info_ind();
+	return pcu_tx_info_ind(ts->trx->bts);
 }
 
 /* 8.4.14 RF CHANnel RELease is received */
@@ -1066,9 +1067,10 @@ static int rsl_rx_rf_chan_rel(struct gsm_lchan *lchan, uint8_t chan_nr)
 		rsl_tx_ipac_dlcx_ind(lchan, RSL_ERR_NORMAL_UNSPEC);
 		osmo_rtp_socket_log_stats(lchan->abis_ip.rtp_socket, DRTP, LOGL_INFO,
 			"Closing RTP socket on Channel Release ");
+		rsl_log_playout_stats(lchan, "Channel Release ");
 		osmo_rtp_socket_free(lchan->abis_ip.rtp_socket);
 		lchan->abis_ip.rtp_socket = NULL;
-		msgb_queue_flush(&lchan->dl_tch_queue);
+		l1sap_dl_tch_flush(lchan);
 	}
 
 	/* release handover state */
@@ -1415,6 +1417,16 @@ static void rsl_add_rtp_stats(struct gsm_lchan *lchan, struct msgb *msg)
 				&stats.packets_sent, &stats.octets_sent,
 				&stats.packets_recv, &stats.octets_recv,
 				&stats.packets_lost, &stats.arrival_jitter);
+	/* with our own playout buffer, the RTP library doesn't see the
+	 * arrival times, so report the jitter we measured */
+	if (!(lchan->abis_ip.rtp_socket->flags & OSMO_RTP_F_POLL)) {
+		stats.arrival_jitter = lchan->dl_tch_ring.stats.jitter >> 4;
+		/* received, but dropped to catch up with the sender */
+		stats.packets_lost += lchan->dl_tch_ring.stats.skipped;
+	}
+	/* frames sent by the egress stage bypass the RTP library */
+	stats.packets_sent += lchan->abis_ip.egress.packets_sent;
+	stats.octets_sent += lchan->abis_ip.egress.octets_sent;
 	/* convert to network byte order */
 	stats.packets_sent = htonl(stats.packets_sent);
 	stats.octets_sent = htonl(stats.octets_sent);
@@ -1425,6 +1437,24 @@ static void rsl_add_rtp_stats(struct gsm_lchan *lchan, struct msgb *msg)
 	msgb_tlv_put(msg, RSL_IE_IPAC_CONN_STAT, sizeof(stats), (uint8_t *) &stats);
 }
 
+/* log the statistics of the downlink playout buffer of the call */
+static void rsl_log_playout_stats(struct gsm_lchan *lchan, const char *pfx)
+{
+	const struct dl_tch_ring_stats *st = &lchan->dl_tch_ring.stats;
+
+	LOGP(DRTP, LOGL_INFO, "%s%s DL playout: rx %u, played %u, concealed %u, "
+	     "late %u, dup %u, skipped %u, underrun %u, resync %u, jitter %u ms, "
+	     "delay/20ms %u/%u/%u/%u/%u/%u/%u/%u, late/frames %u/%u/%u/%u\n",
+	     pfx, gsm_lchan_name(lchan), st->received, st->played, st->concealed,
+	     st->late, st->duplicate, st->skipped, st->underrun, st->resync,
+	     dl_tch_ring_jitter_ms(&lchan->dl_tch_ring),
+	     st->delay_hist[0], st->delay_hist[1], st->delay_hist[2],
+	     st->delay_hist[3], st->delay_hist[4], st->delay_hist[5],
+	     st->delay_hist[6], st->delay_hist[7],
+	     st->late_hist[0], st->late_hist[1], st->late_hist[2],
+	     st->late_hist[3]);
+}
+
 int rsl_tx_ipac_dlcx_ind(struct gsm_lchan *lchan, uint8_t cause)
 {
 	struct msgb *nmsg;
@@ -1683,8 +1713,10 @@ static int rsl_rx_ipac_XXcx(struct msgb *msg)
 		/* FIXME: select default value depending on speech_mode */
 		//if (!payload_type)
 		lchan->tch.last_fn = LCHAN_FN_DUMMY;
+		/* with our own playout buffer, frames are received as soon
+		 * as they arrive instead of being polled for each TCH-RTS */
 		lchan->abis_ip.rtp_socket = osmo_rtp_socket_create(lchan->ts->trx,
-								OSMO_RTP_F_POLL);
+						btsb->rtp_jitter_bts ? 0 : OSMO_RTP_F_POLL);
 		if (!lchan->abis_ip.rtp_socket) {
 			LOGP(DRTP, LOGL_ERROR,
 			     "%s IPAC Failed to create RTP/RTCP sockets\n",
@@ -1695,11 +1727,23 @@ static int rsl_rx_ipac_XXcx(struct msgb *msg)
 			return tx_ipac_XXcx_nack(lchan, RSL_ERR_RES_UNAVAIL,
 						 inc_ip_port, dch->c.msg_type);
 		}
-		rc = osmo_rtp_socket_set_param(lchan->abis_ip.rtp_socket,
-					       btsb->rtp_jitter_adaptive ?
-					       OSMO_RTP_P_JIT_ADAP :
-					       OSMO_RTP_P_JITBUF,
-					       btsb->rtp_jitter_buf_ms);
+		if (btsb->rtp_jitter_bts) {
+			/* no jitter buffer in the RTP library */
+			rc = osmo_rtp_socket_set_param(lchan->abis_ip.rtp_socket,
+						       OSMO_RTP_P_JITBUF, 0);
+			dl_tch_ring_init(&lchan->dl_tch_ring,
+					 btsb->rtp_jitter_buf_ms / 20,
+					 btsb->rtp_jitter_adaptive);
+		} else {
+			rc = osmo_rtp_socket_set_param(lchan->abis_ip.rtp_socket,
+						       btsb->rtp_jitter_adaptive ?
+						       OSMO_RTP_P_JIT_ADAP :
+						       OSMO_RTP_P_JITBUF,
+						       btsb->rtp_jitter_buf_ms);
+			/* frames are polled when due, don't buffer more */
+			dl_tch_ring_init(&lchan->dl_tch_ring, 1, false);
+		}
+		rtp_egress_lchan_init(lchan, btsb->rtp_egress_batch);
 		if (rc < 0)
 			LOGP(DRTP, LOGL_ERROR,
 			     "%s IPAC Failed to set RTP socket parameters: %s\n",
@@ -1736,7 +1780,7 @@ static int rsl_rx_ipac_XXcx(struct msgb *msg)
 				     gsm_lchan_name(lchan));
 			osmo_rtp_socket_free(lchan->abis_ip.rtp_socket);
 			lchan->abis_ip.rtp_socket = NULL;
-			msgb_queue_flush(&lchan->dl_tch_queue);
+			l1sap_dl_tch_flush(lchan);
 			return tx_ipac_XXcx_nack(lchan, RSL_ERR_RES_UNAVAIL,
 						 inc_ip_port, dch->c.msg_type);
 		}
@@ -1756,6 +1800,8 @@ static int rsl_rx_ipac_XXcx(struct msgb *msg)
 			return tx_ipac_XXcx_nack(lchan, RSL_ERR_RES_UNAVAIL,
 						 inc_ip_port, dch->c.msg_type);
 		}
+		/* the frames of the old remote end are not continued */
+		dl_tch_ring_resync(&lchan->dl_tch_ring);
 	}
 
 
@@ -1776,7 +1822,7 @@ static int rsl_rx_ipac_XXcx(struct msgb *msg)
 		     gsm_lchan_name(lchan));
 		osmo_rtp_socket_free(lchan->abis_ip.rtp_socket);
 		lchan->abis_ip.rtp_socket = NULL;
-		msgb_queue_flush(&lchan->dl_tch_queue);
+		l1sap_dl_tch_flush(lchan);
 		return tx_ipac_XXcx_nack(lchan, RSL_ERR_RES_UNAVAIL,
 					 inc_ip_port, dch->c.msg_type);
 	}
@@ -1796,12 +1842,14 @@ static int rsl_rx_ipac_XXcx(struct msgb *msg)
 	/* Everything has succeeded, we can store new values in lchan */
 	if (payload_type) {
 		lchan->abis_ip.rtp_payload = *payload_type;
+		lchan->abis_ip.egress.payload_type = *payload_type;
 		if (lchan->abis_ip.rtp_socket)
 			osmo_rtp_socket_set_pt(lchan->abis_ip.rtp_socket,
 						*payload_type);
 	}
 	if (payload_type2) {
 		lchan->abis_ip.rtp_payload2 = *payload_type2;
+		lchan->abis_ip.egress.payload_type = *payload_type2;
 		if (lchan->abis_ip.rtp_socket)
 			osmo_rtp_socket_set_pt(lchan->abis_ip.rtp_socket,
 						*payload_type2);
@@ -1831,9 +1879,10 @@ static int rsl_rx_ipac_dlcx(struct msgb *msg)
 	rc = rsl_tx_ipac_dlcx_ack(lchan, inc_conn_id);
 	osmo_rtp_socket_log_stats(lchan->abis_ip.rtp_socket, DRTP, LOGL_INFO,
 		"Closing RTP socket on DLCX ");
+	rsl_log_playout_stats(lchan, "DLCX ");
 	osmo_rtp_socket_free(lchan->abis_ip.rtp_socket);
 	lchan->abis_ip.rtp_socket = NULL;
-	msgb_queue_flush(&lchan->dl_tch_queue);
+	l1sap_dl_tch_flush(lchan);
 	return rc;
 }
 
@@ -1980,8 +2029,8 @@ static void rsl_rx_dyn_pdch(struct msgb *msg, bool pdch_act)
 		 * disconnect immediately from here. The PCU will catch up when
 		 * it connects. */
 		/* TODO: timeout on channel connect / disconnect request from PCU? */
-		if (pcu_connected())
-			rc = pcu_tx_info_ind();
+		if (pcu_connected(ts->trx->bts))
+			rc = pcu_tx_info_ind(ts->trx->bts);
 		else
 			rc = bts_model_ts_disconnect(ts);
 	}
@@ -2095,7 +2144,7 @@ static void ipacc_dyn_pdch_ts_connected(struct gsm_bts_trx_ts *ts)
 		/* The PDTCH is connected, now tell the PCU about it. Except
 		 * when the PCU is not connected (yet), then there's nothing
 		 * left to do now. The PCU will catch up when it connects. */
-		if (!pcu_connected()) {
+		if (!pcu_connected(ts->trx->bts)) {
 			ipacc_dyn_pdch_complete(ts, 0);
 			return;
 		}
@@ -2103,7 +2152,7 @@ static void ipacc_dyn_pdch_ts_connected(struct gsm_bts_trx_ts *ts)
 		/* The PCU will request to activate the PDTCH SAPIs, which,
 		 * when done, will call back to ipacc_dyn_pdch_complete(). */
 		/* TODO: timeout on channel connect / disconnect request from PCU? */
-		rc = pcu_tx_info_ind();
+		rc = pcu_tx_info_ind(ts->trx->bts);
 
 		/* Error? then NACK right now. */
 		if (rc)
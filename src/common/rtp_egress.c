@@ -0,0 +1,349 @@
+/* Batched transmission of uplink RTP frames */
+
+/* All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Every lchan has an RTP socket of its own, bound to the port announced
+ * to the BSC, and the RTP library sends one datagram per frame on it.
+ * sendmmsg() can only batch datagrams of one socket, so the egress stage
+ * builds the UDP and RTP headers itself and sends the frames of all
+ * lchans on a single raw socket, with the source port of the lchan's
+ * RTP socket.  Frames are collected while the main loop processes the
+ * indications of the PHY, and flushed by a zero timeout timer, i.e. at
+ * the start of the next main loop iteration.
+ *
+ * The RTP library still owns the stream: SSRC, sequence number and
+ * timestamp are taken from its session when the connection is set up and
+ * written back with each frame, so that its RTCP reports and any frame it
+ * sends itself continue the stream sent here.
+ *
+ * The raw socket needs CAP_NET_RAW.  Without it, lchans keep using the
+ * RTP library.
+ */
+
+#define _GNU_SOURCE	/* sendmmsg() */
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/capability.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+
+#include <osmocom/core/timer.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/trau/osmo_ortp.h>
+
+#include <ortp/ortp.h>
+
+#include <osmo-bts/gsm_data.h>
+#include <osmo-bts/logging.h>
+#include <osmo-bts/rtp_egress.h>
+
+#define RTP_EGRESS_BATCH	256
+#define RTP_HDR_LEN		12
+
+struct rtp_egress_pkt {
+	struct iphdr ip;
+	struct udphdr udp;
+	uint8_t rtp[RTP_HDR_LEN + RTP_EGRESS_MAXLEN];
+} __attribute__((packed));
+
+osmo_static_assert(sizeof(struct rtp_egress_pkt) == RTP_EGRESS_HDR_LEN + RTP_EGRESS_MAXLEN,
+		   rtp_egress_hdr_len);
+
+static void rtp_egress_timer_cb(void *data);
+
+static struct {
+	/* raw socket, -1 if not opened yet */
+	int fd;
+	bool unavailable;
+	struct osmo_timer_list flush_timer;
+	unsigned int num;
+	struct rtp_egress_pkt pkt[RTP_EGRESS_BATCH];
+	struct timespec queued[RTP_EGRESS_BATCH];
+	/* lchan and payload length of each frame, to account for it once sent */
+	struct gsm_lchan *lchan[RTP_EGRESS_BATCH];
+	unsigned int len[RTP_EGRESS_BATCH];
+	struct sockaddr_in dst[RTP_EGRESS_BATCH];
+	struct iovec iov[RTP_EGRESS_BATCH];
+	struct mmsghdr msgs[RTP_EGRESS_BATCH];
+	struct rtp_egress_stats stats;
+} egress = {
+	.fd = -1,
+	.flush_timer = { .cb = rtp_egress_timer_cb },
+};
+
+/* whether we may open a raw socket */
+static bool rtp_egress_cap_net_raw(void)
+{
+	struct __user_cap_header_struct hdr = {
+		.version = _LINUX_CAPABILITY_VERSION_3,
+	};
+	struct __user_cap_data_struct data[_LINUX_CAPABILITY_U32S_3];
+
+	memset(data, 0, sizeof(data));
+	/* if we cannot tell, socket() will */
+	if (syscall(SYS_capget, &hdr, data) < 0)
+		return true;
+
+	return data[CAP_TO_INDEX(CAP_NET_RAW)].effective & CAP_TO_MASK(CAP_NET_RAW);
+}
+
+static int rtp_egress_open(void)
+{
+	unsigned int i;
+	int fd;
+
+	if (egress.fd >= 0)
+		return 0;
+	if (egress.unavailable)
+		return -EPERM;
+
+	if (!rtp_egress_cap_net_raw()) {
+		LOGP(DRTP, LOGL_ERROR, "Batched RTP egress needs CAP_NET_RAW, "
+		     "which osmo-bts does not have, sending uplink frames through "
+		     "the RTP library instead\n");
+		egress.unavailable = true;
+		return -EPERM;
+	}
+
+	/* IPPROTO_RAW implies IP_HDRINCL */
+	fd = socket(AF_INET, SOCK_RAW, IPPROTO_RAW);
+	if (fd < 0) {
+		LOGP(DRTP, LOGL_ERROR, "Cannot open raw socket for batched RTP "
+		     "egress, using the RTP library: %s\n", strerror(errno));
+		egress.unavailable = true;
+		return -errno;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	for (i = 0; i < RTP_EGRESS_BATCH; i++) {
+		egress.iov[i].iov_base = &egress.pkt[i];
+		egress.msgs[i].msg_hdr.msg_iov = &egress.iov[i];
+		egress.msgs[i].msg_hdr.msg_iovlen = 1;
+		egress.msgs[i].msg_hdr.msg_name = &egress.dst[i];
+		egress.msgs[i].msg_hdr.msg_namelen = sizeof(egress.dst[i]);
+	}
+	egress.fd = fd;
+
+	return 0;
+}
+
+/*! \brief set up the RTP state of an lchan for a new RTP connection
+ *
+ *  Called once the RTP socket of the lchan is created, the stream
+ *  continues that of its RTP session.
+ *  \param[in] active send uplink frames through the egress stage */
+void rtp_egress_lchan_init(struct gsm_lchan *lchan, bool active)
+{
+	struct rtp_egress_lchan *e = &lchan->abis_ip.egress;
+	struct osmo_rtp_socket *rs = lchan->abis_ip.rtp_socket;
+
+	/* frames of the previous connection are accounted to it */
+	rtp_egress_flush();
+
+	memset(e, 0, sizeof(*e));
+	if (!active || !rs || rtp_egress_open() < 0)
+		return;
+
+	e->active = true;
+	e->payload_type = RTP_PT_GSM_FULL;
+	e->ssrc = rtp_session_get_send_ssrc(rs->sess);
+	e->seq = rtp_session_get_seq_number(rs->sess);
+	e->timestamp = rs->tx_timestamp;
+}
+
+/* hand the sequence number and timestamp back to the RTP session */
+static void rtp_egress_lchan_sync(struct gsm_lchan *lchan)
+{
+	const struct rtp_egress_lchan *e = &lchan->abis_ip.egress;
+	struct osmo_rtp_socket *rs = lchan->abis_ip.rtp_socket;
+
+	if (!rs)
+		return;
+	rtp_session_set_seq_number(rs->sess, e->seq);
+	rs->tx_timestamp = e->timestamp;
+}
+
+/*! \brief build the IP, UDP and RTP headers of an uplink frame
+ *  \param[out] buf packet, RTP_EGRESS_HDR_LEN + len bytes
+ *  \returns length of the packet */
+unsigned int rtp_egress_build(const struct gsm_lchan *lchan, uint8_t *buf,
+			      const uint8_t *data, unsigned int len, bool marker)
+{
+	const struct rtp_egress_lchan *e = &lchan->abis_ip.egress;
+	struct rtp_egress_pkt *pkt = (struct rtp_egress_pkt *) buf;
+	unsigned int pkt_len = RTP_EGRESS_HDR_LEN + len;
+
+	/* the kernel fills in the checksum and ID, and the source address
+	 * if the RTP socket is bound to INADDR_ANY */
+	memset(&pkt->ip, 0, sizeof(pkt->ip));
+	pkt->ip.version = 4;
+	pkt->ip.ihl = sizeof(pkt->ip) / 4;
+	pkt->ip.ttl = 64;
+	pkt->ip.protocol = IPPROTO_UDP;
+	pkt->ip.tot_len = htons(pkt_len);
+	pkt->ip.saddr = htonl(lchan->abis_ip.bound_ip);
+	pkt->ip.daddr = htonl(lchan->abis_ip.connect_ip);
+
+	/* no UDP checksum, it is optional for IPv4 */
+	pkt->udp.source = htons(lchan->abis_ip.bound_port);
+	pkt->udp.dest = htons(lchan->abis_ip.connect_port);
+	pkt->udp.len = htons(sizeof(pkt->udp) + RTP_HDR_LEN + len);
+	pkt->udp.check = 0;
+
+	pkt->rtp[0] = 0x80;	/* version 2 */
+	pkt->rtp[1] = (marker ? 0x80 : 0) | (e->payload_type & 0x7f);
+	pkt->rtp[2] = e->seq >> 8;
+	pkt->rtp[3] = e->seq;
+	pkt->rtp[4] = e->timestamp >> 24;
+	pkt->rtp[5] = e->timestamp >> 16;
+	pkt->rtp[6] = e->timestamp >> 8;
+	pkt->rtp[7] = e->timestamp;
+	pkt->rtp[8] = e->ssrc >> 24;
+	pkt->rtp[9] = e->ssrc >> 16;
+	pkt->rtp[10] = e->ssrc >> 8;
+	pkt->rtp[11] = e->ssrc;
+	memcpy(pkt->rtp + RTP_HDR_LEN, data, len);
+
+	return pkt_len;
+}
+
+/*! \brief queue an uplink frame for transmission
+ *  \param[in] duration RTP timestamp increment since the last frame */
+int rtp_egress_send(struct gsm_lchan *lchan, const uint8_t *data, unsigned int len,
+		    uint32_t duration, bool marker)
+{
+	struct rtp_egress_lchan *e = &lchan->abis_ip.egress;
+	unsigned int i;
+
+	e->timestamp += duration;
+	rtp_egress_lchan_sync(lchan);
+	if (len > RTP_EGRESS_MAXLEN) {
+		egress.stats.errors++;
+		return -EMSGSIZE;
+	}
+	/* no remote end yet (CRCX without MDCX) */
+	if (!lchan->abis_ip.connect_ip)
+		return -ENOTCONN;
+
+	if (egress.num == RTP_EGRESS_BATCH)
+		rtp_egress_flush();
+	i = egress.num;
+
+	egress.iov[i].iov_len = rtp_egress_build(lchan, (uint8_t *) &egress.pkt[i],
+						 data, len, marker);
+	e->seq++;
+	rtp_egress_lchan_sync(lchan);
+
+	egress.dst[i].sin_family = AF_INET;
+	egress.dst[i].sin_addr.s_addr = egress.pkt[i].ip.daddr;
+	egress.lchan[i] = lchan;
+	egress.len[i] = len;
+	clock_gettime(CLOCK_MONOTONIC, &egress.queued[i]);
+
+	if (egress.num++ == 0)
+		osmo_timer_schedule(&egress.flush_timer, 0, 0);
+
+	return 0;
+}
+
+/*! \brief account for an uplink frame that is not sent */
+void rtp_egress_skipped(struct gsm_lchan *lchan, uint32_t duration)
+{
+	lchan->abis_ip.egress.timestamp += duration;
+	rtp_egress_lchan_sync(lchan);
+}
+
+/*! \brief send all collected frames */
+void rtp_egress_flush(void)
+{
+	struct rtp_egress_stats *st = &egress.stats;
+	struct timespec now;
+	unsigned int i, sent = 0;
+	uint64_t latency;
+	int rc;
+
+	osmo_timer_del(&egress.flush_timer);
+	if (!egress.num)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	for (i = 0; i < egress.num; i++) {
+		latency = (now.tv_sec - egress.queued[i].tv_sec) * 1000000
+			+ (now.tv_nsec - egress.queued[i].tv_nsec) / 1000;
+		st->latency_us_total += latency;
+		if (latency > st->latency_us_max)
+			st->latency_us_max = latency;
+	}
+
+	while (sent < egress.num) {
+		rc = sendmmsg(egress.fd, &egress.msgs[sent], egress.num - sent, 0);
+		st->syscalls++;
+		if (rc < 0) {
+			int err = errno;
+
+			if (err == EINTR)
+				continue;
+			LOGP(DRTP, LOGL_ERROR, "Batched RTP egress failed: %s\n",
+			     strerror(err));
+			if (err == EAGAIN || err == ENOBUFS) {
+				st->errors += egress.num - sent;
+				break;
+			}
+			/* the first frame failed, try the remaining ones */
+			st->errors++;
+			sent++;
+			continue;
+		}
+		st->frames += rc;
+		for (i = sent; i < sent + rc; i++) {
+			egress.lchan[i]->abis_ip.egress.packets_sent++;
+			egress.lchan[i]->abis_ip.egress.octets_sent += egress.len[i];
+		}
+		sent += rc;
+	}
+
+	st->batches++;
+	egress.num = 0;
+}
+
+static void rtp_egress_timer_cb(void *data)
+{
+	rtp_egress_flush();
+}
+
+const struct rtp_egress_stats *rtp_egress_get_stats(void)
+{
+	return &egress.stats;
+}
+
+/*! \brief whether the raw socket could not be opened, e.g. for lack of
+ *  CAP_NET_RAW */
+bool rtp_egress_unavailable(void)
+{
+	return egress.unavailable;
+}
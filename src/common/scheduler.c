@@ -29,7 +29,6 @@
 #include <osmocom/core/msgb.h>
 #include <osmocom/core/talloc.h>
 #include <osmocom/core/bits.h>
-#include <osmocom/gsm/a5.h>
 
 #include <osmo-bts/gsm_data.h>
 #include <osmo-bts/logging.h>
@@ -37,6 +36,7 @@
 #include <osmo-bts/l1sap.h>
 #include <osmo-bts/scheduler.h>
 #include <osmo-bts/scheduler_backend.h>
+#include <osmo-bts/trace.h>
 
 extern void *tall_bts_ctx;
 
@@ -46,6 +46,7 @@ static int rts_tchf_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	enum trx_chan_type chan);
 static int rts_tchh_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	enum trx_chan_type chan);
+static void sched_mf_compile(struct l1sched_ts *l1ts);
 /*! \brief Dummy Burst (TS 05.02 Chapter 5.2.6) */
 static const ubit_t dummy_burst[GSM_BURST_LEN] = {
 	0,0,0,
@@ -220,12 +221,15 @@ int trx_sched_init(struct l1sched_trx *l1t, struct gsm_bts_trx *trx)
 
 		l1ts->mf_index = 0;
 		l1ts->mf_last_fn = 0;
-		INIT_LLIST_HEAD(&l1ts->dl_prims);
+		l1ts->dl_last_fn_valid = 0;
+		for (i = 0; i < ARRAY_SIZE(l1ts->dl_prims); i++)
+			INIT_LLIST_HEAD(&l1ts->dl_prims[i]);
 		for (i = 0; i < ARRAY_SIZE(l1ts->chan_state); i++) {
 			struct l1sched_chan_state *chan_state;
 			chan_state = &l1ts->chan_state[i];
 			chan_state->active = 0;
 		}
+		sched_mf_compile(l1ts);
 	}
 
 	return 0;
@@ -241,17 +245,16 @@ void trx_sched_exit(struct l1sched_trx *l1t)
 
 	for (tn = 0; tn < ARRAY_SIZE(l1t->ts); tn++) {
 		struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
-		msgb_queue_flush(&l1ts->dl_prims);
+		for (i = 0; i < ARRAY_SIZE(l1ts->dl_prims); i++)
+			msgb_queue_flush(&l1ts->dl_prims[i]);
 		for (i = 0; i < _TRX_CHAN_MAX; i++) {
 			struct l1sched_chan_state *chan_state;
 			chan_state = &l1ts->chan_state[i];
-			if (chan_state->dl_bursts) {
-				talloc_free(chan_state->dl_bursts);
-				chan_state->dl_bursts = NULL;
-			}
-			if (chan_state->ul_bursts) {
-				talloc_free(chan_state->ul_bursts);
-				chan_state->ul_bursts = NULL;
+			chan_state->dl_bursts = NULL;
+			chan_state->ul_bursts = NULL;
+			if (chan_state->a5_cache) {
+				talloc_free(chan_state->a5_cache);
+				chan_state->a5_cache = NULL;
 			}
 		}
 		/* clear lchan channel states */
@@ -268,72 +271,147 @@ void trx_sched_reset(struct l1sched_trx *l1t)
 	trx_sched_init(l1t, l1t->trx);
 }
 
+/* get FN and addressing of a queued DL primitive */
+static int prim_fn_addr(struct msgb *msg, uint32_t *fn, uint8_t *chan_nr,
+			uint8_t *link_id)
+{
+	struct osmo_phsap_prim *l1sap = msgb_l1sap_prim(msg);
+
+	if (l1sap->oph.operation != PRIM_OP_REQUEST)
+		return -EINVAL;
+
+	switch (l1sap->oph.primitive) {
+	case PRIM_PH_DATA:
+		*chan_nr = l1sap->u.data.chan_nr;
+		*link_id = l1sap->u.data.link_id;
+		*fn = l1sap->u.data.fn;
+		return 0;
+	case PRIM_TCH:
+		*chan_nr = l1sap->u.tch.chan_nr;
+		*link_id = 0;
+		*fn = l1sap->u.tch.fn;
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+static inline struct llist_head *dl_prim_slot(struct l1sched_ts *l1ts, uint32_t fn)
+{
+	return &l1ts->dl_prims[fn % L1SCHED_DL_PRIM_WINDOW];
+}
+
+/* the last FN transmitted on a TS, or the BTS clock if the TS is not
+ * being clocked (yet, or any more) */
+static uint32_t dl_last_fn(struct l1sched_trx *l1t, struct l1sched_ts *l1ts)
+{
+	uint32_t bts_fn = bts_role_bts(l1t->trx->bts)->gsm_time.fn;
+	uint32_t age;
+
+	if (l1ts->dl_last_fn_valid) {
+		age = (bts_fn + GSM_HYPERFRAME - l1ts->dl_last_fn) % GSM_HYPERFRAME;
+		/* the DL may be clocked ahead of the BTS clock */
+		if (age < L1SCHED_DL_PRIM_WINDOW
+		 || age > GSM_HYPERFRAME - L1SCHED_DL_PRIM_WINDOW)
+			return l1ts->dl_last_fn;
+	}
+
+	return bts_fn;
+}
+
+/* put a DL primitive into the slot of its FN, or drop it if it is too
+ * late or too early to fit into the window of slots */
+static void _sched_enqueue_prim(struct l1sched_trx *l1t, uint8_t tn,
+				struct msgb *msg)
+{
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
+	uint32_t fn, last_fn, dist;
+	uint8_t chan_nr, link_id;
+
+	if (prim_fn_addr(msg, &fn, &chan_nr, &link_id) < 0) {
+		LOGP(DL1P, LOGL_ERROR, "Prim has wrong type.\n");
+		msgb_free(msg);
+		return;
+	}
+
+	/* distance to the next FN we are going to transmit */
+	last_fn = dl_last_fn(l1t, l1ts);
+	dist = (fn + GSM_HYPERFRAME - last_fn - 1) % GSM_HYPERFRAME;
+	if (dist >= GSM_HYPERFRAME - L1SCHED_DL_PRIM_WINDOW) {
+		l1ts->dl_prim_stats.late++;
+		LOGL1S(DL1P, LOGL_NOTICE, l1t, tn, -1, fn,
+		     "Prim for chan_nr=0x%02x is %u FN late. If this "
+		     "happens in conjunction with PCU, increase "
+		     "'rts-advance' by 5.\n", chan_nr,
+		     GSM_HYPERFRAME - dist);
+		msgb_free(msg);
+		return;
+	}
+	if (dist >= L1SCHED_DL_PRIM_WINDOW) {
+		l1ts->dl_prim_stats.out_of_window++;
+		LOGL1S(DL1P, LOGL_NOTICE, l1t, tn, -1, fn,
+		     "Prim for chan_nr=0x%02x is out of range (%u FN "
+		     "ahead of last fn=%u)\n", chan_nr, dist, last_fn);
+		msgb_free(msg);
+		return;
+	}
+
+	msgb_enqueue(dl_prim_slot(l1ts, fn), msg);
+}
+
+/* drop all primitives of the given FN slot which have not been dequeued */
+static void _sched_expire_prims(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn)
+{
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
+	struct llist_head *slot = dl_prim_slot(l1ts, fn);
+	struct msgb *msg;
+	uint32_t prim_fn;
+	uint8_t chan_nr, link_id;
+
+	while ((msg = msgb_dequeue(slot))) {
+		prim_fn_addr(msg, &prim_fn, &chan_nr, &link_id);
+		l1ts->dl_prim_stats.expired++;
+		LOGL1S(DL1P, LOGL_NOTICE, l1t, tn, -1, fn,
+		     "Prim for fn=%u chan_nr=0x%02x link_id=0x%02x was not "
+		     "transmitted, channel %s is disabled?\n", prim_fn,
+		     chan_nr, link_id, get_lchan_by_chan_nr(l1t->trx, chan_nr)->name);
+		msgb_free(msg);
+	}
+
+	l1ts->dl_last_fn = fn;
+	l1ts->dl_last_fn_valid = 1;
+}
+
 struct msgb *_sched_dequeue_prim(struct l1sched_trx *l1t, int8_t tn, uint32_t fn,
 				 enum trx_chan_type chan)
 {
-	struct msgb *msg, *msg2;
-	struct osmo_phsap_prim *l1sap;
+	struct msgb *msg;
 	uint32_t prim_fn;
 	uint8_t chan_nr, link_id;
 	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
 
-	/* get prim of current fn from queue */
-	llist_for_each_entry_safe(msg, msg2, &l1ts->dl_prims, list) {
-		l1sap = msgb_l1sap_prim(msg);
-		if (l1sap->oph.operation != PRIM_OP_REQUEST) {
-wrong_type:
-			LOGL1S(DL1P, LOGL_ERROR, l1t, tn, chan, fn, "Prim has wrong type.\n");
-free_msg:
-			/* unlink and free message */
-			llist_del(&msg->list);
-			msgb_free(msg);
-			return NULL;
-		}
-		switch (l1sap->oph.primitive) {
-		case PRIM_PH_DATA:
-			chan_nr = l1sap->u.data.chan_nr;
-			link_id = l1sap->u.data.link_id;
-			prim_fn = ((l1sap->u.data.fn + GSM_HYPERFRAME - fn) % GSM_HYPERFRAME);
-			break;
-		case PRIM_TCH:
-			chan_nr = l1sap->u.tch.chan_nr;
-			link_id = 0;
-			prim_fn = ((l1sap->u.tch.fn + GSM_HYPERFRAME - fn) % GSM_HYPERFRAME);
-			break;
-		default:
-			goto wrong_type;
-		}
-		if (prim_fn > 100) {
-			LOGL1S(DL1P, LOGL_NOTICE, l1t, tn, chan, fn,
-			     "Prim %u is out of range (100), or channel %s with "
-			     "type %s is already disabled. If this happens in "
-			     "conjunction with PCU, increase 'rts-advance' by 5.",
-			     prim_fn, get_lchan_by_chan_nr(l1t->trx, chan_nr)->name,
-			     get_value_string(trx_chan_type_names, chan));
-			/* unlink and free message */
-			llist_del(&msg->list);
-			msgb_free(msg);
-			continue;
-		}
-		if (prim_fn > 0)
-			continue;
-
-		goto found_msg;
+	/* get prim of current fn from its slot */
+	llist_for_each_entry(msg, dl_prim_slot(l1ts, fn), list) {
+		prim_fn_addr(msg, &prim_fn, &chan_nr, &link_id);
+		if (prim_fn == fn)
+			goto found_msg;
 	}
 
 	return NULL;
 
 found_msg:
+	/* unlink message */
+	llist_del(&msg->list);
+
 	if ((chan_nr ^ (trx_chan_desc[chan].chan_nr | tn))
 	 || ((link_id & 0xc0) ^ trx_chan_desc[chan].link_id)) {
 		LOGL1S(DL1P, LOGL_ERROR, l1t, tn, chan, fn, "Prim has wrong chan_nr=%02x link_id=%02x, "
 			"expecting chan_nr=%02x link_id=%02x.\n", chan_nr, link_id,
 			trx_chan_desc[chan].chan_nr | tn, trx_chan_desc[chan].link_id);
-		goto free_msg;
+		msgb_free(msg);
+		return NULL;
 	}
 
-	/* unlink and return message */
-	llist_del(&msg->list);
 	return msg;
 }
 
@@ -411,7 +489,6 @@ int _sched_compose_tch_ind(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 int trx_sched_ph_data_req(struct l1sched_trx *l1t, struct osmo_phsap_prim *l1sap)
 {
 	uint8_t tn = l1sap->u.data.chan_nr & 7;
-	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
 
 	LOGL1S(DL1P, LOGL_INFO, l1t, tn, -1, l1sap->u.data.fn,
 		"PH-DATA.req: chan_nr=0x%02x link_id=0x%02x\n",
@@ -426,7 +503,7 @@ int trx_sched_ph_data_req(struct l1sched_trx *l1t, struct osmo_phsap_prim *l1sap
 		return 0;
 	}
 
-	msgb_enqueue(&l1ts->dl_prims, l1sap->oph.msg);
+	_sched_enqueue_prim(l1t, tn, l1sap->oph.msg);
 
 	return 0;
 }
@@ -434,7 +511,6 @@ int trx_sched_ph_data_req(struct l1sched_trx *l1t, struct osmo_phsap_prim *l1sap
 int trx_sched_tch_req(struct l1sched_trx *l1t, struct osmo_phsap_prim *l1sap)
 {
 	uint8_t tn = l1sap->u.tch.chan_nr & 7;
-	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
 
 	LOGL1S(DL1P, LOGL_INFO, l1t, tn, -1, l1sap->u.tch.fn, "TCH.req: chan_nr=0x%02x\n",
 		l1sap->u.tch.chan_nr);
@@ -448,7 +524,7 @@ int trx_sched_tch_req(struct l1sched_trx *l1t, struct osmo_phsap_prim *l1sap)
 		return 0;
 	}
 
-	msgb_enqueue(&l1ts->dl_prims, l1sap->oph.msg);
+	_sched_enqueue_prim(l1t, tn, l1sap->oph.msg);
 
 	return 0;
 }
@@ -569,18 +645,6 @@ static int rts_tchh_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
  * multiframe structure
  */
 
-/* frame structures */
-struct trx_sched_frame {
-	/*! \brief downlink TRX channel type */
-	enum trx_chan_type		dl_chan;
-	/*! \brief downlink block ID */
-	uint8_t				dl_bid;
-	/*! \brief uplink TRX channel type */
-	enum trx_chan_type		ul_chan;
-	/*! \brief uplink block ID */
-	uint8_t				ul_bid;
-};
-
 static const struct trx_sched_frame frame_bcch[51] = {
 /*	dl_chan		dl_bid	ul_chan		ul_bid */
       {	TRXC_FCCH,	0,	TRXC_RACH,	0 },
@@ -1323,6 +1387,99 @@ static const struct trx_sched_multiframe trx_sched_multiframes[] = {
 };
 
 
+/* size of burst buffer required by the given channel type */
+static uint16_t sched_burst_buf_len(enum trx_chan_type chan)
+{
+	switch (chan) {
+	case TRXC_IDLE:
+	case TRXC_FCCH:
+	case TRXC_SCH:
+	case TRXC_RACH:
+		return 0;
+	case TRXC_TCHF:
+		return L1SCHED_BURSTS_TCHF;
+	case TRXC_TCHH_0:
+	case TRXC_TCHH_1:
+		return L1SCHED_BURSTS_TCHH;
+	case TRXC_PDTCH:
+		return L1SCHED_BURSTS_PDTCH;
+	default:
+		return L1SCHED_BURSTS_XCCH;
+	}
+}
+
+/* assign burst buffers from the TS pool to all channels of the multiframe,
+ * the layout only depends on the multiframe, so buffers in use stay valid */
+static void sched_burst_pool_assign(struct l1sched_ts *l1ts)
+{
+	const struct trx_sched_frame *frame;
+	unsigned int i, offset = 0;
+	uint8_t used[_TRX_CHAN_MAX];
+
+	memset(used, 0, sizeof(used));
+	for (i = 0; i < l1ts->mf_period; i++) {
+		frame = l1ts->mf_frames + i;
+		used[frame->dl_chan] = 1;
+		used[frame->ul_chan] = 1;
+	}
+
+	for (i = 0; i < _TRX_CHAN_MAX; i++) {
+		struct l1sched_chan_state *chan_state = &l1ts->chan_state[i];
+		uint16_t len = used[i] ? sched_burst_buf_len(i) : 0;
+
+		if (!len) {
+			chan_state->dl_burst_buf = NULL;
+			chan_state->ul_burst_buf = NULL;
+			chan_state->burst_buf_len = 0;
+			continue;
+		}
+		OSMO_ASSERT(offset + len <= L1SCHED_BURST_POOL_SIZE);
+		chan_state->dl_burst_buf = l1ts->dl_burst_pool + offset;
+		chan_state->ul_burst_buf = l1ts->ul_burst_pool + offset;
+		chan_state->burst_buf_len = len;
+		offset += len;
+	}
+}
+
+/* resolve channel description and state of each frame of the multiframe,
+ * must be called whenever multiframe or channel activation changes */
+static void sched_mf_compile(struct l1sched_ts *l1ts)
+{
+	const struct trx_sched_frame *frame;
+	struct l1sched_mf_entry *ent;
+	unsigned int i;
+
+	memset(l1ts->mf_table, 0, sizeof(l1ts->mf_table));
+
+	if (!l1ts->mf_index)
+		return;
+
+	OSMO_ASSERT(l1ts->mf_period <= ARRAY_SIZE(l1ts->mf_table));
+
+	sched_burst_pool_assign(l1ts);
+
+	for (i = 0; i < l1ts->mf_period; i++) {
+		frame = l1ts->mf_frames + i;
+		ent = &l1ts->mf_table[i];
+
+		ent->dl_chan = frame->dl_chan;
+		ent->dl_bid = frame->dl_bid;
+		ent->dl_fn = trx_chan_desc[frame->dl_chan].dl_fn;
+		ent->dl_cs = &l1ts->chan_state[frame->dl_chan];
+		ent->dl_active = trx_chan_desc[frame->dl_chan].auto_active
+				|| ent->dl_cs->active;
+		if (frame->dl_bid == 0)
+			ent->rts_fn = trx_chan_desc[frame->dl_chan].rts_fn;
+
+		ent->ul_chan = frame->ul_chan;
+		ent->ul_bid = frame->ul_bid;
+		ent->ul_fn = trx_chan_desc[frame->ul_chan].ul_fn;
+		ent->ul_cs = &l1ts->chan_state[frame->ul_chan];
+		ent->ul_active = trx_chan_desc[frame->ul_chan].auto_active
+				|| ent->ul_cs->active;
+	}
+}
+
 /*
  * scheduler functions
  */
@@ -1332,14 +1489,22 @@ int trx_sched_set_pchan(struct l1sched_trx *l1t, uint8_t tn,
 	enum gsm_phys_chan_config pchan)
 {
 	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
-	int i;
+	int i, j;
 
 	for (i = 0; i < ARRAY_SIZE(trx_sched_multiframes); i++) {
 		if (trx_sched_multiframes[i].pchan == pchan
 		 && (trx_sched_multiframes[i].slotmask & (1 << tn))) {
+			if (l1ts->mf_frames != trx_sched_multiframes[i].frames) {
+				/* buffer layout changes, drop blocks in progress */
+				for (j = 0; j < _TRX_CHAN_MAX; j++) {
+					l1ts->chan_state[j].dl_bursts = NULL;
+					l1ts->chan_state[j].ul_bursts = NULL;
+				}
+			}
 			l1ts->mf_index = i;
 			l1ts->mf_period = trx_sched_multiframes[i].period;
 			l1ts->mf_frames = trx_sched_multiframes[i].frames;
+			sched_mf_compile(l1ts);
 			LOGP(DL1C, LOGL_NOTICE, "Configuring multiframe with "
 				"%s trx=%d ts=%d\n",
 				trx_sched_multiframes[i].name,
@@ -1381,23 +1546,24 @@ int trx_sched_set_lchan(struct l1sched_trx *l1t, uint8_t chan_nr, uint8_t link_i
 			LOGP(DL1C, LOGL_NOTICE, "%s %s on trx=%d ts=%d\n",
 				(active) ? "Activating" : "Deactivating",
 				trx_chan_desc[i].name, l1t->trx->nr, tn);
+			/* keystream cache is allocated again with ciphering */
+			if (chan_state->a5_cache) {
+				talloc_free(chan_state->a5_cache);
+				chan_state->a5_cache = NULL;
+			}
 			if (active)
 				memset(chan_state, 0, sizeof(*chan_state));
 			chan_state->active = active;
-			/* free burst memory, to cleanly start with burst 0 */
-			if (chan_state->dl_bursts) {
-				talloc_free(chan_state->dl_bursts);
-				chan_state->dl_bursts = NULL;
-			}
-			if (chan_state->ul_bursts) {
-				talloc_free(chan_state->ul_bursts);
-				chan_state->ul_bursts = NULL;
-			}
+			/* release burst memory, to cleanly start with burst 0 */
+			chan_state->dl_bursts = NULL;
+			chan_state->ul_bursts = NULL;
 			if (!active)
 				chan_state->ho_rach_detect = 0;
 		}
 	}
 
+	sched_mf_compile(l1ts);
+
 	/* disable handover detection (on deactivation) */
 	if (!active)
 		_sched_act_rach_det(l1t, tn, ss, 0);
@@ -1495,6 +1661,12 @@ int trx_sched_set_cipher(struct l1sched_trx *l1t, uint8_t chan_nr, int downlink,
 				"ts=%d\n", algo,
 				(downlink) ? "downlink" : "uplink",
 				trx_chan_desc[i].name, l1t->trx->nr, tn);
+			if (algo && !chan_state->a5_cache) {
+				chan_state->a5_cache = talloc_zero(tall_bts_ctx,
+						struct l1sched_a5_cache);
+				if (!chan_state->a5_cache)
+					return -ENOMEM;
+			}
 			if (downlink) {
 				chan_state->dl_encr_algo = algo;
 				memcpy(chan_state->dl_encr_key, key, key_len);
@@ -1504,6 +1676,10 @@ int trx_sched_set_cipher(struct l1sched_trx *l1t, uint8_t chan_nr, int downlink,
 				memcpy(chan_state->ul_encr_key, key, key_len);
 				chan_state->ul_encr_key_len = key_len;
 			}
+			if (chan_state->a5_cache)
+				_sched_a5_set_key(chan_state->a5_cache, downlink, algo,
+					downlink ? chan_state->dl_encr_key
+						 : chan_state->ul_encr_key);
 			rc = 0;
 		}
 	}
@@ -1515,38 +1691,24 @@ int trx_sched_set_cipher(struct l1sched_trx *l1t, uint8_t chan_nr, int downlink,
 int _sched_rts(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn)
 {
 	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
-	const struct trx_sched_frame *frame;
-	uint8_t offset, period, bid;
-	trx_sched_rts_func *func;
-	enum trx_chan_type chan;
+	const struct l1sched_mf_entry *ent;
 
 	/* no multiframe set */
 	if (!l1ts->mf_index)
 		return 0;
 
 	/* get frame from multiframe */
-	period = l1ts->mf_period;
-	offset = fn % period;
-	frame = l1ts->mf_frames + offset;
-
-	chan = frame->dl_chan;
-	bid = frame->dl_bid;
-	func = trx_chan_desc[frame->dl_chan].rts_fn;
-
-	/* only on bid == 0 */
-	if (bid != 0)
-		return 0;
+	ent = &l1ts->mf_table[fn % l1ts->mf_period];
 
-	/* no RTS function */
-	if (!func)
+	/* only on bid == 0, and only if there is an RTS function */
+	if (!ent->rts_fn)
 		return 0;
 
 	/* check if channel is active */
-	if (!trx_chan_desc[chan].auto_active
-	 && !l1ts->chan_state[chan].active)
-	 	return -EINVAL;
+	if (!ent->dl_active)
+		return -EINVAL;
 
-	return func(l1t, tn, fn, frame->dl_chan);
+	return ent->rts_fn(l1t, tn, fn, ent->dl_chan);
 }
 
 /* process downlink burst */
@@ -1555,49 +1717,37 @@ const ubit_t *_sched_dl_burst(struct l1sched_trx *l1t, uint8_t tn,
 {
 	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
 	struct l1sched_chan_state *l1cs;
-	const struct trx_sched_frame *frame;
-	uint8_t offset, period, bid;
-	trx_sched_dl_func *func;
-	enum trx_chan_type chan;
+	const struct l1sched_mf_entry *ent;
 	ubit_t *bits = NULL;
 
 	if (!l1ts->mf_index)
 		goto no_data;
 
 	/* get frame from multiframe */
-	period = l1ts->mf_period;
-	offset = fn % period;
-	frame = l1ts->mf_frames + offset;
-
-	chan = frame->dl_chan;
-	bid = frame->dl_bid;
-	func = trx_chan_desc[chan].dl_fn;
-
-	l1cs = &l1ts->chan_state[chan];
+	ent = &l1ts->mf_table[fn % l1ts->mf_period];
+	l1cs = ent->dl_cs;
 
 	/* check if channel is active */
-	if (!trx_chan_desc[chan].auto_active && !l1cs->active) {
+	if (!ent->dl_active) {
 		if (nbits)
 			*nbits = GSM_BURST_LEN;
 		goto no_data;
 	}
 
 	/* get burst from function */
-	bits = func(l1t, tn, fn, chan, bid, nbits);
+	bits = ent->dl_fn(l1t, tn, fn, ent->dl_chan, ent->dl_bid, nbits);
+	if (bits)
+		BTS_TRACE(BTS_TRACE_SCHED, BTS_TRACE_EV_DL_BURST, fn,
+			  l1t->trx->nr, tn, ent->dl_chan, ent->dl_bid);
 
 	/* encrypt */
-	if (bits && l1cs->dl_encr_algo) {
-		ubit_t ks[114];
-		int i;
-
-		osmo_a5(l1cs->dl_encr_algo, l1cs->dl_encr_key, fn, ks, NULL);
-		for (i = 0; i < 57; i++) {
-			bits[i + 3] ^= ks[i];
-			bits[i + 88] ^= ks[i + 57];
-		}
-	}
+	if (bits && l1cs->dl_encr_algo)
+		_sched_a5_encrypt(bits, _sched_a5_keystream(l1cs->a5_cache, 1, fn));
 
 no_data:
+	/* whatever is left for this FN will never be sent */
+	_sched_expire_prims(l1t, tn, fn);
+
 	/* in case of C0, we need a dummy burst to maintain RF power */
 	if (bits == NULL && l1t->trx == l1t->trx->bts->c0) {
 #if 0
@@ -1618,10 +1768,7 @@ int trx_sched_ul_burst(struct l1sched_trx *l1t, uint8_t tn, uint32_t current_fn,
 {
 	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
 	struct l1sched_chan_state *l1cs;
-	const struct trx_sched_frame *frame;
-	uint8_t offset, period, bid;
-	trx_sched_ul_func *func;
-	enum trx_chan_type chan;
+	const struct l1sched_mf_entry *ent;
 	uint32_t fn, elapsed;
 
 	if (!l1ts->mf_index)
@@ -1639,48 +1786,34 @@ int trx_sched_ul_burst(struct l1sched_trx *l1t, uint8_t tn, uint32_t current_fn,
 
 	while (42) {
 		/* get frame from multiframe */
-		period = l1ts->mf_period;
-		offset = fn % period;
-		frame = l1ts->mf_frames + offset;
-
-		chan = frame->ul_chan;
-		bid = frame->ul_bid;
-		func = trx_chan_desc[chan].ul_fn;
-
-		l1cs = &l1ts->chan_state[chan];
+		ent = &l1ts->mf_table[fn % l1ts->mf_period];
+		l1cs = ent->ul_cs;
 
 		/* check if channel is active */
-		if (!trx_chan_desc[chan].auto_active && !l1cs->active)
+		if (!ent->ul_active)
 			goto next_frame;
 
 		/* omit bursts which have no handler, like IDLE bursts */
-		if (!func)
+		if (!ent->ul_fn)
 			goto next_frame;
 
 		/* put burst to function */
 		if (fn == current_fn) {
 			/* decrypt */
-			if (bits && l1cs->ul_encr_algo) {
-				ubit_t ks[114];
-				int i;
-
-				osmo_a5(l1cs->ul_encr_algo,
-					l1cs->ul_encr_key,
-					fn, NULL, ks);
-				for (i = 0; i < 57; i++) {
-					if (ks[i])
-						bits[i + 3] = - bits[i + 3];
-					if (ks[i + 57])
-						bits[i + 88] = - bits[i + 88];
-				}
-			}
-
-			func(l1t, tn, fn, chan, bid, bits, nbits, rssi, toa);
-		} else if (chan != TRXC_RACH && !l1cs->ho_rach_detect) {
+			if (bits && l1cs->ul_encr_algo)
+				_sched_a5_decrypt(bits,
+					_sched_a5_keystream(l1cs->a5_cache, 0, fn));
+
+			BTS_TRACE(BTS_TRACE_SCHED, BTS_TRACE_EV_UL_BURST, fn,
+				  l1t->trx->nr, tn, ent->ul_chan, ent->ul_bid);
+			ent->ul_fn(l1t, tn, fn, ent->ul_chan, ent->ul_bid,
+				   bits, nbits, rssi, toa);
+		} else if (ent->ul_chan != TRXC_RACH && !l1cs->ho_rach_detect) {
 			sbit_t spare[GSM_BURST_LEN];
 
 			memset(spare, 0, GSM_BURST_LEN);
-			func(l1t, tn, fn, chan, bid, spare, GSM_BURST_LEN, -128, 0);
+			ent->ul_fn(l1t, tn, fn, ent->ul_chan, ent->ul_bid,
+				   spare, GSM_BURST_LEN, -128, 0);
 		}
 
 next_frame:
@@ -0,0 +1,174 @@
+/* A5 ciphering of bursts for the common L1 scheduler */
+
+/* All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include <osmocom/core/bits.h>
+#include <osmocom/gsm/a5.h>
+
+#include <osmo-bts/scheduler.h>
+#include <osmo-bts/scheduler_backend.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+/* The 114 bits of keystream cover the two 57 bit data fields of a
+ * normal burst, which start at bit 3 and bit 88. */
+#define A5_HALF_LEN	57
+
+/*! XOR 57 ubits of \a bits with 57 bits of keystream \a ks */
+static inline void a5_xor_half(ubit_t *bits, const ubit_t *ks)
+{
+	int i = 0;
+
+#if defined(__SSE2__)
+	for (; i + 16 <= A5_HALF_LEN; i += 16) {
+		__m128i b = _mm_loadu_si128((const __m128i *) (bits + i));
+		__m128i k = _mm_loadu_si128((const __m128i *) (ks + i));
+		_mm_storeu_si128((__m128i *) (bits + i), _mm_xor_si128(b, k));
+	}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	for (; i + 16 <= A5_HALF_LEN; i += 16)
+		vst1q_u8(bits + i, veorq_u8(vld1q_u8(bits + i), vld1q_u8(ks + i)));
+#endif
+	for (; i < A5_HALF_LEN; i++)
+		bits[i] ^= ks[i];
+}
+
+/*! negate all of 57 sbits of \a bits whose keystream bit in \a ks is set */
+static inline void a5_negate_half(sbit_t *bits, const ubit_t *ks)
+{
+	int i = 0;
+
+	/* with m = -k (0x00 or 0xff), (b ^ m) - m negates b only if k = 1 */
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= A5_HALF_LEN; i += 16) {
+		__m128i b = _mm_loadu_si128((const __m128i *) (bits + i));
+		__m128i m = _mm_sub_epi8(zero,
+			_mm_loadu_si128((const __m128i *) (ks + i)));
+		b = _mm_sub_epi8(_mm_xor_si128(b, m), m);
+		_mm_storeu_si128((__m128i *) (bits + i), b);
+	}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	for (; i + 16 <= A5_HALF_LEN; i += 16) {
+		int8x16_t b = vld1q_s8(bits + i);
+		int8x16_t m = vnegq_s8(vreinterpretq_s8_u8(vld1q_u8(ks + i)));
+		vst1q_s8(bits + i, vsubq_s8(veorq_s8(b, m), m));
+	}
+#endif
+	for (; i < A5_HALF_LEN; i++) {
+		if (ks[i])
+			bits[i] = -bits[i];
+	}
+}
+
+/*! apply DL keystream \a ks (114 ubits) to a composed normal burst */
+void _sched_a5_encrypt(ubit_t *bits, const ubit_t *ks)
+{
+	a5_xor_half(bits + 3, ks);
+	a5_xor_half(bits + 88, ks + A5_HALF_LEN);
+}
+
+/*! apply UL keystream \a ks (114 ubits) to a received normal burst */
+void _sched_a5_decrypt(sbit_t *bits, const ubit_t *ks)
+{
+	a5_negate_half(bits + 3, ks);
+	a5_negate_half(bits + 88, ks + A5_HALF_LEN);
+}
+
+/*! set algo and key of one direction, flushing its cached keystream
+ *  \param[inout] cache keystream cache of the logical channel
+ *  \param[in] downlink set the DL (1) or UL (0) key
+ *  \param[in] algo A5 algorithm (1..4)
+ *  \param[in] key Kc (MAX_A5_KEY_LEN bytes) */
+void _sched_a5_set_key(struct l1sched_a5_cache *cache, int downlink,
+		       int algo, const uint8_t *key)
+{
+	struct l1sched_a5_cache_key *k = downlink ? &cache->dl_key : &cache->ul_key;
+
+	if (k->algo == algo && !memcmp(k->key, key, sizeof(k->key)))
+		return;
+
+	k->algo = algo;
+	memcpy(k->key, key, sizeof(k->key));
+	if (downlink)
+		cache->dl.valid = 0;
+	else
+		memset(cache->ul, 0, sizeof(cache->ul));
+}
+
+static inline int a5_same_key(const struct l1sched_a5_cache *cache)
+{
+	return cache->dl_key.algo == cache->ul_key.algo &&
+	       !memcmp(cache->dl_key.key, cache->ul_key.key, sizeof(cache->dl_key.key));
+}
+
+/*! obtain the A5 keystream for a given frame number
+ *  \param[inout] cache keystream cache of the logical channel
+ *  \param[in] downlink DL (1) or UL (0) keystream
+ *  \param[in] fn GSM frame number
+ *  \returns keystream (114 ubits)
+ *
+ *  osmo_a5() always generates both directions at once.  If both use the
+ *  same algo and key, the UL keystream generated with the DL burst of an
+ *  FN is kept in a ring indexed by FN, where the UL burst of that FN finds
+ *  it if it arrives less than L1SCHED_A5_CACHE_SIZE frames later.  In any
+ *  other case the keystream is generated on demand. */
+const ubit_t *_sched_a5_keystream(struct l1sched_a5_cache *cache,
+				  int downlink, uint32_t fn)
+{
+	struct l1sched_a5_cache_entry *ent;
+	ubit_t ks[114];
+
+	if (downlink) {
+		ent = &cache->dl;
+		if (ent->valid && ent->fn == fn) {
+			cache->hits++;
+			return ent->ks;
+		}
+		osmo_a5(cache->dl_key.algo, cache->dl_key.key, fn, ent->ks, ks);
+		ent->fn = fn;
+		ent->valid = 1;
+		cache->misses++;
+
+		if (cache->ul_key.algo && a5_same_key(cache)) {
+			ent = &cache->ul[fn % L1SCHED_A5_CACHE_SIZE];
+			memcpy(ent->ks, ks, sizeof(ent->ks));
+			ent->fn = fn;
+			ent->valid = 1;
+		}
+		return cache->dl.ks;
+	}
+
+	ent = &cache->ul[fn % L1SCHED_A5_CACHE_SIZE];
+	if (ent->valid && ent->fn == fn) {
+		cache->hits++;
+		return ent->ks;
+	}
+	osmo_a5(cache->ul_key.algo, cache->ul_key.key, fn, ks, ent->ks);
+	ent->fn = fn;
+	ent->valid = 1;
+	cache->misses++;
+
+	return ent->ks;
+}
@@ -0,0 +1,215 @@
+/* Binary tracing of the L1SAP and scheduler hot paths */
+
+/* All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Every thread that hits an enabled trace point gets a ring of its own,
+ * so that recording a trace needs neither a lock nor an atomic
+ * read-modify-write.  The rings are allocated with malloc() rather than
+ * talloc, which must not be used off the main thread, and are never
+ * freed: the trace of a thread that has exited can still be dumped.
+ *
+ * The dump runs on the main thread while the other threads keep on
+ * writing.  The writer publishes each record by a release store of its
+ * head index; the reader copies the ring and then reads the head once
+ * more, and drops whatever the writer may have overwritten meanwhile.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+
+#include <osmocom/core/utils.h>
+
+#include <osmo-bts/logging.h>
+#include <osmo-bts/trace.h>
+
+#define BTS_TRACE_RING_LEN	65536	/* power of 2, 1.5 MiB */
+#define BTS_TRACE_MAX_RINGS	64
+
+struct bts_trace_ring {
+	/* index of the next record, the oldest is head - BTS_TRACE_RING_LEN */
+	uint64_t head;
+	uint32_t tid;
+	char name[16];
+	struct bts_trace_rec rec[BTS_TRACE_RING_LEN];
+};
+
+uint32_t bts_trace_mask;
+
+static __thread struct bts_trace_ring *bts_trace_ring;
+/* set once the thread found all rings taken, or ran out of memory */
+static __thread int bts_trace_no_ring;
+
+static struct bts_trace_ring *rings[BTS_TRACE_MAX_RINGS];
+static unsigned int num_rings;
+
+static struct bts_trace_ring *bts_trace_ring_alloc(void)
+{
+	struct bts_trace_ring *r;
+	unsigned int idx;
+
+	if (bts_trace_no_ring)
+		return NULL;
+
+	r = calloc(1, sizeof(*r));
+	if (!r) {
+		bts_trace_no_ring = 1;
+		return NULL;
+	}
+	r->tid = syscall(SYS_gettid);
+	prctl(PR_GET_NAME, r->name);
+
+	idx = __atomic_fetch_add(&num_rings, 1, __ATOMIC_RELAXED);
+	if (idx >= BTS_TRACE_MAX_RINGS) {
+		free(r);
+		bts_trace_no_ring = 1;
+		return NULL;
+	}
+	__atomic_store_n(&rings[idx], r, __ATOMIC_RELEASE);
+	bts_trace_ring = r;
+
+	return r;
+}
+
+/*! \brief record a trace event in the ring of the calling thread
+ *
+ *  Called through BTS_TRACE(), which checks the trace class first. */
+void bts_trace(enum bts_trace_event event, uint32_t fn, uint8_t trx,
+	       uint8_t tn, uint8_t chan, uint32_t arg)
+{
+	struct bts_trace_ring *r = bts_trace_ring;
+	struct bts_trace_rec *rec;
+	struct timespec ts;
+	uint64_t head;
+
+	if (!r && !(r = bts_trace_ring_alloc()))
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	head = r->head;
+
+	/* keep the record stores behind the publication of the previous
+	 * record, see bts_trace_dump_ring() */
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	rec = &r->rec[head % BTS_TRACE_RING_LEN];
+	rec->time_ns = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+	rec->fn = fn;
+	rec->arg = arg;
+	rec->event = event;
+	rec->trx = trx;
+	rec->tn = tn;
+	rec->chan = chan;
+
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static int bts_trace_dump_ring(FILE *f, struct bts_trace_ring *r,
+			       struct bts_trace_rec *buf)
+{
+	struct bts_trace_ring_hdr rh;
+	uint64_t head, head2, first, valid, i;
+
+	head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	first = head > BTS_TRACE_RING_LEN ? head - BTS_TRACE_RING_LEN : 0;
+	for (i = first; i < head; i++)
+		buf[i - first] = r->rec[i % BTS_TRACE_RING_LEN];
+
+	/* the writer may have overwritten the oldest records while we
+	 * copied them, including the slot of the record in progress */
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	head2 = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+	valid = first;
+	if (head2 + 1 > BTS_TRACE_RING_LEN && head2 + 1 - BTS_TRACE_RING_LEN > valid)
+		valid = head2 + 1 - BTS_TRACE_RING_LEN;
+	if (valid > head)
+		valid = head;
+
+	memset(&rh, 0, sizeof(rh));
+	rh.magic = BTS_TRACE_RING_MAGIC;
+	rh.tid = r->tid;
+	memcpy(rh.name, r->name, sizeof(rh.name));
+	rh.overwritten = valid;
+	rh.num_recs = head - valid;
+
+	if (fwrite(&rh, sizeof(rh), 1, f) != 1)
+		return -EIO;
+	if (rh.num_recs &&
+	    fwrite(buf + (valid - first), sizeof(*buf), rh.num_recs, f) != rh.num_recs)
+		return -EIO;
+
+	return 0;
+}
+
+/*! \brief write the trace rings of all threads to a file
+ *  \returns 0 on success; negative on error */
+int bts_trace_dump(const char *path)
+{
+	struct bts_trace_file_hdr fh;
+	struct bts_trace_rec *buf;
+	unsigned int i, n;
+	FILE *f;
+	int rc = 0;
+
+	buf = malloc(sizeof(*buf) * BTS_TRACE_RING_LEN);
+	if (!buf)
+		return -ENOMEM;
+
+	f = fopen(path, "w");
+	if (!f) {
+		rc = -errno;
+		free(buf);
+		return rc;
+	}
+
+	/* rings registered after this are not part of the dump */
+	n = OSMO_MIN(__atomic_load_n(&num_rings, __ATOMIC_RELAXED), BTS_TRACE_MAX_RINGS);
+	for (i = 0; i < n; i++) {
+		if (!__atomic_load_n(&rings[i], __ATOMIC_ACQUIRE))
+			break;
+	}
+	n = i;
+
+	memset(&fh, 0, sizeof(fh));
+	fh.magic = BTS_TRACE_FILE_MAGIC;
+	fh.version = BTS_TRACE_VERSION;
+	fh.rec_size = sizeof(struct bts_trace_rec);
+	fh.num_rings = n;
+	if (fwrite(&fh, sizeof(fh), 1, f) != 1)
+		rc = -EIO;
+
+	for (i = 0; i < n && rc == 0; i++)
+		rc = bts_trace_dump_ring(f, rings[i], buf);
+
+	if (fclose(f) != 0 && rc == 0)
+		rc = -errno;
+	free(buf);
+
+	if (rc < 0)
+		LOGP(DL1C, LOGL_ERROR, "Cannot write trace to %s: %s\n",
+		     path, strerror(-rc));
+
+	return rc;
+}
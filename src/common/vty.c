@@ -52,6 +52,7 @@
 #include <osmo-bts/measurement.h>
 #include <osmo-bts/vty.h>
 #include <osmo-bts/l1sap.h>
+#include <osmo-bts/trace.h>
 
 #define VTY_STR	"Configure the VTY\n"
 
@@ -256,6 +257,14 @@ static void config_write_bts_single(struct vty *vty, struct gsm_bts *bts)
 	if (btsb->rtp_jitter_adaptive)
 		vty_out(vty, " adaptive");
 	vty_out(vty, "%s", VTY_NEWLINE);
+	if (btsb->rtp_jitter_bts)
+		vty_out(vty, " rtp bts-jitter-buffer%s", VTY_NEWLINE);
+	if (btsb->rtp_egress_batch)
+		vty_out(vty, " rtp batch-egress%s", VTY_NEWLINE);
+	if (bts_trace_mask & (1 << BTS_TRACE_L1SAP))
+		vty_out(vty, " trace l1sap%s", VTY_NEWLINE);
+	if (bts_trace_mask & (1 << BTS_TRACE_SCHED))
+		vty_out(vty, " trace sched%s", VTY_NEWLINE);
 	vty_out(vty, " paging queue-size %u%s", paging_get_queue_max(btsb->paging_state),
 		VTY_NEWLINE);
 	vty_out(vty, " paging lifetime %u%s", paging_get_lifetime(btsb->paging_state),
@@ -268,6 +277,20 @@ static void config_write_bts_single(struct vty *vty, struct gsm_bts *bts)
 			btsb->agch_queue_thresh_level, btsb->agch_queue_low_level,
 			btsb->agch_queue_high_level, VTY_NEWLINE);
 
+	for (i = 0; i < _NUM_RACH_CAUSE; i++) {
+		const struct rach_adm_bucket *b = &btsb->rach_adm.bucket[i];
+		if (b->rate)
+			vty_out(vty, " rach admission cause %s rate %u burst %u%s",
+				get_value_string(rach_adm_cause_names, i),
+				b->rate, b->burst, VTY_NEWLINE);
+	}
+	if (btsb->rach_adm.load_thresh)
+		vty_out(vty, " rach admission load-threshold %u%s",
+			btsb->rach_adm.load_thresh, VTY_NEWLINE);
+	if (btsb->rach_adm.wait_ind != RACH_ADM_WAIT_IND_DEFAULT)
+		vty_out(vty, " rach admission wait-indication %u%s",
+			btsb->rach_adm.wait_ind, VTY_NEWLINE);
+
 	for (i = 0; i < 32; i++) {
 		if (gsmtap_sapi_mask & (1 << i)) {
 			osmo_str2lower(buf_casecnvt, get_value_string(gsmtap_sapi_names, i));
@@ -284,6 +307,10 @@ static void config_write_bts_single(struct vty *vty, struct gsm_bts *bts)
 		VTY_NEWLINE);
 	if (strcmp(btsb->pcu.sock_path, PCU_SOCK_DEFAULT))
 		vty_out(vty, " pcu-socket %s%s", btsb->pcu.sock_path, VTY_NEWLINE);
+	if (btsb->pcu.queue_low != PCU_QUEUE_LOW_DEFAULT
+	    || btsb->pcu.queue_high != PCU_QUEUE_HIGH_DEFAULT)
+		vty_out(vty, " pcu-queue-mgmt low %u high %u%s",
+			btsb->pcu.queue_low, btsb->pcu.queue_high, VTY_NEWLINE);
 
 	bts_model_config_write_bts(vty, bts);
 
@@ -479,11 +506,114 @@ DEFUN(cfg_bts_rtp_jitbuf,
 	return CMD_SUCCESS;
 }
 
+DEFUN(cfg_bts_rtp_jitbuf_bts,
+	cfg_bts_rtp_jitbuf_bts_cmd,
+	"rtp bts-jitter-buffer",
+	RTP_STR "Buffer downlink frames in the BTS, adapting to the measured jitter "
+	"if the jitter-buffer is adaptive\n")
+{
+	struct gsm_bts *bts = vty->index;
+	struct gsm_bts_role_bts *btsb = bts_role_bts(bts);
+
+	btsb->rtp_jitter_bts = true;
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_bts_no_rtp_jitbuf_bts,
+	cfg_bts_no_rtp_jitbuf_bts_cmd,
+	"no rtp bts-jitter-buffer",
+	NO_STR RTP_STR "Buffer downlink frames in the RTP library\n")
+{
+	struct gsm_bts *bts = vty->index;
+	struct gsm_bts_role_bts *btsb = bts_role_bts(bts);
+
+	btsb->rtp_jitter_bts = false;
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_bts_rtp_batch_egress,
+	cfg_bts_rtp_batch_egress_cmd,
+	"rtp batch-egress",
+	RTP_STR "Send uplink frames of all lchans in batches on a raw socket "
+	"(needs CAP_NET_RAW)\n")
+{
+	struct gsm_bts *bts = vty->index;
+	struct gsm_bts_role_bts *btsb = bts_role_bts(bts);
+
+	btsb->rtp_egress_batch = true;
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_bts_no_rtp_batch_egress,
+	cfg_bts_no_rtp_batch_egress_cmd,
+	"no rtp batch-egress",
+	NO_STR RTP_STR "Send uplink frames through the RTP library\n")
+{
+	struct gsm_bts *bts = vty->index;
+	struct gsm_bts_role_bts *btsb = bts_role_bts(bts);
+
+	btsb->rtp_egress_batch = false;
+
+	return CMD_SUCCESS;
+}
+
+#define TRACE_STR "Binary tracing of the L1 hot paths\n"
+#define TRACE_CLASS_STR "L1SAP primitives\n" "Scheduler bursts\n"
+
+static int trace_class(const char *name)
+{
+	return !strcmp(name, "l1sap") ? BTS_TRACE_L1SAP : BTS_TRACE_SCHED;
+}
+
+DEFUN(cfg_bts_trace,
+	cfg_bts_trace_cmd,
+	"trace (l1sap|sched)",
+	TRACE_STR TRACE_CLASS_STR)
+{
+#ifndef HAVE_BTS_TRACE
+	vty_out(vty, "%% built with --disable-bts-trace, ignoring%s",
+		VTY_NEWLINE);
+#endif
+	bts_trace_mask |= 1 << trace_class(argv[0]);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_bts_no_trace,
+	cfg_bts_no_trace_cmd,
+	"no trace (l1sap|sched)",
+	NO_STR TRACE_STR TRACE_CLASS_STR)
+{
+	bts_trace_mask &= ~(1 << trace_class(argv[0]));
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(trace_dump,
+	trace_dump_cmd,
+	"trace dump FILE",
+	TRACE_STR "Write the trace records of all threads to a file\n"
+	"File name\n")
+{
+	int rc = bts_trace_dump(argv[0]);
+
+	if (rc < 0) {
+		vty_out(vty, "%% cannot write %s: %s%s", argv[0],
+			strerror(-rc), VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	return CMD_SUCCESS;
+}
+
 #define PAG_STR "Paging related parameters\n"
 
 DEFUN(cfg_bts_paging_queue_size,
 	cfg_bts_paging_queue_size_cmd,
-	"paging queue-size <1-1024>",
+	"paging queue-size <1-65535>",
 	PAG_STR "Maximum length of BTS-internal paging queue\n"
 	        "Maximum length of BTS-internal paging queue\n")
 {
@@ -545,6 +675,68 @@ DEFUN(cfg_bts_agch_queue_mgmt_default,
 	return CMD_SUCCESS;
 }
 
+#define RACH_ADM_STR "RACH related parameters\n" \
+		     "Local admission control of RR access requests\n"
+#define RACH_CAUSE_STR "Limit an establishment cause\n" \
+		       "Emergency calls\n" \
+		       "Originating calls and call re-establishment\n" \
+		       "Answers to paging\n" \
+		       "Location updating\n" \
+		       "Data calls and other procedures (SMS, SS)\n"
+
+DEFUN(cfg_bts_rach_adm_cause, cfg_bts_rach_adm_cause_cmd,
+	"rach admission cause (emergency|call|paging|lu|data) rate <1-1000> burst <1-1000>",
+	RACH_ADM_STR RACH_CAUSE_STR
+	"Rate of admitted requests\n" "Requests per second\n"
+	"Number of requests admitted back to back\n" "Requests\n")
+{
+	struct gsm_bts *bts = vty->index;
+
+	rach_adm_set_bucket(bts, get_string_value(rach_adm_cause_names, argv[0]),
+			    atoi(argv[1]), atoi(argv[2]));
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_bts_no_rach_adm_cause, cfg_bts_no_rach_adm_cause_cmd,
+	"no rach admission cause (emergency|call|paging|lu|data)",
+	NO_STR RACH_ADM_STR RACH_CAUSE_STR)
+{
+	struct gsm_bts *bts = vty->index;
+
+	rach_adm_set_bucket(bts, get_string_value(rach_adm_cause_names, argv[0]), 0, 0);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_bts_rach_adm_load_thresh, cfg_bts_rach_adm_load_thresh_cmd,
+	"rach admission load-threshold <0-100>",
+	RACH_ADM_STR
+	"Only limit requests while the RACH load is at or above a threshold\n"
+	"RACH load in percent (as in the CCCH LOAD INDICATION)\n")
+{
+	struct gsm_bts *bts = vty->index;
+	struct gsm_bts_role_bts *btsb = bts_role_bts(bts);
+
+	btsb->rach_adm.load_thresh = atoi(argv[0]);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_bts_rach_adm_wait_ind, cfg_bts_rach_adm_wait_ind_cmd,
+	"rach admission wait-indication <0-255>",
+	RACH_ADM_STR
+	"Wait indication of the IMMEDIATE ASSIGNMENT REJECT sent to rejected MS\n"
+	"T3122 in seconds\n")
+{
+	struct gsm_bts *bts = vty->index;
+	struct gsm_bts_role_bts *btsb = bts_role_bts(bts);
+
+	btsb->rach_adm.wait_ind = atoi(argv[0]);
+
+	return CMD_SUCCESS;
+}
+
 DEFUN(cfg_bts_ul_power_target, cfg_bts_ul_power_target_cmd,
 	"uplink-power-target <-110-0>",
 	"Set the nominal target Rx Level for uplink power control loop\n"
@@ -601,6 +793,46 @@ DEFUN(cfg_bts_pcu_sock, cfg_bts_pcu_sock_cmd,
 	return CMD_SUCCESS;
 }
 
+#define PCU_QUEUE_STR "Queue of messages to the PCU\n"
+
+DEFUN(cfg_bts_pcu_queue_mgmt, cfg_bts_pcu_queue_mgmt_cmd,
+	"pcu-queue-mgmt low <1-16384> high <1-16384>",
+	PCU_QUEUE_STR
+	"Low watermark, below which the PCU is no longer congested\n"
+	"in messages\n"
+	"High watermark, above which TIME.ind and RTS.req are dropped\n"
+	"in messages\n")
+{
+	struct gsm_bts *bts = vty->index;
+	struct gsm_bts_role_bts *btsb = bts_role_bts(bts);
+	unsigned int low = atoi(argv[0]), high = atoi(argv[1]);
+
+	if (low >= high) {
+		vty_out(vty, "%% The low watermark must be below the high "
+			"one%s", VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	btsb->pcu.queue_low = low;
+	btsb->pcu.queue_high = high;
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_bts_pcu_queue_mgmt_default, cfg_bts_pcu_queue_mgmt_default_cmd,
+	"pcu-queue-mgmt default",
+	PCU_QUEUE_STR
+	"Reset the watermarks to their default values\n")
+{
+	struct gsm_bts *bts = vty->index;
+	struct gsm_bts_role_bts *btsb = bts_role_bts(bts);
+
+	btsb->pcu.queue_low = PCU_QUEUE_LOW_DEFAULT;
+	btsb->pcu.queue_high = PCU_QUEUE_HIGH_DEFAULT;
+
+	return CMD_SUCCESS;
+}
+
 
 #define DB_DBM_STR 							\
 	"Unit is dB (decibels)\n"					\
@@ -731,6 +963,7 @@ static unsigned int llist_length(struct llist_head *list)
 static void bts_dump_vty(struct vty *vty, struct gsm_bts *bts)
 {
 	struct gsm_bts_role_bts *btsb = bts->role;
+	const struct pcu_sock_stats *pcu_stats;
 	struct gsm_bts_trx *trx;
 
 	vty_out(vty, "BTS %u is of %s type in band %s, has CI %u LAC %u, "
@@ -751,6 +984,19 @@ static void bts_dump_vty(struct vty *vty, struct gsm_bts *bts)
 	if (strnlen(bts->pcu_version, MAX_VERSION_LENGTH))
 		vty_out(vty, "  PCU version %s connected%s",
 			bts->pcu_version, VTY_NEWLINE);
+	pcu_stats = pcu_sock_get_stats(bts);
+	if (pcu_stats) {
+		vty_out(vty, "  PCU socket %s: queue %u (max %u, low %u, "
+			"high %u)%s, write latency avg %"PRIu64" max %"PRIu32
+			" us%s", btsb->pcu.sock_path, pcu_stats->queue_len,
+			pcu_stats->queue_max, btsb->pcu.queue_low,
+			btsb->pcu.queue_high,
+			pcu_stats->congested ? " congested" : "",
+			pcu_stats->lat_num ?
+				pcu_stats->lat_sum_us / pcu_stats->lat_num : 0,
+			pcu_stats->lat_max_us, VTY_NEWLINE);
+		vty_out_rate_ctr_group(vty, "    ", pcu_stats->ctrs);
+	}
 	vty_out(vty, "  Paging: Queue size %u, occupied %u, lifetime %us%s",
 		paging_get_queue_max(btsb->paging_state), paging_queue_length(btsb->paging_state),
 		paging_get_lifetime(btsb->paging_state), VTY_NEWLINE);
@@ -762,6 +1008,22 @@ static void bts_dump_vty(struct vty *vty, struct gsm_bts *bts)
 		btsb->agch_queue_rejected_msgs, btsb->agch_queue_agch_msgs,
 		btsb->agch_queue_pch_msgs,
 		VTY_NEWLINE);
+	vty_out(vty, "  RACH: load %u%%, admission control above %u%%%s",
+		btsb->load.rach.percent, btsb->rach_adm.load_thresh, VTY_NEWLINE);
+	if (btsb->rach_adm.ctrs)
+		vty_out_rate_ctr_group(vty, "    ", btsb->rach_adm.ctrs);
+	if (btsb->rtp_egress_batch && rtp_egress_unavailable())
+		vty_out(vty, "  RTP egress: unavailable (no CAP_NET_RAW?), "
+			"using the RTP library%s", VTY_NEWLINE);
+	else if (btsb->rtp_egress_batch) {
+		const struct rtp_egress_stats *es = rtp_egress_get_stats();
+		vty_out(vty, "  RTP egress: frames %"PRIu64", batches %"PRIu64", "
+			"sendmmsg %"PRIu64", errors %"PRIu64", latency avg %"PRIu64"us, "
+			"max %"PRIu64"us%s",
+			es->frames, es->batches, es->syscalls, es->errors,
+			es->frames ? es->latency_us_total / es->frames : 0,
+			es->latency_us_max, VTY_NEWLINE);
+	}
 	vty_out(vty, "  CBCH backlog queue length: %u%s",
 		llist_length(&btsb->smscb_state.queue), VTY_NEWLINE);
 	vty_out(vty, "  Paging: queue length %d, buffer space %d%s",
@@ -808,6 +1070,51 @@ DEFUN(show_bts, show_bts_cmd, "show bts <0-255>",
 	return CMD_SUCCESS;
 }
 
+DEFUN(show_bts_paging, show_bts_paging_cmd, "show bts <0-255> paging",
+	SHOW_STR "Display information about a BTS\n"
+		"BTS number\n"
+		"Paging efficiency, queue occupancy and expiry per paging group\n")
+{
+	struct gsm_network *net = gsmnet_from_vty(vty);
+	struct gsm_bts_role_bts *btsb;
+	const struct paging_pack_stats *pack;
+	struct gsm_bts *bts;
+	unsigned int i, num;
+	int bts_nr = atoi(argv[0]);
+
+	if (bts_nr >= net->num_bts) {
+		vty_out(vty, "%% can't find BTS '%s'%s", argv[0], VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+	bts = gsm_bts_num(net, bts_nr);
+	btsb = bts_role_bts(bts);
+
+	vty_out(vty, "BTS %u paging: queue size %u, occupied %u, lifetime %us%s",
+		bts->nr, paging_get_queue_max(btsb->paging_state),
+		paging_queue_length(btsb->paging_state),
+		paging_get_lifetime(btsb->paging_state), VTY_NEWLINE);
+
+	pack = paging_get_pack_stats(btsb->paging_state);
+	vty_out(vty, "  Efficiency: %"PRIu64" identities in %"PRIu64" blocks (%.2f per block), "
+		"Type 1 %"PRIu64", Type 2 %"PRIu64", Type 3 %"PRIu64"%s",
+		pack->identities, pack->blocks,
+		pack->blocks ? (double) pack->identities / pack->blocks : 0.0,
+		pack->type[0], pack->type[1], pack->type[2], VTY_NEWLINE);
+
+	num = paging_num_groups(btsb->paging_state);
+	for (i = 0; i < num; i++) {
+		const struct paging_group_stats *st;
+
+		st = paging_get_group_stats(btsb->paging_state, i);
+		if (!st)
+			break;
+		vty_out(vty, "  Group %2u: queued %u, expired %"PRIu64"%s",
+			i, st->queued, st->expired, VTY_NEWLINE);
+	}
+
+	return CMD_SUCCESS;
+}
+
 static struct gsm_lchan *resolve_lchan(struct gsm_network *net,
 					const char **argv, int idx)
 {
@@ -1001,6 +1308,12 @@ DEFUN(bts_t_t_l_jitter_buf,
 		return CMD_WARNING;
 	}
 	btsb = bts_role_bts(lchan->ts->trx->bts);
+	if (!(lchan->abis_ip.rtp_socket->flags & OSMO_RTP_F_POLL)) {
+		dl_tch_ring_set_max_depth(&lchan->dl_tch_ring, jitbuf_ms / 20);
+		vty_out(vty, "%% playout buffer set to %u frames%s",
+			lchan->dl_tch_ring.max_depth, VTY_NEWLINE);
+		return CMD_SUCCESS;
+	}
 	rc = osmo_rtp_socket_set_param(lchan->abis_ip.rtp_socket,
 				  btsb->rtp_jitter_adaptive ?
 				  OSMO_RTP_P_JIT_ADAP : OSMO_RTP_P_JITBUF,
@@ -1067,6 +1380,7 @@ int bts_vty_init(struct gsm_bts *bts, const struct log_info *cat)
 						"\n", "", 0);
 
 	install_element_ve(&show_bts_cmd);
+	install_element_ve(&show_bts_paging_cmd);
 
 	logging_vty_add_cmds(cat);
 
@@ -1077,6 +1391,12 @@ int bts_vty_init(struct gsm_bts *bts, const struct log_info *cat)
 	install_element(BTS_NODE, &cfg_bts_oml_ip_cmd);
 	install_element(BTS_NODE, &cfg_bts_rtp_bind_ip_cmd);
 	install_element(BTS_NODE, &cfg_bts_rtp_jitbuf_cmd);
+	install_element(BTS_NODE, &cfg_bts_rtp_jitbuf_bts_cmd);
+	install_element(BTS_NODE, &cfg_bts_no_rtp_jitbuf_bts_cmd);
+	install_element(BTS_NODE, &cfg_bts_rtp_batch_egress_cmd);
+	install_element(BTS_NODE, &cfg_bts_no_rtp_batch_egress_cmd);
+	install_element(BTS_NODE, &cfg_bts_trace_cmd);
+	install_element(BTS_NODE, &cfg_bts_no_trace_cmd);
 	install_element(BTS_NODE, &cfg_bts_band_cmd);
 	install_element(BTS_NODE, &cfg_description_cmd);
 	install_element(BTS_NODE, &cfg_no_description_cmd);
@@ -1084,10 +1404,16 @@ int bts_vty_init(struct gsm_bts *bts, const struct log_info *cat)
 	install_element(BTS_NODE, &cfg_bts_paging_lifetime_cmd);
 	install_element(BTS_NODE, &cfg_bts_agch_queue_mgmt_default_cmd);
 	install_element(BTS_NODE, &cfg_bts_agch_queue_mgmt_params_cmd);
+	install_element(BTS_NODE, &cfg_bts_rach_adm_cause_cmd);
+	install_element(BTS_NODE, &cfg_bts_no_rach_adm_cause_cmd);
+	install_element(BTS_NODE, &cfg_bts_rach_adm_load_thresh_cmd);
+	install_element(BTS_NODE, &cfg_bts_rach_adm_wait_ind_cmd);
 	install_element(BTS_NODE, &cfg_bts_ul_power_target_cmd);
 	install_element(BTS_NODE, &cfg_bts_min_qual_rach_cmd);
 	install_element(BTS_NODE, &cfg_bts_min_qual_norm_cmd);
 	install_element(BTS_NODE, &cfg_bts_pcu_sock_cmd);
+	install_element(BTS_NODE, &cfg_bts_pcu_queue_mgmt_cmd);
+	install_element(BTS_NODE, &cfg_bts_pcu_queue_mgmt_default_cmd);
 
 	install_element(BTS_NODE, &cfg_trx_gsmtap_sapi_cmd);
 	install_element(BTS_NODE, &cfg_trx_no_gsmtap_sapi_cmd);
@@ -1106,6 +1432,7 @@ int bts_vty_init(struct gsm_bts *bts, const struct log_info *cat)
 	install_element(ENABLE_NODE, &bts_t_t_l_jitter_buf_cmd);
 	install_element(ENABLE_NODE, &bts_t_t_l_loopback_cmd);
 	install_element(ENABLE_NODE, &no_bts_t_t_l_loopback_cmd);
+	install_element(ENABLE_NODE, &trace_dump_cmd);
 
 	install_element(CONFIG_NODE, &cfg_phy_cmd);
 	install_node(&phy_node, config_write_phy);
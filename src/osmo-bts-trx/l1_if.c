@@ -42,6 +42,7 @@
 
 #include "l1_if.h"
 #include "trx_if.h"
+#include "trx_worker.h"
 
 
 static const uint8_t transceiver_chan_types[_GSM_PCHAN_MAX] = {
@@ -118,6 +119,8 @@ int bts_model_lchan_deactivate(struct gsm_lchan *lchan)
 	/* set lchan inactive */
 	lchan_set_state(lchan, LCHAN_S_NONE);
 
+	/* complete the frames still being decoded first */
+	trx_worker_sync_lchan(l1h->worker, gsm_lchan2chan_nr(lchan));
 	return trx_sched_set_lchan(&l1h->l1s, gsm_lchan2chan_nr(lchan),
 				   LID_DEDIC, 0);
 }
@@ -126,6 +129,8 @@ int bts_model_lchan_deactivate_sacch(struct gsm_lchan *lchan)
 {
 	struct phy_instance *pinst = trx_phy_instance(lchan->ts->trx);
 	struct trx_l1h *l1h = pinst->u.osmotrx.hdl;
+
+	trx_worker_sync_lchan(l1h->worker, gsm_lchan2chan_nr(lchan));
 	return trx_sched_set_lchan(&l1h->l1s, gsm_lchan2chan_nr(lchan),
 				   LID_SACCH, 0);
 }
@@ -267,6 +272,7 @@ int bts_model_trx_close(struct gsm_bts_trx *trx)
 	enum gsm_phys_chan_config pchan = trx->ts[0].pchan;
 
 	/* close all logical channels and reset timeslots */
+	trx_worker_sync(l1h->worker);
 	trx_sched_reset(&l1h->l1s);
 
 	/* deactivate lchan for CCCH */
@@ -284,6 +290,10 @@ int bts_model_trx_close(struct gsm_bts_trx *trx)
 	/* Set to Operational State: Disabled */
 	check_transceiver_availability_trx(l1h, 0);
 
+	/* the BCCH carrier is gone, the clock thread (if any) is done */
+	if (trx == trx->bts->c0)
+		trx_sched_clock_thread_stop(pinst->phy_link);
+
 	return 0;
 }
 
@@ -377,6 +387,7 @@ static uint8_t trx_set_ts_as_pchan(struct gsm_bts_trx_ts *ts,
 	 * decided on a more specific PCHAN type already. */
 	OSMO_ASSERT(pchan != GSM_PCHAN_TCH_F_PDCH);
 	OSMO_ASSERT(pchan != GSM_PCHAN_TCH_F_TCH_H_PDCH);
+	trx_worker_sync_ts(l1h->worker, tn);
 	rc = trx_sched_set_pchan(&l1h->l1s, tn, pchan);
 	if (rc)
 		return NM_NACK_RES_NOTAVAIL;
@@ -538,6 +549,8 @@ int bts_model_l1sap_down(struct gsm_bts_trx *trx, struct osmo_phsap_prim *l1sap)
 	case OSMO_PRIM(PRIM_PH_DATA, PRIM_OP_REQUEST):
 		if (!msg)
 			break;
+		/* have the worker encode it ahead of its FN, if possible */
+		trx_worker_post_dl(l1h->worker, l1sap);
 		/* put data into scheduler's queue */
 		return trx_sched_ph_data_req(&l1h->l1s, l1sap);
 	case OSMO_PRIM(PRIM_TCH, PRIM_OP_REQUEST):
@@ -560,6 +573,9 @@ int bts_model_l1sap_down(struct gsm_bts_trx *trx, struct osmo_phsap_prim *l1sap)
 		case PRIM_INFO_MODIFY:
 			chan_nr = l1sap->u.info.u.act_req.chan_nr;
 			lchan = get_lchan_by_chan_nr(trx, chan_nr);
+			/* complete the frames of this lchan still being
+			 * decoded with the old config, others go on */
+			trx_worker_sync_lchan(l1h->worker, chan_nr);
 			if (l1sap->u.info.type == PRIM_INFO_ACTIVATE) {
 				if ((chan_nr & 0xE0) == 0x80) {
 					LOGP(DL1C, LOGL_ERROR, "Cannot activate"
@@ -45,6 +45,13 @@ struct trx_config {
 	int			slottype_sent[TRX_NR_TS];
 };
 
+/* DL bursts collected for one FN, flushed at once by trx_if_flush_bursts() */
+struct trx_burst_batch {
+	uint8_t			buf[TRX_NR_TS][TRX_MAX_BURST_LEN];
+	uint16_t		len[TRX_NR_TS];
+	unsigned int		num;		/* number of bursts in buf */
+};
+
 struct trx_l1h {
 	struct llist_head	trx_ctrl_list;
 	/* Latest RSPed cmd, used to catch duplicate RSPs from sent retransmissions */
@@ -57,6 +64,28 @@ struct trx_l1h {
 	struct osmo_timer_list	trx_ctrl_timer;
 	struct osmo_fd		trx_ofd_data;
 
+	/* worker thread running the channel coding (NULL: main thread) */
+	struct trx_worker	*worker;
+	/* CPU to pin the worker to, -1 for none */
+	int			worker_cpu;
+
+	/* burst batch for TX */
+	struct trx_burst_batch	tx_batch;
+	/* sendmmsg() turned out to be unsupported, don't batch (run time
+	 * state, unlike the burst-batching option) */
+	bool			tx_batch_unsupported;
+	struct {
+		uint64_t	bursts;		/* bursts sent to transceiver */
+		uint64_t	syscalls;	/* send()/sendmmsg() calls used */
+		uint64_t	saved;		/* send() calls saved by batching */
+	} tx_stats;
+	struct {
+		uint64_t	bursts;		/* bursts received from transceiver */
+		uint64_t	wakeups;	/* read callbacks on data socket */
+		/* number of wakeups by bursts read (index 0 = nothing read) */
+		uint64_t	batch_hist[TRX_RX_BATCH_MAX + 1];
+	} rx_stats;
+
 	/* transceiver config */
 	struct trx_config	config;
 	uint8_t			ho_rach_detect[TRX_NR_TS][TS_MAX_LCHAN];
@@ -73,6 +102,41 @@ void l1if_fill_meas_res(struct osmo_phsap_prim *l1sap, uint8_t chan_nr, float ta
 int l1if_process_meas_res(struct gsm_bts_trx *trx, uint8_t tn, uint32_t fn, uint8_t chan_nr,
 	int n_errors, int n_bits_total, float rssi, float toa);
 
+/* scheduler_trx.c: compose and send the DL bursts of all TRX for one FN */
+int trx_sched_fn(struct gsm_bts *bts, uint32_t fn);
+/* scheduler_trx.c: compose and send the DL bursts of one TRX for one FN */
+void trx_sched_fn_dl(struct trx_l1h *l1h, uint32_t fn);
+
+/* histogram of clock measurements, bucket i counts values < bounds[i],
+ * the last bucket counts everything above */
+#define TRX_CLK_HIST_MAX	8
+struct trx_clk_hist {
+	const char	*name;
+	unsigned int	num;			/* number of buckets */
+	const int	*bounds;		/* num - 1 upper bounds */
+	uint64_t	count[TRX_CLK_HIST_MAX];
+};
+
+/* telemetry of the TRX frame clock */
+struct trx_clk_stats {
+	struct trx_clk_hist	jitter;		/* |timer error| per FN timer expiry, us,
+						 * as seen when the frames are processed */
+	struct trx_clk_hist	latency;	/* clock thread event to processing, us */
+	struct trx_clk_hist	catchup;	/* FN caught up per clock indication */
+	struct trx_clk_hist	drift;		/* local - TRX clock per clock indication, us */
+	uint64_t		timer_missed;	/* FN timer expirations we were too late for */
+	uint64_t		skew_resets;	/* clock reset due to exceeding MAX_FN_SKEW */
+	uint64_t		evt_dropped;	/* clock thread events the main thread missed */
+};
+
+/* scheduler_trx.c: TRX frame clock */
+const struct trx_clk_stats *trx_sched_clock_stats(void);
+int trx_sched_clock_at(struct gsm_bts *bts, uint32_t fn, const struct timespec *tv);
+int trx_sched_clock_thread_start(struct phy_link *plink);
+void trx_sched_clock_thread_stop(struct phy_link *plink);
+int trx_clk_hist_fmt(char *buf, size_t len, const struct trx_clk_hist *h,
+		     unsigned int i);
+
 static inline struct l1sched_trx *trx_l1sched_hdl(struct gsm_bts_trx *trx)
 {
 	struct phy_instance *pinst = trx->role_bts.l1h;
@@ -58,6 +58,7 @@
 
 #include "l1_if.h"
 #include "trx_if.h"
+#include "sbits.h"
 
 /* dummy, since no direct dsp support */
 uint32_t trx_get_hlayer1(struct gsm_bts_trx *trx)
@@ -111,6 +112,10 @@ int bts_model_init(struct gsm_bts *bts)
 
 	bts_model_vty_init(bts);
 
+	trx_sbits_init();
+	LOGP(DL1C, LOGL_INFO, "Using %s soft-bit conversion\n",
+	     trx_sbits_impl_name);
+
 	return 0;
 }
 
@@ -125,6 +130,9 @@ void bts_model_phy_link_set_defaults(struct phy_link *plink)
 	plink->u.osmotrx.trx_ta_loop = true;
 	plink->u.osmotrx.trx_ms_power_loop = false;
 	plink->u.osmotrx.trx_target_rssi = -10;
+	plink->u.osmotrx.burst_batching = true;
+	plink->u.osmotrx.rx_batch_max = TRX_RX_BATCH_DEFAULT;
+	plink->u.osmotrx.clock_thread_cpu = -1;
 }
 
 void bts_model_phy_instance_set_defaults(struct phy_instance *pinst)
@@ -135,6 +143,7 @@ void bts_model_phy_instance_set_defaults(struct phy_instance *pinst)
 	pinst->u.osmotrx.hdl = l1h;
 
 	l1h->config.power_oml = 1;
+	l1h->worker_cpu = -1;
 }
 
 int main(int argc, char **argv)
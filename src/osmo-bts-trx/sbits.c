@@ -0,0 +1,165 @@
+/* Soft-bit conversion of TRX uplink bursts for OsmoBTS-TRX */
+
+/* All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdint.h>
+
+#include <osmocom/core/bits.h>
+
+#include "sbits.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#if defined(__arm__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
+/* The TRX sends soft-bits as unsigned values {254..0}, where 0 is a
+ * certain '1' and 254 a certain '0'.  We need them as sbit_t
+ * {-127..127}, i.e. 127 - x.  The value 255 is mapped to -127 as well.
+ *
+ * For x in 0..254, 127 - x equals (x ^ 0x7f) interpreted as signed, and
+ * 255 ^ 0x7f would be -128.  So all vector variants simply clamp the
+ * input to 254 and XOR it with 0x7f, which gives the very same result
+ * as the scalar loop. */
+
+/*! portable reference implementation */
+void trx_sbits_conv_scalar(sbit_t *out, const uint8_t *in, unsigned int len)
+{
+	unsigned int i;
+
+	for (i = 0; i < len; i++) {
+		if (in[i] == 255)
+			out[i] = -127;
+		else
+			out[i] = 127 - in[i];
+	}
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+void trx_sbits_conv_sse2(sbit_t *out, const uint8_t *in, unsigned int len)
+{
+	const __m128i max = _mm_set1_epi8((char) 254);
+	const __m128i mask = _mm_set1_epi8(0x7f);
+	unsigned int i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (in + i));
+		v = _mm_xor_si128(_mm_min_epu8(v, max), mask);
+		_mm_storeu_si128((__m128i *) (out + i), v);
+	}
+
+	trx_sbits_conv_scalar(out + i, in + i, len - i);
+}
+
+__attribute__((target("avx2")))
+void trx_sbits_conv_avx2(sbit_t *out, const uint8_t *in, unsigned int len)
+{
+	const __m256i max = _mm256_set1_epi8((char) 254);
+	const __m256i mask = _mm256_set1_epi8(0x7f);
+	unsigned int i;
+
+	for (i = 0; i + 32 <= len; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *) (in + i));
+		v = _mm256_xor_si256(_mm256_min_epu8(v, max), mask);
+		_mm256_storeu_si256((__m256i *) (out + i), v);
+	}
+
+	trx_sbits_conv_scalar(out + i, in + i, len - i);
+}
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+void trx_sbits_conv_neon(sbit_t *out, const uint8_t *in, unsigned int len)
+{
+	const uint8x16_t max = vdupq_n_u8(254);
+	const uint8x16_t mask = vdupq_n_u8(0x7f);
+	unsigned int i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		uint8x16_t v = vld1q_u8(in + i);
+		v = veorq_u8(vminq_u8(v, max), mask);
+		vst1q_s8(out + i, vreinterpretq_s8_u8(v));
+	}
+
+	trx_sbits_conv_scalar(out + i, in + i, len - i);
+}
+#endif
+
+int trx_sbits_have_sse2(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_cpu_supports("sse2");
+#else
+	return 0;
+#endif
+}
+
+int trx_sbits_have_avx2(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_cpu_supports("avx2");
+#else
+	return 0;
+#endif
+}
+
+int trx_sbits_have_neon(void)
+{
+#if defined(__aarch64__)
+	return 1;
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	return !!(getauxval(AT_HWCAP) & HWCAP_NEON);
+#else
+	return 0;
+#endif
+}
+
+trx_sbits_conv_func *trx_sbits_conv = trx_sbits_conv_scalar;
+const char *trx_sbits_impl_name = "scalar";
+
+/*! select the fastest implementation supported by the CPU we run on */
+void trx_sbits_init(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (trx_sbits_have_avx2()) {
+		trx_sbits_conv = trx_sbits_conv_avx2;
+		trx_sbits_impl_name = "avx2";
+		return;
+	}
+	if (trx_sbits_have_sse2()) {
+		trx_sbits_conv = trx_sbits_conv_sse2;
+		trx_sbits_impl_name = "sse2";
+		return;
+	}
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+	if (trx_sbits_have_neon()) {
+		trx_sbits_conv = trx_sbits_conv_neon;
+		trx_sbits_impl_name = "neon";
+		return;
+	}
+#endif
+}
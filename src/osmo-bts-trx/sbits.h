@@ -0,0 +1,32 @@
+#ifndef _TRX_SBITS_H
+#define _TRX_SBITS_H
+
+#include <stdint.h>
+#include <osmocom/core/bits.h>
+
+/*
+ * conversion of TRX soft-bits {254..0} (255 = -127) to sbits {-127..127}
+ */
+
+typedef void trx_sbits_conv_func(sbit_t *out, const uint8_t *in, unsigned int len);
+
+/* currently selected implementation, set up by trx_sbits_init() */
+extern trx_sbits_conv_func *trx_sbits_conv;
+extern const char *trx_sbits_impl_name;
+
+void trx_sbits_init(void);
+
+/* individual implementations, for testing */
+void trx_sbits_conv_scalar(sbit_t *out, const uint8_t *in, unsigned int len);
+#if defined(__x86_64__) || defined(__i386__)
+void trx_sbits_conv_sse2(sbit_t *out, const uint8_t *in, unsigned int len);
+void trx_sbits_conv_avx2(sbit_t *out, const uint8_t *in, unsigned int len);
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+void trx_sbits_conv_neon(sbit_t *out, const uint8_t *in, unsigned int len);
+#endif
+int trx_sbits_have_sse2(void);
+int trx_sbits_have_avx2(void);
+int trx_sbits_have_neon(void);
+
+#endif /* _TRX_SBITS_H */
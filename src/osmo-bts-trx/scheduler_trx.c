@@ -20,13 +20,19 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *
  */
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
 #include <stdint.h>
 #include <ctype.h>
 #include <inttypes.h>
+#include <string.h>
+#include <poll.h>
+#include <sched.h>
+#include <pthread.h>
 #include <sys/timerfd.h>
+#include <sys/eventfd.h>
 
 #include <osmocom/core/msgb.h>
 #include <osmocom/core/talloc.h>
@@ -46,6 +52,8 @@
 #include "l1_if.h"
 #include "trx_if.h"
 #include "loops.h"
+#include "trx_worker.h"
+#include "spsc.h"
 
 extern void *tall_bts_ctx;
 
@@ -57,6 +65,10 @@ extern void *tall_bts_ctx;
 /* Maximum size of a EGPRS message in bytes */
 #define EGPRS_0503_MAX_BYTES		155
 
+/* PDTCH burst buffer in the TS pool must hold an EGPRS block */
+osmo_static_assert(L1SCHED_BURSTS_PDTCH == GSM0503_EGPRS_BURSTS_NBITS,
+		   pdtch_burst_buf_len);
+
 
 /* Compute the bit error rate in 1/10000 units */
 static inline uint16_t compute_ber10k(int n_bits_total, int n_errors)
@@ -142,10 +154,37 @@ ubit_t *tx_sch_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	return bits;
 }
 
+/*! \brief encode a DL block of a block interleaved channel
+ *
+ *  Nothing but \a data and \a bursts is accessed here, so this may run on
+ *  the worker thread of the TRX.
+ *  \returns number of bits encoded; negative on error */
+int trx_sched_dl_encode(enum trx_dl_kind kind, uint8_t *data, uint16_t len,
+			ubit_t *bursts)
+{
+	int rc;
+
+	switch (kind) {
+	case TRX_DL_XCCH:
+		if (len != GSM_MACBLOCK_LEN)
+			return -EINVAL;
+		gsm0503_xcch_encode(bursts, data);
+		return L1SCHED_BURSTS_XCCH;
+	case TRX_DL_PDTCH:
+		rc = gsm0503_pdtch_egprs_encode(bursts, data, len);
+		if (rc < 0)
+			rc = gsm0503_pdtch_encode(bursts, data, len);
+		return rc;
+	}
+
+	return -EINVAL;
+}
+
 /* obtain a to-be-transmitted data (SACCH/SDCCH) burst */
 ubit_t *tx_data_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	enum trx_chan_type chan, uint8_t bid, uint16_t *nbits)
 {
+	struct trx_l1h *l1h = container_of(l1t, struct trx_l1h, l1s);
 	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
 	struct gsm_bts_trx_ts *ts = &l1t->trx->ts[tn];
 	uint8_t link_id = trx_chan_desc[chan].link_id;
@@ -173,11 +212,8 @@ ubit_t *tx_data_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	LOGL1S(DL1P, LOGL_INFO, l1t, tn, chan, fn, "No prim for transmit.\n");
 
 no_msg:
-	/* free burst memory */
-	if (*bursts_p) {
-		talloc_free(*bursts_p);
-		*bursts_p = NULL;
-	}
+	/* release burst memory */
+	*bursts_p = NULL;
 	return NULL;
 
 got_msg:
@@ -209,15 +245,13 @@ got_msg:
 		}
 	}
 
-	/* allocate burst memory, if not already */
-	if (!*bursts_p) {
-		*bursts_p = talloc_zero_size(tall_bts_ctx, 464);
-		if (!*bursts_p)
-			return NULL;
-	}
+	/* claim burst memory, if not already */
+	if (!*bursts_p)
+		*bursts_p = _sched_dl_bursts_claim(&l1ts->chan_state[chan]);
 
-	/* encode bursts */
-	gsm0503_xcch_encode(*bursts_p, msg->l2h);
+	/* encode bursts, unless the worker has done so already */
+	if (trx_worker_fetch_dl(l1h->worker, msg, TRX_DL_XCCH, *bursts_p) < 0)
+		gsm0503_xcch_encode(*bursts_p, msg->l2h);
 
 	/* free message */
 	msgb_free(msg);
@@ -243,6 +277,7 @@ send_burst:
 ubit_t *tx_pdtch_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	enum trx_chan_type chan, uint8_t bid, uint16_t *nbits)
 {
+	struct trx_l1h *l1h = container_of(l1t, struct trx_l1h, l1s);
 	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
 	struct gsm_bts_trx_ts *ts = &l1t->trx->ts[tn];
 	struct msgb *msg = NULL; /* make GCC happy */
@@ -266,28 +301,22 @@ ubit_t *tx_pdtch_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	LOGL1S(DL1P, LOGL_INFO, l1t, tn, chan, fn, "No prim for transmit.\n");
 
 no_msg:
-	/* free burst memory */
-	if (*bursts_p) {
-		talloc_free(*bursts_p);
-		*bursts_p = NULL;
-	}
+	/* release burst memory */
+	*bursts_p = NULL;
 	return NULL;
 
 got_msg:
 	/* BURST BYPASS */
 
-	/* allocate burst memory, if not already */
-	if (!*bursts_p) {
-		*bursts_p = talloc_zero_size(tall_bts_ctx,
-					     GSM0503_EGPRS_BURSTS_NBITS);
-		if (!*bursts_p)
-			return NULL;
-	}
+	/* claim burst memory, if not already */
+	if (!*bursts_p)
+		*bursts_p = _sched_dl_bursts_claim(&l1ts->chan_state[chan]);
 
-	/* encode bursts */
-	rc = gsm0503_pdtch_egprs_encode(*bursts_p, msg->l2h, msg->tail - msg->l2h);
+	/* encode bursts, unless the worker has done so already */
+	rc = trx_worker_fetch_dl(l1h->worker, msg, TRX_DL_PDTCH, *bursts_p);
 	if (rc < 0)
-		rc = gsm0503_pdtch_encode(*bursts_p, msg->l2h, msg->tail - msg->l2h);
+		rc = trx_sched_dl_encode(TRX_DL_PDTCH, msg->l2h,
+					 msg->tail - msg->l2h, *bursts_p);
 
 	/* check validity of message */
 	if (rc < 0) {
@@ -555,12 +584,10 @@ ubit_t *tx_tchf_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 
 	/* BURST BYPASS */
 
-	/* allocate burst memory, if not already,
+	/* claim burst memory, if not already,
 	 * otherwise shift buffer by 4 bursts for interleaving */
 	if (!*bursts_p) {
-		*bursts_p = talloc_zero_size(tall_bts_ctx, 928);
-		if (!*bursts_p)
-			return NULL;
+		*bursts_p = _sched_dl_bursts_claim(chan_state);
 	} else {
 		memcpy(*bursts_p, *bursts_p + 464, 464);
 		memset(*bursts_p + 464, 0, 464);
@@ -643,12 +670,10 @@ ubit_t *tx_tchh_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 
 	/* BURST BYPASS */
 
-	/* allocate burst memory, if not already,
+	/* claim burst memory, if not already,
 	 * otherwise shift buffer by 2 bursts for interleaving */
 	if (!*bursts_p) {
-		*bursts_p = talloc_zero_size(tall_bts_ctx, 696);
-		if (!*bursts_p)
-			return NULL;
+		*bursts_p = _sched_dl_bursts_claim(chan_state);
 	} else {
 		memcpy(*bursts_p, *bursts_p + 232, 232);
 		if (chan_state->dl_ongoing_facch) {
@@ -755,6 +780,155 @@ int rx_rach_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	return 0;
 }
 
+/*! \brief decode a complete UL frame
+ *
+ *  Nothing but \a ctx, \a bursts and \a res is accessed here, so this may
+ *  run on the worker thread of the TRX. */
+void trx_sched_ul_decode(const struct trx_ul_ctx *ctx, const sbit_t *bursts,
+			 struct trx_ul_res *res)
+{
+	uint8_t codec[4];
+	int fn_is_odd;
+
+	res->rc = -EINVAL;
+	res->n_errors = 0;
+	res->n_bits_total = 0;
+	res->ul_ft = ctx->ul_ft;
+	res->ul_cmr = ctx->ul_cmr;
+	memcpy(codec, ctx->codec, sizeof(codec));
+
+	switch (ctx->kind) {
+	case TRX_UL_XCCH:
+		res->rc = gsm0503_xcch_decode(res->data, bursts, &res->n_errors,
+					      &res->n_bits_total);
+		break;
+	case TRX_UL_PDTCH:
+		/*
+		 * Attempt to decode EGPRS bursts first. For 8-PSK EGPRS this is all we
+		 * do. Attempt GPRS decoding on EGPRS failure. If the burst is GPRS,
+		 * then we incur decoding overhead of 31 bits on the Type 3 EGPRS
+		 * header, which is tolerable.
+		 */
+		res->rc = gsm0503_pdtch_egprs_decode(res->data, bursts, ctx->bursts_len,
+					NULL, &res->n_errors, &res->n_bits_total);
+
+		if ((ctx->nbits == GSM_BURST_LEN) && (res->rc < 0)) {
+			res->rc = gsm0503_pdtch_decode(res->data, bursts, NULL,
+					  &res->n_errors, &res->n_bits_total);
+		}
+		break;
+	case TRX_UL_TCHF:
+		switch ((ctx->rsl_cmode != RSL_CMOD_SPD_SPEECH) ? GSM48_CMODE_SPEECH_V1
+								      : ctx->tch_mode) {
+		case GSM48_CMODE_SPEECH_V1: /* FR */
+			res->rc = gsm0503_tch_fr_decode(res->data, bursts, 1, 0,
+					&res->n_errors, &res->n_bits_total);
+			break;
+		case GSM48_CMODE_SPEECH_EFR: /* EFR */
+			res->rc = gsm0503_tch_fr_decode(res->data, bursts, 1, 1,
+					&res->n_errors, &res->n_bits_total);
+			break;
+		case GSM48_CMODE_SPEECH_AMR: /* AMR */
+			/* the first FN 0,8,17 defines that CMI is included in frame,
+			 * the first FN 4,13,21 defines that CMR is included in frame.
+			 * NOTE: A frame ends 7 FN after start.
+			 */
+			res->rc = gsm0503_tch_afs_decode(res->data + 2, bursts,
+				(((ctx->fn + 26 - 7) % 26) >> 2) & 1, codec,
+				ctx->codecs, &res->ul_ft, &res->ul_cmr,
+				&res->n_errors, &res->n_bits_total);
+			break;
+		}
+		break;
+	case TRX_UL_TCHH:
+		/* Note on FN-10: If we are at FN 10, we decoded an even aligned
+		 * TCH/FACCH frame, because our burst buffer carries 6 bursts.
+		 * Even FN ending at: 10,11,19,20,2,3
+		 */
+		fn_is_odd = (((ctx->fn + 26 - 10) % 26) >> 2) & 1;
+
+		switch ((ctx->rsl_cmode != RSL_CMOD_SPD_SPEECH) ? GSM48_CMODE_SPEECH_V1
+								      : ctx->tch_mode) {
+		case GSM48_CMODE_SPEECH_V1: /* HR or signalling */
+			res->rc = gsm0503_tch_hr_decode(res->data, bursts, fn_is_odd,
+					&res->n_errors, &res->n_bits_total);
+			break;
+		case GSM48_CMODE_SPEECH_AMR: /* AMR */
+			/* the first FN 0,8,17 or 1,9,18 defines that CMI is included
+			 * in frame, the first FN 4,13,21 or 5,14,22 defines that CMR
+			 * is included in frame.
+			 */
+			res->rc = gsm0503_tch_ahs_decode(res->data + 2, bursts,
+				fn_is_odd, fn_is_odd, codec, ctx->codecs,
+				&res->ul_ft, &res->ul_cmr,
+				&res->n_errors, &res->n_bits_total);
+			break;
+		}
+		break;
+	}
+}
+
+/* fill the decoding context of a complete UL frame from the channel state */
+static void rx_ctx_init(struct trx_ul_ctx *ctx, enum trx_ul_kind kind,
+	uint8_t tn, uint32_t fn, enum trx_chan_type chan,
+	const struct l1sched_chan_state *chan_state, uint16_t bursts_len)
+{
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->kind = kind;
+	ctx->tn = tn;
+	ctx->chan = chan;
+	ctx->fn = fn;
+	ctx->first_fn = chan_state->ul_first_fn;
+	ctx->bursts_len = bursts_len;
+	ctx->rsl_cmode = chan_state->rsl_cmode;
+	ctx->tch_mode = chan_state->tch_mode;
+	memcpy(ctx->codec, chan_state->codec, sizeof(ctx->codec));
+	ctx->codecs = chan_state->codecs;
+	ctx->ul_ft = chan_state->ul_ft;
+	ctx->ul_cmr = chan_state->ul_cmr;
+}
+
+/* decode a complete UL frame on the worker of the TRX, or right here */
+static int rx_decode(struct l1sched_trx *l1t, const struct trx_ul_ctx *ctx,
+	const sbit_t *bursts)
+{
+	struct trx_l1h *l1h = container_of(l1t, struct trx_l1h, l1s);
+	struct trx_ul_res res;
+
+	if (l1h->worker)
+		return trx_worker_post(l1h->worker, ctx, bursts);
+
+	trx_sched_ul_decode(ctx, bursts, &res);
+	return trx_sched_ul_complete(l1t, ctx, &res);
+}
+
+/* process a decoded SDCCH/SACCH frame */
+static int rx_data_complete(struct l1sched_trx *l1t, const struct trx_ul_ctx *ctx,
+	struct trx_ul_res *res)
+{
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, ctx->tn);
+	uint8_t tn = ctx->tn;
+	enum trx_chan_type chan = ctx->chan;
+	uint32_t fn = ctx->fn;
+	uint8_t l2_len;
+	uint16_t ber10k;
+
+	if (res->rc) {
+		LOGL1S(DL1P, LOGL_NOTICE, l1t, tn, chan, fn, "Received bad data (%u/%u)\n",
+			ctx->first_fn, ctx->first_fn % l1ts->mf_period);
+		l2_len = 0;
+	} else
+		l2_len = GSM_MACBLOCK_LEN;
+
+	/* Send uplink measurement information to L2 */
+	l1if_process_meas_res(l1t->trx, tn, ctx->first_fn, trx_chan_desc[chan].chan_nr | tn,
+		res->n_errors, res->n_bits_total, ctx->rssi, ctx->toa);
+	ber10k = compute_ber10k(res->n_bits_total, res->n_errors);
+	return _sched_compose_ph_data_ind(l1t, tn, ctx->first_fn, chan, res->data, l2_len,
+					  ctx->rssi, 4 * ctx->toa, 0, ber10k,
+					  PRES_INFO_UNKNOWN);
+}
+
 /*! \brief a single (SDCCH/SACCH) burst was received by the PHY, process it */
 int rx_data_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	enum trx_chan_type chan, uint8_t bid, sbit_t *bits, uint16_t nbits,
@@ -769,10 +943,7 @@ int rx_data_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	uint8_t *rssi_num = &chan_state->rssi_num;
 	float *toa_sum = &chan_state->toa_sum;
 	uint8_t *toa_num = &chan_state->toa_num;
-	uint8_t l2[GSM_MACBLOCK_LEN], l2_len;
-	int n_errors, n_bits_total;
-	uint16_t ber10k;
-	int rc;
+	struct trx_ul_ctx ctx;
 
 	/* handle RACH, if handover RACH detection is turned on */
 	if (chan_state->ho_rach_detect == 1)
@@ -780,12 +951,9 @@ int rx_data_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 
 	LOGL1S(DL1P, LOGL_DEBUG, l1t, tn, chan, fn, "Received Data, bid=%u\n", bid);
 
-	/* allocate burst memory, if not already */
-	if (!*bursts_p) {
-		*bursts_p = talloc_zero_size(tall_bts_ctx, 464);
-		if (!*bursts_p)
-			return -ENOMEM;
-	}
+	/* claim burst memory, if not already */
+	if (!*bursts_p)
+		*bursts_p = _sched_ul_bursts_claim(chan_state);
 
 	/* clear burst & store frame number of first burst */
 	if (bid == 0) {
@@ -834,22 +1002,35 @@ int rx_data_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	*mask = 0x0;
 
 	/* decode */
-	rc = gsm0503_xcch_decode(l2, *bursts_p, &n_errors, &n_bits_total);
-	if (rc) {
-		LOGL1S(DL1P, LOGL_NOTICE, l1t, tn, chan, fn, "Received bad data (%u/%u)\n",
-			*first_fn, (*first_fn) % l1ts->mf_period);
-		l2_len = 0;
-	} else
-		l2_len = GSM_MACBLOCK_LEN;
+	rx_ctx_init(&ctx, TRX_UL_XCCH, tn, fn, chan, chan_state, 464);
+	ctx.rssi = *rssi_sum / *rssi_num;
+	ctx.toa = *toa_sum / *toa_num;
+	return rx_decode(l1t, &ctx, *bursts_p);
+}
+
+/* process a decoded PDTCH frame */
+static int rx_pdtch_complete(struct l1sched_trx *l1t, const struct trx_ul_ctx *ctx,
+	struct trx_ul_res *res)
+{
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, ctx->tn);
+	uint8_t tn = ctx->tn;
+	enum trx_chan_type chan = ctx->chan;
+	uint32_t fn = ctx->fn;
+	uint16_t ber10k;
 
 	/* Send uplink measurement information to L2 */
-	l1if_process_meas_res(l1t->trx, tn, *first_fn, trx_chan_desc[chan].chan_nr | tn,
-		n_errors, n_bits_total, *rssi_sum / *rssi_num, *toa_sum / *toa_num);
-	ber10k = compute_ber10k(n_bits_total, n_errors);
-	return _sched_compose_ph_data_ind(l1t, tn, *first_fn, chan, l2, l2_len,
-					  *rssi_sum / *rssi_num,
-					  4 * (*toa_sum) / *toa_num, 0, ber10k,
-					  PRES_INFO_UNKNOWN);
+	l1if_process_meas_res(l1t->trx, tn, ctx->first_fn, trx_chan_desc[chan].chan_nr | tn,
+		res->n_errors, res->n_bits_total, ctx->rssi, ctx->toa);
+
+	if (res->rc <= 0) {
+		LOGL1S(DL1P, LOGL_DEBUG, l1t, tn, chan, fn, "Received bad PDTCH (%u/%u)\n",
+			fn % l1ts->mf_period, l1ts->mf_period);
+		return 0;
+	}
+	ber10k = compute_ber10k(res->n_bits_total, res->n_errors);
+	return _sched_compose_ph_data_ind(l1t, tn, (fn + GSM_HYPERFRAME - 3) % GSM_HYPERFRAME, chan,
+		res->data, res->rc, ctx->rssi, 4 * ctx->toa, 0,
+					  ber10k, PRES_INFO_BOTH);
 }
 
 /*! \brief a single PDTCH burst was received by the PHY, process it */
@@ -866,20 +1047,14 @@ int rx_pdtch_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	uint8_t *rssi_num = &chan_state->rssi_num;
 	float *toa_sum = &chan_state->toa_sum;
 	uint8_t *toa_num = &chan_state->toa_num;
-	uint8_t l2[EGPRS_0503_MAX_BYTES];
-	int n_errors, n_bursts_bits, n_bits_total;
-	uint16_t ber10k;
-	int rc;
+	int n_bursts_bits;
+	struct trx_ul_ctx ctx;
 
 	LOGL1S(DL1P, LOGL_DEBUG, l1t, tn, chan, fn, "Received PDTCH bid=%u\n", bid);
 
-	/* allocate burst memory, if not already */
-	if (!*bursts_p) {
-		*bursts_p = talloc_zero_size(tall_bts_ctx,
-					     GSM0503_EGPRS_BURSTS_NBITS);
-		if (!*bursts_p)
-			return -ENOMEM;
-	}
+	/* claim burst memory, if not already */
+	if (!*bursts_p)
+		*bursts_p = _sched_ul_bursts_claim(chan_state);
 
 	/* clear burst */
 	if (bid == 0) {
@@ -923,114 +1098,40 @@ int rx_pdtch_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	}
 	*mask = 0x0;
 
-	/*
-	 * Attempt to decode EGPRS bursts first. For 8-PSK EGPRS this is all we
-	 * do. Attempt GPRS decoding on EGPRS failure. If the burst is GPRS,
-	 * then we incur decoding overhead of 31 bits on the Type 3 EGPRS
-	 * header, which is tolerable.
-	 */
-	rc = gsm0503_pdtch_egprs_decode(l2, *bursts_p, n_bursts_bits,
-				NULL, &n_errors, &n_bits_total);
-
-	if ((nbits == GSM_BURST_LEN) && (rc < 0)) {
-		rc = gsm0503_pdtch_decode(l2, *bursts_p, NULL,
-				  &n_errors, &n_bits_total);
-	}
-
-
-	/* Send uplink measurement information to L2 */
-	l1if_process_meas_res(l1t->trx, tn, *first_fn, trx_chan_desc[chan].chan_nr | tn,
-		n_errors, n_bits_total, *rssi_sum / *rssi_num, *toa_sum / *toa_num);
-
-	if (rc <= 0) {
-		LOGL1S(DL1P, LOGL_DEBUG, l1t, tn, chan, fn, "Received bad PDTCH (%u/%u)\n",
-			fn % l1ts->mf_period, l1ts->mf_period);
-		return 0;
-	}
-	ber10k = compute_ber10k(n_bits_total, n_errors);
-	return _sched_compose_ph_data_ind(l1t, tn, (fn + GSM_HYPERFRAME - 3) % GSM_HYPERFRAME, chan,
-		l2, rc, *rssi_sum / *rssi_num, 4 * (*toa_sum) / *toa_num, 0,
-					  ber10k, PRES_INFO_BOTH);
+	/* decode */
+	rx_ctx_init(&ctx, TRX_UL_PDTCH, tn, fn, chan, chan_state, n_bursts_bits);
+	ctx.nbits = nbits;
+	ctx.rssi = *rssi_sum / *rssi_num;
+	ctx.toa = *toa_sum / *toa_num;
+	return rx_decode(l1t, &ctx, *bursts_p);
 }
 
-/*! \brief a single TCH/F burst was received by the PHY, process it */
-int rx_tchf_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
-	enum trx_chan_type chan, uint8_t bid, sbit_t *bits, uint16_t nbits,
-	int8_t rssi, float toa)
+/* process a decoded TCH/F frame */
+static int rx_tchf_complete(struct l1sched_trx *l1t, const struct trx_ul_ctx *ctx,
+	struct trx_ul_res *res)
 {
-	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
-	struct l1sched_chan_state *chan_state = &l1ts->chan_state[chan];
-	sbit_t *burst, **bursts_p = &chan_state->ul_bursts;
-	uint32_t *first_fn = &chan_state->ul_first_fn;
-	uint8_t *mask = &chan_state->ul_mask;
-	uint8_t rsl_cmode = chan_state->rsl_cmode;
-	uint8_t tch_mode = chan_state->tch_mode;
-	uint8_t tch_data[128]; /* just to be safe */
-	int rc, amr = 0;
-	int n_errors, n_bits_total;
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, ctx->tn);
+	struct l1sched_chan_state *chan_state = &l1ts->chan_state[ctx->chan];
+	uint8_t tn = ctx->tn;
+	enum trx_chan_type chan = ctx->chan;
+	uint32_t fn = ctx->fn;
+	uint8_t rsl_cmode = ctx->rsl_cmode;
+	uint8_t tch_mode = ctx->tch_mode;
+	uint8_t *tch_data = res->data;
+	int rc = res->rc, amr = 0;
+	int n_errors = res->n_errors, n_bits_total = res->n_bits_total;
 	struct gsm_lchan *lchan =
 		get_lchan_by_chan_nr(l1t->trx, trx_chan_desc[chan].chan_nr | tn);
 
-	/* handle rach, if handover rach detection is turned on */
-	if (chan_state->ho_rach_detect == 1)
-		return rx_rach_fn(l1t, tn, fn, chan, bid, bits, GSM_BURST_LEN, rssi, toa);
-
-	LOGL1S(DL1P, LOGL_DEBUG, l1t, tn, chan, fn, "Received TCH/F, bid=%u\n", bid);
-
-	/* allocate burst memory, if not already */
-	if (!*bursts_p) {
-		*bursts_p = talloc_zero_size(tall_bts_ctx, 928);
-		if (!*bursts_p)
-			return -ENOMEM;
-	}
-
-	/* clear burst */
-	if (bid == 0) {
-		memset(*bursts_p + 464, 0, 464);
-		*mask = 0x0;
-		*first_fn = fn;
-	}
-
-	/* update mask */
-	*mask |= (1 << bid);
-
-	/* copy burst to end of buffer of 8 bursts */
-	burst = *bursts_p + bid * 116 + 464;
-	memcpy(burst, bits + 3, 58);
-	memcpy(burst + 58, bits + 87, 58);
-
-	/* wait until complete set of bursts */
-	if (bid != 3)
-		return 0;
-
-	/* check for complete set of bursts */
-	if ((*mask & 0xf) != 0xf) {
-		LOGL1S(DL1P, LOGL_NOTICE, l1t, tn, chan, fn, "Received incomplete frame (%u/%u)\n",
-			fn % l1ts->mf_period, l1ts->mf_period);
-	}
-	*mask = 0x0;
-
-	/* decode
-	 * also shift buffer by 4 bursts for interleaving */
 	switch ((rsl_cmode != RSL_CMOD_SPD_SPEECH) ? GSM48_CMODE_SPEECH_V1
 								: tch_mode) {
 	case GSM48_CMODE_SPEECH_V1: /* FR */
-		rc = gsm0503_tch_fr_decode(tch_data, *bursts_p, 1, 0, &n_errors, &n_bits_total);
 		if (rc >= 0)
 			lchan_set_marker(osmo_fr_check_sid(tch_data, rc), lchan); /* DTXu */
 		break;
-	case GSM48_CMODE_SPEECH_EFR: /* EFR */
-		rc = gsm0503_tch_fr_decode(tch_data, *bursts_p, 1, 1, &n_errors, &n_bits_total);
-		break;
 	case GSM48_CMODE_SPEECH_AMR: /* AMR */
-		/* the first FN 0,8,17 defines that CMI is included in frame,
-		 * the first FN 4,13,21 defines that CMR is included in frame.
-		 * NOTE: A frame ends 7 FN after start.
-		 */
-		rc = gsm0503_tch_afs_decode(tch_data + 2, *bursts_p,
-			(((fn + 26 - 7) % 26) >> 2) & 1, chan_state->codec,
-			chan_state->codecs, &chan_state->ul_ft,
-			&chan_state->ul_cmr, &n_errors, &n_bits_total);
+		chan_state->ul_ft = res->ul_ft;
+		chan_state->ul_cmr = res->ul_cmr;
 		if (rc)
 			trx_loop_amr_input(l1t,
 				trx_chan_desc[chan].chan_nr | tn, chan_state,
@@ -1043,16 +1144,11 @@ int rx_tchf_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 				chan_state->codec[chan_state->ul_ft], AMR_GOOD);
 		}
 		break;
-	default:
-		LOGL1S(DL1P, LOGL_ERROR, l1t, tn, chan, fn, "TCH mode %u invalid, please fix!\n",
-			tch_mode);
-		return -EINVAL;
 	}
-	memcpy(*bursts_p, *bursts_p + 464, 464);
 
 	/* Send uplink measurement information to L2 */
-	l1if_process_meas_res(l1t->trx, tn, *first_fn, trx_chan_desc[chan].chan_nr|tn,
-		n_errors, n_bits_total, rssi, toa);
+	l1if_process_meas_res(l1t->trx, tn, ctx->first_fn, trx_chan_desc[chan].chan_nr|tn,
+		n_errors, n_bits_total, ctx->rssi, ctx->toa);
 
 	/* Check if the frame is bad */
 	if (rc < 0) {
@@ -1070,7 +1166,7 @@ int rx_tchf_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	if (rc == GSM_MACBLOCK_LEN) {
 		uint16_t ber10k = compute_ber10k(n_bits_total, n_errors);
 		_sched_compose_ph_data_ind(l1t, tn, (fn + GSM_HYPERFRAME - 7) % GSM_HYPERFRAME, chan,
-			tch_data + amr, GSM_MACBLOCK_LEN, rssi, 4 * toa, 0,
+			tch_data + amr, GSM_MACBLOCK_LEN, ctx->rssi, 4 * ctx->toa, 0,
 					   ber10k, PRES_INFO_UNKNOWN);
 bfi:
 		if (rsl_cmode == RSL_CMOD_SPD_SPEECH) {
@@ -1113,45 +1209,33 @@ bfi:
 		tch_data, rc);
 }
 
-/*! \brief a single TCH/H burst was received by the PHY, process it */
-int rx_tchh_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
+/*! \brief a single TCH/F burst was received by the PHY, process it */
+int rx_tchf_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	enum trx_chan_type chan, uint8_t bid, sbit_t *bits, uint16_t nbits,
 	int8_t rssi, float toa)
 {
 	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
 	struct l1sched_chan_state *chan_state = &l1ts->chan_state[chan];
+	struct trx_l1h *l1h = container_of(l1t, struct trx_l1h, l1s);
 	sbit_t *burst, **bursts_p = &chan_state->ul_bursts;
 	uint32_t *first_fn = &chan_state->ul_first_fn;
 	uint8_t *mask = &chan_state->ul_mask;
-	uint8_t rsl_cmode = chan_state->rsl_cmode;
-	uint8_t tch_mode = chan_state->tch_mode;
-	uint8_t tch_data[128]; /* just to be safe */
-	int rc, amr = 0;
-	int n_errors, n_bits_total;
-	struct gsm_lchan *lchan =
-		get_lchan_by_chan_nr(l1t->trx, trx_chan_desc[chan].chan_nr | tn);
-	/* Note on FN-10: If we are at FN 10, we decoded an even aligned
-	 * TCH/FACCH frame, because our burst buffer carries 6 bursts.
-	 * Even FN ending at: 10,11,19,20,2,3
-	 */
-	int fn_is_odd = (((fn + 26 - 10) % 26) >> 2) & 1;
+	struct trx_ul_ctx ctx;
+	int rc;
 
-	/* handle RACH, if handover RACH detection is turned on */
+	/* handle rach, if handover rach detection is turned on */
 	if (chan_state->ho_rach_detect == 1)
 		return rx_rach_fn(l1t, tn, fn, chan, bid, bits, GSM_BURST_LEN, rssi, toa);
 
-	LOGL1S(DL1P, LOGL_DEBUG, l1t, tn, chan, fn, "Received TCH/H, bid=%u\n", bid);
+	LOGL1S(DL1P, LOGL_DEBUG, l1t, tn, chan, fn, "Received TCH/F, bid=%u\n", bid);
 
-	/* allocate burst memory, if not already */
-	if (!*bursts_p) {
-		*bursts_p = talloc_zero_size(tall_bts_ctx, 696);
-		if (!*bursts_p)
-			return -ENOMEM;
-	}
+	/* claim burst memory, if not already */
+	if (!*bursts_p)
+		*bursts_p = _sched_ul_bursts_claim(chan_state);
 
 	/* clear burst */
 	if (bid == 0) {
-		memset(*bursts_p + 464, 0, 232);
+		memset(*bursts_p + 464, 0, 464);
 		*mask = 0x0;
 		*first_fn = fn;
 	}
@@ -1159,53 +1243,124 @@ int rx_tchh_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	/* update mask */
 	*mask |= (1 << bid);
 
-	/* copy burst to end of buffer of 6 bursts */
+	/* copy burst to end of buffer of 8 bursts */
 	burst = *bursts_p + bid * 116 + 464;
 	memcpy(burst, bits + 3, 58);
 	memcpy(burst + 58, bits + 87, 58);
 
 	/* wait until complete set of bursts */
-	if (bid != 1)
+	if (bid != 3)
 		return 0;
 
 	/* check for complete set of bursts */
-	if ((*mask & 0x3) != 0x3) {
+	if ((*mask & 0xf) != 0xf) {
 		LOGL1S(DL1P, LOGL_NOTICE, l1t, tn, chan, fn, "Received incomplete frame (%u/%u)\n",
 			fn % l1ts->mf_period, l1ts->mf_period);
 	}
 	*mask = 0x0;
 
-	/* skip second of two TCH frames of FACCH was received */
-	if (chan_state->ul_ongoing_facch) {
-		chan_state->ul_ongoing_facch = 0;
-		memcpy(*bursts_p, *bursts_p + 232, 232);
-		memcpy(*bursts_p + 232, *bursts_p + 464, 232);
-		goto bfi;
+	switch ((chan_state->rsl_cmode != RSL_CMOD_SPD_SPEECH) ? GSM48_CMODE_SPEECH_V1
+							       : chan_state->tch_mode) {
+	case GSM48_CMODE_SPEECH_V1:
+	case GSM48_CMODE_SPEECH_EFR:
+		break;
+	case GSM48_CMODE_SPEECH_AMR:
+		/* the AMR codec mode of the previous frame is needed */
+		trx_worker_sync_chan(l1h->worker, tn, chan);
+		break;
+	default:
+		LOGL1S(DL1P, LOGL_ERROR, l1t, tn, chan, fn, "TCH mode %u invalid, please fix!\n",
+			chan_state->tch_mode);
+		return -EINVAL;
 	}
 
 	/* decode
 	 * also shift buffer by 4 bursts for interleaving */
+	rx_ctx_init(&ctx, TRX_UL_TCHF, tn, fn, chan, chan_state, 928);
+	ctx.rssi = rssi;
+	ctx.toa = toa;
+	rc = rx_decode(l1t, &ctx, *bursts_p);
+	memcpy(*bursts_p, *bursts_p + 464, 464);
+
+	return rc;
+}
+
+/* send a bad frame indication for TCH/H */
+static int rx_tchh_bfi(struct l1sched_trx *l1t, const struct trx_ul_ctx *ctx,
+	uint8_t *tch_data)
+{
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, ctx->tn);
+	struct l1sched_chan_state *chan_state = &l1ts->chan_state[ctx->chan];
+	uint8_t tn = ctx->tn;
+	enum trx_chan_type chan = ctx->chan;
+	uint32_t fn = ctx->fn;
+	struct gsm_lchan *lchan =
+		get_lchan_by_chan_nr(l1t->trx, trx_chan_desc[chan].chan_nr | tn);
+	int rc;
+
+	if (ctx->rsl_cmode != RSL_CMOD_SPD_SPEECH)
+		return 0;
+
+	/* indicate bad frame */
+	switch (ctx->tch_mode) {
+	case GSM48_CMODE_SPEECH_V1: /* HR */
+		if (lchan->tch.dtx.ul_sid)
+			return 0; /* DTXu: pause in progress */
+		tch_data[0] = 0x70; /* F = 0, FT = 111 */
+		memset(tch_data + 1, 0, 14);
+		rc = 15;
+		break;
+	case GSM48_CMODE_SPEECH_AMR: /* AMR */
+		rc = osmo_amr_rtp_enc(tch_data,
+			chan_state->codec[chan_state->dl_cmr],
+			chan_state->codec[chan_state->dl_ft],
+			AMR_BAD);
+		if (rc < 2)
+			break;
+		memset(tch_data + 2, 0, rc - 2);
+		break;
+	default:
+		LOGL1S(DL1P, LOGL_ERROR, l1t, tn, chan, fn,
+			"TCH mode %u invalid, please fix!\n", ctx->tch_mode);
+		return -EINVAL;
+	}
+
+	/* Note on FN 19 or 20: If we received the last burst of a frame,
+	 * it actually starts at FN 8 or 9. A burst starting there, overlaps
+	 * with the slot 12, so an extra FN must be subtracted to get correct
+	 * start of frame.
+	 */
+	return _sched_compose_tch_ind(l1t, tn,
+		(fn + GSM_HYPERFRAME - 10 - ((fn%26)==19) - ((fn%26)==20)) % GSM_HYPERFRAME,
+		chan, tch_data, rc);
+}
+
+/* process a decoded TCH/H frame */
+static int rx_tchh_complete(struct l1sched_trx *l1t, const struct trx_ul_ctx *ctx,
+	struct trx_ul_res *res)
+{
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, ctx->tn);
+	struct l1sched_chan_state *chan_state = &l1ts->chan_state[ctx->chan];
+	uint8_t tn = ctx->tn;
+	enum trx_chan_type chan = ctx->chan;
+	uint32_t fn = ctx->fn;
+	uint8_t rsl_cmode = ctx->rsl_cmode;
+	uint8_t tch_mode = ctx->tch_mode;
+	uint8_t *tch_data = res->data;
+	int rc = res->rc, amr = 0;
+	int n_errors = res->n_errors, n_bits_total = res->n_bits_total;
+	struct gsm_lchan *lchan =
+		get_lchan_by_chan_nr(l1t->trx, trx_chan_desc[chan].chan_nr | tn);
+
 	switch ((rsl_cmode != RSL_CMOD_SPD_SPEECH) ? GSM48_CMODE_SPEECH_V1
 								: tch_mode) {
 	case GSM48_CMODE_SPEECH_V1: /* HR or signalling */
-		/* Note on FN-10: If we are at FN 10, we decoded an even aligned
-		 * TCH/FACCH frame, because our burst buffer carries 6 bursts.
-		 * Even FN ending at: 10,11,19,20,2,3
-		 */
-		rc = gsm0503_tch_hr_decode(tch_data, *bursts_p,
-			fn_is_odd, &n_errors, &n_bits_total);
 		if (rc) /* DTXu */
 			lchan_set_marker(osmo_hr_check_sid(tch_data, rc), lchan);
 		break;
 	case GSM48_CMODE_SPEECH_AMR: /* AMR */
-		/* the first FN 0,8,17 or 1,9,18 defines that CMI is included
-		 * in frame, the first FN 4,13,21 or 5,14,22 defines that CMR
-		 * is included in frame.
-		 */
-		rc = gsm0503_tch_ahs_decode(tch_data + 2, *bursts_p,
-			fn_is_odd, fn_is_odd, chan_state->codec,
-			chan_state->codecs, &chan_state->ul_ft,
-			&chan_state->ul_cmr, &n_errors, &n_bits_total);
+		chan_state->ul_ft = res->ul_ft;
+		chan_state->ul_cmr = res->ul_cmr;
 		if (rc)
 			trx_loop_amr_input(l1t,
 				trx_chan_desc[chan].chan_nr | tn, chan_state,
@@ -1218,28 +1373,22 @@ int rx_tchh_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 				chan_state->codec[chan_state->ul_ft], AMR_GOOD);
 		}
 		break;
-	default:
-		LOGL1S(DL1P, LOGL_ERROR, l1t, tn, chan, fn, "TCH mode %u invalid, please fix!\n",
-			tch_mode);
-		return -EINVAL;
 	}
-	memcpy(*bursts_p, *bursts_p + 232, 232);
-	memcpy(*bursts_p + 232, *bursts_p + 464, 232);
 
 	/* Send uplink measurement information to L2 */
-	l1if_process_meas_res(l1t->trx, tn, *first_fn, trx_chan_desc[chan].chan_nr|tn,
-		n_errors, n_bits_total, rssi, toa);
+	l1if_process_meas_res(l1t->trx, tn, ctx->first_fn, trx_chan_desc[chan].chan_nr|tn,
+		n_errors, n_bits_total, ctx->rssi, ctx->toa);
 
 	/* Check if the frame is bad */
 	if (rc < 0) {
 		LOGL1S(DL1P, LOGL_NOTICE, l1t, tn, chan, fn, "Received bad data (%u/%u)\n",
 			fn % l1ts->mf_period, l1ts->mf_period);
-		goto bfi;
+		return rx_tchh_bfi(l1t, ctx, tch_data);
 	}
 	if (rc < 4) {
 		LOGL1S(DL1P, LOGL_NOTICE, l1t, tn, chan, fn, "Received bad data (%u/%u) "
 			"with invalid codec mode %d\n", fn % l1ts->mf_period, l1ts->mf_period, rc);
-		goto bfi;
+		return rx_tchh_bfi(l1t, ctx, tch_data);
 	}
 
 	/* FACCH */
@@ -1248,58 +1397,150 @@ int rx_tchh_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 		uint16_t ber10k = compute_ber10k(n_bits_total, n_errors);
 		_sched_compose_ph_data_ind(l1t, tn,
 			(fn + GSM_HYPERFRAME - 10 - ((fn % 26) >= 19)) % GSM_HYPERFRAME, chan,
-			tch_data + amr, GSM_MACBLOCK_LEN, rssi, 4 * toa, 0,
+			tch_data + amr, GSM_MACBLOCK_LEN, ctx->rssi, 4 * ctx->toa, 0,
 					   ber10k, PRES_INFO_UNKNOWN);
-bfi:
-		if (rsl_cmode == RSL_CMOD_SPD_SPEECH) {
-			/* indicate bad frame */
-			switch (tch_mode) {
-			case GSM48_CMODE_SPEECH_V1: /* HR */
-				if (lchan->tch.dtx.ul_sid)
-					return 0; /* DTXu: pause in progress */
-				tch_data[0] = 0x70; /* F = 0, FT = 111 */
-				memset(tch_data + 1, 0, 14);
-				rc = 15;
-				break;
-			case GSM48_CMODE_SPEECH_AMR: /* AMR */
-				rc = osmo_amr_rtp_enc(tch_data,
-					chan_state->codec[chan_state->dl_cmr],
-					chan_state->codec[chan_state->dl_ft],
-					AMR_BAD);
-				if (rc < 2)
-					break;
-				memset(tch_data + 2, 0, rc - 2);
-				break;
-			default:
-				LOGL1S(DL1P, LOGL_ERROR, l1t, tn, chan, fn,
-					"TCH mode %u invalid, please fix!\n", tch_mode);
-				return -EINVAL;
-			}
-		}
+		return rx_tchh_bfi(l1t, ctx, tch_data);
 	}
 
 	if (rsl_cmode != RSL_CMOD_SPD_SPEECH)
 		return 0;
 
-	/* TCH or BFI */
-	/* Note on FN 19 or 20: If we received the last burst of a frame,
-	 * it actually starts at FN 8 or 9. A burst starting there, overlaps
-	 * with the slot 12, so an extra FN must be subtracted to get correct
-	 * start of frame.
-	 */
+	/* TCH */
+	/* Note on FN 19 or 20: see rx_tchh_bfi() */
 	return _sched_compose_tch_ind(l1t, tn,
 		(fn + GSM_HYPERFRAME - 10 - ((fn%26)==19) - ((fn%26)==20)) % GSM_HYPERFRAME,
 		chan, tch_data, rc);
 }
 
+/*! \brief a single TCH/H burst was received by the PHY, process it */
+int rx_tchh_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
+	enum trx_chan_type chan, uint8_t bid, sbit_t *bits, uint16_t nbits,
+	int8_t rssi, float toa)
+{
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
+	struct l1sched_chan_state *chan_state = &l1ts->chan_state[chan];
+	struct trx_l1h *l1h = container_of(l1t, struct trx_l1h, l1s);
+	sbit_t *burst, **bursts_p = &chan_state->ul_bursts;
+	uint32_t *first_fn = &chan_state->ul_first_fn;
+	uint8_t *mask = &chan_state->ul_mask;
+	uint8_t tch_data[128]; /* just to be safe */
+	struct trx_ul_ctx ctx;
+	int rc;
+
+	/* handle RACH, if handover RACH detection is turned on */
+	if (chan_state->ho_rach_detect == 1)
+		return rx_rach_fn(l1t, tn, fn, chan, bid, bits, GSM_BURST_LEN, rssi, toa);
+
+	LOGL1S(DL1P, LOGL_DEBUG, l1t, tn, chan, fn, "Received TCH/H, bid=%u\n", bid);
+
+	/* claim burst memory, if not already */
+	if (!*bursts_p)
+		*bursts_p = _sched_ul_bursts_claim(chan_state);
+
+	/* clear burst */
+	if (bid == 0) {
+		memset(*bursts_p + 464, 0, 232);
+		*mask = 0x0;
+		*first_fn = fn;
+	}
+
+	/* update mask */
+	*mask |= (1 << bid);
+
+	/* copy burst to end of buffer of 6 bursts */
+	burst = *bursts_p + bid * 116 + 464;
+	memcpy(burst, bits + 3, 58);
+	memcpy(burst + 58, bits + 87, 58);
+
+	/* wait until complete set of bursts */
+	if (bid != 1)
+		return 0;
+
+	/* check for complete set of bursts */
+	if ((*mask & 0x3) != 0x3) {
+		LOGL1S(DL1P, LOGL_NOTICE, l1t, tn, chan, fn, "Received incomplete frame (%u/%u)\n",
+			fn % l1ts->mf_period, l1ts->mf_period);
+	}
+	*mask = 0x0;
+
+	switch ((chan_state->rsl_cmode != RSL_CMOD_SPD_SPEECH) ? GSM48_CMODE_SPEECH_V1
+							       : chan_state->tch_mode) {
+	case GSM48_CMODE_SPEECH_V1:
+	case GSM48_CMODE_SPEECH_AMR:
+		break;
+	default:
+		LOGL1S(DL1P, LOGL_ERROR, l1t, tn, chan, fn, "TCH mode %u invalid, please fix!\n",
+			chan_state->tch_mode);
+		return -EINVAL;
+	}
+
+	/* a FACCH and the AMR codec mode of the previous frame are needed */
+	trx_worker_sync_chan(l1h->worker, tn, chan);
+
+	rx_ctx_init(&ctx, TRX_UL_TCHH, tn, fn, chan, chan_state, 696);
+	ctx.rssi = rssi;
+	ctx.toa = toa;
+
+	/* skip second of two TCH frames of FACCH was received */
+	if (chan_state->ul_ongoing_facch) {
+		chan_state->ul_ongoing_facch = 0;
+		memcpy(*bursts_p, *bursts_p + 232, 232);
+		memcpy(*bursts_p + 232, *bursts_p + 464, 232);
+		return rx_tchh_bfi(l1t, &ctx, tch_data);
+	}
+
+	/* decode
+	 * also shift buffer by 4 bursts for interleaving */
+	rc = rx_decode(l1t, &ctx, *bursts_p);
+	memcpy(*bursts_p, *bursts_p + 232, 232);
+	memcpy(*bursts_p + 232, *bursts_p + 464, 232);
+
+	return rc;
+}
+
+/*! \brief process the result of decoding a UL frame, on the main thread */
+int trx_sched_ul_complete(struct l1sched_trx *l1t, const struct trx_ul_ctx *ctx,
+			  struct trx_ul_res *res)
+{
+	switch (ctx->kind) {
+	case TRX_UL_XCCH:
+		return rx_data_complete(l1t, ctx, res);
+	case TRX_UL_PDTCH:
+		return rx_pdtch_complete(l1t, ctx, res);
+	case TRX_UL_TCHF:
+		return rx_tchf_complete(l1t, ctx, res);
+	case TRX_UL_TCHH:
+		return rx_tchh_complete(l1t, ctx, res);
+	}
+
+	return -EINVAL;
+}
+
+/* compose and send the DL bursts of one TRX for given FN */
+void trx_sched_fn_dl(struct trx_l1h *l1h, uint32_t fn)
+{
+	struct l1sched_trx *l1t = &l1h->l1s;
+	const ubit_t *bits;
+	uint16_t nbits;
+	uint8_t tn;
+
+	for (tn = 0; tn < ARRAY_SIZE(l1t->ts); tn++) {
+		/* get burst for FN */
+		bits = _sched_dl_burst(l1t, tn, fn, &nbits);
+		/* if no bits, send no burst */
+		if (bits && nbits)
+			trx_if_send_burst(l1h, tn, fn, 0, bits, nbits);
+	}
+
+	/* send all bursts of this FN at once (if batching) */
+	trx_if_flush_bursts(l1h);
+}
+
 /* schedule all frames of all TRX for given FN */
-static int trx_sched_fn(struct gsm_bts *bts, uint32_t fn)
+int trx_sched_fn(struct gsm_bts *bts, uint32_t fn)
 {
 	struct gsm_bts_trx *trx;
 	uint8_t tn;
-	const ubit_t *bits;
-	uint8_t gain;
-	uint16_t nbits;
 
 	/* send time indication */
 	l1if_mph_time_ind(bts, fn);
@@ -1319,21 +1560,13 @@ static int trx_sched_fn(struct gsm_bts *bts, uint32_t fn)
 		if (!trx_if_powered(l1h))
 			continue;
 
-		/* process every TS of TRX */
-		for (tn = 0; tn < ARRAY_SIZE(l1t->ts); tn++) {
-			/* ready-to-send */
+		/* ready-to-send for every TS of TRX */
+		for (tn = 0; tn < ARRAY_SIZE(l1t->ts); tn++)
 			_sched_rts(l1t, tn,
 				(fn + plink->u.osmotrx.rts_advance) % GSM_HYPERFRAME);
-			/* get burst for FN */
-			bits = _sched_dl_burst(l1t, tn, fn, &nbits);
-			if (!bits) {
-				/* if no bits, send no burst */
-				continue;
-			} else
-				gain = 0;
-			if (nbits)
-				trx_if_send_burst(l1h, tn, fn, gain, bits, nbits);
-		}
+
+		/* compose and send the bursts */
+		trx_sched_fn_dl(l1h, fn);
 	}
 
 	return 0;
@@ -1356,8 +1589,50 @@ static int trx_sched_fn(struct gsm_bts *bts, uint32_t fn)
  * accordingly: If we were transmitting too fast, we're delaying the
  * next interval timer accordingly.  If we were too slow, we immediately
  * send burst data for the missing frame numbers.
+ *
+ * Optionally, the timerfd and the clock socket are served by a separate
+ * (real-time) thread, so that a busy main loop no longer delays the
+ * reading of the clock.  This thread only reads the timer expirations and
+ * clock indications and queues them, with the time they were read, to the
+ * main thread, which runs all of the clock handling.
  */
 
+/*! events from the clock thread to the main thread */
+enum trx_clk_evt_type {
+	TRX_CLK_EVT_TIMER,	/*!< FN timer expired, val = expirations */
+	TRX_CLK_EVT_IND,	/*!< clock indication, val = FN */
+	TRX_CLK_EVT_BAD,	/*!< invalid message on the clock socket */
+};
+
+struct trx_clk_evt {
+	uint32_t type;
+	uint32_t val;
+	/*! time at which the thread saw the event */
+	struct timespec tv;
+};
+
+/* must hold more than MAX_FN_SKEW frames */
+#define TRX_CLK_EVT_QLEN	256
+
+/*! clock thread, if enabled */
+struct trx_clk_thread {
+	pthread_t thread;
+	/*! phy link whose clock socket is served by the thread */
+	struct phy_link *plink;
+	/*! clock socket, served by the thread instead of the main loop */
+	struct osmo_fd *clk_ofd;
+	/*! events to the main thread */
+	struct spsc_ring evt_q;
+	struct trx_clk_evt evt_buf[TRX_CLK_EVT_QLEN];
+	/*! eventfd, signalled whenever evt_q got new entries */
+	struct osmo_fd notify_ofd;
+	/*! eventfd, signalled by the main thread to stop the thread */
+	int stop_fd;
+	int stop;
+	int prio;
+	int cpu;
+};
+
 /*! clock state of a given TRX */
 struct osmo_trx_clock_state {
 	/*! number of FN periods without TRX clock indication */
@@ -1365,8 +1640,11 @@ struct osmo_trx_clock_state {
 	struct {
 		/*! last FN we processed based on FN period timer */
 		uint32_t fn;
-		/*! time at which we last processed FN */
+		/*! time at which the FN timer last expired */
 		struct timespec tv;
+		/*! time at which we last processed FN, later than \ref tv
+		 *  if the expiry was queued by the clock thread */
+		struct timespec tv_proc;
 	} last_fn_timer;
 	struct {
 		/*! last FN we received a clock indication for */
@@ -1376,10 +1654,59 @@ struct osmo_trx_clock_state {
 	} last_clk_ind;
 	/*! Osmocom FD wrapper for timerfd */
 	struct osmo_fd fn_timer_ofd;
+	/*! clock thread (NULL: the clock runs on the main thread) */
+	struct trx_clk_thread *thr;
+	/*! telemetry */
+	struct trx_clk_stats stats;
 };
 
+static const int clk_jitter_bounds[] = { 10, 50, 100, 250, 500, 1000, 4615 };
+static const int clk_catchup_bounds[] = { 1, 2, 3, 5, 9, 17, 33 };
+static const int clk_drift_bounds[] = { -1000, -250, -50, 51, 251, 1001 };
+
 /* TODO: This must go and become part of the phy_link */
-static struct osmo_trx_clock_state g_clk_s = { .fn_timer_ofd.fd = -1 };
+static struct osmo_trx_clock_state g_clk_s = {
+	.fn_timer_ofd.fd = -1,
+	.stats = {
+		.jitter = { "timer jitter (us)", ARRAY_SIZE(clk_jitter_bounds) + 1,
+			    clk_jitter_bounds },
+		.latency = { "thread latency (us)", ARRAY_SIZE(clk_jitter_bounds) + 1,
+			     clk_jitter_bounds },
+		.catchup = { "catch-up (FN)", ARRAY_SIZE(clk_catchup_bounds) + 1,
+			     clk_catchup_bounds },
+		.drift = { "clock-ind drift (us)", ARRAY_SIZE(clk_drift_bounds) + 1,
+			   clk_drift_bounds },
+	},
+};
+
+static void clk_hist_add(struct trx_clk_hist *h, int val)
+{
+	unsigned int i;
+
+	for (i = 0; i < h->num - 1; i++) {
+		if (val < h->bounds[i])
+			break;
+	}
+	h->count[i]++;
+}
+
+/*! print the range of bucket \a i of histogram \a h to \a buf */
+int trx_clk_hist_fmt(char *buf, size_t len, const struct trx_clk_hist *h,
+		     unsigned int i)
+{
+	if (i == 0)
+		return snprintf(buf, len, "< %d", h->bounds[0]);
+	if (i == h->num - 1)
+		return snprintf(buf, len, ">= %d", h->bounds[i - 1]);
+	if (h->bounds[i] - 1 == h->bounds[i - 1])
+		return snprintf(buf, len, "%d", h->bounds[i - 1]);
+	return snprintf(buf, len, "%d..%d", h->bounds[i - 1], h->bounds[i] - 1);
+}
+
+const struct trx_clk_stats *trx_sched_clock_stats(void)
+{
+	return &g_clk_s.stats;
+}
 
 /*! duration of a GSM frame in nano-seconds. (120ms/26) */
 #define FRAME_DURATION_nS	4615384
@@ -1480,29 +1807,20 @@ static int timer_ofd_setup(struct osmo_fd *ofd, int (*cb)(struct osmo_fd *, unsi
 
 extern int quit;
 
-/*! this is the timerfd-callback firing for every FN to be processed */
-static int trx_fn_timer_cb(struct osmo_fd *ofd, unsigned int what)
+/*! the FN timer expired \a expire_count times, last at \a tv_now, the
+ *  frames are processed at \a tv_proc */
+static int trx_fn_timer_expired(struct gsm_bts *bts, struct osmo_trx_clock_state *tcs,
+	uint64_t expire_count, const struct timespec *tv_now,
+	const struct timespec *tv_proc)
 {
-	struct gsm_bts *bts = ofd->data;
-	struct osmo_trx_clock_state *tcs = &g_clk_s;
-	struct timespec tv_now;
-	uint64_t expire_count;
 	int elapsed_us;
 	int error_us;
-	int rc, i;
-
-	if (!(what & BSC_FD_READ))
-		return 0;
-
-	/* read from timerfd: number of expirations of periodic timer */
-	rc = read(ofd->fd, (void *) &expire_count, sizeof(expire_count));
-	if (rc < 0 && errno == EAGAIN)
-		return 0;
-	OSMO_ASSERT(rc == sizeof(expire_count));
+	int i;
 
 	if (expire_count > 1) {
 		LOGP(DL1C, LOGL_NOTICE, "FN timer expire_count=%"PRIu64": We missed %"PRIu64" timers\n",
 			expire_count, expire_count-1);
+		tcs->stats.timer_missed += expire_count - 1;
 	}
 
 	/* check if transceiver is still alive */
@@ -1512,14 +1830,19 @@ static int trx_fn_timer_cb(struct osmo_fd *ofd, unsigned int what)
 	}
 
 	/* compute actual elapsed time and resulting OS scheduling error */
-	clock_gettime(CLOCK_MONOTONIC, &tv_now);
-	elapsed_us = compute_elapsed_us(&tcs->last_fn_timer.tv, &tv_now);
+	elapsed_us = compute_elapsed_us(&tcs->last_fn_timer.tv, tv_now);
 	error_us = elapsed_us - FRAME_DURATION_uS;
 #ifdef DEBUG_CLOCK
 	printf("%s(): %09ld, elapsed_us=%05d, error_us=%-d: fn=%d\n", __func__,
-		tv_now.tv_nsec, elapsed_us, error_us, tcs->last_fn_timer.fn+1);
+		tv_now->tv_nsec, elapsed_us, error_us, tcs->last_fn_timer.fn+1);
 #endif
-	tcs->last_fn_timer.tv = tv_now;
+	tcs->last_fn_timer.tv = *tv_now;
+
+	/* the jitter the frames get, the clock thread only reads the timer */
+	clk_hist_add(&tcs->stats.jitter,
+		     abs(compute_elapsed_us(&tcs->last_fn_timer.tv_proc, tv_proc)
+			 - FRAME_DURATION_uS));
+	tcs->last_fn_timer.tv_proc = *tv_proc;
 
 	/* if someone played with clock, or if the process stalled */
 	if (elapsed_us > FRAME_DURATION_uS * MAX_FN_SKEW || elapsed_us < 0) {
@@ -1545,10 +1868,33 @@ no_clock:
 	return -1;
 }
 
+/*! this is the timerfd-callback firing for every FN to be processed */
+static int trx_fn_timer_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	struct gsm_bts *bts = ofd->data;
+	struct osmo_trx_clock_state *tcs = &g_clk_s;
+	struct timespec tv_now;
+	uint64_t expire_count;
+	int rc;
+
+	if (!(what & BSC_FD_READ))
+		return 0;
+
+	/* read from timerfd: number of expirations of periodic timer */
+	rc = read(ofd->fd, (void *) &expire_count, sizeof(expire_count));
+	if (rc < 0 && errno == EAGAIN)
+		return 0;
+	OSMO_ASSERT(rc == sizeof(expire_count));
+
+	clock_gettime(CLOCK_MONOTONIC, &tv_now);
+
+	return trx_fn_timer_expired(bts, tcs, expire_count, &tv_now, &tv_now);
+}
+
 /*! reset clock with current fn and schedule it. Called when trx becomes
  *  available or when max clock skew is reached */
 static int trx_setup_clock(struct gsm_bts *bts, struct osmo_trx_clock_state *tcs,
-	struct timespec *tv_now, const struct timespec *interval, uint32_t fn)
+	const struct timespec *tv_now, const struct timespec *interval, uint32_t fn)
 {
 	tcs->last_fn_timer.fn = fn;
 	/* call trx cheduler function for new 'last' FN */
@@ -1559,6 +1905,7 @@ static int trx_setup_clock(struct gsm_bts *bts, struct osmo_trx_clock_state *tcs
 	timer_ofd_schedule(&tcs->fn_timer_ofd, NULL, interval);
 
 	tcs->last_fn_timer.tv = *tv_now;
+	clock_gettime(CLOCK_MONOTONIC, &tcs->last_fn_timer.tv_proc);
 	tcs->last_clk_ind.tv = *tv_now;
 	tcs->last_clk_ind.fn = fn;
 
@@ -1568,8 +1915,17 @@ static int trx_setup_clock(struct gsm_bts *bts, struct osmo_trx_clock_state *tcs
 /*! called every time we receive a clock indication from TRX */
 int trx_sched_clock(struct gsm_bts *bts, uint32_t fn)
 {
-	struct osmo_trx_clock_state *tcs = &g_clk_s;
 	struct timespec tv_now;
+
+	clock_gettime(CLOCK_MONOTONIC, &tv_now);
+
+	return trx_sched_clock_at(bts, fn, &tv_now);
+}
+
+/*! process a clock indication from TRX, received at \a tv_now */
+int trx_sched_clock_at(struct gsm_bts *bts, uint32_t fn, const struct timespec *tv_now)
+{
+	struct osmo_trx_clock_state *tcs = &g_clk_s;
 	int elapsed_us, elapsed_fn;
 	int elapsed_us_since_clk, elapsed_fn_since_clk, error_us_since_clk;
 	unsigned int fn_caught_up = 0;
@@ -1581,8 +1937,6 @@ int trx_sched_clock(struct gsm_bts *bts, uint32_t fn)
 	/* reset lost counter */
 	tcs->fn_without_clock_ind = 0;
 
-	clock_gettime(CLOCK_MONOTONIC, &tv_now);
-
 	/* clock becomes valid */
 	if (!transceiver_available) {
 		LOGP(DL1C, LOGL_NOTICE, "initial GSM clock received: fn=%u\n", fn);
@@ -1595,15 +1949,15 @@ int trx_sched_clock(struct gsm_bts *bts, uint32_t fn)
 		/* tell BSC */
 		check_transceiver_availability(bts, 1);
 
-		return trx_setup_clock(bts, tcs, &tv_now, &interval, fn);
+		return trx_setup_clock(bts, tcs, tv_now, &interval, fn);
 	}
 
 	/* calculate elapsed time +fn since last timer */
-	elapsed_us = compute_elapsed_us(&tcs->last_fn_timer.tv, &tv_now);
+	elapsed_us = compute_elapsed_us(&tcs->last_fn_timer.tv, tv_now);
 	elapsed_fn = compute_elapsed_fn(tcs->last_fn_timer.fn, fn);
 #ifdef DEBUG_CLOCK
 	printf("%s(): LAST_TIMER %9ld, elapsed_us=%7d, elapsed_fn=%+3d\n", __func__,
-		tv_now.tv_nsec, elapsed_us, elapsed_fn);
+		tv_now->tv_nsec, elapsed_us, elapsed_fn);
 #endif
 	/* negative elapsed_fn values mean that we've already processed
 	 * more FN based on the local interval timer than what the TRX
@@ -1611,26 +1965,28 @@ int trx_sched_clock(struct gsm_bts *bts, uint32_t fn)
 	 * values mean we still have a backlog to process */
 
 	/* calculate elapsed time +fn since last clk ind */
-	elapsed_us_since_clk = compute_elapsed_us(&tcs->last_clk_ind.tv, &tv_now);
+	elapsed_us_since_clk = compute_elapsed_us(&tcs->last_clk_ind.tv, tv_now);
 	elapsed_fn_since_clk = compute_elapsed_fn(tcs->last_clk_ind.fn, fn);
 	/* error (delta) between local clock since last CLK and CLK based on FN clock at TRX */
 	error_us_since_clk = elapsed_us_since_clk - (FRAME_DURATION_uS * elapsed_fn_since_clk);
 	LOGP(DL1C, LOGL_INFO, "TRX Clock Ind: elapsed_us=%7d, elapsed_fn=%3d, error_us=%+5d\n",
 		elapsed_us_since_clk, elapsed_fn_since_clk, error_us_since_clk);
+	clk_hist_add(&tcs->stats.drift, error_us_since_clk);
 
 	/* TODO: put this computed error_us_since_clk into some filter
 	 * function and use that to adjust our regular timer interval to
 	 * compensate for clock drift between the PC clock and the
 	 * TRX/SDR clock */
 
-	tcs->last_clk_ind.tv = tv_now;
+	tcs->last_clk_ind.tv = *tv_now;
 	tcs->last_clk_ind.fn = fn;
 
 	/* check for max clock skew */
 	if (elapsed_fn > MAX_FN_SKEW || elapsed_fn < -MAX_FN_SKEW) {
 		LOGP(DL1C, LOGL_NOTICE, "GSM clock skew: old fn=%u, "
 			"new fn=%u\n", tcs->last_fn_timer.fn, fn);
-		return trx_setup_clock(bts, tcs, &tv_now, &interval, fn);
+		tcs->stats.skew_resets++;
+		return trx_setup_clock(bts, tcs, tv_now, &interval, fn);
 	}
 
 	LOGP(DL1C, LOGL_INFO, "GSM clock jitter: %d us (elapsed_fn=%d)\n",
@@ -1646,6 +2002,7 @@ int trx_sched_clock(struct gsm_bts *bts, uint32_t fn)
 		LOGP(DL1C, LOGL_NOTICE, "We were %d FN faster than TRX, compensating\n", -elapsed_fn);
 		/* set time to the time our next FN has to be transmitted */
 		timer_ofd_schedule(&tcs->fn_timer_ofd, &first, &interval);
+		clk_hist_add(&tcs->stats.catchup, 0);
 		return 0;
 	}
 
@@ -1655,15 +2012,277 @@ int trx_sched_clock(struct gsm_bts *bts, uint32_t fn)
 		trx_sched_fn(bts, tcs->last_fn_timer.fn);
 		fn_caught_up++;
 	}
+	clk_hist_add(&tcs->stats.catchup, fn_caught_up);
 
 	if (fn_caught_up) {
 		LOGP(DL1C, LOGL_NOTICE, "We were %d FN slower than TRX, compensated\n", elapsed_fn);
-		tcs->last_fn_timer.tv = tv_now;
+		tcs->last_fn_timer.tv = *tv_now;
+		clock_gettime(CLOCK_MONOTONIC, &tcs->last_fn_timer.tv_proc);
 	}
 
 	return 0;
 }
 
+/*! clock thread: queue an event, stamped with the current time */
+static void clk_thread_evt(struct osmo_trx_clock_state *tcs, enum trx_clk_evt_type type,
+			   uint32_t val)
+{
+	struct trx_clk_evt *evt = spsc_ring_claim(&tcs->thr->evt_q);
+
+	if (!evt) {
+		__atomic_add_fetch(&tcs->stats.evt_dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	evt->type = type;
+	evt->val = val;
+	clock_gettime(CLOCK_MONOTONIC, &evt->tv);
+	spsc_ring_commit(&tcs->thr->evt_q);
+}
+
+/*! main thread: handle the events queued by the clock thread
+ *
+ *  The frames are still processed here, on the main loop; the thread only
+ *  takes the timing of the timer and clock socket reads off it.  So the
+ *  time an event took to get here is accounted as latency, and the jitter
+ *  is measured when the frames are processed, not when the timer fired. */
+static void clk_thread_drain(struct osmo_trx_clock_state *tcs)
+{
+	struct trx_clk_evt *evt, e;
+	struct timespec tv_proc;
+
+	/* the thread may be stopped from within, e.g. on loss of clock */
+	while (tcs->thr && (evt = spsc_ring_peek(&tcs->thr->evt_q))) {
+		struct phy_link *plink = tcs->thr->plink;
+
+		e = *evt;
+		spsc_ring_release(&tcs->thr->evt_q);
+
+		clock_gettime(CLOCK_MONOTONIC, &tv_proc);
+		clk_hist_add(&tcs->stats.latency, compute_elapsed_us(&e.tv, &tv_proc));
+
+		switch (e.type) {
+		case TRX_CLK_EVT_TIMER:
+			trx_fn_timer_expired(tcs->fn_timer_ofd.data, tcs, e.val,
+					     &e.tv, &tv_proc);
+			break;
+		case TRX_CLK_EVT_IND:
+			trx_if_clk_ind(plink, e.val, &e.tv);
+			break;
+		case TRX_CLK_EVT_BAD:
+			LOGP(DTRX, LOGL_NOTICE, "Invalid message on clock port\n");
+			break;
+		}
+	}
+}
+
+static int clk_notify_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	uint64_t count;
+
+	if (read(ofd->fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+		return -errno;
+
+	clk_thread_drain(ofd->data);
+
+	return 0;
+}
+
+/*! the clock thread only reads the FN timer and the clock socket, and
+ *  queues what it got along with the time it got it */
+static void *clk_thread_main(void *arg)
+{
+	struct osmo_trx_clock_state *tcs = arg;
+	struct trx_clk_thread *thr = tcs->thr;
+	const uint64_t one = 1;
+	struct pollfd pfd[3];
+	uint64_t expire_count;
+	char buf[1500];
+	uint32_t fn;
+	ssize_t rc;
+
+	pthread_setname_np(pthread_self(), "trx-clock");
+
+	/* the timerfd and clock socket never change while we run */
+	pfd[0].fd = tcs->fn_timer_ofd.fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = thr->clk_ofd->fd;
+	pfd[1].events = POLLIN;
+	pfd[2].fd = thr->stop_fd;
+	pfd[2].events = POLLIN;
+
+	while (!__atomic_load_n(&thr->stop, __ATOMIC_ACQUIRE)) {
+		if (poll(pfd, ARRAY_SIZE(pfd), -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		if (pfd[0].revents & POLLIN) {
+			rc = read(pfd[0].fd, &expire_count, sizeof(expire_count));
+			if (rc == sizeof(expire_count))
+				clk_thread_evt(tcs, TRX_CLK_EVT_TIMER, expire_count);
+		}
+		if (pfd[1].revents & POLLIN) {
+			rc = trx_if_clk_recv(pfd[1].fd, buf, sizeof(buf), &fn);
+			if (rc == 0)
+				clk_thread_evt(tcs, TRX_CLK_EVT_IND, fn);
+			else if (rc == -ENOMSG || rc == -EBADMSG)
+				clk_thread_evt(tcs, TRX_CLK_EVT_BAD, 0);
+		}
+
+		/* a failing write means the counter is already non-zero */
+		if (spsc_ring_count(&thr->evt_q))
+			rc = write(thr->notify_ofd.fd, &one, sizeof(one));
+	}
+
+	(void) rc;
+	return NULL;
+}
+
+/*! move the frame clock of \a plink to a separate thread
+ *
+ *  The thread owns the FN timerfd and reads the clock socket of the phy,
+ *  which must already be open.  As there is only one frame clock (see
+ *  g_clk_s), only one phy link can have a clock thread. */
+int trx_sched_clock_thread_start(struct phy_link *plink)
+{
+	struct osmo_trx_clock_state *tcs = &g_clk_s;
+	struct trx_clk_thread *thr;
+	pthread_attr_t attr;
+	struct sched_param param;
+	int rc;
+
+	if (tcs->thr) {
+		LOGP(DL1C, LOGL_ERROR, "The clock thread already serves phy %d\n",
+			tcs->thr->plink->num);
+		return -EBUSY;
+	}
+	/* the timerfd must not be registered with the main loop */
+	if (tcs->fn_timer_ofd.fd >= 0)
+		return -EBUSY;
+
+	thr = talloc_zero(tall_bts_ctx, struct trx_clk_thread);
+	if (!thr)
+		return -ENOMEM;
+	thr->plink = plink;
+	thr->clk_ofd = &plink->u.osmotrx.trx_ofd_clk;
+	thr->prio = plink->u.osmotrx.clock_thread_prio;
+	thr->cpu = plink->u.osmotrx.clock_thread_cpu;
+	spsc_ring_init(&thr->evt_q, thr->evt_buf, sizeof(thr->evt_buf[0]),
+		       ARRAY_SIZE(thr->evt_buf));
+
+	tcs->fn_timer_ofd.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	thr->notify_ofd.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	thr->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (tcs->fn_timer_ofd.fd < 0 || thr->notify_ofd.fd < 0 || thr->stop_fd < 0) {
+		rc = -errno;
+		goto err;
+	}
+	thr->notify_ofd.when = BSC_FD_READ;
+	thr->notify_ofd.cb = clk_notify_cb;
+	thr->notify_ofd.data = tcs;
+	osmo_fd_register(&thr->notify_ofd);
+
+	pthread_attr_init(&attr);
+	if (thr->prio > 0) {
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		param.sched_priority = thr->prio;
+		pthread_attr_setschedparam(&attr, &param);
+	}
+	if (thr->cpu >= 0) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(thr->cpu, &set);
+		rc = pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+		if (rc) {
+			LOGP(DL1C, LOGL_ERROR, "Cannot pin the clock thread to CPU %d: %s\n",
+				thr->cpu, strerror(rc));
+			thr->cpu = -1;
+		}
+	}
+
+	/* from now on, the main loop no longer reads the clock socket */
+	thr->clk_ofd->when &= ~BSC_FD_READ;
+	tcs->thr = thr;
+
+	rc = pthread_create(&thr->thread, &attr, clk_thread_main, tcs);
+	if (rc == EPERM && thr->prio > 0) {
+		LOGP(DL1C, LOGL_ERROR, "Not permitted to use SCHED_FIFO priority %d "
+			"for the clock thread, using normal scheduling\n", thr->prio);
+		pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+		thr->prio = 0;
+		rc = pthread_create(&thr->thread, &attr, clk_thread_main, tcs);
+	}
+	pthread_attr_destroy(&attr);
+	if (rc) {
+		LOGP(DL1C, LOGL_ERROR, "Cannot create clock thread (prio %d, cpu %d): %s\n",
+			thr->prio, thr->cpu, strerror(rc));
+		tcs->thr = NULL;
+		thr->clk_ofd->when |= BSC_FD_READ;
+		osmo_fd_unregister(&thr->notify_ofd);
+		rc = -rc;
+		goto err;
+	}
+
+	LOGP(DL1C, LOGL_NOTICE, "Started clock thread (prio %d, cpu %d)\n",
+		thr->prio, thr->cpu);
+
+	return 0;
+
+err:
+	if (tcs->fn_timer_ofd.fd >= 0)
+		close(tcs->fn_timer_ofd.fd);
+	tcs->fn_timer_ofd.fd = -1;
+	if (thr->notify_ofd.fd >= 0)
+		close(thr->notify_ofd.fd);
+	if (thr->stop_fd >= 0)
+		close(thr->stop_fd);
+	talloc_free(thr);
+	return rc;
+}
+
+/*! stop the clock thread of \a plink, if it has one; the frame clock
+ *  continues on the main thread */
+void trx_sched_clock_thread_stop(struct phy_link *plink)
+{
+	struct osmo_trx_clock_state *tcs = &g_clk_s;
+	struct trx_clk_thread *thr = tcs->thr;
+	const uint64_t one = 1;
+	ssize_t rc;
+
+	/* may be called again while we handle the last events below */
+	if (!thr || thr->plink != plink || thr->stop)
+		return;
+
+	__atomic_store_n(&thr->stop, 1, __ATOMIC_RELEASE);
+	rc = write(thr->stop_fd, &one, sizeof(one));
+	(void) rc;
+	pthread_join(thr->thread, NULL);
+
+	/* handle what the thread has left, then take over its fds */
+	clk_thread_drain(tcs);
+	tcs->thr = NULL;
+
+	thr->clk_ofd->when |= BSC_FD_READ;
+	if (tcs->fn_timer_ofd.cb) {
+		/* the clock is running, serve the timerfd from the main loop */
+		tcs->fn_timer_ofd.when = BSC_FD_READ;
+		osmo_fd_register(&tcs->fn_timer_ofd);
+	} else {
+		close(tcs->fn_timer_ofd.fd);
+		tcs->fn_timer_ofd.fd = -1;
+	}
+
+	osmo_fd_unregister(&thr->notify_ofd);
+	close(thr->notify_ofd.fd);
+	close(thr->stop_fd);
+	talloc_free(thr);
+
+	LOGP(DL1C, LOGL_NOTICE, "Stopped clock thread\n");
+}
+
 void _sched_act_rach_det(struct l1sched_trx *l1t, uint8_t tn, uint8_t ss, int activate)
 {
 	struct phy_instance *pinst = trx_phy_instance(l1t->trx);
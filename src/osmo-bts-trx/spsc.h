@@ -0,0 +1,90 @@
+#ifndef _TRX_SPSC_H
+#define _TRX_SPSC_H
+
+/*
+ * lock-free single-producer / single-consumer ring of fixed size elements
+ *
+ * Exactly one thread may call spsc_ring_claim()/spsc_ring_commit() and
+ * exactly one (other) thread may call spsc_ring_peek()/spsc_ring_release().
+ * Elements are filled and consumed in place, so nothing is copied twice.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct spsc_ring {
+	uint8_t		*buf;
+	size_t		elem_size;
+	unsigned int	mask;		/* number of elements - 1 */
+	/* head and tail on separate cache lines, so that producer and
+	 * consumer don't keep stealing the line from each other */
+	uint8_t		_pad0[64];
+	/* next element to be written, only stored by the producer */
+	unsigned int	head;
+	uint8_t		_pad1[64];
+	/* next element to be read, only stored by the consumer */
+	unsigned int	tail;
+	uint8_t		_pad2[64];
+};
+
+/*! \brief initialize a ring on top of \a buf
+ *  \param[in] buf storage of \a num * \a elem_size bytes
+ *  \param[in] num number of elements, must be a power of two
+ *  \returns 0 on success; negative if \a num is not a power of two */
+static inline int spsc_ring_init(struct spsc_ring *r, void *buf, size_t elem_size,
+				 unsigned int num)
+{
+	if (!num || (num & (num - 1)))
+		return -1;
+
+	r->buf = buf;
+	r->elem_size = elem_size;
+	r->mask = num - 1;
+	r->head = 0;
+	r->tail = 0;
+
+	return 0;
+}
+
+/*! \brief producer: get the next free element, NULL if the ring is full */
+static inline void *spsc_ring_claim(struct spsc_ring *r)
+{
+	unsigned int tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+
+	if (r->head - tail > r->mask)
+		return NULL;
+
+	return r->buf + (r->head & r->mask) * r->elem_size;
+}
+
+/*! \brief producer: make the element returned by spsc_ring_claim() visible */
+static inline void spsc_ring_commit(struct spsc_ring *r)
+{
+	__atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+}
+
+/*! \brief consumer: get the oldest element, NULL if the ring is empty */
+static inline void *spsc_ring_peek(struct spsc_ring *r)
+{
+	unsigned int head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+
+	if (head == r->tail)
+		return NULL;
+
+	return r->buf + (r->tail & r->mask) * r->elem_size;
+}
+
+/*! \brief consumer: hand the element returned by spsc_ring_peek() back */
+static inline void spsc_ring_release(struct spsc_ring *r)
+{
+	__atomic_store_n(&r->tail, r->tail + 1, __ATOMIC_RELEASE);
+}
+
+/*! \brief number of elements currently queued (approximate for the other side) */
+static inline unsigned int spsc_ring_count(struct spsc_ring *r)
+{
+	return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE)
+		- __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
+
+#endif /* _TRX_SPSC_H */
@@ -0,0 +1,106 @@
+/* Control Interface for OsmoBTS-TRX */
+
+/* All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#include <osmocom/core/talloc.h>
+#include <osmocom/ctrl/control_cmd.h>
+
+#include <osmo-bts/gsm_data.h>
+#include <osmo-bts/bts_model.h>
+
+#include "l1_if.h"
+
+/* "<b0:n0,<b1:n1,...,>=bN:nN" */
+static char *clk_hist_reply(void *ctx, const struct trx_clk_hist *h)
+{
+	char *reply = talloc_strdup(ctx, "");
+	unsigned int i;
+
+	for (i = 0; i < h->num; i++) {
+		if (i < h->num - 1)
+			reply = talloc_asprintf_append(reply, "%s<%d:%"PRIu64,
+						       i ? "," : "", h->bounds[i],
+						       h->count[i]);
+		else
+			reply = talloc_asprintf_append(reply, ",>=%d:%"PRIu64,
+						       h->bounds[i - 1], h->count[i]);
+	}
+
+	return reply;
+}
+
+CTRL_CMD_DEFINE_RO(clk_jitter, "trx-clock-jitter");
+static int get_clk_jitter(struct ctrl_cmd *cmd, void *data)
+{
+	cmd->reply = clk_hist_reply(cmd, &trx_sched_clock_stats()->jitter);
+
+	return CTRL_CMD_REPLY;
+}
+
+CTRL_CMD_DEFINE_RO(clk_latency, "trx-clock-latency");
+static int get_clk_latency(struct ctrl_cmd *cmd, void *data)
+{
+	cmd->reply = clk_hist_reply(cmd, &trx_sched_clock_stats()->latency);
+
+	return CTRL_CMD_REPLY;
+}
+
+CTRL_CMD_DEFINE_RO(clk_catchup, "trx-clock-catchup");
+static int get_clk_catchup(struct ctrl_cmd *cmd, void *data)
+{
+	cmd->reply = clk_hist_reply(cmd, &trx_sched_clock_stats()->catchup);
+
+	return CTRL_CMD_REPLY;
+}
+
+CTRL_CMD_DEFINE_RO(clk_drift, "trx-clock-drift");
+static int get_clk_drift(struct ctrl_cmd *cmd, void *data)
+{
+	cmd->reply = clk_hist_reply(cmd, &trx_sched_clock_stats()->drift);
+
+	return CTRL_CMD_REPLY;
+}
+
+/* "timer-missed,skew-resets,events-dropped" */
+CTRL_CMD_DEFINE_RO(clk_counters, "trx-clock-counters");
+static int get_clk_counters(struct ctrl_cmd *cmd, void *data)
+{
+	const struct trx_clk_stats *st = trx_sched_clock_stats();
+
+	cmd->reply = talloc_asprintf(cmd, "%"PRIu64",%"PRIu64",%"PRIu64,
+				     st->timer_missed, st->skew_resets,
+				     st->evt_dropped);
+
+	return CTRL_CMD_REPLY;
+}
+
+int bts_model_ctrl_cmds_install(struct gsm_bts *bts)
+{
+	int rc = 0;
+
+	rc |= ctrl_cmd_install(CTRL_NODE_ROOT, &cmd_clk_jitter);
+	rc |= ctrl_cmd_install(CTRL_NODE_ROOT, &cmd_clk_latency);
+	rc |= ctrl_cmd_install(CTRL_NODE_ROOT, &cmd_clk_catchup);
+	rc |= ctrl_cmd_install(CTRL_NODE_ROOT, &cmd_clk_drift);
+	rc |= ctrl_cmd_install(CTRL_NODE_ROOT, &cmd_clk_counters);
+
+	return rc;
+}
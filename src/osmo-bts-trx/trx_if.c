@@ -24,14 +24,18 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdint.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
+#include <time.h>
 
 #include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 #include <osmocom/core/select.h>
 #include <osmocom/core/socket.h>
@@ -46,14 +50,14 @@
 
 #include "l1_if.h"
 #include "trx_if.h"
+#include "sbits.h"
+#include "trx_worker.h"
 
 /* enable to print RSSI level graph */
 //#define TOA_RSSI_DEBUG
 
 int transceiver_available = 0;
 
-#define TRX_MAX_BURST_LEN	512
-
 /*
  * socket helper functions
  */
@@ -94,32 +98,41 @@ static void trx_udp_close(struct osmo_fd *ofd)
  * TRX clock socket
  */
 
-/* get clock from clock socket */
-static int trx_clk_read_cb(struct osmo_fd *ofd, unsigned int what)
+/*! receive and parse a clock indication from the clock socket
+ *  \param[out] buf buffer of \a len bytes for the message, NUL-terminated
+ *  \param[out] fn frame number indicated by the transceiver
+ *  \returns 0 on success; -ENOMSG if the message is no clock indication;
+ *  -EBADMSG if it cannot be parsed; other negative values on error
+ *
+ *  Nothing but \a buf and \a fn is touched, so this may run on the clock
+ *  thread. */
+int trx_if_clk_recv(int fd, char *buf, size_t len, uint32_t *fn)
 {
-	struct phy_link *plink = ofd->data;
-	struct phy_instance *pinst = phy_instance_by_num(plink, 0);
-	char buf[1500];
-	int len;
-	uint32_t fn;
+	int rc;
 
-	OSMO_ASSERT(pinst);
+	rc = recv(fd, buf, len - 1, 0);
+	if (rc < 0)
+		return -errno;
+	if (rc == 0)
+		return -EAGAIN;
+	buf[rc] = '\0';
 
-	len = recv(ofd->fd, buf, sizeof(buf) - 1, 0);
-	if (len <= 0)
-		return len;
-	buf[len] = '\0';
+	if (!!strncmp(buf, "IND CLOCK ", 10))
+		return -ENOMSG;
 
-	if (!!strncmp(buf, "IND CLOCK ", 10)) {
-		LOGP(DTRX, LOGL_NOTICE, "Unknown message on clock port: %s\n",
-			buf);
-		return 0;
-	}
+	if (sscanf(buf, "IND CLOCK %u", fn) != 1)
+		return -EBADMSG;
 
-	if (sscanf(buf, "IND CLOCK %u", &fn) != 1) {
-		LOGP(DTRX, LOGL_ERROR, "Unable to parse '%s'\n", buf);
-		return 0;
-	}
+	return 0;
+}
+
+/*! process a clock indication from the transceiver of \a plink
+ *  \param[in] tv time at which the indication was received */
+void trx_if_clk_ind(struct phy_link *plink, uint32_t fn, const struct timespec *tv)
+{
+	struct phy_instance *pinst = phy_instance_by_num(plink, 0);
+
+	OSMO_ASSERT(pinst);
 
 	LOGP(DTRX, LOGL_INFO, "Clock indication: fn=%u\n", fn);
 
@@ -130,7 +143,35 @@ static int trx_clk_read_cb(struct osmo_fd *ofd, unsigned int what)
 	}
 
 	/* inform core TRX clock handling code that a FN has been received */
-	trx_sched_clock(pinst->trx->bts, fn);
+	trx_sched_clock_at(pinst->trx->bts, fn, tv);
+}
+
+/* get clock from clock socket */
+static int trx_clk_read_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	struct phy_link *plink = ofd->data;
+	struct timespec tv_now;
+	char buf[1500];
+	uint32_t fn;
+	int rc;
+
+	rc = trx_if_clk_recv(ofd->fd, buf, sizeof(buf), &fn);
+	switch (rc) {
+	case 0:
+		break;
+	case -ENOMSG:
+		LOGP(DTRX, LOGL_NOTICE, "Unknown message on clock port: %s\n",
+			buf);
+		return 0;
+	case -EBADMSG:
+		LOGP(DTRX, LOGL_ERROR, "Unable to parse '%s'\n", buf);
+		return 0;
+	default:
+		return rc;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &tv_now);
+	trx_if_clk_ind(plink, fn, &tv_now);
 
 	return 0;
 }
@@ -513,22 +554,17 @@ rsp_error:
  * TRX burst data socket
  */
 
-static int trx_data_read_cb(struct osmo_fd *ofd, unsigned int what)
+/*! parse one UL burst message from TRX and feed it into the scheduler */
+static int trx_data_handle_burst(struct trx_l1h *l1h, const uint8_t *buf, int len)
 {
-	struct trx_l1h *l1h = ofd->data;
-	uint8_t buf[TRX_MAX_BURST_LEN];
-	int len;
 	uint8_t tn;
 	int8_t rssi;
 	float toa = 0.0;
 	uint32_t fn;
 	sbit_t bits[EGPRS_BURST_LEN];
-	int i, burst_len = GSM_BURST_LEN;
+	int burst_len = GSM_BURST_LEN;
 
-	len = recv(ofd->fd, buf, sizeof(buf), 0);
-	if (len <= 0) {
-		return len;
-	} else if (len == EGPRS_BURST_LEN + 10) {
+	if (len == EGPRS_BURST_LEN + 10) {
 		burst_len = EGPRS_BURST_LEN;
 	/* Accept bursts ending with 2 bytes of padding (OpenBTS compatible trx) or without them: */
 	} else if (len != GSM_BURST_LEN + 10 && len != GSM_BURST_LEN + 8) {
@@ -541,14 +577,6 @@ static int trx_data_read_cb(struct osmo_fd *ofd, unsigned int what)
 	rssi = -(int8_t)buf[5];
 	toa = ((int16_t)(buf[6] << 8) | buf[7]) / 256.0F;
 
-	/* copy and convert bits {254..0} to sbits {-127..127} */
-	for (i = 0; i < burst_len; i++) {
-		if (buf[8 + i] == 255)
-			bits[i] = -127;
-		else
-			bits[i] = 127 - buf[8 + i];
-	}
-
 	if (tn >= 8) {
 		LOGP(DTRX, LOGL_ERROR, "Illegal TS %d\n", tn);
 		return -EINVAL;
@@ -570,12 +598,79 @@ static int trx_data_read_cb(struct osmo_fd *ofd, unsigned int what)
 	fprintf(stderr, "%s\n", deb);
 #endif
 
+	/* copy and convert bits {254..0} to sbits {-127..127} */
+	trx_sbits_conv(bits, buf + 8, burst_len);
+
 	/* feed received burst into scheduler code */
 	trx_sched_ul_burst(&l1h->l1s, tn, fn, bits, burst_len, rssi, toa);
 
 	return 0;
 }
 
+/*! account for \a num bursts having been read in one wakeup */
+static void trx_data_rx_stats(struct trx_l1h *l1h, unsigned int num)
+{
+	l1h->rx_stats.wakeups++;
+	l1h->rx_stats.bursts += num;
+	l1h->rx_stats.batch_hist[OSMO_MIN(num, TRX_RX_BATCH_MAX)]++;
+}
+
+#ifdef HAVE_RECVMMSG
+/*! drain up to \a max queued UL bursts from the data socket at once */
+static int trx_data_read_batch(struct trx_l1h *l1h, struct osmo_fd *ofd,
+			       unsigned int max)
+{
+	uint8_t buf[TRX_RX_BATCH_MAX][TRX_MAX_BURST_LEN];
+	struct mmsghdr msgs[TRX_RX_BATCH_MAX];
+	struct iovec iov[TRX_RX_BATCH_MAX];
+	unsigned int i;
+	int rc;
+
+	memset(msgs, 0, sizeof(msgs));
+	for (i = 0; i < max; i++) {
+		iov[i].iov_base = buf[i];
+		iov[i].iov_len = sizeof(buf[i]);
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	rc = recvmmsg(ofd->fd, msgs, max, MSG_DONTWAIT, NULL);
+	if (rc <= 0) {
+		trx_data_rx_stats(l1h, 0);
+		return rc;
+	}
+
+	trx_data_rx_stats(l1h, rc);
+
+	for (i = 0; i < rc; i++)
+		trx_data_handle_burst(l1h, buf[i], msgs[i].msg_len);
+
+	return 0;
+}
+#endif
+
+static int trx_data_read_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	struct trx_l1h *l1h = ofd->data;
+	uint8_t buf[TRX_MAX_BURST_LEN];
+	int len;
+
+#ifdef HAVE_RECVMMSG
+	struct phy_link *plink = l1h->phy_inst->phy_link;
+
+	if (plink->u.osmotrx.rx_batch_max > 1)
+		return trx_data_read_batch(l1h, ofd,
+			OSMO_MIN(plink->u.osmotrx.rx_batch_max, TRX_RX_BATCH_MAX));
+#endif
+
+	len = recv(ofd->fd, buf, sizeof(buf), 0);
+	trx_data_rx_stats(l1h, len > 0 ? 1 : 0);
+	if (len <= 0)
+		return len;
+
+	return trx_data_handle_burst(l1h, buf, len);
+}
+
 /*! Send burst data for given FN/timeslot to TRX
  *  \param[inout] l1h TRX Layer1 handle referring to TX
  *  \param[in] tn Timeslot Number (0..7)
@@ -583,19 +678,43 @@ static int trx_data_read_cb(struct osmo_fd *ofd, unsigned int what)
  *  \param[in] pwr Transmit Power to use
  *  \param[in] bits Unpacked bits to be transmitted
  *  \param[in] nbits Number of \a bits
- *  \returns 0 on success; negative on error */
+ *  \returns 0 on success; negative on error
+ *
+ *  If burst batching is enabled on the PHY link, the burst is only
+ *  appended to the batch of the current FN.  The caller must then call
+ *  trx_if_flush_bursts() once all bursts of the frame are composed. */
 int trx_if_send_burst(struct trx_l1h *l1h, uint8_t tn, uint32_t fn, uint8_t pwr,
 	const ubit_t *bits, uint16_t nbits)
 {
-	uint8_t buf[TRX_MAX_BURST_LEN];
+	struct phy_link *plink = l1h->phy_inst->phy_link;
+	struct trx_burst_batch *bb = &l1h->tx_batch;
+	uint8_t single_buf[TRX_MAX_BURST_LEN];
+	uint8_t *buf = single_buf;
+	bool batch;
 
 	if ((nbits != GSM_BURST_LEN) && (nbits != EGPRS_BURST_LEN)) {
 		LOGP(DTRX, LOGL_ERROR, "Tx burst length %u invalid\n", nbits);
 		return -1;
 	}
 
+	/* we must be sure that we have clock, and we have sent all control
+	 * data */
+	if (!transceiver_available || !llist_empty(&l1h->trx_ctrl_list)) {
+		LOGP(DTRX, LOGL_DEBUG, "Ignoring TX data, transceiver "
+			"offline.\n");
+		return 0;
+	}
+
 	LOGP(DTRX, LOGL_DEBUG, "TX burst tn=%u fn=%u pwr=%u\n", tn, fn, pwr);
 
+	batch = plink->u.osmotrx.burst_batching && !l1h->tx_batch_unsupported;
+	if (batch) {
+		/* should not happen, as we flush at the end of each FN */
+		if (bb->num >= ARRAY_SIZE(bb->buf))
+			trx_if_flush_bursts(l1h);
+		buf = bb->buf[bb->num];
+	}
+
 	buf[0] = tn;
 	buf[1] = (fn >> 24) & 0xff;
 	buf[2] = (fn >> 16) & 0xff;
@@ -606,17 +725,73 @@ int trx_if_send_burst(struct trx_l1h *l1h, uint8_t tn, uint32_t fn, uint8_t pwr,
 	/* copy ubits {0,1} */
 	memcpy(buf + 6, bits, nbits);
 
-	/* we must be sure that we have clock, and we have sent all control
-	 * data */
-	if (transceiver_available && llist_empty(&l1h->trx_ctrl_list)) {
-		send(l1h->trx_ofd_data.fd, buf, nbits + 6, 0);
-	} else
-		LOGP(DTRX, LOGL_DEBUG, "Ignoring TX data, transceiver "
-			"offline.\n");
+	if (batch) {
+		bb->len[bb->num++] = nbits + 6;
+		return 0;
+	}
+
+	send(l1h->trx_ofd_data.fd, buf, nbits + 6, 0);
+	l1h->tx_stats.bursts++;
+	l1h->tx_stats.syscalls++;
 
 	return 0;
 }
 
+/*! Send all bursts collected by trx_if_send_burst() to TRX
+ *  \param[inout] l1h TRX Layer1 handle referring to TX
+ *  \returns number of bursts flushed
+ *
+ *  All bursts of the batch are handed to the kernel using a single
+ *  sendmmsg() call.  If sendmmsg() is not available, or only a part of
+ *  the batch could be sent, the remaining bursts are sent one by one. */
+int trx_if_flush_bursts(struct trx_l1h *l1h)
+{
+	struct trx_burst_batch *bb = &l1h->tx_batch;
+	unsigned int i, sent = 0;
+	int num = bb->num;
+#ifdef HAVE_SENDMMSG
+	struct mmsghdr msgs[ARRAY_SIZE(bb->buf)];
+	struct iovec iov[ARRAY_SIZE(bb->buf)];
+	int rc;
+#endif
+
+	if (!bb->num)
+		return 0;
+
+#ifdef HAVE_SENDMMSG
+	memset(msgs, 0, sizeof(msgs));
+	for (i = 0; i < bb->num; i++) {
+		iov[i].iov_base = bb->buf[i];
+		iov[i].iov_len = bb->len[i];
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	rc = sendmmsg(l1h->trx_ofd_data.fd, msgs, bb->num, 0);
+	l1h->tx_stats.syscalls++;
+	if (rc > 0) {
+		sent = rc;
+		l1h->tx_stats.saved += rc - 1;
+	} else if (rc < 0 && errno == ENOSYS) {
+		LOGP(DTRX, LOGL_NOTICE, "sendmmsg() not supported, disabling "
+			"burst batching for %s\n",
+			phy_instance_name(l1h->phy_inst));
+		l1h->tx_batch_unsupported = true;
+	}
+#endif
+
+	/* send whatever is left one by one */
+	for (i = sent; i < bb->num; i++) {
+		send(l1h->trx_ofd_data.fd, bb->buf[i], bb->len[i], 0);
+		l1h->tx_stats.syscalls++;
+	}
+
+	l1h->tx_stats.bursts += bb->num;
+	bb->num = 0;
+
+	return num;
+}
+
 
 /*
  * open/close
@@ -645,6 +820,7 @@ void trx_if_close(struct trx_l1h *l1h)
 		phy_instance_name(pinst));
 
 	trx_if_flush(l1h);
+	l1h->tx_batch.num = 0;
 
 	/* close sockets */
 	trx_udp_close(&l1h->trx_ofd_ctrl);
@@ -714,6 +890,7 @@ static void trx_phy_inst_close(struct phy_instance *pinst)
 {
 	struct trx_l1h *l1h = pinst->u.osmotrx.hdl;
 
+	trx_worker_stop(l1h);
 	trx_if_close(l1h);
 	trx_sched_exit(&l1h->l1s);
 }
@@ -743,6 +920,13 @@ static int trx_phy_inst_open(struct phy_instance *pinst)
 		return -EIO;
 	}
 
+	if (pinst->phy_link->u.osmotrx.worker_threads) {
+		rc = trx_worker_start(l1h, l1h->worker_cpu);
+		if (rc < 0)
+			LOGP(DL1C, LOGL_ERROR, "Cannot start worker thread for phy "
+			     "instance %d, using main thread\n", pinst->num);
+	}
+
 	return 0;
 }
 
@@ -771,6 +955,11 @@ int bts_model_phy_link_open(struct phy_link *plink)
 		if (trx_phy_inst_open(pinst) < 0)
 			goto cleanup;
 	}
+	if (plink->u.osmotrx.clock_thread &&
+	    trx_sched_clock_thread_start(plink) < 0)
+		LOGP(DL1C, LOGL_ERROR, "Cannot start clock thread, the frame "
+		     "clock runs on the main thread\n");
+
 	/* FIXME: is there better way to check/report TRX availability? */
 	transceiver_available = 1;
 	phy_link_state_set(plink, PHY_LINK_CONNECTED);
@@ -780,6 +969,7 @@ cleanup:
 	phy_link_state_set(plink, PHY_LINK_SHUTDOWN);
 	llist_for_each_entry(pinst, &plink->instances, list) {
 		if (pinst->u.osmotrx.hdl) {
+			trx_worker_stop(pinst->u.osmotrx.hdl);
 			trx_if_close(pinst->u.osmotrx.hdl);
 			pinst->u.osmotrx.hdl = NULL;
 		}
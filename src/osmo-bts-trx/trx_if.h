@@ -3,7 +3,14 @@
 
 extern int transceiver_available;
 
+#define TRX_MAX_BURST_LEN	512
+/* maximum number of UL bursts read from the data socket per wakeup */
+#define TRX_RX_BATCH_MAX	32
+#define TRX_RX_BATCH_DEFAULT	16
+
 struct trx_l1h;
+struct phy_link;
+struct timespec;
 
 struct trx_ctrl_msg {
 	struct llist_head	list;
@@ -29,6 +36,9 @@ int trx_if_cmd_handover(struct trx_l1h *l1h, uint8_t tn, uint8_t ss);
 int trx_if_cmd_nohandover(struct trx_l1h *l1h, uint8_t tn, uint8_t ss);
 int trx_if_send_burst(struct trx_l1h *l1h, uint8_t tn, uint32_t fn, uint8_t pwr,
 	const ubit_t *bits, uint16_t nbits);
+int trx_if_flush_bursts(struct trx_l1h *l1h);
 int trx_if_powered(struct trx_l1h *l1h);
+int trx_if_clk_recv(int fd, char *buf, size_t len, uint32_t *fn);
+void trx_if_clk_ind(struct phy_link *plink, uint32_t fn, const struct timespec *tv);
 
 #endif /* TRX_IF_H */
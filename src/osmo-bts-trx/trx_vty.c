@@ -45,6 +45,7 @@
 #include "l1_if.h"
 #include "trx_if.h"
 #include "loops.h"
+#include "trx_worker.h"
 
 #define OSMOTRX_STR	"OsmoTRX Transceiver configuration\n"
 
@@ -93,9 +94,41 @@ DEFUN(show_transceiver, show_transceiver_cmd, "show transceiver",
 }
 
 
+static void show_clk_hist(struct vty *vty, const struct trx_clk_hist *h)
+{
+	char range[32];
+	unsigned int i;
+
+	vty_out(vty, " %s:%s", h->name, VTY_NEWLINE);
+	for (i = 0; i < h->num; i++) {
+		trx_clk_hist_fmt(range, sizeof(range), h, i);
+		vty_out(vty, "  %-14s %"PRIu64"%s", range, h->count[i], VTY_NEWLINE);
+	}
+}
+
+DEFUN(show_transceiver_clock, show_transceiver_clock_cmd, "show transceiver clock",
+	SHOW_STR "Display information about transceivers\n"
+	"Display statistics of the TRX frame clock\n")
+{
+	const struct trx_clk_stats *st = trx_sched_clock_stats();
+
+	vty_out(vty, "missed timer expirations: %"PRIu64"%s",
+		st->timer_missed, VTY_NEWLINE);
+	vty_out(vty, "clock skew resets: %"PRIu64"%s", st->skew_resets, VTY_NEWLINE);
+	vty_out(vty, "clock thread events dropped: %"PRIu64"%s",
+		st->evt_dropped, VTY_NEWLINE);
+	show_clk_hist(vty, &st->jitter);
+	show_clk_hist(vty, &st->latency);
+	show_clk_hist(vty, &st->catchup);
+	show_clk_hist(vty, &st->drift);
+
+	return CMD_SUCCESS;
+}
+
 static void show_phy_inst_single(struct vty *vty, struct phy_instance *pinst)
 {
 	uint8_t tn;
+	unsigned int i;
 	struct trx_l1h *l1h = pinst->u.osmotrx.hdl;
 
 	vty_out(vty, "PHY Instance %s%s",
@@ -133,6 +166,34 @@ static void show_phy_inst_single(struct vty *vty, struct phy_instance *pinst)
 			vty_out(vty, " slot #%d: undefined%s", tn,
 				VTY_NEWLINE);
 	}
+	for (tn = 0; tn < TRX_NR_TS; tn++) {
+		struct l1sched_ts *l1ts = l1sched_trx_get_ts(&l1h->l1s, tn);
+		vty_out(vty, " slot #%d DL prims: late %u, out of window %u, "
+			"expired %u%s", tn, l1ts->dl_prim_stats.late,
+			l1ts->dl_prim_stats.out_of_window,
+			l1ts->dl_prim_stats.expired, VTY_NEWLINE);
+	}
+	vty_out(vty, " tx bursts      : %"PRIu64" in %"PRIu64" syscalls "
+		"(%"PRIu64" saved by batching)%s", l1h->tx_stats.bursts,
+		l1h->tx_stats.syscalls,
+		l1h->tx_stats.saved, VTY_NEWLINE);
+	vty_out(vty, " rx bursts      : %"PRIu64" in %"PRIu64" wakeups%s",
+		l1h->rx_stats.bursts, l1h->rx_stats.wakeups, VTY_NEWLINE);
+	for (i = 0; i < ARRAY_SIZE(l1h->rx_stats.batch_hist); i++) {
+		if (!l1h->rx_stats.batch_hist[i])
+			continue;
+		vty_out(vty, "  %2u bursts/wakeup: %"PRIu64"%s", i,
+			l1h->rx_stats.batch_hist[i], VTY_NEWLINE);
+	}
+	if (l1h->worker) {
+		struct trx_worker *w = l1h->worker;
+		vty_out(vty, " worker thread  : cpu %d, %"PRIu64" UL frames decoded, "
+			"%u in flight, %"PRIu64" waits for results%s", w->cpu,
+			w->stats.jobs, w->in_flight, w->stats.waits, VTY_NEWLINE);
+		vty_out(vty, "                  %"PRIu64" DL blocks encoded, "
+			"%"PRIu64" of them too late%s", w->stats.dl_jobs,
+			w->stats.dl_misses, VTY_NEWLINE);
+	}
 }
 
 static void show_phy_single(struct vty *vty, struct phy_link *plink)
@@ -493,6 +554,139 @@ DEFUN(cfg_phy_no_setbsic, cfg_phy_no_setbsic_cmd,
 	return CMD_SUCCESS;
 }
 
+DEFUN(cfg_phy_burst_batching, cfg_phy_burst_batching_cmd,
+	"osmotrx burst-batching", OSMOTRX_STR
+	"Send all bursts of a TDMA frame to the transceiver using one sendmmsg() call\n")
+{
+	struct phy_link *plink = vty->index;
+	plink->u.osmotrx.burst_batching = true;
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_phy_no_burst_batching, cfg_phy_no_burst_batching_cmd,
+	"no osmotrx burst-batching",
+	NO_STR OSMOTRX_STR "Send each burst to the transceiver using a separate send() call\n")
+{
+	struct phy_link *plink = vty->index;
+	plink->u.osmotrx.burst_batching = false;
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_phy_rx_batch, cfg_phy_rx_batch_cmd,
+	"osmotrx rx-batch <1-32>", OSMOTRX_STR
+	"Set the maximum number of uplink bursts read from the transceiver "
+	"in one wakeup using recvmmsg()\n"
+	"Maximum number of bursts (1 disables recvmmsg())\n")
+{
+	struct phy_link *plink = vty->index;
+	plink->u.osmotrx.rx_batch_max = atoi(argv[0]);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_phy_worker_threads, cfg_phy_worker_threads_cmd,
+	"osmotrx worker-threads", OSMOTRX_STR
+	"Run the channel coding of each transceiver on its own thread "
+	"(takes effect when the phy is opened)\n")
+{
+	struct phy_link *plink = vty->index;
+	plink->u.osmotrx.worker_threads = true;
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_phy_no_worker_threads, cfg_phy_no_worker_threads_cmd,
+	"no osmotrx worker-threads",
+	NO_STR OSMOTRX_STR "Run the channel coding of all transceivers on the main thread\n")
+{
+	struct phy_link *plink = vty->index;
+	plink->u.osmotrx.worker_threads = false;
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_phyinst_worker_cpu, cfg_phyinst_worker_cpu_cmd,
+	"osmotrx worker-cpu <0-1023>", OSMOTRX_STR
+	"Pin the worker thread of this transceiver to a CPU\n"
+	"CPU number\n")
+{
+	struct phy_instance *pinst = vty->index;
+	struct trx_l1h *l1h = pinst->u.osmotrx.hdl;
+
+	l1h->worker_cpu = atoi(argv[0]);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_phyinst_no_worker_cpu, cfg_phyinst_no_worker_cpu_cmd,
+	"no osmotrx worker-cpu", NO_STR OSMOTRX_STR
+	"Let the worker thread of this transceiver run on any CPU\n")
+{
+	struct phy_instance *pinst = vty->index;
+	struct trx_l1h *l1h = pinst->u.osmotrx.hdl;
+
+	l1h->worker_cpu = -1;
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_phy_clock_thread, cfg_phy_clock_thread_cmd,
+	"osmotrx clock-thread", OSMOTRX_STR
+	"Read the frame clock on a separate thread (takes effect when the phy is opened)\n")
+{
+	struct phy_link *plink = vty->index;
+	plink->u.osmotrx.clock_thread = true;
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_phy_no_clock_thread, cfg_phy_no_clock_thread_cmd,
+	"no osmotrx clock-thread",
+	NO_STR OSMOTRX_STR "Read the frame clock on the main thread\n")
+{
+	struct phy_link *plink = vty->index;
+	plink->u.osmotrx.clock_thread = false;
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_phy_clock_thread_prio, cfg_phy_clock_thread_prio_cmd,
+	"osmotrx clock-thread priority <0-99>", OSMOTRX_STR
+	"Frame clock thread\n"
+	"Set the SCHED_FIFO priority of the clock thread\n"
+	"Priority (0 for normal scheduling)\n")
+{
+	struct phy_link *plink = vty->index;
+	plink->u.osmotrx.clock_thread_prio = atoi(argv[0]);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_phy_clock_thread_cpu, cfg_phy_clock_thread_cpu_cmd,
+	"osmotrx clock-thread cpu <0-1023>", OSMOTRX_STR
+	"Frame clock thread\n"
+	"Pin the clock thread to a CPU\n"
+	"CPU number\n")
+{
+	struct phy_link *plink = vty->index;
+	plink->u.osmotrx.clock_thread_cpu = atoi(argv[0]);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_phy_no_clock_thread_cpu, cfg_phy_no_clock_thread_cpu_cmd,
+	"no osmotrx clock-thread cpu",
+	NO_STR OSMOTRX_STR "Frame clock thread\n"
+	"Let the clock thread run on any CPU\n")
+{
+	struct phy_link *plink = vty->index;
+	plink->u.osmotrx.clock_thread_cpu = -1;
+
+	return CMD_SUCCESS;
+}
+
 void bts_model_config_write_phy(struct vty *vty, struct phy_link *plink)
 {
 	if (plink->u.osmotrx.local_ip)
@@ -522,6 +716,21 @@ void bts_model_config_write_phy(struct vty *vty, struct phy_link *plink)
 
 	if (plink->u.osmotrx.use_legacy_setbsic)
 		vty_out(vty, " osmotrx legacy-setbsic%s", VTY_NEWLINE);
+	if (!plink->u.osmotrx.burst_batching)
+		vty_out(vty, " no osmotrx burst-batching%s", VTY_NEWLINE);
+	if (plink->u.osmotrx.rx_batch_max != TRX_RX_BATCH_DEFAULT)
+		vty_out(vty, " osmotrx rx-batch %u%s",
+			plink->u.osmotrx.rx_batch_max, VTY_NEWLINE);
+	if (plink->u.osmotrx.worker_threads)
+		vty_out(vty, " osmotrx worker-threads%s", VTY_NEWLINE);
+	if (plink->u.osmotrx.clock_thread)
+		vty_out(vty, " osmotrx clock-thread%s", VTY_NEWLINE);
+	if (plink->u.osmotrx.clock_thread_prio)
+		vty_out(vty, " osmotrx clock-thread priority %d%s",
+			plink->u.osmotrx.clock_thread_prio, VTY_NEWLINE);
+	if (plink->u.osmotrx.clock_thread_cpu >= 0)
+		vty_out(vty, " osmotrx clock-thread cpu %d%s",
+			plink->u.osmotrx.clock_thread_cpu, VTY_NEWLINE);
 }
 
 void bts_model_config_write_phy_inst(struct vty *vty, struct phy_instance *pinst)
@@ -542,6 +751,8 @@ void bts_model_config_write_phy_inst(struct vty *vty, struct phy_instance *pinst
 		vty_out(vty, "  osmotrx maxdly %d%s", l1h->config.maxdly, VTY_NEWLINE);
 	if (l1h->config.maxdlynb_valid)
 		vty_out(vty, "  osmotrx maxdlynb %d%s", l1h->config.maxdlynb, VTY_NEWLINE);
+	if (l1h->worker_cpu >= 0)
+		vty_out(vty, "  osmotrx worker-cpu %d%s", l1h->worker_cpu, VTY_NEWLINE);
 	if (l1h->config.slotmask != 0xff)
 		vty_out(vty, "  slotmask %d %d %d %d %d %d %d %d%s",
 			l1h->config.slotmask & 1,
@@ -568,6 +779,7 @@ int bts_model_vty_init(struct gsm_bts *bts)
 	vty_bts = bts;
 
 	install_element_ve(&show_transceiver_cmd);
+	install_element_ve(&show_transceiver_clock_cmd);
 	install_element_ve(&show_phy_cmd);
 
 	install_element(PHY_NODE, &cfg_phy_ms_power_loop_cmd);
@@ -581,6 +793,16 @@ int bts_model_vty_init(struct gsm_bts *bts)
 	install_element(PHY_NODE, &cfg_phy_osmotrx_ip_cmd);
 	install_element(PHY_NODE, &cfg_phy_setbsic_cmd);
 	install_element(PHY_NODE, &cfg_phy_no_setbsic_cmd);
+	install_element(PHY_NODE, &cfg_phy_burst_batching_cmd);
+	install_element(PHY_NODE, &cfg_phy_no_burst_batching_cmd);
+	install_element(PHY_NODE, &cfg_phy_rx_batch_cmd);
+	install_element(PHY_NODE, &cfg_phy_worker_threads_cmd);
+	install_element(PHY_NODE, &cfg_phy_no_worker_threads_cmd);
+	install_element(PHY_NODE, &cfg_phy_clock_thread_cmd);
+	install_element(PHY_NODE, &cfg_phy_no_clock_thread_cmd);
+	install_element(PHY_NODE, &cfg_phy_clock_thread_prio_cmd);
+	install_element(PHY_NODE, &cfg_phy_clock_thread_cpu_cmd);
+	install_element(PHY_NODE, &cfg_phy_no_clock_thread_cpu_cmd);
 
 	install_element(PHY_INST_NODE, &cfg_phyinst_rxgain_cmd);
 	install_element(PHY_INST_NODE, &cfg_phyinst_tx_atten_cmd);
@@ -593,11 +815,8 @@ int bts_model_vty_init(struct gsm_bts *bts)
 	install_element(PHY_INST_NODE, &cfg_phyinst_no_maxdly_cmd);
 	install_element(PHY_INST_NODE, &cfg_phyinst_maxdlynb_cmd);
 	install_element(PHY_INST_NODE, &cfg_phyinst_no_maxdlynb_cmd);
+	install_element(PHY_INST_NODE, &cfg_phyinst_worker_cpu_cmd);
+	install_element(PHY_INST_NODE, &cfg_phyinst_no_worker_cpu_cmd);
 
 	return 0;
 }
-
-int bts_model_ctrl_cmds_install(struct gsm_bts *bts)
-{
-	return 0;
-}
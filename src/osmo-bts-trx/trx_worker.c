@@ -0,0 +1,462 @@
+/* Per-TRX worker threads for the channel coding of OsmoBTS-TRX */
+
+/* All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/eventfd.h>
+
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/select.h>
+
+#include <osmo-bts/logging.h>
+#include <osmo-bts/l1sap.h>
+#include <osmo-bts/scheduler.h>
+#include <osmo-bts/scheduler_backend.h>
+
+#include "l1_if.h"
+#include "trx_worker.h"
+
+extern void *tall_bts_ctx;
+
+/*
+ * worker side, nothing but the job and its result may be touched here
+ */
+
+/* encode the DL blocks the main thread has queued for us, they are due
+ * before any UL result */
+static void worker_process_dl(struct trx_worker *w)
+{
+	struct trx_worker_dl_job *job;
+	struct trx_worker_dl_done *done;
+
+	while ((job = spsc_ring_peek(&w->dl_job_q))) {
+		/* the main thread makes room before it queues a job */
+		done = spsc_ring_claim(&w->dl_done_q);
+		if (!done)
+			break;
+
+		done->id = job->id;
+		done->kind = job->kind;
+		done->rc = trx_sched_dl_encode(job->kind, job->data, job->len,
+					       done->bursts);
+		spsc_ring_release(&w->dl_job_q);
+		spsc_ring_commit(&w->dl_done_q);
+	}
+}
+
+/* decode everything the main thread has queued for us */
+static void worker_process(struct trx_worker *w)
+{
+	const uint64_t one = 1;
+	struct trx_worker_job *job;
+	struct trx_worker_done *done;
+	int num = 0;
+	ssize_t rc;
+
+	while ((job = spsc_ring_peek(&w->job_q))) {
+		/* cannot fail, the main thread keeps no more jobs in flight
+		 * than done_q can hold */
+		done = spsc_ring_claim(&w->done_q);
+		if (!done)
+			break;
+
+		done->ctx = job->ctx;
+		trx_sched_ul_decode(&job->ctx, job->bursts, &done->res);
+		spsc_ring_release(&w->job_q);
+
+		pthread_mutex_lock(&w->done_lock);
+		spsc_ring_commit(&w->done_q);
+		pthread_cond_signal(&w->done_cond);
+		pthread_mutex_unlock(&w->done_lock);
+		num++;
+
+		/* a DL block queued meanwhile is due earlier */
+		worker_process_dl(w);
+	}
+
+	if (!num)
+		return;
+
+	/* a failing write means the counter is already non-zero */
+	rc = write(w->notify_ofd.fd, &one, sizeof(one));
+	(void) rc;
+}
+
+static void *worker_main(void *arg)
+{
+	struct trx_worker *w = arg;
+	char name[16];
+
+	snprintf(name, sizeof(name), "trx-worker%u", w->l1h->phy_inst->num);
+	pthread_setname_np(pthread_self(), name);
+
+	while (1) {
+		if (sem_wait(&w->wake) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		/* finish all jobs queued before we were told to stop */
+		worker_process_dl(w);
+		worker_process(w);
+
+		if (__atomic_load_n(&w->stop, __ATOMIC_ACQUIRE))
+			break;
+	}
+
+	return NULL;
+}
+
+/*
+ * main thread side
+ */
+
+/* process all results the worker has queued for us */
+static void worker_drain(struct trx_worker *w)
+{
+	struct trx_worker_done *slot, done;
+
+	while ((slot = spsc_ring_peek(&w->done_q))) {
+		/* release before completing, L2 may change the config from
+		 * within and get us here again through trx_worker_sync() */
+		done = *slot;
+		spsc_ring_release(&w->done_q);
+		w->in_flight--;
+		w->pending[done.ctx.tn][done.ctx.chan]--;
+		trx_sched_ul_complete(&w->l1h->l1s, &done.ctx, &done.res);
+	}
+}
+
+static int worker_notify_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	struct trx_worker *w = ofd->data;
+	uint64_t count;
+
+	if (read(ofd->fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+		return -errno;
+
+	worker_drain(w);
+
+	return 0;
+}
+
+/* wait for the next result of the worker and process it */
+static void worker_wait(struct trx_worker *w)
+{
+	w->stats.waits++;
+
+	pthread_mutex_lock(&w->done_lock);
+	while (!spsc_ring_count(&w->done_q))
+		pthread_cond_wait(&w->done_cond, &w->done_lock);
+	pthread_mutex_unlock(&w->done_lock);
+
+	worker_drain(w);
+}
+
+/*! \brief process all outstanding results of the worker of a TRX,
+ *  waiting for them if needed (no-op if there is no worker)
+ *
+ *  To be called before the config of the whole TRX is reset, so that all
+ *  frames are completed with the config they were received with. */
+void trx_worker_sync(struct trx_worker *w)
+{
+	if (!w)
+		return;
+
+	worker_drain(w);
+	while (w->in_flight)
+		worker_wait(w);
+}
+
+/*! \brief process the outstanding results of one logical channel,
+ *  waiting for them if needed (no-op if there is no worker) */
+void trx_worker_sync_chan(struct trx_worker *w, uint8_t tn,
+			  enum trx_chan_type chan)
+{
+	if (!w)
+		return;
+
+	worker_drain(w);
+	while (w->pending[tn][chan])
+		worker_wait(w);
+}
+
+/*! \brief process the outstanding results of all channels of a timeslot,
+ *  to be called before its channel combination is changed */
+void trx_worker_sync_ts(struct trx_worker *w, uint8_t tn)
+{
+	int chan;
+
+	if (!w)
+		return;
+
+	for (chan = 0; chan < _TRX_CHAN_MAX; chan++)
+		trx_worker_sync_chan(w, tn, chan);
+}
+
+/*! \brief process the outstanding results of the channels (main and
+ *  associated) of one lchan, to be called before its config is changed;
+ *  frames of other lchans remain in flight */
+void trx_worker_sync_lchan(struct trx_worker *w, uint8_t chan_nr)
+{
+	uint8_t tn = L1SAP_CHAN2TS(chan_nr);
+	int chan;
+
+	if (!w)
+		return;
+
+	for (chan = 0; chan < _TRX_CHAN_MAX; chan++) {
+		if (trx_chan_desc[chan].chan_nr == (chan_nr & 0xf8))
+			trx_worker_sync_chan(w, tn, chan);
+	}
+}
+
+/*! \brief queue a complete UL frame to the worker of a TRX for decoding
+ *  \param[in] ctx what is needed to decode and complete the frame
+ *  \param[in] bursts soft-bits of the frame, ctx->bursts_len are copied
+ *  \returns 0; the result is processed later, on the main thread */
+int trx_worker_post(struct trx_worker *w, const struct trx_ul_ctx *ctx,
+		    const sbit_t *bursts)
+{
+	struct trx_worker_job *job;
+
+	/* make room, if the worker has fallen behind */
+	while (w->in_flight >= TRX_WORKER_QLEN)
+		worker_wait(w);
+
+	job = spsc_ring_claim(&w->job_q);
+	OSMO_ASSERT(job);
+	job->ctx = *ctx;
+	memcpy(job->bursts, bursts, ctx->bursts_len);
+	spsc_ring_commit(&w->job_q);
+
+	w->in_flight++;
+	w->pending[ctx->tn][ctx->chan]++;
+	w->stats.jobs++;
+	sem_post(&w->wake);
+
+	return 0;
+}
+
+/* keep the DL blocks the worker has encoded until they are due */
+static void worker_drain_dl(struct trx_worker *w)
+{
+	struct trx_worker_dl_done *done, *slot;
+
+	while ((done = spsc_ring_peek(&w->dl_done_q))) {
+		if (done->rc > 0) {
+			slot = &w->dl_coded[done->id % TRX_WORKER_DL_SLOTS];
+			slot->id = done->id;
+			slot->kind = done->kind;
+			slot->rc = done->rc;
+			memcpy(slot->bursts, done->bursts, done->rc);
+		}
+		spsc_ring_release(&w->dl_done_q);
+	}
+}
+
+/*! \brief queue a DL block handed down by L2 to the worker of a TRX, so
+ *  that it is encoded ahead of its FN
+ *  \param[in] l1sap PH-DATA.req, its msgb is still to be queued to the
+ *  scheduler, the worker gets a copy of the data
+ *  \returns 0 if queued; negative if the block is to be encoded on the
+ *  main thread, when it is due */
+int trx_worker_post_dl(struct trx_worker *w, const struct osmo_phsap_prim *l1sap)
+{
+	struct msgb *msg = l1sap->oph.msg;
+	uint8_t chan_nr = l1sap->u.data.chan_nr;
+	struct trx_worker_dl_job *job;
+	enum trx_dl_kind kind;
+
+	trx_dl_job_id(msg) = 0;
+
+	if (!w || !msgb_l2len(msg) || msgb_l2len(msg) > sizeof(job->data))
+		return -EINVAL;
+
+	if (L1SAP_IS_CHAN_PDCH(chan_nr))
+		kind = TRX_DL_PDTCH;
+	else if (!L1SAP_IS_CHAN_TCHF(chan_nr) && !L1SAP_IS_CHAN_TCHH(chan_nr))
+		kind = TRX_DL_XCCH;
+	else if (L1SAP_IS_LINK_SACCH(l1sap->u.data.link_id))
+		kind = TRX_DL_XCCH;
+	else {
+		/* FACCH is encoded along with the TCH */
+		return -ENOTSUP;
+	}
+
+	/* make room for the result before the job is queued */
+	worker_drain_dl(w);
+
+	job = spsc_ring_claim(&w->dl_job_q);
+	if (!job)
+		return -ENOSPC;
+	job->id = ++w->dl_id;
+	job->kind = kind;
+	job->len = msgb_l2len(msg);
+	memcpy(job->data, msgb_l2(msg), job->len);
+	spsc_ring_commit(&w->dl_job_q);
+
+	trx_dl_job_id(msg) = job->id;
+	w->stats.dl_jobs++;
+	sem_post(&w->wake);
+
+	return 0;
+}
+
+/*! \brief get the bursts the worker has encoded for a DL block that is due
+ *  \param[in] msg the block, as dequeued by the scheduler
+ *  \param[in] kind how the caller would encode the block
+ *  \param[out] bursts where the bursts are copied to
+ *  \returns number of bits; negative if the block is to be encoded by the
+ *  caller, never waits for the worker */
+int trx_worker_fetch_dl(struct trx_worker *w, struct msgb *msg,
+			enum trx_dl_kind kind, ubit_t *bursts)
+{
+	unsigned long id = trx_dl_job_id(msg);
+	struct trx_worker_dl_done *slot;
+
+	if (!w || !id)
+		return -ENOENT;
+
+	worker_drain_dl(w);
+
+	slot = &w->dl_coded[id % TRX_WORKER_DL_SLOTS];
+	if (slot->id != id || slot->kind != kind) {
+		w->stats.dl_misses++;
+		return -ENOENT;
+	}
+
+	memcpy(bursts, slot->bursts, slot->rc);
+	slot->id = 0;
+
+	return slot->rc;
+}
+
+static void *ring_alloc(struct trx_worker *w, struct spsc_ring *r,
+			size_t elem_size, unsigned int num)
+{
+	void *buf = talloc_zero_size(w, elem_size * num);
+
+	if (buf)
+		spsc_ring_init(r, buf, elem_size, num);
+	return buf;
+}
+
+/*! \brief move the channel coding of a TRX to its own thread
+ *  \param[in] l1h TRX handle, scheduler must be initialized
+ *  \param[in] cpu CPU to pin the thread to, -1 for none
+ *  \returns 0 on success; negative on error */
+int trx_worker_start(struct trx_l1h *l1h, int cpu)
+{
+	struct trx_worker *w;
+	int rc;
+
+	w = talloc_zero(tall_bts_ctx, struct trx_worker);
+	if (!w)
+		return -ENOMEM;
+	w->l1h = l1h;
+	w->cpu = cpu;
+
+	if (!ring_alloc(w, &w->job_q, sizeof(struct trx_worker_job), TRX_WORKER_QLEN)
+	 || !ring_alloc(w, &w->done_q, sizeof(struct trx_worker_done), TRX_WORKER_QLEN)
+	 || !ring_alloc(w, &w->dl_job_q, sizeof(struct trx_worker_dl_job), TRX_WORKER_DL_QLEN)
+	 || !ring_alloc(w, &w->dl_done_q, sizeof(struct trx_worker_dl_done), TRX_WORKER_DL_QLEN)) {
+		talloc_free(w);
+		return -ENOMEM;
+	}
+
+	w->notify_ofd.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (w->notify_ofd.fd < 0) {
+		talloc_free(w);
+		return -errno;
+	}
+	w->notify_ofd.when = BSC_FD_READ;
+	w->notify_ofd.cb = worker_notify_cb;
+	w->notify_ofd.data = w;
+	osmo_fd_register(&w->notify_ofd);
+
+	pthread_mutex_init(&w->done_lock, NULL);
+	pthread_cond_init(&w->done_cond, NULL);
+	sem_init(&w->wake, 0, 0);
+
+	rc = pthread_create(&w->thread, NULL, worker_main, w);
+	if (rc) {
+		LOGP(DL1C, LOGL_ERROR, "Cannot create worker thread for %s: %s\n",
+			phy_instance_name(l1h->phy_inst), strerror(rc));
+		osmo_fd_unregister(&w->notify_ofd);
+		close(w->notify_ofd.fd);
+		sem_destroy(&w->wake);
+		pthread_cond_destroy(&w->done_cond);
+		pthread_mutex_destroy(&w->done_lock);
+		talloc_free(w);
+		return -rc;
+	}
+
+	if (cpu >= 0) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		rc = pthread_setaffinity_np(w->thread, sizeof(set), &set);
+		if (rc)
+			LOGP(DL1C, LOGL_ERROR, "Cannot pin worker of %s to CPU %d: %s\n",
+				phy_instance_name(l1h->phy_inst), cpu, strerror(rc));
+	}
+
+	l1h->worker = w;
+
+	LOGP(DL1C, LOGL_NOTICE, "Started worker thread for %s (cpu %d)\n",
+		phy_instance_name(l1h->phy_inst), cpu);
+
+	return 0;
+}
+
+/*! \brief stop the worker of a TRX, the channel coding returns to the main thread */
+void trx_worker_stop(struct trx_l1h *l1h)
+{
+	struct trx_worker *w = l1h->worker;
+
+	if (!w)
+		return;
+
+	__atomic_store_n(&w->stop, 1, __ATOMIC_RELEASE);
+	sem_post(&w->wake);
+	pthread_join(w->thread, NULL);
+
+	/* the worker has decoded all jobs before it stopped */
+	worker_drain(w);
+	OSMO_ASSERT(!w->in_flight);
+
+	l1h->worker = NULL;
+
+	osmo_fd_unregister(&w->notify_ofd);
+	close(w->notify_ofd.fd);
+	sem_destroy(&w->wake);
+	pthread_cond_destroy(&w->done_cond);
+	pthread_mutex_destroy(&w->done_lock);
+	talloc_free(w);
+}
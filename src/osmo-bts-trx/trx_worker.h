@@ -0,0 +1,186 @@
+#ifndef _TRX_WORKER_H
+#define _TRX_WORKER_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include <osmocom/core/bits.h>
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/select.h>
+#include <osmocom/gsm/l1sap.h>
+#include <osmocom/coding/gsm0503_coding.h>
+
+#include <osmo-bts/scheduler.h>
+
+#include "spsc.h"
+
+/*
+ * per-TRX worker thread doing the channel coding of one transceiver
+ *
+ * Everything except the coding itself stays on the main thread: the
+ * frame clock, the RTS indications, the collection of UL bursts, the
+ * measurements, the loops and all configuration.  Once all bursts of a UL
+ * frame have been received, the main thread copies them, along with the
+ * bits of channel state the decoder needs, into a job for the worker.
+ * The worker only runs trx_sched_ul_decode(), which touches nothing but
+ * the job and its result.  The results are queued back and applied by
+ * the main thread in trx_sched_ul_complete(), woken up by an eventfd.
+ *
+ * A frame may depend on the result of the previous frame of the same
+ * channel (AMR codec mode, FACCH/H), so the main thread waits for the
+ * outstanding results of a channel before it decodes its next frame, and
+ * for those of a logical channel (or timeslot) before it changes its
+ * config.
+ *
+ * DL blocks of the block interleaved channels (xCCH, PDTCH) are encoded
+ * by the worker as soon as L2 hands them down, ahead of their FN.  The
+ * coded bursts are queued back and picked up by the DL scheduler when
+ * the block is due; if the worker has not got to it by then, the block
+ * is encoded on the main thread as before, nobody ever waits for a DL
+ * result.  TCH is encoded on the main thread, its diagonal interleaving
+ * depends on the previous frames actually sent.
+ */
+
+/* number of jobs in flight, must be a power of two */
+#define TRX_WORKER_QLEN		64
+/* number of DL blocks in flight, must be a power of two */
+#define TRX_WORKER_DL_QLEN	32
+/* number of encoded DL blocks kept until they are due */
+#define TRX_WORKER_DL_SLOTS	(2 * TRX_WORKER_DL_QLEN)
+
+/* ID of the DL job of a msgb queued to the scheduler, 0 for none */
+#define trx_dl_job_id(x) ((x)->cb[0])
+
+struct trx_l1h;
+
+/* kind of UL frame to decode */
+enum trx_ul_kind {
+	TRX_UL_XCCH,
+	TRX_UL_PDTCH,
+	TRX_UL_TCHF,
+	TRX_UL_TCHH,
+};
+
+/* a complete UL frame: what the decoder needs and what is needed to
+ * process its result, copied from the channel state at the last burst */
+struct trx_ul_ctx {
+	enum trx_ul_kind	kind;
+	uint8_t			tn;
+	enum trx_chan_type	chan;
+	uint32_t		fn;		/* FN of last burst */
+	uint32_t		first_fn;	/* FN of first burst */
+	uint16_t		nbits;		/* length of last burst */
+	uint16_t		bursts_len;	/* soft-bits to decode */
+	uint8_t			rsl_cmode, tch_mode;
+	uint8_t			codec[4];
+	int			codecs;
+	uint8_t			ul_ft, ul_cmr;
+	float			rssi, toa;
+};
+
+/* result of decoding a UL frame */
+struct trx_ul_res {
+	int			rc;		/* return code of the decoder */
+	int			n_errors;
+	int			n_bits_total;
+	uint8_t			ul_ft, ul_cmr;	/* AMR: updated by the decoder */
+	uint8_t			data[EGPRS_0503_MAX_BYTES];
+};
+
+/* kind of DL block to encode */
+enum trx_dl_kind {
+	TRX_DL_XCCH,
+	TRX_DL_PDTCH,
+};
+
+/* DL block to encode, main thread -> worker */
+struct trx_worker_dl_job {
+	unsigned long		id;
+	enum trx_dl_kind	kind;
+	uint16_t		len;
+	uint8_t			data[EGPRS_0503_MAX_BYTES];
+};
+
+/* encoded DL block, worker -> main thread */
+struct trx_worker_dl_done {
+	unsigned long		id;
+	enum trx_dl_kind	kind;
+	int			rc;	/* bits encoded, negative on error */
+	ubit_t			bursts[GSM0503_EGPRS_BURSTS_NBITS];
+};
+
+/* UL frame to decode, main thread -> worker */
+struct trx_worker_job {
+	struct trx_ul_ctx	ctx;
+	sbit_t			bursts[GSM0503_EGPRS_BURSTS_NBITS];
+};
+
+/* decoded UL frame, worker -> main thread */
+struct trx_worker_done {
+	struct trx_ul_ctx	ctx;
+	struct trx_ul_res	res;
+};
+
+struct trx_worker {
+	struct trx_l1h		*l1h;
+	pthread_t		thread;
+	/* posted for every job queued to the worker */
+	sem_t			wake;
+	int			stop;
+	/* CPU the thread is pinned to, -1 for none */
+	int			cpu;
+
+	struct spsc_ring	job_q;		/* frames to decode */
+	struct spsc_ring	done_q;		/* decoded frames */
+	struct spsc_ring	dl_job_q;	/* DL blocks to encode */
+	struct spsc_ring	dl_done_q;	/* encoded DL blocks */
+
+	/* eventfd, signalled by the worker if done_q has entries */
+	struct osmo_fd		notify_ofd;
+	/* signalled with every entry in done_q, for trx_worker_sync() */
+	pthread_mutex_t		done_lock;
+	pthread_cond_t		done_cond;
+
+	/* main thread only: jobs not completed yet, in total and per channel */
+	unsigned int		in_flight;
+	uint8_t			pending[TRX_NR_TS][_TRX_CHAN_MAX];
+	/* main thread only: last DL job ID and the encoded DL blocks,
+	 * in the slot of their ID modulo TRX_WORKER_DL_SLOTS */
+	unsigned long		dl_id;
+	struct trx_worker_dl_done dl_coded[TRX_WORKER_DL_SLOTS];
+
+	struct {
+		uint64_t	jobs;		/* frames decoded by the worker */
+		uint64_t	waits;		/* main thread waited for a result */
+		uint64_t	dl_jobs;	/* DL blocks encoded by the worker */
+		uint64_t	dl_misses;	/* DL blocks encoded on the main thread */
+	} stats;
+};
+
+int trx_worker_start(struct trx_l1h *l1h, int cpu);
+void trx_worker_stop(struct trx_l1h *l1h);
+
+int trx_worker_post(struct trx_worker *w, const struct trx_ul_ctx *ctx,
+		    const sbit_t *bursts);
+void trx_worker_sync(struct trx_worker *w);
+void trx_worker_sync_ts(struct trx_worker *w, uint8_t tn);
+void trx_worker_sync_lchan(struct trx_worker *w, uint8_t chan_nr);
+void trx_worker_sync_chan(struct trx_worker *w, uint8_t tn,
+			  enum trx_chan_type chan);
+
+int trx_worker_post_dl(struct trx_worker *w, const struct osmo_phsap_prim *l1sap);
+int trx_worker_fetch_dl(struct trx_worker *w, struct msgb *msg,
+			enum trx_dl_kind kind, ubit_t *bursts);
+
+/* scheduler_trx.c: decode a UL frame, without access to any shared state */
+void trx_sched_ul_decode(const struct trx_ul_ctx *ctx, const sbit_t *bursts,
+			 struct trx_ul_res *res);
+/* scheduler_trx.c: encode a DL block, without access to any shared state */
+int trx_sched_dl_encode(enum trx_dl_kind kind, uint8_t *data, uint16_t len,
+			ubit_t *bursts);
+/* scheduler_trx.c: process the result of decoding a UL frame */
+int trx_sched_ul_complete(struct l1sched_trx *l1t, const struct trx_ul_ctx *ctx,
+			  struct trx_ul_res *res);
+
+#endif /* _TRX_WORKER_H */
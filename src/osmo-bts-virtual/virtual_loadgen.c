@@ -0,0 +1,1037 @@
+/* Load generator for the virtual Um interface of osmo-bts-virtual */
+
+/* All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Emulates a population of mobile stations on the multicast groups of
+ * the virtual Um interface, so that a BTS+BSC(+MSC) chain can be put
+ * under load without any RF hardware.  Each virtual MS goes through
+ *
+ *   RACH -> IMMEDIATE ASSIGNMENT -> SABM(L3 info) -> UA
+ *        -> [ASSIGNMENT COMMAND -> SABM(ASSIGNMENT COMPLETE) -> UA
+ *            -> TCH uplink frames]
+ *        -> CHANNEL RELEASE or hold time expiry -> DISC
+ *
+ * Access attempts arrive at a configurable rate, periodically or as a
+ * Poisson process, and are served by whichever MS is idle.  The time
+ * from the RACH to the matching IMMEDIATE ASSIGNMENT and the SABM/UA
+ * round trip on the dedicated channel are recorded.
+ *
+ * Only what the virtual PHY of osmo-bts passes on is emulated: no
+ * SACCH, no ciphering, no frequency hopping, and the TCH frames carry
+ * a dummy speech pattern.  The frame number is extrapolated from the
+ * downlink, so the tool needs to see the BCCH before it starts.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <math.h>
+#include <time.h>
+#include <inttypes.h>
+#include <arpa/inet.h>
+
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/application.h>
+#include <osmocom/core/logging.h>
+#include <osmocom/core/linuxlist.h>
+#include <osmocom/core/select.h>
+#include <osmocom/core/timer.h>
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/core/gsmtap.h>
+#include <osmocom/core/gsmtap_util.h>
+#include <osmocom/gsm/rsl.h>
+#include <osmocom/gsm/gsm48.h>
+#include <osmocom/gsm/gsm_utils.h>
+#include <osmocom/gsm/protocol/gsm_04_08.h>
+#include <osmocom/gsm/protocol/gsm_08_58.h>
+
+#include "virtual_um.h"
+
+#define LG_HYPERFRAME		(26 * 51 * 2048)
+#define LG_FRAME_US		4615
+
+/* like T3126 and T200, but generous: we measure, not conform */
+#define LG_RACH_TIMEOUT_MS	1000
+#define LG_EST_TIMEOUT_MS	1000
+#define LG_MAX_RETRIES		3
+
+#define LG_TCH_INTERVAL_MS	20
+#define LG_LAT_BUCKETS		17	/* < 1 ms, then powers of two up to 32 s */
+
+#define LG_IMSI_MAX_DIGITS	15
+#define LG_MID_MAX_LEN		11
+#define LG_FR_BYTES		33
+#define LG_HR_BYTES		14
+
+enum {
+	DLOADGEN,
+};
+
+static struct log_info_cat lg_log_info_cat[] = {
+	[DLOADGEN] = {
+		.name = "DLOADGEN",
+		.description = "Virtual Um load generator",
+		.enabled = 1, .loglevel = LOGL_NOTICE,
+	},
+};
+
+static const struct log_info lg_log_info = {
+	.cat = lg_log_info_cat,
+	.num_cat = ARRAY_SIZE(lg_log_info_cat),
+};
+
+enum vms_state {
+	VMS_S_IDLE,
+	VMS_S_RACH,		/* waiting for IMMEDIATE ASSIGNMENT */
+	VMS_S_EST,		/* waiting for UA on the SDCCH */
+	VMS_S_DEDIC,		/* established, waiting for the network */
+	VMS_S_ASSIGN,		/* waiting for UA on the assigned channel */
+	VMS_S_TCH,		/* sending TCH frames */
+};
+
+/* one virtual MS */
+struct vms {
+	/* in the idle list, the RACH list of its RA or the list of its
+	 * dedicated channel, depending on the state */
+	struct llist_head list;
+	unsigned int nr;
+	char imsi[LG_IMSI_MAX_DIGITS + 1];
+	enum vms_state state;
+	struct osmo_timer_list timer;
+	unsigned int retries;
+
+	/* last access burst */
+	uint8_t ra;
+	uint32_t rach_fn;
+	uint64_t rach_us;
+
+	/* dedicated channel */
+	uint16_t arfcn;
+	uint8_t chan_nr;
+	uint8_t vr;		/* LAPDm V(R) */
+	uint8_t l3[20];		/* contents of the SABM */
+	uint8_t l3_len;
+	uint64_t sabm_us;
+};
+
+struct lat_stat {
+	const char *name;
+	uint64_t num, sum_us;
+	uint64_t min_us, max_us;
+	uint64_t hist[LG_LAT_BUCKETS];
+};
+
+static struct {
+	/* configuration */
+	unsigned int num_ms;
+	double rate;
+	bool poisson;
+	bool call;
+	bool tch;
+	unsigned int hold_s;
+	unsigned int duration_s;
+	unsigned int stats_interval_s;
+	int arfcn;
+	const char *imsi_base;
+	const char *ms_group, *bts_group;
+	uint16_t ms_port, bts_port;
+	const char *csv_path;
+	unsigned int min_success;
+	unsigned int seed;
+
+	/* state */
+	struct virt_um_inst *vui;
+	struct vms *ms;
+	struct llist_head idle;
+	struct llist_head rach_wait[256];
+	struct llist_head chan[256];
+	bool have_cell;
+	uint32_t dl_fn;
+	uint64_t dl_fn_us;
+	uint64_t start_us;
+	FILE *csv;
+	struct osmo_timer_list arrival_timer, tch_timer, stats_timer, end_timer;
+
+	struct {
+		uint64_t attempts, no_idle_ms;
+		uint64_t rach, rach_retrans, rach_fail;
+		uint64_t imm_ass, imm_ass_rej;
+		uint64_t sabm, sabm_retrans, est_ok, est_fail;
+		uint64_t ass_cmd, ass_ok, ass_fail;
+		uint64_t chan_rel, local_rel;
+		uint64_t tch_frames, dl_frames;
+	} ctr;
+	struct lat_stat lat_imm_ass, lat_est;
+} lg = {
+	.num_ms = 1000,
+	.rate = 10,
+	.poisson = true,
+	.tch = true,
+	.hold_s = 10,
+	.stats_interval_s = 10,
+	.arfcn = -1,
+	.imsi_base = "001010000000001",
+	.ms_group = DEFAULT_MS_MCAST_GROUP,
+	.ms_port = DEFAULT_MS_MCAST_PORT,
+	.bts_group = DEFAULT_BTS_MCAST_GROUP,
+	.bts_port = DEFAULT_BTS_MCAST_PORT,
+	.lat_imm_ass = { .name = "RACH -> IMM ASS" },
+	.lat_est = { .name = "SABM -> UA" },
+};
+
+static volatile int quit;
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* the frame number the BTS is at, extrapolated from the last downlink */
+static uint32_t cur_fn(void)
+{
+	return (lg.dl_fn + (now_us() - lg.dl_fn_us) / LG_FRAME_US) % LG_HYPERFRAME;
+}
+
+static double rnd_uniform(void)
+{
+	return random() / ((double) RAND_MAX + 1);
+}
+
+/*
+ * latency statistics
+ */
+
+static void lat_add(struct lat_stat *s, uint64_t us, const struct vms *ms)
+{
+	unsigned int b = 0;
+	uint64_t ms_val = us / 1000;
+
+	while (ms_val && b < LG_LAT_BUCKETS - 1) {
+		ms_val >>= 1;
+		b++;
+	}
+	s->hist[b]++;
+	if (!s->num || us < s->min_us)
+		s->min_us = us;
+	if (us > s->max_us)
+		s->max_us = us;
+	s->num++;
+	s->sum_us += us;
+
+	if (lg.csv)
+		fprintf(lg.csv, "%.6f,%s,%u,%"PRIu64"\n",
+			(now_us() - lg.start_us) / 1e6, s->name, ms->nr, us);
+}
+
+/* upper bound in ms of the bucket holding the given percentile */
+static unsigned int lat_percentile(const struct lat_stat *s, unsigned int pct)
+{
+	uint64_t want = (s->num * pct + 99) / 100, sum = 0;
+	unsigned int b;
+
+	for (b = 0; b < LG_LAT_BUCKETS; b++) {
+		sum += s->hist[b];
+		if (sum >= want)
+			break;
+	}
+	return 1 << b;
+}
+
+static void lat_print(const struct lat_stat *s, bool hist)
+{
+	unsigned int b;
+
+	if (!s->num) {
+		printf("  %-16s no samples\n", s->name);
+		return;
+	}
+	printf("  %-16s n=%"PRIu64" min=%.1f avg=%.1f max=%.1f ms, "
+	       "p50<%u p95<%u p99<%u ms\n", s->name, s->num,
+	       s->min_us / 1e3, s->sum_us / 1e3 / s->num, s->max_us / 1e3,
+	       lat_percentile(s, 50), lat_percentile(s, 95),
+	       lat_percentile(s, 99));
+	if (!hist)
+		return;
+	for (b = 0; b < LG_LAT_BUCKETS; b++) {
+		if (!s->hist[b])
+			continue;
+		printf("    < %6u ms: %"PRIu64"\n", 1 << b, s->hist[b]);
+	}
+}
+
+/*
+ * uplink
+ */
+
+static int tx_um(uint16_t arfcn, uint8_t chan_type, uint8_t tn, uint8_t ss,
+		 uint32_t fn, const uint8_t *data, unsigned int len)
+{
+	struct msgb *msg;
+
+	msg = gsmtap_makemsg(arfcn | GSMTAP_ARFCN_F_UPLINK, tn, chan_type, ss,
+			     fn, 63, 63, data, len);
+	if (!msg)
+		return -ENOMEM;
+	return virt_um_write_msg(lg.vui, msg);
+}
+
+/* send on the main signalling channel, the FACCH on a TCH */
+static int tx_dcch(struct vms *ms, const uint8_t *data, unsigned int len)
+{
+	uint8_t rsl_chantype, ss, tn;
+
+	if (rsl_dec_chan_nr(ms->chan_nr, &rsl_chantype, &ss, &tn) < 0)
+		return -EINVAL;
+	return tx_um(ms->arfcn, chantype_rsl2gsmtap(rsl_chantype, 0), tn, ss,
+		     cur_fn(), data, len);
+}
+
+/* LAPDm frame on SAPI 0, C/R as sent by the MS */
+static int tx_lapdm(struct vms *ms, bool cmd, uint8_t ctrl,
+		    const uint8_t *l3, uint8_t l3_len)
+{
+	uint8_t buf[GSM_MACBLOCK_LEN];
+
+	memset(buf, GSM_MACBLOCK_PADDING, sizeof(buf));
+	buf[0] = cmd ? 0x01 : 0x03;
+	buf[1] = ctrl;
+	buf[2] = (l3_len << 2) | 0x01;
+	if (l3_len)
+		memcpy(buf + 3, l3, l3_len);
+
+	return tx_dcch(ms, buf, sizeof(buf));
+}
+
+#define LAPDM_CTRL_SABM_P	0x3f
+#define LAPDM_CTRL_DISC_P	0x53
+#define LAPDM_CTRL_UA		0x63
+#define LAPDM_CTRL_RR(nr)	(((nr) << 5) | 0x01)
+
+static void tx_sabm(struct vms *ms)
+{
+	tx_lapdm(ms, true, LAPDM_CTRL_SABM_P, ms->l3, ms->l3_len);
+	ms->sabm_us = now_us();
+	lg.ctr.sabm++;
+	osmo_timer_schedule(&ms->timer, 0, LG_EST_TIMEOUT_MS * 1000);
+}
+
+/* the initial layer 3 message of an access */
+static void fill_initial_l3(struct vms *ms)
+{
+	uint8_t mid[LG_MID_MAX_LEN];
+	uint8_t *l3 = ms->l3;
+	int mid_len;
+
+	/* TV, the tag is not sent in either message */
+	mid_len = gsm48_generate_mid_from_imsi(mid, ms->imsi);
+
+	*l3++ = GSM48_PDISC_MM;
+	if (lg.call) {
+		*l3++ = GSM48_MT_MM_CM_SERV_REQ;
+		*l3++ = 0x71;			/* no CKSN, MO call */
+		*l3++ = 3;			/* MS classmark 2 */
+		*l3++ = 0x33;
+		*l3++ = 0x19;
+		*l3++ = 0xa2;
+	} else {
+		*l3++ = GSM48_MT_MM_LOC_UPD_REQUEST;
+		*l3++ = 0x70;			/* no CKSN, normal LU */
+		memset(l3, 0xff, 5);		/* no valid old LAI */
+		l3 += 5;
+		*l3++ = 0x33;			/* MS classmark 1 */
+	}
+	memcpy(l3, mid + 1, mid_len - 1);
+	l3 += mid_len - 1;
+
+	ms->l3_len = l3 - ms->l3;
+}
+
+/*
+ * MS states
+ */
+
+static void vms_idle(struct vms *ms)
+{
+	osmo_timer_del(&ms->timer);
+	llist_del(&ms->list);
+	ms->state = VMS_S_IDLE;
+	llist_add_tail(&ms->list, &lg.idle);
+}
+
+static void vms_rach(struct vms *ms)
+{
+	/* establishment cause, then a random reference */
+	ms->ra = lg.call ? 0xe0 | (random() & 0x1f) : random() & 0x0f;
+	/* the request reference is built from the FN the RACH is sent on */
+	ms->rach_fn = cur_fn();
+	/* the latency counts from the first attempt */
+	if (!ms->retries)
+		ms->rach_us = now_us();
+
+	llist_del(&ms->list);
+	llist_add_tail(&ms->list, &lg.rach_wait[ms->ra]);
+	ms->state = VMS_S_RACH;
+
+	tx_um(lg.arfcn, GSMTAP_CHANNEL_RACH, 0, 0, ms->rach_fn, &ms->ra, 1);
+	lg.ctr.rach++;
+	osmo_timer_schedule(&ms->timer, 0, LG_RACH_TIMEOUT_MS * 1000);
+}
+
+/* move the MS to the list of a dedicated channel, kicking out a previous
+ * user whose release we missed */
+static void vms_set_chan(struct vms *ms, uint16_t arfcn, uint8_t chan_nr)
+{
+	struct vms *other, *tmp;
+
+	llist_for_each_entry_safe(other, tmp, &lg.chan[chan_nr], list) {
+		if (other != ms && other->arfcn == arfcn)
+			vms_idle(other);
+	}
+
+	ms->arfcn = arfcn;
+	ms->chan_nr = chan_nr;
+	ms->vr = 0;
+	llist_del(&ms->list);
+	llist_add_tail(&ms->list, &lg.chan[chan_nr]);
+}
+
+static void vms_release(struct vms *ms)
+{
+	tx_lapdm(ms, true, LAPDM_CTRL_DISC_P, NULL, 0);
+	vms_idle(ms);
+}
+
+static void vms_timer_cb(void *data)
+{
+	struct vms *ms = data;
+
+	switch (ms->state) {
+	case VMS_S_RACH:
+		if (++ms->retries > LG_MAX_RETRIES) {
+			lg.ctr.rach_fail++;
+			vms_idle(ms);
+			return;
+		}
+		lg.ctr.rach_retrans++;
+		vms_rach(ms);
+		break;
+	case VMS_S_EST:
+	case VMS_S_ASSIGN:
+		if (++ms->retries > LG_MAX_RETRIES) {
+			if (ms->state == VMS_S_EST)
+				lg.ctr.est_fail++;
+			else
+				lg.ctr.ass_fail++;
+			vms_release(ms);
+			return;
+		}
+		lg.ctr.sabm_retrans++;
+		tx_sabm(ms);
+		break;
+	case VMS_S_DEDIC:
+	case VMS_S_TCH:
+		/* hold time expired */
+		lg.ctr.local_rel++;
+		vms_release(ms);
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * downlink
+ */
+
+static void req_ref_from_fn(uint8_t *req_ref, uint8_t ra, uint32_t fn)
+{
+	uint8_t t1 = (fn / (26 * 51)) % 32, t2 = fn % 26, t3 = fn % 51;
+
+	req_ref[0] = ra;
+	req_ref[1] = (t1 << 3) | (t3 >> 3);
+	req_ref[2] = ((t3 & 7) << 5) | t2;
+}
+
+static struct vms *vms_by_req_ref(const uint8_t *req_ref)
+{
+	struct vms *ms;
+	uint8_t ref[3];
+
+	llist_for_each_entry(ms, &lg.rach_wait[req_ref[0]], list) {
+		req_ref_from_fn(ref, ms->ra, ms->rach_fn);
+		if (!memcmp(ref, req_ref, sizeof(ref)))
+			return ms;
+	}
+	return NULL;
+}
+
+/* ARFCN from a channel description (10.5.2.5), the cell's if hopping */
+static uint16_t chan_desc_arfcn(const uint8_t *chan_desc)
+{
+	if (chan_desc[1] & 0x10)
+		return lg.arfcn;
+	return ((chan_desc[1] & 0x03) << 8) | chan_desc[2];
+}
+
+static void rx_imm_ass(const uint8_t *chan_desc, const uint8_t *req_ref)
+{
+	struct vms *ms = vms_by_req_ref(req_ref);
+
+	if (!ms)
+		return;
+
+	lg.ctr.imm_ass++;
+	lat_add(&lg.lat_imm_ass, now_us() - ms->rach_us, ms);
+
+	osmo_timer_del(&ms->timer);
+	vms_set_chan(ms, chan_desc_arfcn(chan_desc), chan_desc[0]);
+	ms->state = VMS_S_EST;
+	ms->retries = 0;
+	fill_initial_l3(ms);
+	tx_sabm(ms);
+}
+
+static void rx_imm_ass_rej(const uint8_t *req_ref)
+{
+	struct vms *ms = vms_by_req_ref(req_ref);
+
+	if (!ms)
+		return;
+
+	lg.ctr.imm_ass_rej++;
+	vms_idle(ms);
+}
+
+/* AGCH and PCH, with the L2 pseudo length in front */
+static void rx_ccch(const uint8_t *data, unsigned int len)
+{
+	unsigned int i;
+
+	if (len < 3 || (data[1] & 0x0f) != GSM48_PDISC_RR)
+		return;
+
+	switch (data[2]) {
+	case GSM48_MT_RR_IMM_ASS:
+		if (len >= 10)
+			rx_imm_ass(data + 4, data + 7);
+		break;
+	case GSM48_MT_RR_IMM_ASS_EXT:
+		if (len >= 17) {
+			rx_imm_ass(data + 4, data + 7);
+			rx_imm_ass(data + 11, data + 14);
+		}
+		break;
+	case GSM48_MT_RR_IMM_ASS_REJ:
+		/* four request references, each followed by a wait indication */
+		for (i = 0; i < 4 && len >= 4 + (i + 1) * 4; i++)
+			rx_imm_ass_rej(data + 4 + i * 4);
+		break;
+	}
+}
+
+static void rx_rr(struct vms *ms, const uint8_t *l3, unsigned int len)
+{
+	switch (l3[1]) {
+	case GSM48_MT_RR_CHAN_REL:
+		lg.ctr.chan_rel++;
+		vms_release(ms);
+		break;
+	case GSM48_MT_RR_ASS_CMD:
+		if (len < 5)
+			break;
+		lg.ctr.ass_cmd++;
+		osmo_timer_del(&ms->timer);
+		vms_set_chan(ms, chan_desc_arfcn(l3 + 2), l3[2]);
+		ms->state = VMS_S_ASSIGN;
+		ms->retries = 0;
+		ms->l3[0] = GSM48_PDISC_RR;
+		ms->l3[1] = GSM48_MT_RR_ASS_COMPL;
+		ms->l3[2] = GSM48_RR_CAUSE_NORMAL;
+		ms->l3_len = 3;
+		tx_sabm(ms);
+		break;
+	}
+}
+
+/* main signalling channel of an MS */
+static void rx_dcch(struct vms *ms, const uint8_t *data, unsigned int len)
+{
+	uint8_t ctrl, ns, l3_len;
+
+	/* SAPI 0 only */
+	if (len < 3 || (data[0] & 0x1c))
+		return;
+	ctrl = data[1];
+
+	if ((ctrl & ~0x10) == LAPDM_CTRL_UA) {
+		if (ms->state != VMS_S_EST && ms->state != VMS_S_ASSIGN)
+			return;
+		lat_add(&lg.lat_est, now_us() - ms->sabm_us, ms);
+		if (ms->state == VMS_S_EST) {
+			lg.ctr.est_ok++;
+			ms->state = VMS_S_DEDIC;
+		} else {
+			lg.ctr.ass_ok++;
+			if ((ms->chan_nr & 0xf8) == RSL_CHAN_Bm_ACCH ||
+			    (ms->chan_nr & 0xf0) == RSL_CHAN_Lm_ACCH)
+				ms->state = VMS_S_TCH;
+			else
+				ms->state = VMS_S_DEDIC;
+		}
+		osmo_timer_schedule(&ms->timer, lg.hold_s, 0);
+		return;
+	}
+
+	/* I frames only, acknowledged by RR */
+	if (ctrl & 0x01)
+		return;
+	if (ms->state == VMS_S_IDLE || ms->state == VMS_S_RACH)
+		return;
+	ns = (ctrl >> 1) & 7;
+	if (ns != ms->vr) {
+		tx_lapdm(ms, false, LAPDM_CTRL_RR(ms->vr), NULL, 0);
+		return;
+	}
+	ms->vr = (ms->vr + 1) & 7;
+	tx_lapdm(ms, false, LAPDM_CTRL_RR(ms->vr), NULL, 0);
+
+	l3_len = data[2] >> 2;
+	if (l3_len < 2 || 3 + l3_len > len)
+		return;
+	if ((data[3] & 0x0f) == GSM48_PDISC_RR)
+		rx_rr(ms, data + 3, l3_len);
+}
+
+static void rx_cb(struct virt_um_inst *vui, struct msgb *msg)
+{
+	struct gsmtap_hdr *gh;
+	unsigned int hdr_len, len;
+	uint16_t arfcn;
+	uint8_t chantype, rsl_chantype, link_id, chan_nr;
+	const uint8_t *data;
+	struct vms *ms;
+
+	if (!msg) {
+		LOGP(DLOADGEN, LOGL_ERROR, "Virtual Um socket died\n");
+		quit = 1;
+		return;
+	}
+
+	gh = (struct gsmtap_hdr *) msgb_data(msg);
+	if (msgb_length(msg) < sizeof(*gh) || gh->type != GSMTAP_TYPE_UM)
+		goto out;
+	hdr_len = gh->hdr_len * 4;
+	if (msgb_length(msg) < hdr_len)
+		goto out;
+	data = msgb_data(msg) + hdr_len;
+	len = msgb_length(msg) - hdr_len;
+	arfcn = ntohs(gh->arfcn);
+	if (arfcn & GSMTAP_ARFCN_F_UPLINK)
+		goto out;
+	arfcn &= GSMTAP_ARFCN_MASK;
+	chantype = gh->sub_type;
+
+	lg.ctr.dl_frames++;
+	lg.dl_fn = ntohl(gh->frame_number);
+	lg.dl_fn_us = now_us();
+
+	if (!lg.have_cell) {
+		if (chantype != GSMTAP_CHANNEL_BCCH)
+			goto out;
+		if (lg.arfcn < 0)
+			lg.arfcn = arfcn;
+		else if (lg.arfcn != arfcn)
+			goto out;
+		LOGP(DLOADGEN, LOGL_NOTICE, "Found the BCCH on ARFCN %u, "
+		     "starting %u virtual MS\n", arfcn, lg.num_ms);
+		lg.have_cell = true;
+	}
+
+	switch (chantype) {
+	case GSMTAP_CHANNEL_AGCH:
+	case GSMTAP_CHANNEL_PCH:
+		if (arfcn == lg.arfcn)
+			rx_ccch(data, len);
+		break;
+	case GSMTAP_CHANNEL_SDCCH4:
+	case GSMTAP_CHANNEL_SDCCH8:
+	case GSMTAP_CHANNEL_TCH_F:
+	case GSMTAP_CHANNEL_TCH_H:
+		chantype_gsmtap2rsl(chantype, &rsl_chantype, &link_id);
+		chan_nr = rsl_enc_chan_nr(rsl_chantype, gh->sub_slot, gh->timeslot);
+		llist_for_each_entry(ms, &lg.chan[chan_nr], list) {
+			if (ms->arfcn == arfcn) {
+				rx_dcch(ms, data, len);
+				break;
+			}
+		}
+		break;
+	}
+
+out:
+	msgb_free(msg);
+}
+
+/*
+ * load
+ */
+
+static void arrival_timer_cb(void *data)
+{
+	double wait_s = lg.poisson ? -log(1 - rnd_uniform()) / lg.rate : 1 / lg.rate;
+	struct vms *ms;
+
+	osmo_timer_schedule(&lg.arrival_timer, (unsigned long) wait_s,
+			    (wait_s - (unsigned long) wait_s) * 1e6);
+
+	if (!lg.have_cell)
+		return;
+
+	lg.ctr.attempts++;
+	if (llist_empty(&lg.idle)) {
+		lg.ctr.no_idle_ms++;
+		return;
+	}
+	ms = llist_entry(lg.idle.next, struct vms, list);
+	ms->retries = 0;
+	vms_rach(ms);
+}
+
+static void tch_timer_cb(void *data)
+{
+	/* FR and HR frames with the signature of a speech frame, which
+	 * also keeps LAPDm from taking them for FACCH */
+	static const uint8_t fr[LG_FR_BYTES] = { 0xd0 };
+	static const uint8_t hr[LG_HR_BYTES] = { 0x00 };
+	uint8_t rsl_chantype, ss, tn;
+	struct vms *ms;
+	unsigned int i;
+
+	osmo_timer_schedule(&lg.tch_timer, 0, LG_TCH_INTERVAL_MS * 1000);
+
+	for (i = 0; i < ARRAY_SIZE(lg.chan); i++) {
+		llist_for_each_entry(ms, &lg.chan[i], list) {
+			if (ms->state != VMS_S_TCH)
+				continue;
+			if (rsl_dec_chan_nr(ms->chan_nr, &rsl_chantype, &ss, &tn) < 0)
+				continue;
+			if (rsl_chantype == RSL_CHAN_Bm_ACCH)
+				tx_um(ms->arfcn, GSMTAP_CHANNEL_TCH_F, tn, ss,
+				      cur_fn(), fr, sizeof(fr));
+			else
+				tx_um(ms->arfcn, GSMTAP_CHANNEL_TCH_H, tn, ss,
+				      cur_fn(), hr, sizeof(hr));
+			lg.ctr.tch_frames++;
+		}
+	}
+}
+
+static unsigned int num_busy(void)
+{
+	struct llist_head *pos;
+	unsigned int idle = 0;
+
+	llist_for_each(pos, &lg.idle)
+		idle++;
+	return lg.num_ms - idle;
+}
+
+static void stats_timer_cb(void *data)
+{
+	osmo_timer_schedule(&lg.stats_timer, lg.stats_interval_s, 0);
+
+	printf("%8.1fs busy %u, attempts %"PRIu64", IMM ASS %"PRIu64
+	       " (rej %"PRIu64"), est %"PRIu64", released %"PRIu64
+	       ", TCH frames %"PRIu64"\n", (now_us() - lg.start_us) / 1e6,
+	       num_busy(), lg.ctr.attempts, lg.ctr.imm_ass,
+	       lg.ctr.imm_ass_rej, lg.ctr.est_ok,
+	       lg.ctr.chan_rel + lg.ctr.local_rel, lg.ctr.tch_frames);
+	lat_print(&lg.lat_imm_ass, false);
+	lat_print(&lg.lat_est, false);
+	fflush(stdout);
+}
+
+static void end_timer_cb(void *data)
+{
+	quit = 1;
+}
+
+static void print_summary(void)
+{
+	printf("\nAfter %.1f s with %u virtual MS at %.1f attempts/s (%s):\n",
+	       (now_us() - lg.start_us) / 1e6, lg.num_ms, lg.rate,
+	       lg.poisson ? "poisson" : "periodic");
+	printf("  access attempts  %"PRIu64" (%"PRIu64" found no idle MS)\n",
+	       lg.ctr.attempts, lg.ctr.no_idle_ms);
+	printf("  RACH             %"PRIu64" (%"PRIu64" repeated, %"PRIu64
+	       " given up)\n", lg.ctr.rach, lg.ctr.rach_retrans,
+	       lg.ctr.rach_fail);
+	printf("  IMM ASS          %"PRIu64" (%"PRIu64" rejected)\n",
+	       lg.ctr.imm_ass, lg.ctr.imm_ass_rej);
+	printf("  SABM             %"PRIu64" (%"PRIu64" repeated)\n",
+	       lg.ctr.sabm, lg.ctr.sabm_retrans);
+	printf("  established      %"PRIu64" (%"PRIu64" failed)\n",
+	       lg.ctr.est_ok, lg.ctr.est_fail);
+	printf("  assignments      %"PRIu64" (%"PRIu64" completed, %"PRIu64
+	       " failed)\n", lg.ctr.ass_cmd, lg.ctr.ass_ok, lg.ctr.ass_fail);
+	printf("  released         %"PRIu64" by the network, %"PRIu64
+	       " at the end of the hold time\n", lg.ctr.chan_rel,
+	       lg.ctr.local_rel);
+	printf("  TCH frames sent  %"PRIu64"\n", lg.ctr.tch_frames);
+	printf("  downlink frames  %"PRIu64"\n", lg.ctr.dl_frames);
+	printf("Latencies:\n");
+	lat_print(&lg.lat_imm_ass, true);
+	lat_print(&lg.lat_est, true);
+}
+
+/*
+ * main
+ */
+
+static void print_help(void)
+{
+	printf("Usage: osmo-bts-virtual-loadgen [options]\n"
+		"  -h	--help			this text\n"
+		"  -n	--num-ms NUM		Number of virtual MS (default %u)\n"
+		"  -r	--rate RATE		Access attempts per second (default %.0f)\n"
+		"  -p	--periodic		Periodic instead of Poisson arrivals\n"
+		"  -c	--call			CM SERVICE REQUEST instead of LU\n"
+		"  -H	--hold SECONDS		Release a dedicated channel after (default %u)\n"
+		"  -N	--no-tch		Don't send TCH frames after an assignment\n"
+		"  -d	--duration SECONDS	Stop after, 0 to run until SIGINT (default)\n"
+		"  -s	--stats SECONDS		Interval of the progress report, 0 for none (default %u)\n"
+		"  -a	--arfcn ARFCN		ARFCN of the cell (default: the first BCCH seen)\n"
+		"  -i	--imsi IMSI		IMSI of the first MS, incremented for the others\n"
+		"  -o	--output FILE		Write each latency sample to a CSV file\n"
+		"  -S	--min-success PERCENT	Exit with 1 if fewer attempts got a channel\n"
+		"  -R	--seed SEED		Seed of the random number generator\n"
+		"	--ms-group GROUP	Multicast group of the MS side (default %s)\n"
+		"	--ms-port PORT		(default %u)\n"
+		"	--bts-group GROUP	Multicast group of the BTS side (default %s)\n"
+		"	--bts-port PORT		(default %u)\n",
+		lg.num_ms, lg.rate, lg.hold_s, lg.stats_interval_s,
+		lg.ms_group, lg.ms_port, lg.bts_group, lg.bts_port);
+}
+
+static void handle_options(int argc, char **argv)
+{
+	while (1) {
+		int option_idx = 0, c;
+		static const struct option long_options[] = {
+			{ "help", 0, 0, 'h' },
+			{ "num-ms", 1, 0, 'n' },
+			{ "rate", 1, 0, 'r' },
+			{ "periodic", 0, 0, 'p' },
+			{ "call", 0, 0, 'c' },
+			{ "hold", 1, 0, 'H' },
+			{ "no-tch", 0, 0, 'N' },
+			{ "duration", 1, 0, 'd' },
+			{ "stats", 1, 0, 's' },
+			{ "arfcn", 1, 0, 'a' },
+			{ "imsi", 1, 0, 'i' },
+			{ "output", 1, 0, 'o' },
+			{ "min-success", 1, 0, 'S' },
+			{ "seed", 1, 0, 'R' },
+			{ "ms-group", 1, 0, 1 },
+			{ "ms-port", 1, 0, 2 },
+			{ "bts-group", 1, 0, 3 },
+			{ "bts-port", 1, 0, 4 },
+			{ 0, 0, 0, 0 }
+		};
+
+		c = getopt_long(argc, argv, "hn:r:pcH:Nd:s:a:i:o:S:R:",
+				long_options, &option_idx);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'h':
+			print_help();
+			exit(0);
+		case 'n':
+			lg.num_ms = atoi(optarg);
+			break;
+		case 'r':
+			lg.rate = atof(optarg);
+			break;
+		case 'p':
+			lg.poisson = false;
+			break;
+		case 'c':
+			lg.call = true;
+			break;
+		case 'H':
+			lg.hold_s = atoi(optarg);
+			break;
+		case 'N':
+			lg.tch = false;
+			break;
+		case 'd':
+			lg.duration_s = atoi(optarg);
+			break;
+		case 's':
+			lg.stats_interval_s = atoi(optarg);
+			break;
+		case 'a':
+			lg.arfcn = atoi(optarg);
+			break;
+		case 'i':
+			lg.imsi_base = optarg;
+			break;
+		case 'o':
+			lg.csv_path = optarg;
+			break;
+		case 'S':
+			lg.min_success = atoi(optarg);
+			break;
+		case 'R':
+			lg.seed = atoi(optarg);
+			break;
+		case 1:
+			lg.ms_group = optarg;
+			break;
+		case 2:
+			lg.ms_port = atoi(optarg);
+			break;
+		case 3:
+			lg.bts_group = optarg;
+			break;
+		case 4:
+			lg.bts_port = atoi(optarg);
+			break;
+		default:
+			print_help();
+			exit(2);
+		}
+	}
+
+	if (optind < argc || !lg.num_ms || lg.rate <= 0 ||
+	    strlen(lg.imsi_base) > LG_IMSI_MAX_DIGITS ||
+	    strspn(lg.imsi_base, "0123456789") != strlen(lg.imsi_base)) {
+		print_help();
+		exit(2);
+	}
+}
+
+static void signal_handler(int signal)
+{
+	quit = 1;
+}
+
+int main(int argc, char **argv)
+{
+	void *tall_ctx = talloc_named_const(NULL, 1, "loadgen");
+	unsigned long long imsi;
+	unsigned int i, digits;
+	int rc = 0;
+
+	osmo_init_logging(&lg_log_info);
+	lg.seed = time(NULL);
+	handle_options(argc, argv);
+	srandom(lg.seed);
+
+	INIT_LLIST_HEAD(&lg.idle);
+	for (i = 0; i < ARRAY_SIZE(lg.chan); i++) {
+		INIT_LLIST_HEAD(&lg.rach_wait[i]);
+		INIT_LLIST_HEAD(&lg.chan[i]);
+	}
+
+	lg.ms = talloc_zero_array(tall_ctx, struct vms, lg.num_ms);
+	if (!lg.ms) {
+		fprintf(stderr, "Cannot allocate %u MS\n", lg.num_ms);
+		exit(1);
+	}
+	imsi = strtoull(lg.imsi_base, NULL, 10);
+	digits = strlen(lg.imsi_base);
+	for (i = 0; i < lg.num_ms; i++) {
+		struct vms *ms = &lg.ms[i];
+
+		ms->nr = i;
+		snprintf(ms->imsi, sizeof(ms->imsi), "%0*llu", digits, imsi + i);
+		ms->timer.cb = vms_timer_cb;
+		ms->timer.data = ms;
+		llist_add_tail(&ms->list, &lg.idle);
+	}
+
+	if (lg.csv_path) {
+		lg.csv = fopen(lg.csv_path, "w");
+		if (!lg.csv) {
+			fprintf(stderr, "Cannot open %s: %s\n", lg.csv_path,
+				strerror(errno));
+			exit(1);
+		}
+		fprintf(lg.csv, "time_s,latency,ms,us\n");
+	}
+
+	/* we send where the BTS listens, and listen where it sends */
+	lg.vui = virt_um_init(tall_ctx, (char *) lg.bts_group, lg.bts_port,
+			      (char *) lg.ms_group, lg.ms_port, rx_cb);
+	if (!lg.vui || !lg.vui->mcast_sock) {
+		fprintf(stderr, "Cannot join the virtual Um multicast groups\n");
+		exit(1);
+	}
+
+	signal(SIGINT, signal_handler);
+	signal(SIGTERM, signal_handler);
+
+	lg.start_us = now_us();
+	lg.arrival_timer.cb = arrival_timer_cb;
+	osmo_timer_schedule(&lg.arrival_timer, 0, 0);
+	if (lg.tch) {
+		lg.tch_timer.cb = tch_timer_cb;
+		osmo_timer_schedule(&lg.tch_timer, 0, LG_TCH_INTERVAL_MS * 1000);
+	}
+	if (lg.stats_interval_s) {
+		lg.stats_timer.cb = stats_timer_cb;
+		osmo_timer_schedule(&lg.stats_timer, lg.stats_interval_s, 0);
+	}
+	if (lg.duration_s) {
+		lg.end_timer.cb = end_timer_cb;
+		osmo_timer_schedule(&lg.end_timer, lg.duration_s, 0);
+	}
+
+	while (!quit)
+		osmo_select_main(0);
+
+	print_summary();
+
+	if (lg.min_success && lg.ctr.attempts &&
+	    lg.ctr.est_ok * 100 < lg.ctr.attempts * lg.min_success) {
+		printf("Only %"PRIu64" of %"PRIu64" attempts got a channel, "
+		       "below %u%%\n", lg.ctr.est_ok, lg.ctr.attempts,
+		       lg.min_success);
+		rc = 1;
+	}
+
+	if (lg.csv)
+		fclose(lg.csv);
+	virt_um_destroy(lg.vui);
+	talloc_free(tall_ctx);
+
+	return rc;
+}
@@ -20,6 +20,7 @@
  *
  */
 #include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
 
 #include <osmo-bts/bts.h>
 #include <osmo-bts/logging.h>
@@ -27,6 +28,7 @@
 
 #include <inttypes.h>
 #include <unistd.h>
+#include <errno.h>
 
 static struct gsm_bts *bts;
 static struct gsm_bts_role_bts *btsb;
@@ -188,6 +190,206 @@ static void test_agch_queue(void)
 	       btsb->agch_queue_pch_msgs);
 }
 
+static void enqueue_imm_ass(int idx)
+{
+	struct msgb *msg = msgb_alloc(GSM_MACBLOCK_LEN, __FUNCTION__);
+	put_imm_ass(msg, idx);
+	OSMO_ASSERT(bts_agch_enqueue(bts, msg) == 0);
+}
+
+static void enqueue_imm_ass_rej(int idx)
+{
+	struct msgb *msg = msgb_alloc(GSM_MACBLOCK_LEN, __FUNCTION__);
+	put_imm_ass_rej(msg, idx, 10);
+	OSMO_ASSERT(bts_agch_enqueue(bts, msg) == 0);
+}
+
+/* dequeue the next message, check its type and return its (first) index */
+static int dequeue_agch(uint8_t msg_type, int num_refs)
+{
+	struct gsm48_imm_ass_rej *rej;
+	struct gsm48_imm_ass *ima;
+	struct msgb *msg;
+	int idx;
+
+	msg = bts_agch_dequeue(bts);
+	OSMO_ASSERT(msg);
+	ima = msgb_l3(msg);
+	rej = msgb_l3(msg);
+	OSMO_ASSERT(ima->msg_type == msg_type);
+	if (msg_type == GSM48_MT_RR_IMM_ASS_REJ) {
+		OSMO_ASSERT(count_imm_ass_rej_refs(rej) == num_refs);
+		idx = rej->req_ref1.t1;
+	} else
+		idx = ima->req_ref.t1;
+	msgb_free(msg);
+
+	return idx;
+}
+
+static void test_agch_lanes(void)
+{
+	uint64_t dropped, merged;
+	int i;
+
+	printf("Testing AGCH queue lanes.\n");
+
+	/* no dropping */
+	btsb->agch_max_queue_length = 10;
+	btsb->agch_queue_thresh_level = 100;
+	btsb->agch_queue_low_level = 10;
+	btsb->agch_queue_high_level = 10;
+	dropped = btsb->agch_queue_dropped_msgs;
+	merged = btsb->agch_queue_merged_msgs;
+
+	/* assignments go first, but a reject waits for four of them at most */
+	enqueue_imm_ass_rej(1);
+	for (i = 2; i <= 7; i++)
+		enqueue_imm_ass(i);
+	OSMO_ASSERT(btsb->agch_queue_length == 7);
+	for (i = 2; i <= 5; i++)
+		OSMO_ASSERT(dequeue_agch(GSM48_MT_RR_IMM_ASS, 0) == i);
+	OSMO_ASSERT(dequeue_agch(GSM48_MT_RR_IMM_ASS_REJ, 1) == 1);
+	for (i = 6; i <= 7; i++)
+		OSMO_ASSERT(dequeue_agch(GSM48_MT_RR_IMM_ASS, 0) == i);
+	OSMO_ASSERT(btsb->agch_queue_length == 0);
+	OSMO_ASSERT(bts_agch_dequeue(bts) == NULL);
+
+	/* a full reject moves to the reject lane, a new one is started */
+	for (i = 1; i <= 5; i++)
+		enqueue_imm_ass_rej(i);
+	OSMO_ASSERT(btsb->agch_queue_merged_msgs == merged + 3);
+	OSMO_ASSERT(btsb->agch_queue_length == 2);
+	OSMO_ASSERT(!llist_empty(&btsb->agch_rej_queue));
+	OSMO_ASSERT(btsb->agch_rej_pending);
+	OSMO_ASSERT(dequeue_agch(GSM48_MT_RR_IMM_ASS_REJ, 4) == 1);
+	OSMO_ASSERT(dequeue_agch(GSM48_MT_RR_IMM_ASS_REJ, 1) == 5);
+	OSMO_ASSERT(btsb->agch_queue_length == 0);
+
+	/* the lane holds one full reject, another one is pending */
+	for (i = 1; i <= 5; i++)
+		enqueue_imm_ass_rej(i);
+	merged = btsb->agch_queue_merged_msgs;
+
+	/* drop on arrival from a reject lane length of 2 on */
+	btsb->agch_queue_thresh_level = 20;
+
+	/* the oldest request reference is dropped, the new one is merged */
+	enqueue_imm_ass_rej(6);
+	OSMO_ASSERT(btsb->agch_queue_dropped_msgs == dropped + 1);
+	OSMO_ASSERT(btsb->agch_queue_merged_msgs == merged + 1);
+	OSMO_ASSERT(btsb->agch_queue_length == 2);
+	enqueue_imm_ass_rej(7);
+	enqueue_imm_ass_rej(8);
+	OSMO_ASSERT(btsb->agch_queue_dropped_msgs == dropped + 3);
+	OSMO_ASSERT(btsb->agch_queue_merged_msgs == merged + 3);
+	OSMO_ASSERT(btsb->agch_queue_length == 2);
+
+	/* a reject goes when its last reference is dropped */
+	enqueue_imm_ass_rej(9);
+	OSMO_ASSERT(btsb->agch_queue_dropped_msgs == dropped + 4);
+	OSMO_ASSERT(btsb->agch_queue_length == 2);
+	OSMO_ASSERT(dequeue_agch(GSM48_MT_RR_IMM_ASS_REJ, 4) == 5);
+	OSMO_ASSERT(dequeue_agch(GSM48_MT_RR_IMM_ASS_REJ, 1) == 9);
+	OSMO_ASSERT(bts_agch_dequeue(bts) == NULL);
+
+	/* assignments do not count, nothing is dropped */
+	for (i = 10; i <= 12; i++)
+		enqueue_imm_ass(i);
+	enqueue_imm_ass_rej(13);
+	OSMO_ASSERT(btsb->agch_queue_dropped_msgs == dropped + 4);
+	OSMO_ASSERT(btsb->agch_queue_length == 4);
+	for (i = 10; i <= 12; i++)
+		OSMO_ASSERT(dequeue_agch(GSM48_MT_RR_IMM_ASS, 0) == i);
+	OSMO_ASSERT(dequeue_agch(GSM48_MT_RR_IMM_ASS_REJ, 1) == 13);
+	OSMO_ASSERT(bts_agch_dequeue(bts) == NULL);
+
+	/* nothing is left behind by a flush */
+	enqueue_imm_ass(1);
+	enqueue_imm_ass_rej(2);
+	bts_agch_flush(bts);
+	OSMO_ASSERT(btsb->agch_queue_length == 0);
+	OSMO_ASSERT(!btsb->agch_rej_pending);
+	OSMO_ASSERT(bts_agch_dequeue(bts) == NULL);
+
+	btsb->agch_max_queue_length = 32;
+	btsb->agch_queue_low_level = 30;
+	btsb->agch_queue_high_level = 30;
+	btsb->agch_queue_thresh_level = 60;
+}
+
+static void test_rach_admission(void)
+{
+	struct gsm48_imm_ass_rej *rej;
+	struct msgb *msg;
+	uint32_t fn = 1000;
+	int rc;
+
+	printf("Testing RACH admission control.\n");
+
+	OSMO_ASSERT(rach_adm_get_cause(0xa5, false) == RACH_CAUSE_EMERG);
+	OSMO_ASSERT(rach_adm_get_cause(0x85, false) == RACH_CAUSE_PAGING);
+	OSMO_ASSERT(rach_adm_get_cause(0x15, false) == RACH_CAUSE_PAGING);
+	OSMO_ASSERT(rach_adm_get_cause(0x15, true) == RACH_CAUSE_DATA);
+	OSMO_ASSERT(rach_adm_get_cause(0x05, false) == RACH_CAUSE_LU);
+	OSMO_ASSERT(rach_adm_get_cause(0x05, true) == RACH_CAUSE_LU);
+	OSMO_ASSERT(rach_adm_get_cause(0xe5, true) == RACH_CAUSE_CALL);
+	OSMO_ASSERT(rach_adm_get_cause(0x45, true) == RACH_CAUSE_CALL);
+	OSMO_ASSERT(rach_adm_get_cause(0x6a, true) == RACH_CAUSE_CALL);
+	OSMO_ASSERT(rach_adm_get_cause(0x55, true) == RACH_CAUSE_DATA);
+
+	OSMO_ASSERT(btsb->agch_queue_length == 0);
+
+	/* one LU per second, two back to back */
+	rach_adm_set_bucket(bts, RACH_CAUSE_LU, 1, 2);
+	OSMO_ASSERT(rach_adm_check(bts, 0x05, fn) == 0);
+	OSMO_ASSERT(rach_adm_check(bts, 0x06, fn) == 0);
+	OSMO_ASSERT(rach_adm_check(bts, 0x07, fn) == -EBUSY);
+	/* other causes are not limited */
+	OSMO_ASSERT(rach_adm_check(bts, 0xa5, fn) == 0);
+
+	/* the reject has been queued to the AGCH */
+	OSMO_ASSERT(btsb->agch_queue_length == 1);
+	msg = bts_agch_dequeue(bts);
+	OSMO_ASSERT(msg);
+	rej = msgb_l3(msg);
+	OSMO_ASSERT(rej->msg_type == GSM48_MT_RR_IMM_ASS_REJ);
+	OSMO_ASSERT(rej->req_ref1.ra == 0x07);
+	OSMO_ASSERT(rej->wait_ind1 == btsb->rach_adm.wait_ind);
+	msgb_free(msg);
+
+	/* 217 frames are a bit more than a second */
+	fn += 216;
+	OSMO_ASSERT(rach_adm_check(bts, 0x05, fn) == -EBUSY);
+	fn += 1;
+	OSMO_ASSERT(rach_adm_check(bts, 0x05, fn) == 0);
+	OSMO_ASSERT(rach_adm_check(bts, 0x05, fn) == -EBUSY);
+
+	/* no limit below the load threshold */
+	btsb->rach_adm.load_thresh = 50;
+	btsb->load.rach.percent = 49;
+	OSMO_ASSERT(rach_adm_check(bts, 0x05, fn) == 0);
+	btsb->load.rach.percent = 50;
+	OSMO_ASSERT(rach_adm_check(bts, 0x05, fn) == -EBUSY);
+
+	/* a jump of the frame clock neither refills nor stalls the buckets */
+	fn = (fn + GSM_HYPERFRAME - 1000) % GSM_HYPERFRAME;
+	OSMO_ASSERT(rach_adm_check(bts, 0x05, fn) == -EBUSY);
+	fn += 217;
+	OSMO_ASSERT(rach_adm_check(bts, 0x05, fn) == 0);
+
+	rc = 0;
+	while ((msg = bts_agch_dequeue(bts))) {
+		msgb_free(msg);
+		rc++;
+	}
+	OSMO_ASSERT(rc == 1);
+
+	rach_adm_set_bucket(bts, RACH_CAUSE_LU, 0, 0);
+	btsb->rach_adm.load_thresh = 0;
+	btsb->load.rach.percent = 0;
+}
+
 static void test_agch_queue_length_computation(void)
 {
 	static const int ccch_configs[] = {
@@ -234,6 +436,8 @@ int main(int argc, char **argv)
 	btsb = bts_role_bts(bts);
 	test_agch_queue_length_computation();
 	test_agch_queue();
+	test_agch_lanes();
+	test_rach_admission();
 	printf("Success\n");
 
 	return 0;
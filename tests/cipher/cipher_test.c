@@ -21,8 +21,11 @@
 #include <osmo-bts/logging.h>
 #include <osmo-bts/paging.h>
 #include <osmo-bts/gsm_data.h>
+#include <osmo-bts/scheduler.h>
+#include <osmo-bts/scheduler_backend.h>
 
 #include <osmocom/core/talloc.h>
+#include <osmocom/gsm/a5.h>
 
 #include <errno.h>
 #include <unistd.h>
@@ -64,6 +67,103 @@ static void test_cipher_parsing(void)
 	ASSERT_TRUE(bts_supports_cipher(btsb, 0x9) == -ENOTSUP);
 }
 
+/* check a keystream against plain osmo_a5() and run it through the
+ * encryption or decryption kernel */
+static void check_a5_ks(int algo, const uint8_t *key, uint32_t fn,
+			int downlink, const ubit_t *ks)
+{
+	ubit_t ks_dl[114], ks_ul[114];
+	ubit_t ubits[GSM_BURST_LEN], ref_u[GSM_BURST_LEN];
+	sbit_t sbits[GSM_BURST_LEN], ref_s[GSM_BURST_LEN];
+	int i;
+
+	osmo_a5(algo, key, fn, ks_dl, ks_ul);
+	ASSERT_TRUE(memcmp(ks, downlink ? ks_dl : ks_ul, 114) == 0);
+
+	for (i = 0; i < GSM_BURST_LEN; i++) {
+		ubits[i] = ref_u[i] = (fn * 7 + i * 13) & 1;
+		sbits[i] = ref_s[i] = (int) ((fn * 31 + i * 17) % 255) - 127;
+	}
+	for (i = 0; i < 57; i++) {
+		ref_u[i + 3] ^= ks_dl[i];
+		ref_u[i + 88] ^= ks_dl[i + 57];
+		if (ks_ul[i])
+			ref_s[i + 3] = -ref_s[i + 3];
+		if (ks_ul[i + 57])
+			ref_s[i + 88] = -ref_s[i + 88];
+	}
+
+	if (downlink) {
+		_sched_a5_encrypt(ubits, ks);
+		ASSERT_TRUE(memcmp(ubits, ref_u, sizeof(ubits)) == 0);
+	} else {
+		_sched_a5_decrypt(sbits, ks);
+		ASSERT_TRUE(memcmp(sbits, ref_s, sizeof(sbits)) == 0);
+	}
+}
+
+/* DL bursts are generated 'gap' frames ahead of the UL bursts of the same
+ * FN, like with the clock advance of osmo-bts-trx */
+static void run_a5_gap(struct l1sched_a5_cache *cache, int algo,
+		       const uint8_t *dl_key, const uint8_t *ul_key,
+		       uint32_t fn0, unsigned int gap)
+{
+	const unsigned int num = 2 * L1SCHED_A5_CACHE_SIZE;
+	uint32_t i, fn;
+
+	memset(cache, 0, sizeof(*cache));
+	_sched_a5_set_key(cache, 1, algo, dl_key);
+	_sched_a5_set_key(cache, 0, algo, ul_key);
+
+	for (i = 0; i < num + gap; i++) {
+		if (i < num) {
+			fn = (fn0 + i) % GSM_HYPERFRAME;
+			check_a5_ks(algo, dl_key, fn, 1,
+				    _sched_a5_keystream(cache, 1, fn));
+		}
+		if (i >= gap) {
+			fn = (fn0 + i - gap) % GSM_HYPERFRAME;
+			check_a5_ks(algo, ul_key, fn, 0,
+				    _sched_a5_keystream(cache, 0, fn));
+		}
+	}
+	printf("A5/%d, UL %u frames behind%s: hits=%u misses=%u\n", algo, gap,
+	       memcmp(dl_key, ul_key, 8) ? ", other UL key" : "",
+	       cache->hits, cache->misses);
+}
+
+static void test_a5_burst(void)
+{
+	static const uint8_t key[MAX_A5_KEY_LEN] = { 0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde, 0xf0 };
+	static const uint8_t key2[MAX_A5_KEY_LEN] = { 0x0f, 0xed, 0xcb, 0xa9, 0x87, 0x65, 0x43, 0x21 };
+	static struct l1sched_a5_cache cache;
+	const ubit_t *ks;
+	int algo;
+
+	printf("Testing A5 burst ciphering\n");
+
+	for (algo = 1; algo <= 2; algo++) {
+		/* same FN back to back */
+		run_a5_gap(&cache, algo, key, key, 0, 0);
+		/* default fn-advance of osmo-bts-trx plus some latency,
+		 * across the end of the hyperframe */
+		run_a5_gap(&cache, algo, key, key, GSM_HYPERFRAME - 50, 23);
+		/* too late for the cache, generated on demand */
+		run_a5_gap(&cache, algo, key, key, 0, L1SCHED_A5_CACHE_SIZE);
+		/* UL not switched to the new key yet */
+		run_a5_gap(&cache, algo, key, key2, 0, 23);
+	}
+
+	/* changing the UL key leaves the DL keystream alone */
+	run_a5_gap(&cache, 1, key, key, 100, 0);
+	_sched_a5_set_key(&cache, 0, 1, key2);
+	ks = _sched_a5_keystream(&cache, 1, 100 + 2 * L1SCHED_A5_CACHE_SIZE - 1);
+	check_a5_ks(1, key, 100 + 2 * L1SCHED_A5_CACHE_SIZE - 1, 1, ks);
+	ks = _sched_a5_keystream(&cache, 0, 100 + 2 * L1SCHED_A5_CACHE_SIZE - 1);
+	check_a5_ks(1, key2, 100 + 2 * L1SCHED_A5_CACHE_SIZE - 1, 0, ks);
+	printf("after UL key change: hits=%u misses=%u\n", cache.hits, cache.misses);
+}
+
 int main(int argc, char **argv)
 {
 	tall_bts_ctx = talloc_named_const(NULL, 1, "OsmoBTS context");
@@ -79,6 +179,7 @@ int main(int argc, char **argv)
 
 	btsb = bts_role_bts(bts);
 	test_cipher_parsing();
+	test_a5_burst();
 	printf("Success\n");
 
 	return 0;
@@ -0,0 +1,120 @@
+/* Offline benchmark of the L1SAP lchan lookup and of the TCH-RTS.ind
+ * handling.
+ *
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/msgb.h>
+#include <osmocom/gsm/l1sap.h>
+
+#include <osmo-bts/bts.h>
+#include <osmo-bts/logging.h>
+#include <osmo-bts/gsm_data.h>
+#include <osmo-bts/l1sap.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#define NUM_LOOKUPS	10000000
+#define NUM_PRIMS	1000000
+
+static struct gsm_bts *bts;
+
+/* the lookup as it was done before the table */
+static struct gsm_lchan *lookup_computed(struct gsm_bts_trx *trx, unsigned int chan_nr)
+{
+	return &trx->ts[L1SAP_CHAN2TS(chan_nr)].lchan[l1sap_chan2ss(chan_nr)];
+}
+
+static long elapsed_us(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000000
+		+ (end->tv_nsec - start->tv_nsec) / 1000;
+}
+
+static void bench_lchan_lookup(void)
+{
+	struct gsm_bts_trx *trx = bts->c0;
+	struct timespec start, end;
+	volatile uintptr_t sum = 0;
+	unsigned int i;
+
+	/* a mix of TCH/F, TCH/H and SDCCH/8 channel numbers */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < NUM_LOOKUPS; i++)
+		sum += (uintptr_t) lookup_computed(trx, 0x08 + (i & 0x3f));
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printf("%u lookups computed from chan_nr: %ld us\n",
+		NUM_LOOKUPS, elapsed_us(&start, &end));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < NUM_LOOKUPS; i++)
+		sum += (uintptr_t) get_lchan_by_chan_nr(trx, 0x08 + (i & 0x3f));
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printf("%u lookups from table: %ld us\n",
+		NUM_LOOKUPS, elapsed_us(&start, &end));
+}
+
+static void bench_tch_rts(void)
+{
+	struct gsm_bts_trx *trx = bts->c0;
+	struct osmo_phsap_prim *l1sap;
+	struct timespec start, end;
+	struct msgb *msg;
+	unsigned int i;
+
+	for (i = 1; i < 8; i++) {
+		trx->ts[i].lchan[0].type = GSM_LCHAN_TCH_F;
+		trx->ts[i].lchan[0].state = LCHAN_S_ACTIVE;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < NUM_PRIMS; i++) {
+		msg = l1sap_msgb_alloc(0);
+		OSMO_ASSERT(msg);
+		l1sap = msgb_l1sap_prim(msg);
+		osmo_prim_init(&l1sap->oph, SAP_GSM_PH, PRIM_TCH_RTS,
+			       PRIM_OP_INDICATION, msg);
+		l1sap->u.tch.chan_nr = 0x08 + 1 + (i % 7);
+		l1sap->u.tch.fn = i;
+		l1sap_up(trx, l1sap);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printf("%u TCH-RTS.ind: %ld us\n", NUM_PRIMS, elapsed_us(&start, &end));
+}
+
+int main(int argc, char **argv)
+{
+	tall_bts_ctx = talloc_named_const(NULL, 1, "OsmoBTS context");
+	msgb_talloc_ctx_init(tall_bts_ctx, 0);
+
+	bts_log_init(NULL);
+	/* benchmark the hot path, not the logging */
+	log_set_log_level(osmo_stderr_target, LOGL_FATAL);
+
+	bts = gsm_bts_alloc(tall_bts_ctx, 0);
+	if (bts_init(bts) < 0) {
+		fprintf(stderr, "unable to open bts\n");
+		exit(1);
+	}
+
+	bench_lchan_lookup();
+	bench_tch_rts();
+
+	return 0;
+}
@@ -0,0 +1,95 @@
+/* testing the L1SAP lchan lookup and primitive handling */
+
+/* All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/msgb.h>
+#include <osmocom/gsm/l1sap.h>
+
+#include <osmo-bts/bts.h>
+#include <osmo-bts/logging.h>
+#include <osmo-bts/gsm_data.h>
+#include <osmo-bts/l1sap.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+
+static struct gsm_bts *bts;
+
+/* the lookup as it was done before the table */
+static struct gsm_lchan *lookup_computed(struct gsm_bts_trx *trx, unsigned int chan_nr)
+{
+	return &trx->ts[L1SAP_CHAN2TS(chan_nr)].lchan[l1sap_chan2ss(chan_nr)];
+}
+
+static void test_lchan_lookup(void)
+{
+	struct gsm_bts_trx *trx = bts->c0;
+	unsigned int i;
+
+	printf("Testing lchan lookup by chan_nr.\n");
+
+	for (i = 0; i < 256; i++)
+		OSMO_ASSERT(get_lchan_by_chan_nr(trx, i) == lookup_computed(trx, i));
+}
+
+static void test_tch_rts(void)
+{
+	struct gsm_bts_trx *trx = bts->c0;
+	struct osmo_phsap_prim *l1sap;
+	struct msgb *msg;
+	unsigned int i;
+
+	printf("Testing TCH-RTS.ind.\n");
+
+	for (i = 1; i < 8; i++) {
+		trx->ts[i].lchan[0].type = GSM_LCHAN_TCH_F;
+		trx->ts[i].lchan[0].state = LCHAN_S_ACTIVE;
+	}
+
+	/* each TCH/F once, nothing to send */
+	for (i = 0; i < 7; i++) {
+		msg = l1sap_msgb_alloc(0);
+		OSMO_ASSERT(msg);
+		l1sap = msgb_l1sap_prim(msg);
+		osmo_prim_init(&l1sap->oph, SAP_GSM_PH, PRIM_TCH_RTS,
+			       PRIM_OP_INDICATION, msg);
+		l1sap->u.tch.chan_nr = 0x08 + 1 + i;
+		l1sap->u.tch.fn = i;
+		l1sap_up(trx, l1sap);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	tall_bts_ctx = talloc_named_const(NULL, 1, "OsmoBTS context");
+	msgb_talloc_ctx_init(tall_bts_ctx, 0);
+
+	bts_log_init(NULL);
+
+	bts = gsm_bts_alloc(tall_bts_ctx, 0);
+	if (bts_init(bts) < 0) {
+		fprintf(stderr, "unable to open bts\n");
+		exit(1);
+	}
+
+	test_lchan_lookup();
+	test_tch_rts();
+	printf("Success\n");
+
+	return 0;
+}
@@ -23,11 +23,18 @@
 #include <osmo-bts/bts.h>
 #include <osmo-bts/msg_utils.h>
 #include <osmo-bts/logging.h>
+#include <osmo-bts/rtp_egress.h>
 
 #include <osmocom/gsm/protocol/ipaccess.h>
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
 
 static const uint8_t ipa_rsl_connect[] = {
 	0x00, 0x1c, 0xff, 0x10, 0x80, 0x00, 0x0a, 0x0d,
@@ -157,6 +164,54 @@ static void test_sacch_get(void)
 	}
 }
 
+static void test_rtp_egress(void)
+{
+	uint8_t buf[RTP_EGRESS_HDR_LEN + RTP_EGRESS_MAXLEN];
+	struct gsm_lchan lchan;
+	struct iphdr *ip = (struct iphdr *) buf;
+	struct udphdr *udp = (struct udphdr *) (buf + sizeof(*ip));
+	uint8_t *rtp = buf + sizeof(*ip) + sizeof(*udp);
+	uint8_t data[33];
+	unsigned int len;
+
+	printf("Testing batched RTP egress\n");
+
+	memset(&lchan, 0, sizeof(lchan));
+	memset(data, 0xa5, sizeof(data));
+	lchan.abis_ip.bound_ip = 0x0a000001;
+	lchan.abis_ip.bound_port = 4000;
+	lchan.abis_ip.egress.payload_type = 3;
+	lchan.abis_ip.egress.seq = 0x1234;
+	lchan.abis_ip.egress.timestamp = 0x01020304 - 160;
+	lchan.abis_ip.egress.ssrc = 0xdeadbeef;
+
+	/* nothing is sent before the BSC tells us where to */
+	OSMO_ASSERT(rtp_egress_send(&lchan, data, sizeof(data), 160, false) == -ENOTCONN);
+	OSMO_ASSERT(lchan.abis_ip.egress.seq == 0x1234);
+
+	lchan.abis_ip.connect_ip = 0x0a000002;
+	lchan.abis_ip.connect_port = 5000;
+	len = rtp_egress_build(&lchan, buf, data, sizeof(data), true);
+	OSMO_ASSERT(len == 20 + 8 + 12 + 33);
+
+	OSMO_ASSERT(ip->version == 4 && ip->ihl == 5);
+	OSMO_ASSERT(ip->protocol == IPPROTO_UDP);
+	OSMO_ASSERT(ntohs(ip->tot_len) == len);
+	OSMO_ASSERT(ntohl(ip->saddr) == 0x0a000001);
+	OSMO_ASSERT(ntohl(ip->daddr) == 0x0a000002);
+
+	OSMO_ASSERT(ntohs(udp->source) == 4000);
+	OSMO_ASSERT(ntohs(udp->dest) == 5000);
+	OSMO_ASSERT(ntohs(udp->len) == 8 + 12 + 33);
+
+	OSMO_ASSERT(rtp[0] == 0x80);
+	OSMO_ASSERT(rtp[1] == (0x80 | 3));
+	OSMO_ASSERT(rtp[2] == 0x12 && rtp[3] == 0x34);
+	OSMO_ASSERT(rtp[4] == 0x01 && rtp[5] == 0x02 && rtp[6] == 0x03 && rtp[7] == 0x04);
+	OSMO_ASSERT(rtp[8] == 0xde && rtp[9] == 0xad && rtp[10] == 0xbe && rtp[11] == 0xef);
+	OSMO_ASSERT(!memcmp(rtp + 12, data, sizeof(data)));
+}
+
 int main(int argc, char **argv)
 {
 	bts_log_init(NULL);
@@ -164,5 +219,6 @@ int main(int argc, char **argv)
 	test_sacch_get();
 	test_msg_utils_ipa();
 	test_msg_utils_oml();
+	test_rtp_egress();
 	return EXIT_SUCCESS;
 }
@@ -19,6 +19,7 @@
  *
  */
 #include <osmocom/core/talloc.h>
+#include <osmocom/core/bits.h>
 
 #include <osmo-bts/bts.h>
 #include <osmo-bts/logging.h>
@@ -26,6 +27,8 @@
 #include <osmo-bts/gsm_data.h>
 
 #include <unistd.h>
+#include <errno.h>
+#include <time.h>
 
 static struct gsm_bts *bts;
 static struct gsm_bts_role_bts *btsb;
@@ -110,6 +113,163 @@ static void test_paging_sleep(void)
 	ASSERT_TRUE(paging_queue_length(btsb->paging_state) == 0);
 }
 
+static void gen_msg_at(uint32_t fn, uint8_t t3, int *is_empty)
+{
+	uint8_t out_buf[GSM_MACBLOCK_LEN];
+	struct gsm_time g_time;
+
+	gsm_fn2gsmtime(&g_time, fn);
+	ASSERT_TRUE(g_time.t3 == t3);
+	paging_gen_msg(btsb->paging_state, out_buf, &g_time, is_empty);
+}
+
+static void test_paging_wheel(void)
+{
+	struct paging_state *ps = btsb->paging_state;
+	int rc, k;
+	int is_empty = -1;
+	printf("Testing that paging messages expire on the frame clock.\n");
+
+	/* 1s = 5 multiframes */
+	paging_set_lifetime(ps, 1);
+
+	/* paged once, then expired without being paged again */
+	rc = paging_add_identity(ps, 0, static_ilv, 0);
+	ASSERT_TRUE(rc == 0);
+	gen_msg_at(6, 6, &is_empty);
+	ASSERT_TRUE(is_empty == 0);
+	ASSERT_TRUE(paging_queue_length(ps) == 1);
+
+	for (k = 1; k <= 4; k++) {
+		gen_msg_at(51 * k + 12, 12, &is_empty);
+		ASSERT_TRUE(is_empty == 1);
+	}
+	ASSERT_TRUE(paging_queue_length(ps) == 1);
+	gen_msg_at(51 * 5 + 12, 12, &is_empty);
+	ASSERT_TRUE(paging_queue_length(ps) == 0);
+	ASSERT_TRUE(paging_group_queue_empty(ps, 0));
+	ASSERT_TRUE(paging_get_group_stats(ps, 0)->queued == 0);
+	ASSERT_TRUE(paging_get_group_stats(ps, 0)->expired == 3);
+
+	/* expired before it was paged: it must still be paged once */
+	rc = paging_add_identity(ps, 2, static_ilv, 0);
+	ASSERT_TRUE(rc == 0);
+	for (k = 6; k <= 12; k++)
+		gen_msg_at(51 * k + 12, 12, &is_empty);
+	ASSERT_TRUE(paging_queue_length(ps) == 1);
+	ASSERT_TRUE(paging_get_group_stats(ps, 2)->queued == 1);
+	gen_msg_at(51 * 12 + 16, 16, &is_empty);
+	ASSERT_TRUE(is_empty == 0);
+	ASSERT_TRUE(paging_queue_length(ps) == 0);
+	ASSERT_TRUE(paging_get_group_stats(ps, 2)->expired == 1);
+
+	paging_set_lifetime(ps, 0);
+}
+
+static void test_paging_pack(void)
+{
+	struct paging_state *ps = btsb->paging_state;
+	const struct paging_pack_stats *st = paging_get_pack_stats(ps);
+	uint8_t imsi2_lv[sizeof(static_ilv)];
+	uint8_t tmsi_lv[] = { 0x05, 0xF4, 0x00, 0x00, 0x00, 0x00 };
+	uint8_t out_buf[GSM_MACBLOCK_LEN];
+	struct gsm_time g_time;
+	uint64_t blocks = st->blocks, identities = st->identities;
+	int rc, i, is_empty = -1;
+	printf("Testing that paging messages are packed.\n");
+
+	memcpy(imsi2_lv, static_ilv, sizeof(imsi2_lv));
+	imsi2_lv[8] = 0x29;
+
+	/* queue is TMSI, IMSI, IMSI, TMSI, TMSI, TMSI: looking at only the
+	 * first four, this would take three blocks */
+	for (i = 4; i >= 2; i--) {
+		tmsi_lv[5] = i;
+		rc = paging_add_identity(ps, 0, tmsi_lv, 0);
+		ASSERT_TRUE(rc == 0);
+	}
+	rc = paging_add_identity(ps, 0, imsi2_lv, 0);
+	ASSERT_TRUE(rc == 0);
+	rc = paging_add_identity(ps, 0, static_ilv, 0);
+	ASSERT_TRUE(rc == 0);
+	tmsi_lv[5] = 1;
+	rc = paging_add_identity(ps, 0, tmsi_lv, 0);
+	ASSERT_TRUE(rc == 0);
+	ASSERT_TRUE(paging_queue_length(ps) == 6);
+
+	gsm_fn2gsmtime(&g_time, 51 * 14 + 6);
+	rc = paging_gen_msg(ps, out_buf, &g_time, &is_empty);
+	ASSERT_TRUE(is_empty == 0);
+	ASSERT_TRUE(out_buf[2] == GSM48_MT_RR_PAG_REQ_3);
+	ASSERT_TRUE(paging_queue_length(ps) == 2);
+
+	gsm_fn2gsmtime(&g_time, 51 * 16 + 6);
+	rc = paging_gen_msg(ps, out_buf, &g_time, &is_empty);
+	ASSERT_TRUE(is_empty == 0);
+	ASSERT_TRUE(out_buf[2] == GSM48_MT_RR_PAG_REQ_1);
+	ASSERT_TRUE(paging_queue_length(ps) == 0);
+
+	ASSERT_TRUE(st->blocks - blocks == 2);
+	ASSERT_TRUE(st->identities - identities == 6);
+}
+
+static void test_paging_stress(void)
+{
+	struct paging_state *ps = btsb->paging_state;
+	const unsigned int num = 100000;
+	unsigned int queue_max = paging_get_queue_max(ps);
+	uint8_t tmsi_lv[] = { 0x05, 0xF4, 0x00, 0x00, 0x00, 0x00 };
+	struct timespec start, end;
+	unsigned int i;
+	int rc;
+
+	printf("Testing paging of %u identities.\n", num);
+
+	/* don't measure the logging of each record */
+	log_set_category_filter(osmo_stderr_target, DPAG, 1, LOGL_NOTICE);
+
+	paging_set_queue_max(ps, num);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < num; i++) {
+		osmo_store32be(i, tmsi_lv + 2);
+		rc = paging_add_identity(ps, i % 81, tmsi_lv, 0);
+		ASSERT_TRUE(rc == 0);
+	}
+	ASSERT_TRUE(paging_queue_length(ps) == num);
+	ASSERT_TRUE(paging_buffer_space(ps) == 0);
+
+	/* every identity is a duplicate now, the same TMSI in another group is not */
+	paging_set_queue_max(ps, num + 1);
+	for (i = 0; i < num; i++) {
+		osmo_store32be(i, tmsi_lv + 2);
+		rc = paging_add_identity(ps, i % 81, tmsi_lv, 0);
+		ASSERT_TRUE(rc == -EEXIST);
+	}
+	osmo_store32be(0, tmsi_lv + 2);
+	rc = paging_add_identity(ps, 1, tmsi_lv, 0);
+	ASSERT_TRUE(rc == 0);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	/* not part of the expected output, as it depends on the machine */
+	fprintf(stderr, "Added %u identities and %u duplicates in %ld ms\n",
+		num + 1, num, (end.tv_sec - start.tv_sec) * 1000
+			      + (end.tv_nsec - start.tv_nsec) / 1000000);
+
+	paging_reset(ps);
+	ASSERT_TRUE(paging_queue_length(ps) == 0);
+	for (i = 0; i < 81; i++)
+		ASSERT_TRUE(paging_group_queue_empty(ps, i));
+
+	/* records are re-used after the reset */
+	osmo_store32be(0, tmsi_lv + 2);
+	rc = paging_add_identity(ps, 0, tmsi_lv, 0);
+	ASSERT_TRUE(rc == 0);
+	paging_reset(ps);
+
+	paging_set_queue_max(ps, queue_max);
+}
+
 int main(int argc, char **argv)
 {
 	tall_bts_ctx = talloc_named_const(NULL, 1, "OsmoBTS context");
@@ -126,6 +286,9 @@ int main(int argc, char **argv)
 	btsb = bts_role_bts(bts);
 	test_paging_smoke();
 	test_paging_sleep();
+	test_paging_wheel();
+	test_paging_pack();
+	test_paging_stress();
 	printf("Success\n");
 
 	return 0;
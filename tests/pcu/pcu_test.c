@@ -0,0 +1,558 @@
+/* testing the PCU interface */
+
+/* All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/select.h>
+#include <osmocom/core/signal.h>
+#include <osmocom/core/timer.h>
+
+#include <osmo-bts/bts.h>
+#include <osmo-bts/logging.h>
+#include <osmo-bts/pcu_shm.h>
+#include <osmo-bts/pcu_if.h>
+#include <osmo-bts/pcuif_proto.h>
+#include <osmo-bts/l1sap.h>
+#include <osmo-bts/signal.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+static int pcu_shm_rx_count;
+
+static int pcu_shm_test_rx_cb(void *data, struct gsm_pcu_if *pcu_prim)
+{
+	OSMO_ASSERT(pcu_prim->msg_type == PCU_IF_MSG_DATA_REQ);
+	OSMO_ASSERT(pcu_prim->u.data_req.fn == pcu_shm_rx_count);
+	pcu_shm_rx_count++;
+	return 0;
+}
+
+static void test_pcu_shm(void)
+{
+	struct pcu_shm shm;
+	struct gsm_pcu_if_shm_ring *r;
+	struct gsm_pcu_if *pcu_prim;
+	uint64_t cnt;
+	int i;
+
+	printf("Testing PCU shared memory transport\n");
+
+	if (!pcu_shm_supported())
+		return;
+	OSMO_ASSERT(pcu_shm_open(&shm, pcu_shm_test_rx_cb, NULL) == 0);
+
+	/* the doorbell is only rung for the first of a burst */
+	for (i = 0; i < 3; i++) {
+		pcu_prim = pcu_shm_claim(&shm);
+		OSMO_ASSERT(pcu_prim);
+		pcu_prim->msg_type = PCU_IF_MSG_TIME_IND;
+		pcu_shm_commit(&shm);
+	}
+	OSMO_ASSERT(shm.tx == 3 && shm.doorbells == 1);
+	OSMO_ASSERT(read(shm.tx_efd, &cnt, sizeof(cnt)) == sizeof(cnt) && cnt == 1);
+
+	/* the PCU does not consume, the ring runs full */
+	for (i = 3; i < PCU_IF_SHM_SLOTS; i++) {
+		OSMO_ASSERT(pcu_shm_claim(&shm));
+		pcu_shm_commit(&shm);
+	}
+	OSMO_ASSERT(!pcu_shm_claim(&shm) && shm.tx_full == 1);
+
+	/* primitives from the PCU are handed over in order */
+	r = &shm.map->to_bts;
+	for (i = 0; i < 5; i++) {
+		r->slot[i].msg_type = PCU_IF_MSG_DATA_REQ;
+		r->slot[i].u.data_req.fn = i;
+	}
+	r->head = 5;
+	OSMO_ASSERT(pcu_shm_rx(&shm) == 0);
+	OSMO_ASSERT(pcu_shm_rx_count == 5 && r->tail == 5);
+
+	pcu_shm_close(&shm);
+}
+
+/* what the PCU receives, a TIME_RTS.ind may be longer than struct gsm_pcu_if */
+static union {
+	struct gsm_pcu_if prim;
+	uint8_t buf[sizeof(struct gsm_pcu_if) +
+		    PCU_IF_TIME_RTS_MAX * sizeof(struct gsm_pcu_if_rts_req)];
+} pcu_rx;
+
+#define PCU_TIME_RTS_HDR_LEN \
+	(offsetof(struct gsm_pcu_if, u) + sizeof(struct gsm_pcu_if_time_rts_ind))
+
+static const struct gsm_pcu_if_rts_req *pcu_rx_rts(unsigned int i)
+{
+	return (const struct gsm_pcu_if_rts_req *) (pcu_rx.buf +
+		PCU_TIME_RTS_HDR_LEN) + i;
+}
+
+/* accept, read, write and run the timers of zero timeout */
+static void pcu_test_select(void)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+		osmo_select_main(1);
+}
+
+/* receive one primitive at the PCU end, returns its length or -errno */
+static int pcu_test_recv(int fd)
+{
+	int rc;
+
+	memset(&pcu_rx, 0, sizeof(pcu_rx));
+	rc = recv(fd, pcu_rx.buf, sizeof(pcu_rx.buf), MSG_DONTWAIT);
+	return rc < 0 ? -errno : rc;
+}
+
+static void pcu_test_send(int fd, uint8_t msg_type, uint8_t bts_nr,
+			  const struct gsm_pcu_if *pcu_prim)
+{
+	struct gsm_pcu_if p = *pcu_prim;
+
+	p.msg_type = msg_type;
+	p.bts_nr = bts_nr;
+	OSMO_ASSERT(send(fd, &p, sizeof(p), 0) == sizeof(p));
+	pcu_test_select();
+}
+
+/* the PCU sockets are created in a directory of the test run */
+static char pcu_test_dir[] = "/tmp/pcu_test_XXXXXX";
+
+static void pcu_test_path(struct sockaddr_un *sa, const char *name)
+{
+	memset(sa, 0, sizeof(*sa));
+	sa->sun_family = AF_UNIX;
+	OSMO_ASSERT(snprintf(sa->sun_path, sizeof(sa->sun_path), "%s/%s",
+			     pcu_test_dir, name) < sizeof(sa->sun_path));
+}
+
+/* open the PCU socket of a BTS, connect to it and take the INFO.ind */
+static int pcu_test_connect(struct gsm_bts *bts, const char *name)
+{
+	struct sockaddr_un sa;
+	int fd;
+
+	pcu_test_path(&sa, name);
+	OSMO_ASSERT(pcu_sock_init(bts, sa.sun_path) == 0);
+	fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	OSMO_ASSERT(fd >= 0);
+	OSMO_ASSERT(connect(fd, (struct sockaddr *) &sa, sizeof(sa)) == 0);
+	pcu_test_select();
+
+	OSMO_ASSERT(pcu_connected(bts));
+	OSMO_ASSERT(pcu_test_recv(fd) == sizeof(struct gsm_pcu_if));
+	OSMO_ASSERT(pcu_rx.prim.msg_type == PCU_IF_MSG_INFO_IND);
+	OSMO_ASSERT(pcu_rx.prim.bts_nr == bts->nr);
+	OSMO_ASSERT(pcu_rx.prim.u.info_ind.flags & PCU_IF_FLAG_TIME_RTS);
+	return fd;
+}
+
+static void pcu_test_disconnect(struct gsm_bts *bts, const char *name, int fd)
+{
+	struct sockaddr_un sa;
+
+	pcu_test_path(&sa, name);
+	pcu_sock_exit(bts);
+	if (fd >= 0)
+		close(fd);
+	unlink(sa.sun_path);
+}
+
+static void test_pcu_time_rts(struct gsm_bts *bts)
+{
+	const char *name = "time_rts";
+	struct gsm_bts_trx_ts *ts = &bts->c0->ts[7];
+	struct gsm_pcu_if caps = {};
+	const struct gsm_pcu_if_rts_req *rts_req;
+	int fd, i;
+
+	printf("Testing PCU TIME_RTS.ind\n");
+
+	fd = pcu_test_connect(bts, name);
+
+	/* without CAPS.ind, TIME.ind and RTS.req are sent as they are */
+	OSMO_ASSERT(pcu_tx_time_ind(bts, 13) == 0);
+	OSMO_ASSERT(pcu_tx_rts_req(ts, 0, 13, 871, 0) == 0);
+	pcu_test_select();
+	OSMO_ASSERT(pcu_test_recv(fd) == sizeof(struct gsm_pcu_if));
+	OSMO_ASSERT(pcu_rx.prim.msg_type == PCU_IF_MSG_TIME_IND);
+	OSMO_ASSERT(pcu_rx.prim.u.time_ind.fn == 13);
+	OSMO_ASSERT(pcu_test_recv(fd) == sizeof(struct gsm_pcu_if));
+	OSMO_ASSERT(pcu_rx.prim.msg_type == PCU_IF_MSG_RTS_REQ);
+	OSMO_ASSERT(pcu_rx.prim.u.rts_req.fn == 13);
+	OSMO_ASSERT(pcu_test_recv(fd) == -EAGAIN);
+
+	caps.u.caps_ind.flags = PCU_IF_FLAG_TIME_RTS;
+	pcu_test_send(fd, PCU_IF_MSG_CAPS_IND, bts->nr, &caps);
+
+	/* the TIME.ind and RTS.req of one iteration go into one message */
+	OSMO_ASSERT(pcu_tx_time_ind(bts, 17) == 0);
+	for (i = 0; i < 3; i++)
+		OSMO_ASSERT(pcu_tx_rts_req(ts, i == 2, 17, 871, i) == 0);
+	OSMO_ASSERT(pcu_test_recv(fd) == -EAGAIN);
+	pcu_test_select();
+	OSMO_ASSERT(pcu_test_recv(fd) == PCU_TIME_RTS_HDR_LEN + 3 * sizeof(*rts_req));
+	OSMO_ASSERT(pcu_rx.prim.msg_type == PCU_IF_MSG_TIME_RTS_IND);
+	OSMO_ASSERT(pcu_rx.prim.bts_nr == bts->nr);
+	OSMO_ASSERT(pcu_rx.prim.u.time_rts_ind.has_time);
+	OSMO_ASSERT(pcu_rx.prim.u.time_rts_ind.fn == 17);
+	OSMO_ASSERT(pcu_rx.prim.u.time_rts_ind.num_rts == 3);
+	for (i = 0; i < 3; i++) {
+		rts_req = pcu_rx_rts(i);
+		OSMO_ASSERT(rts_req->sapi == (i == 2 ? PCU_IF_SAPI_PTCCH : PCU_IF_SAPI_PDTCH));
+		OSMO_ASSERT(rts_req->fn == 17 && rts_req->arfcn == 871);
+		OSMO_ASSERT(rts_req->trx_nr == 0 && rts_req->ts_nr == 7);
+		OSMO_ASSERT(rts_req->block_nr == i);
+	}
+	OSMO_ASSERT(pcu_test_recv(fd) == -EAGAIN);
+
+	/* RTS.req only, e.g. on a FN without TIME.ind */
+	OSMO_ASSERT(pcu_tx_rts_req(ts, 0, 18, 871, 1) == 0);
+	pcu_test_select();
+	OSMO_ASSERT(pcu_test_recv(fd) == PCU_TIME_RTS_HDR_LEN + sizeof(*rts_req));
+	OSMO_ASSERT(!pcu_rx.prim.u.time_rts_ind.has_time);
+	OSMO_ASSERT(pcu_rx.prim.u.time_rts_ind.num_rts == 1);
+	OSMO_ASSERT(pcu_rx_rts(0)->fn == 18);
+
+	/* a second TIME.ind flushes the first one */
+	OSMO_ASSERT(pcu_tx_time_ind(bts, 21) == 0);
+	OSMO_ASSERT(pcu_tx_rts_req(ts, 0, 21, 871, 2) == 0);
+	OSMO_ASSERT(pcu_tx_time_ind(bts, 26) == 0);
+	OSMO_ASSERT(pcu_test_recv(fd) == PCU_TIME_RTS_HDR_LEN + sizeof(*rts_req));
+	OSMO_ASSERT(pcu_rx.prim.u.time_rts_ind.fn == 21);
+	OSMO_ASSERT(pcu_rx.prim.u.time_rts_ind.num_rts == 1);
+	pcu_test_select();
+	OSMO_ASSERT(pcu_test_recv(fd) == PCU_TIME_RTS_HDR_LEN);
+	OSMO_ASSERT(pcu_rx.prim.u.time_rts_ind.has_time);
+	OSMO_ASSERT(pcu_rx.prim.u.time_rts_ind.fn == 26);
+	OSMO_ASSERT(pcu_rx.prim.u.time_rts_ind.num_rts == 0);
+
+	/* a full message is sent at once, the rest with the timer */
+	for (i = 0; i < PCU_IF_TIME_RTS_MAX + 1; i++)
+		OSMO_ASSERT(pcu_tx_rts_req(ts, 0, i, 871, 0) == 0);
+	OSMO_ASSERT(pcu_test_recv(fd) == PCU_TIME_RTS_HDR_LEN +
+		    PCU_IF_TIME_RTS_MAX * sizeof(*rts_req));
+	OSMO_ASSERT(pcu_rx.prim.u.time_rts_ind.num_rts == PCU_IF_TIME_RTS_MAX);
+	OSMO_ASSERT(pcu_rx_rts(PCU_IF_TIME_RTS_MAX - 1)->fn == PCU_IF_TIME_RTS_MAX - 1);
+	OSMO_ASSERT(pcu_test_recv(fd) == -EAGAIN);
+	pcu_test_select();
+	OSMO_ASSERT(pcu_test_recv(fd) == PCU_TIME_RTS_HDR_LEN + sizeof(*rts_req));
+	OSMO_ASSERT(pcu_rx_rts(0)->fn == PCU_IF_TIME_RTS_MAX);
+
+	/* other primitives keep their place */
+	OSMO_ASSERT(pcu_tx_rts_req(ts, 0, 30, 871, 0) == 0);
+	OSMO_ASSERT(pcu_tx_rach_ind(bts, 0, 0x42, 30, 0, GSM_L1_BURST_TYPE_ACCESS_0) == 0);
+	pcu_test_select();
+	OSMO_ASSERT(pcu_test_recv(fd) == PCU_TIME_RTS_HDR_LEN + sizeof(*rts_req));
+	OSMO_ASSERT(pcu_rx.prim.msg_type == PCU_IF_MSG_TIME_RTS_IND);
+	OSMO_ASSERT(pcu_test_recv(fd) == sizeof(struct gsm_pcu_if));
+	OSMO_ASSERT(pcu_rx.prim.msg_type == PCU_IF_MSG_RACH_IND);
+	OSMO_ASSERT(pcu_rx.prim.u.rach_ind.ra == 0x42);
+	OSMO_ASSERT(pcu_test_recv(fd) == -EAGAIN);
+
+	pcu_test_disconnect(bts, name, fd);
+}
+
+static void test_pcu_multi_bts(struct gsm_bts *bts0, struct gsm_bts *bts1)
+{
+	const char *name0 = "bts0";
+	const char *name1 = "bts1";
+	int fd0, fd1;
+
+	printf("Testing PCU sockets of two BTS\n");
+
+	fd0 = pcu_test_connect(bts0, name0);
+	fd1 = pcu_test_connect(bts1, name1);
+	OSMO_ASSERT(pcu_sock_get_stats(bts0) != pcu_sock_get_stats(bts1));
+
+	/* each BTS talks to its own PCU */
+	OSMO_ASSERT(pcu_tx_rach_ind(bts1, 0, 0x11, 42, 0, GSM_L1_BURST_TYPE_ACCESS_0) == 0);
+	OSMO_ASSERT(pcu_tx_rach_ind(bts0, 0, 0x10, 42, 0, GSM_L1_BURST_TYPE_ACCESS_0) == 0);
+	pcu_test_select();
+	OSMO_ASSERT(pcu_test_recv(fd0) == sizeof(struct gsm_pcu_if));
+	OSMO_ASSERT(pcu_rx.prim.bts_nr == 0 && pcu_rx.prim.u.rach_ind.ra == 0x10);
+	OSMO_ASSERT(pcu_test_recv(fd0) == -EAGAIN);
+	OSMO_ASSERT(pcu_test_recv(fd1) == sizeof(struct gsm_pcu_if));
+	OSMO_ASSERT(pcu_rx.prim.bts_nr == 1 && pcu_rx.prim.u.rach_ind.ra == 0x11);
+	OSMO_ASSERT(pcu_test_recv(fd1) == -EAGAIN);
+
+	/* the attributes of one BTS do not activate the PCU of the other */
+	bts0->si_valid |= (1 << SYSINFO_TYPE_3);
+	osmo_signal_dispatch(SS_GLOBAL, S_NEW_SYSINFO, bts0);
+	osmo_signal_dispatch(SS_GLOBAL, S_NEW_NSE_ATTR, bts0);
+	osmo_signal_dispatch(SS_GLOBAL, S_NEW_CELL_ATTR, bts0);
+	pcu_test_select();
+	OSMO_ASSERT(pcu_test_recv(fd0) == -EAGAIN);
+	osmo_signal_dispatch(SS_GLOBAL, S_NEW_NSVC_ATTR, &bts0->gprs.nsvc[0]);
+	pcu_test_select();
+	OSMO_ASSERT(pcu_test_recv(fd0) == sizeof(struct gsm_pcu_if));
+	OSMO_ASSERT(pcu_rx.prim.msg_type == PCU_IF_MSG_INFO_IND);
+	OSMO_ASSERT(pcu_rx.prim.u.info_ind.flags & PCU_IF_FLAG_ACTIVE);
+	OSMO_ASSERT(pcu_test_recv(fd1) == -EAGAIN);
+
+	/* and an update for the other BTS does not go to the active PCU */
+	osmo_signal_dispatch(SS_GLOBAL, S_NEW_NSE_ATTR, bts1);
+	pcu_test_select();
+	OSMO_ASSERT(pcu_test_recv(fd0) == -EAGAIN);
+	OSMO_ASSERT(pcu_test_recv(fd1) == -EAGAIN);
+	OSMO_ASSERT(pcu_tx_info_ind(bts1) == 0);
+	pcu_test_select();
+	OSMO_ASSERT(pcu_test_recv(fd1) == sizeof(struct gsm_pcu_if));
+	OSMO_ASSERT(pcu_rx.prim.bts_nr == 1);
+	OSMO_ASSERT(!(pcu_rx.prim.u.info_ind.flags & PCU_IF_FLAG_ACTIVE));
+
+	/* losing one PCU leaves the other connected */
+	close(fd1);
+	pcu_test_select();
+	OSMO_ASSERT(!pcu_connected(bts1) && pcu_connected(bts0));
+
+	pcu_test_disconnect(bts1, name1, -1);
+	pcu_test_disconnect(bts0, name0, fd0);
+}
+
+static uint64_t pcu_test_ctr(struct gsm_bts *bts, enum pcu_sock_ctr i)
+{
+	return pcu_sock_get_stats(bts)->ctrs->ctr[i].current;
+}
+
+static int pcu_test_data_ind(struct gsm_bts *bts, uint32_t fn)
+{
+	uint8_t data[23] = {};
+
+	return pcu_tx_data_ind(&bts->c0->ts[7], PCU_IF_SAPI_PDTCH, fn, 871, 0,
+			       data, sizeof(data), -60, 0, 0, 100);
+}
+
+/* switch to the shared memory transport, returns its rings */
+static struct gsm_pcu_if_shm *pcu_test_shm(struct gsm_bts *bts, int fd, int fds[3])
+{
+	struct gsm_pcu_if req = {}, cnf;
+	union {
+		char buf[CMSG_SPACE(3 * sizeof(int))];
+		struct cmsghdr align;
+	} u;
+	struct iovec iov = {
+		.iov_base = &cnf,
+		.iov_len = sizeof(cnf),
+	};
+	struct msghdr mh = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = u.buf,
+		.msg_controllen = sizeof(u.buf),
+	};
+	struct cmsghdr *cmsg;
+	void *map;
+
+	pcu_test_send(fd, PCU_IF_MSG_SHM_REQ, bts->nr, &req);
+	OSMO_ASSERT(recvmsg(fd, &mh, MSG_DONTWAIT) == sizeof(cnf));
+	OSMO_ASSERT(cnf.msg_type == PCU_IF_MSG_SHM_CNF);
+	cmsg = CMSG_FIRSTHDR(&mh);
+	OSMO_ASSERT(cmsg && cmsg->cmsg_type == SCM_RIGHTS);
+	memcpy(fds, CMSG_DATA(cmsg), 3 * sizeof(int));
+
+	map = mmap(NULL, sizeof(struct gsm_pcu_if_shm), PROT_READ | PROT_WRITE,
+		   MAP_SHARED, fds[0], 0);
+	OSMO_ASSERT(map != MAP_FAILED);
+	return map;
+}
+
+static void test_pcu_queue(struct gsm_bts *bts)
+{
+	const char *name = "queue";
+	struct gsm_bts_role_bts *btsb = bts_role_bts(bts);
+	const struct pcu_sock_stats *stats;
+	struct gsm_pcu_if_shm *map;
+	struct gsm_pcu_if_shm_ring *r;
+	uint64_t tx_msgs;
+	int fd, fds[3], i;
+
+	printf("Testing PCU queue\n");
+
+	/* the queue runs on the clock of the timers */
+	osmo_gettimeofday_override = true;
+	osmo_gettimeofday_override_time = (struct timeval) { .tv_sec = 1000 };
+	btsb->pcu.queue_low = 2;
+	btsb->pcu.queue_high = 4;
+	fd = pcu_test_connect(bts, name);
+	stats = pcu_sock_get_stats(bts);
+
+	/* nothing is written until select, the PCU is congested at the
+	 * high watermark */
+	for (i = 0; i < 3; i++)
+		OSMO_ASSERT(pcu_test_data_ind(bts, i) == 0);
+	OSMO_ASSERT(pcu_tx_time_ind(bts, 0) == 0);
+	OSMO_ASSERT(stats->queue_len == 4 && stats->congested);
+	OSMO_ASSERT(pcu_test_ctr(bts, PCU_SOCK_CTR_CONGESTED) == 1);
+
+	/* then TIME.ind and RTS.req are dropped, other messages at the hard
+	 * limit, but DATA.ind never */
+	OSMO_ASSERT(pcu_tx_time_ind(bts, 4) == -ENOBUFS);
+	OSMO_ASSERT(pcu_tx_rts_req(&bts->c0->ts[7], 0, 4, 871, 0) == -ENOBUFS);
+	OSMO_ASSERT(pcu_test_ctr(bts, PCU_SOCK_CTR_DROP_CONGESTED) == 2);
+	for (i = 4; i < 16; i++)
+		OSMO_ASSERT(pcu_test_data_ind(bts, i) == 0);
+	OSMO_ASSERT(pcu_tx_rach_ind(bts, 0, 0x42, 16, 0, GSM_L1_BURST_TYPE_ACCESS_0) == -ENOBUFS);
+	OSMO_ASSERT(pcu_test_ctr(bts, PCU_SOCK_CTR_DROP_OVERFLOW) == 1);
+	for (i = 16; i < 20; i++)
+		OSMO_ASSERT(pcu_test_data_ind(bts, i) == 0);
+	OSMO_ASSERT(pcu_test_ctr(bts, PCU_SOCK_CTR_DROP_OVERFLOW) == 1);
+	OSMO_ASSERT(stats->queue_len == 20 && stats->queue_max == 20);
+
+	pcu_test_select();
+	OSMO_ASSERT(stats->queue_len == 0 && !stats->congested);
+	for (i = 0; i < 20; i++) {
+		OSMO_ASSERT(pcu_test_recv(fd) == sizeof(struct gsm_pcu_if));
+		if (i == 3) {
+			OSMO_ASSERT(pcu_rx.prim.msg_type == PCU_IF_MSG_TIME_IND);
+			continue;
+		}
+		OSMO_ASSERT(pcu_rx.prim.msg_type == PCU_IF_MSG_DATA_IND);
+		OSMO_ASSERT(pcu_rx.prim.u.data_ind.fn == i);
+	}
+	OSMO_ASSERT(pcu_test_recv(fd) == -EAGAIN);
+
+	/* a TIME.ind that waited longer than a radio block is not sent */
+	OSMO_ASSERT(pcu_tx_time_ind(bts, 8) == 0);
+	OSMO_ASSERT(pcu_test_data_ind(bts, 8) == 0);
+	osmo_gettimeofday_override_add(0, 20000);
+	pcu_test_select();
+	OSMO_ASSERT(pcu_test_ctr(bts, PCU_SOCK_CTR_DROP_STALE) == 1);
+	OSMO_ASSERT(pcu_test_recv(fd) == sizeof(struct gsm_pcu_if));
+	OSMO_ASSERT(pcu_rx.prim.msg_type == PCU_IF_MSG_DATA_IND);
+	OSMO_ASSERT(pcu_test_recv(fd) == -EAGAIN);
+
+	if (!pcu_shm_supported())
+		goto out;
+
+	/* the same on the shared memory ring, the PCU reads it without
+	 * telling the BTS */
+	map = pcu_test_shm(bts, fd, fds);
+	r = &map->to_pcu;
+	tx_msgs = pcu_test_ctr(bts, PCU_SOCK_CTR_TX_MSGS);
+	for (i = 0; i < 3; i++)
+		OSMO_ASSERT(pcu_test_data_ind(bts, i) == 0);
+	OSMO_ASSERT(pcu_tx_time_ind(bts, 0) == 0);
+	OSMO_ASSERT(r->head - r->tail == 4);
+	OSMO_ASSERT(pcu_test_ctr(bts, PCU_SOCK_CTR_TX_MSGS) == tx_msgs + 4);
+	OSMO_ASSERT(stats->queue_len == 4 && stats->congested);
+	OSMO_ASSERT(pcu_test_ctr(bts, PCU_SOCK_CTR_CONGESTED) == 2);
+	OSMO_ASSERT(pcu_tx_time_ind(bts, 4) == -ENOBUFS);
+
+	/* congested until drained to the low watermark */
+	r->tail++;
+	OSMO_ASSERT(pcu_tx_time_ind(bts, 4) == -ENOBUFS);
+	OSMO_ASSERT(stats->queue_len == 3 && stats->congested);
+	r->tail++;
+	OSMO_ASSERT(pcu_tx_time_ind(bts, 4) == 0);
+	OSMO_ASSERT(stats->queue_len == 3 && !stats->congested);
+	OSMO_ASSERT(pcu_test_ctr(bts, PCU_SOCK_CTR_DROP_CONGESTED) == 4);
+	OSMO_ASSERT(r->head - r->tail == 3);
+
+	/* with the ring full, DATA.ind wait behind it, not on the socket
+	 * where they would overtake those on the ring */
+	btsb->pcu.queue_low = PCU_QUEUE_LOW_DEFAULT;
+	btsb->pcu.queue_high = PCU_QUEUE_HIGH_DEFAULT;
+	for (i = 3; i < PCU_IF_SHM_SLOTS; i++)
+		OSMO_ASSERT(pcu_test_data_ind(bts, i) == 0);
+	OSMO_ASSERT(r->head - r->tail == PCU_IF_SHM_SLOTS && stats->congested);
+	OSMO_ASSERT(pcu_tx_time_ind(bts, 8) == -ENOBUFS);
+	OSMO_ASSERT(pcu_test_data_ind(bts, PCU_IF_SHM_SLOTS) == 0);
+	OSMO_ASSERT(pcu_test_data_ind(bts, PCU_IF_SHM_SLOTS + 1) == 0);
+	OSMO_ASSERT(stats->queue_len == PCU_IF_SHM_SLOTS + 2);
+	pcu_test_select();
+	OSMO_ASSERT(pcu_test_recv(fd) == -EAGAIN);
+
+	/* they go onto the ring in order as the PCU makes room, also
+	 * before a new message */
+	r->tail++;
+	OSMO_ASSERT(pcu_test_data_ind(bts, PCU_IF_SHM_SLOTS + 2) == 0);
+	OSMO_ASSERT(r->head - r->tail == PCU_IF_SHM_SLOTS);
+	OSMO_ASSERT(r->slot[(r->head - 1) % PCU_IF_SHM_SLOTS].u.data_ind.fn == PCU_IF_SHM_SLOTS);
+	OSMO_ASSERT(stats->queue_len == PCU_IF_SHM_SLOTS + 2);
+	r->tail += 3;
+	OSMO_ASSERT(pcu_test_data_ind(bts, PCU_IF_SHM_SLOTS + 3) == 0);
+	OSMO_ASSERT(r->slot[(r->head - 3) % PCU_IF_SHM_SLOTS].u.data_ind.fn == PCU_IF_SHM_SLOTS + 1);
+	OSMO_ASSERT(r->slot[(r->head - 2) % PCU_IF_SHM_SLOTS].u.data_ind.fn == PCU_IF_SHM_SLOTS + 2);
+	OSMO_ASSERT(r->slot[(r->head - 1) % PCU_IF_SHM_SLOTS].u.data_ind.fn == PCU_IF_SHM_SLOTS + 3);
+	OSMO_ASSERT(stats->queue_len == PCU_IF_SHM_SLOTS);
+	pcu_test_select();
+	OSMO_ASSERT(pcu_test_recv(fd) == -EAGAIN);
+
+	/* or after a while, with the timer */
+	OSMO_ASSERT(pcu_test_data_ind(bts, PCU_IF_SHM_SLOTS + 4) == 0);
+	OSMO_ASSERT(stats->queue_len == PCU_IF_SHM_SLOTS + 1);
+	r->tail++;
+	osmo_gettimeofday_override_add(0, 2000);
+	pcu_test_select();
+	OSMO_ASSERT(r->slot[(r->head - 1) % PCU_IF_SHM_SLOTS].u.data_ind.fn == PCU_IF_SHM_SLOTS + 4);
+	OSMO_ASSERT(stats->queue_len == PCU_IF_SHM_SLOTS);
+
+	munmap(map, sizeof(struct gsm_pcu_if_shm));
+	for (i = 0; i < 3; i++)
+		close(fds[i]);
+out:
+	pcu_test_disconnect(bts, name, fd);
+	btsb->pcu.queue_low = PCU_QUEUE_LOW_DEFAULT;
+	btsb->pcu.queue_high = PCU_QUEUE_HIGH_DEFAULT;
+	osmo_gettimeofday_override = false;
+}
+
+int main(int argc, char **argv)
+{
+	struct gsm_bts *bts, *bts1;
+
+	tall_bts_ctx = talloc_named_const(NULL, 1, "OsmoBTS context");
+	msgb_talloc_ctx_init(tall_bts_ctx, 0);
+
+	bts_log_init(NULL);
+
+	bts = gsm_bts_alloc(tall_bts_ctx, 0);
+	if (bts_init(bts) < 0) {
+		fprintf(stderr, "unable to open bts\n");
+		exit(1);
+	}
+	bts1 = gsm_bts_alloc(tall_bts_ctx, 1);
+	if (bts_init(bts1) < 0) {
+		fprintf(stderr, "unable to open bts\n");
+		exit(1);
+	}
+	OSMO_ASSERT(mkdtemp(pcu_test_dir));
+
+	test_pcu_shm();
+	test_pcu_time_rts(bts);
+	test_pcu_multi_bts(bts, bts1);
+	test_pcu_queue(bts);
+
+	rmdir(pcu_test_dir);
+	printf("Success\n");
+
+	return 0;
+}
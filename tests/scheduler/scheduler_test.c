@@ -0,0 +1,356 @@
+/* Scheduler dispatch tests
+ *
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <osmo-bts/bts.h>
+#include <osmo-bts/logging.h>
+#include <osmo-bts/gsm_data.h>
+#include <osmo-bts/l1sap.h>
+#include <osmo-bts/scheduler.h>
+#include <osmo-bts/scheduler_backend.h>
+
+#include <osmocom/core/talloc.h>
+#include <osmocom/gsm/protocol/gsm_08_58.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static struct gsm_bts *bts;
+static struct l1sched_trx l1t;
+
+#define ASSERT_TRUE(rc) \
+	if (!(rc)) { \
+		printf("Assert failed in %s:%d.\n",  \
+		       __FILE__, __LINE__);          \
+		abort();			     \
+	}
+
+/* last call of a burst handler, recorded by the backend stubs below */
+struct burst_call {
+	unsigned int		num;
+	uint32_t		fn;
+	enum trx_chan_type	chan;
+	uint8_t			bid;
+};
+
+static struct burst_call dl_call, ul_call;
+
+static ubit_t *record_dl(uint32_t fn, enum trx_chan_type chan, uint8_t bid)
+{
+	dl_call.num++;
+	dl_call.fn = fn;
+	dl_call.chan = chan;
+	dl_call.bid = bid;
+	return NULL;
+}
+
+static int record_ul(uint32_t fn, enum trx_chan_type chan, uint8_t bid)
+{
+	ul_call.num++;
+	ul_call.fn = fn;
+	ul_call.chan = chan;
+	ul_call.bid = bid;
+	return 0;
+}
+
+ubit_t *tx_idle_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
+	enum trx_chan_type chan, uint8_t bid, uint16_t *nbits)
+{ return record_dl(fn, chan, bid); }
+ubit_t *tx_fcch_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
+	enum trx_chan_type chan, uint8_t bid, uint16_t *nbits)
+{ return record_dl(fn, chan, bid); }
+ubit_t *tx_sch_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
+	enum trx_chan_type chan, uint8_t bid, uint16_t *nbits)
+{ return record_dl(fn, chan, bid); }
+ubit_t *tx_data_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
+	enum trx_chan_type chan, uint8_t bid, uint16_t *nbits)
+{ return record_dl(fn, chan, bid); }
+ubit_t *tx_pdtch_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
+	enum trx_chan_type chan, uint8_t bid, uint16_t *nbits)
+{ return record_dl(fn, chan, bid); }
+ubit_t *tx_tchf_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
+	enum trx_chan_type chan, uint8_t bid, uint16_t *nbits)
+{ return record_dl(fn, chan, bid); }
+ubit_t *tx_tchh_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
+	enum trx_chan_type chan, uint8_t bid, uint16_t *nbits)
+{ return record_dl(fn, chan, bid); }
+
+int rx_rach_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
+	enum trx_chan_type chan, uint8_t bid, sbit_t *bits, uint16_t nbits,
+	int8_t rssi, float toa)
+{ return record_ul(fn, chan, bid); }
+int rx_data_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
+	enum trx_chan_type chan, uint8_t bid, sbit_t *bits, uint16_t nbits,
+	int8_t rssi, float toa)
+{ return record_ul(fn, chan, bid); }
+int rx_pdtch_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
+	enum trx_chan_type chan, uint8_t bid, sbit_t *bits, uint16_t nbits,
+	int8_t rssi, float toa)
+{ return record_ul(fn, chan, bid); }
+int rx_tchf_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
+	enum trx_chan_type chan, uint8_t bid, sbit_t *bits, uint16_t nbits,
+	int8_t rssi, float toa)
+{ return record_ul(fn, chan, bid); }
+int rx_tchh_fn(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
+	enum trx_chan_type chan, uint8_t bid, sbit_t *bits, uint16_t nbits,
+	int8_t rssi, float toa)
+{ return record_ul(fn, chan, bid); }
+
+void _sched_act_rach_det(struct l1sched_trx *l1t, uint8_t tn, uint8_t ss, int activate)
+{ }
+
+/* reference: resolve a frame the way the scheduler did before the
+ * dispatch table, from multiframe layout, descriptions and states */
+static int ref_active(struct l1sched_ts *l1ts, enum trx_chan_type chan)
+{
+	return trx_chan_desc[chan].auto_active || l1ts->chan_state[chan].active;
+}
+
+static void check_frame(uint8_t tn, uint32_t fn, unsigned int *num_dl,
+			unsigned int *num_ul)
+{
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(&l1t, tn);
+	const struct trx_sched_frame *frame;
+	const struct l1sched_mf_entry *ent;
+	const ubit_t *bits;
+	sbit_t burst[GSM_BURST_LEN];
+	uint16_t nbits = 0;
+
+	frame = l1ts->mf_frames + fn % l1ts->mf_period;
+	ent = &l1ts->mf_table[fn % l1ts->mf_period];
+
+	/* RTS is not invoked, as the real RTS functions talk to L2 */
+	if (frame->dl_bid == 0) {
+		ASSERT_TRUE(ent->rts_fn == trx_chan_desc[frame->dl_chan].rts_fn);
+	} else {
+		ASSERT_TRUE(ent->rts_fn == NULL);
+	}
+
+	memset(&dl_call, 0, sizeof(dl_call));
+	bits = _sched_dl_burst(&l1t, tn, fn, &nbits);
+	/* always a dummy burst on C0 */
+	ASSERT_TRUE(bits != NULL);
+	if (ref_active(l1ts, frame->dl_chan)) {
+		ASSERT_TRUE(ent->dl_active);
+		ASSERT_TRUE(dl_call.num == 1);
+		ASSERT_TRUE(dl_call.fn == fn);
+		ASSERT_TRUE(dl_call.chan == frame->dl_chan);
+		ASSERT_TRUE(dl_call.bid == frame->dl_bid);
+		(*num_dl)++;
+	} else {
+		ASSERT_TRUE(!ent->dl_active);
+		ASSERT_TRUE(dl_call.num == 0);
+		ASSERT_TRUE(nbits == GSM_BURST_LEN);
+	}
+
+	memset(&ul_call, 0, sizeof(ul_call));
+	memset(burst, 0, sizeof(burst));
+	ASSERT_TRUE(trx_sched_ul_burst(&l1t, tn, fn, burst, GSM_BURST_LEN,
+				       -60, 0) == 0);
+	if (ref_active(l1ts, frame->ul_chan)
+	 && trx_chan_desc[frame->ul_chan].ul_fn) {
+		ASSERT_TRUE(ul_call.num == 1);
+		ASSERT_TRUE(ul_call.fn == fn);
+		ASSERT_TRUE(ul_call.chan == frame->ul_chan);
+		ASSERT_TRUE(ul_call.bid == frame->ul_bid);
+		(*num_ul)++;
+	} else {
+		ASSERT_TRUE(ul_call.num == 0);
+	}
+}
+
+static void test_replay(void)
+{
+	static const enum gsm_phys_chan_config pchan[TRX_NR_TS] = {
+		GSM_PCHAN_CCCH_SDCCH4, GSM_PCHAN_TCH_F, GSM_PCHAN_TCH_H,
+		GSM_PCHAN_TCH_H, GSM_PCHAN_SDCCH8_SACCH8C, GSM_PCHAN_PDCH,
+		GSM_PCHAN_CCCH, GSM_PCHAN_TCH_F,
+	};
+	/* one hyperframe segment of 51 x 26 frames, crossing FN wrap */
+	const unsigned int num_frames = 51 * 26;
+	const uint32_t start = GSM_HYPERFRAME - num_frames / 2;
+	unsigned int i, num_dl = 0, num_ul = 0;
+	uint32_t fn;
+	uint8_t tn;
+
+	printf("Testing hyperframe replay\n");
+
+	ASSERT_TRUE(trx_sched_init(&l1t, bts->c0) == 0);
+	for (tn = 0; tn < TRX_NR_TS; tn++) {
+		ASSERT_TRUE(trx_sched_set_pchan(&l1t, tn, pchan[tn]) == 0);
+		l1sched_trx_get_ts(&l1t, tn)->mf_last_fn =
+			(start + GSM_HYPERFRAME - 1) % GSM_HYPERFRAME;
+	}
+
+	ASSERT_TRUE(trx_sched_set_lchan(&l1t, RSL_CHAN_SDCCH4_ACCH + (1 << 3) + 0, 0x00, 1) == 0);
+	ASSERT_TRUE(trx_sched_set_lchan(&l1t, RSL_CHAN_SDCCH4_ACCH + (1 << 3) + 0, 0x40, 1) == 0);
+	ASSERT_TRUE(trx_sched_set_lchan(&l1t, RSL_CHAN_Bm_ACCHs + 1, 0x00, 1) == 0);
+	ASSERT_TRUE(trx_sched_set_lchan(&l1t, RSL_CHAN_Bm_ACCHs + 1, 0x40, 1) == 0);
+	/* TCH/H(0) without its SACCH */
+	ASSERT_TRUE(trx_sched_set_lchan(&l1t, RSL_CHAN_Lm_ACCHs + 2, 0x00, 1) == 0);
+	ASSERT_TRUE(trx_sched_set_lchan(&l1t, RSL_CHAN_SDCCH8_ACCH + 4, 0x00, 1) == 0);
+	ASSERT_TRUE(trx_sched_set_lchan(&l1t, RSL_CHAN_SDCCH8_ACCH + (3 << 3) + 4, 0x00, 1) == 0);
+	ASSERT_TRUE(trx_sched_set_lchan(&l1t, RSL_CHAN_OSMO_PDCH + 5, 0x00, 1) == 0);
+
+	for (i = 0; i < num_frames; i++) {
+		fn = (start + i) % GSM_HYPERFRAME;
+
+		/* re-arrange channels half way, the table must follow */
+		if (i == num_frames / 2) {
+			ASSERT_TRUE(trx_sched_set_lchan(&l1t, RSL_CHAN_Bm_ACCHs + 1, 0x00, 0) == 0);
+			ASSERT_TRUE(trx_sched_set_lchan(&l1t, RSL_CHAN_Lm_ACCHs + (1 << 3) + 3, 0x00, 1) == 0);
+			ASSERT_TRUE(trx_sched_set_lchan(&l1t, RSL_CHAN_Lm_ACCHs + (1 << 3) + 3, 0x40, 1) == 0);
+			ASSERT_TRUE(trx_sched_set_lchan(&l1t, RSL_CHAN_SDCCH8_ACCH + 4, 0x00, 0) == 0);
+		}
+
+		for (tn = 0; tn < TRX_NR_TS; tn++)
+			check_frame(tn, fn, &num_dl, &num_ul);
+	}
+
+	/* auto-active BCCH/CCCH alone guarantee both directions were hit */
+	ASSERT_TRUE(num_dl > num_frames);
+	ASSERT_TRUE(num_ul > 0);
+
+	trx_sched_exit(&l1t);
+}
+
+static void test_burst_pool(void)
+{
+	static const enum gsm_phys_chan_config pchan[] = {
+		GSM_PCHAN_CCCH, GSM_PCHAN_CCCH_SDCCH4, GSM_PCHAN_SDCCH8_SACCH8C,
+		GSM_PCHAN_TCH_F, GSM_PCHAN_TCH_H, GSM_PCHAN_PDCH,
+	};
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(&l1t, 2);
+	unsigned int i, c, total;
+
+	printf("Testing burst pool\n");
+
+	ASSERT_TRUE(trx_sched_init(&l1t, bts->c0) == 0);
+	for (i = 0; i < ARRAY_SIZE(pchan); i++) {
+		ASSERT_TRUE(trx_sched_set_pchan(&l1t, 2, pchan[i]) == 0);
+
+		/* every channel with a burst handler owns its own slice */
+		total = 0;
+		for (c = 0; c < _TRX_CHAN_MAX; c++) {
+			struct l1sched_chan_state *cs = &l1ts->chan_state[c];
+
+			if (!cs->burst_buf_len) {
+				ASSERT_TRUE(cs->dl_burst_buf == NULL);
+				continue;
+			}
+			ASSERT_TRUE(cs->dl_burst_buf == l1ts->dl_burst_pool + total);
+			ASSERT_TRUE(cs->ul_burst_buf == l1ts->ul_burst_pool + total);
+			total += cs->burst_buf_len;
+		}
+		ASSERT_TRUE(total > 0 && total <= L1SCHED_BURST_POOL_SIZE);
+	}
+
+	/* activation must not lose the assignment */
+	ASSERT_TRUE(trx_sched_set_lchan(&l1t, RSL_CHAN_OSMO_PDCH + 2, 0x00, 1) == 0);
+	ASSERT_TRUE(l1ts->chan_state[TRXC_PDTCH].dl_burst_buf != NULL);
+	ASSERT_TRUE(l1ts->chan_state[TRXC_PDTCH].burst_buf_len == L1SCHED_BURSTS_PDTCH);
+
+	trx_sched_exit(&l1t);
+}
+
+static int ph_data_req(uint8_t tn, uint32_t fn)
+{
+	struct osmo_phsap_prim *l1sap;
+	struct msgb *msg;
+
+	msg = msgb_alloc_headroom(256, 64, "PH-DATA.req");
+	msg->l1h = msgb_put(msg, sizeof(*l1sap));
+	l1sap = msgb_l1sap_prim(msg);
+	osmo_prim_init(&l1sap->oph, SAP_GSM_PH, PRIM_PH_DATA, PRIM_OP_REQUEST, msg);
+	l1sap->u.data.chan_nr = RSL_CHAN_Bm_ACCHs | tn;
+	l1sap->u.data.link_id = 0x00;
+	l1sap->u.data.fn = fn;
+	msg->l2h = msgb_put(msg, GSM_MACBLOCK_LEN);
+	memset(msg->l2h, GSM_MACBLOCK_PADDING, GSM_MACBLOCK_LEN);
+
+	return trx_sched_ph_data_req(&l1t, l1sap);
+}
+
+static int dl_prim_queued(uint8_t tn, uint32_t fn)
+{
+	struct msgb *msg = _sched_dequeue_prim(&l1t, tn, fn, TRXC_TCHF);
+
+	if (!msg)
+		return 0;
+	msgb_free(msg);
+	return 1;
+}
+
+static void test_dl_prims(void)
+{
+	struct gsm_bts_role_bts *btsb = bts_role_bts(bts);
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(&l1t, 1);
+
+	printf("Testing DL prim window\n");
+
+	ASSERT_TRUE(trx_sched_init(&l1t, bts->c0) == 0);
+	ASSERT_TRUE(trx_sched_set_pchan(&l1t, 1, GSM_PCHAN_TCH_F) == 0);
+
+	/* TS not clocked yet: the BTS clock decides */
+	btsb->gsm_time.fn = 1000;
+	ASSERT_TRUE(ph_data_req(1, 1010) == 0);
+	ASSERT_TRUE(ph_data_req(1, 990) == 0);
+	ASSERT_TRUE(ph_data_req(1, 1000 + L1SCHED_DL_PRIM_WINDOW + 1) == 0);
+	ASSERT_TRUE(dl_prim_queued(1, 1010));
+	ASSERT_TRUE(l1ts->dl_prim_stats.late == 1);
+	ASSERT_TRUE(l1ts->dl_prim_stats.out_of_window == 1);
+
+	/* clocked ahead of the BTS clock: the last FN sent decides */
+	_sched_dl_burst(&l1t, 1, 1020, NULL);
+	ASSERT_TRUE(ph_data_req(1, 1015) == 0);
+	ASSERT_TRUE(ph_data_req(1, 1025) == 0);
+	ASSERT_TRUE(dl_prim_queued(1, 1025));
+	ASSERT_TRUE(l1ts->dl_prim_stats.late == 2);
+
+	/* no longer clocked: back to the BTS clock */
+	btsb->gsm_time.fn = 5000;
+	ASSERT_TRUE(ph_data_req(1, 5010) == 0);
+	ASSERT_TRUE(dl_prim_queued(1, 5010));
+	ASSERT_TRUE(l1ts->dl_prim_stats.late == 2);
+	ASSERT_TRUE(l1ts->dl_prim_stats.out_of_window == 1);
+
+	btsb->gsm_time.fn = 0;
+	trx_sched_exit(&l1t);
+}
+
+int main(int argc, char **argv)
+{
+	tall_bts_ctx = talloc_named_const(NULL, 1, "OsmoBTS context");
+	msgb_talloc_ctx_init(tall_bts_ctx, 0);
+
+	bts_log_init(NULL);
+
+	bts = gsm_bts_alloc(tall_bts_ctx, 0);
+	if (bts_init(bts) < 0) {
+		fprintf(stderr, "unable to open bts\n");
+		exit(1);
+	}
+
+	test_replay();
+	test_burst_pool();
+	test_dl_prims();
+	printf("Success\n");
+
+	return 0;
+}
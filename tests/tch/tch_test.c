@@ -0,0 +1,223 @@
+/* testing the downlink TCH playout buffer */
+
+/* All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/msgb.h>
+#include <osmocom/gsm/l1sap.h>
+
+#include <osmo-bts/bts.h>
+#include <osmo-bts/logging.h>
+#include <osmo-bts/msg_utils.h>
+#include <osmo-bts/dl_tch_ring.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#define TEST_SSRC	0x1234
+
+static int put_rtp(struct dl_tch_ring *ring, uint32_t ssrc, uint16_t seq, bool marker,
+		   unsigned int ms)
+{
+	struct timespec now = { .tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000 };
+	uint8_t data[33];
+
+	memset(data, seq & 0xff, sizeof(data));
+	/* sent every 20 ms from timestamp 0 on */
+	return dl_tch_ring_put(ring, data, sizeof(data), ssrc, seq,
+			       (uint16_t)(seq - 100) * 160, marker, &now);
+}
+
+static int put_frame(struct dl_tch_ring *ring, uint16_t seq, unsigned int ms)
+{
+	return put_rtp(ring, TEST_SSRC, seq, false, ms);
+}
+
+static void expect_frame(struct dl_tch_ring *ring, int seq)
+{
+	struct msgb *msg = dl_tch_ring_get(ring);
+
+	if (seq < 0) {
+		OSMO_ASSERT(!msg);
+		return;
+	}
+	OSMO_ASSERT(msg);
+	OSMO_ASSERT(rtpmsg_seq(msg) == seq);
+	OSMO_ASSERT(msg->len == 33 && msg->data[0] == (seq & 0xff));
+	msgb_free(msg);
+}
+
+static void test_dl_tch_ring(void)
+{
+	struct dl_tch_ring ring;
+	struct msgb *msg, *msg2;
+
+	printf("Testing DL TCH playout buffer\n");
+
+	memset(&ring, 0, sizeof(ring));
+	dl_tch_ring_init(&ring, 3, false);
+
+	/* playout starts with three frames buffered */
+	OSMO_ASSERT(put_frame(&ring, 100, 1000) == 0);
+	OSMO_ASSERT(put_frame(&ring, 101, 1020) == 0);
+	expect_frame(&ring, -1);
+	/* reordered */
+	OSMO_ASSERT(put_frame(&ring, 103, 1060) == 0);
+	OSMO_ASSERT(put_frame(&ring, 102, 1061) == 0);
+	OSMO_ASSERT(put_frame(&ring, 102, 1062) == -EEXIST);
+	expect_frame(&ring, 100);
+	expect_frame(&ring, 101);
+	/* 104 is lost */
+	OSMO_ASSERT(put_frame(&ring, 105, 1100) == 0);
+	expect_frame(&ring, 102);
+	expect_frame(&ring, 103);
+	expect_frame(&ring, -1);
+	OSMO_ASSERT(ring.stats.concealed == 1);
+	expect_frame(&ring, 105);
+	/* too late */
+	OSMO_ASSERT(put_frame(&ring, 104, 1140) == -ETIME);
+	OSMO_ASSERT(ring.stats.late == 1 && ring.stats.late_hist[1] == 1);
+	/* empty, buffering again */
+	expect_frame(&ring, -1);
+	OSMO_ASSERT(ring.stats.underrun == 1);
+	OSMO_ASSERT(put_frame(&ring, 106, 1120) == 0);
+	expect_frame(&ring, -1);
+
+	OSMO_ASSERT(ring.stats.received == 8);
+	OSMO_ASSERT(ring.stats.played == 5);
+	OSMO_ASSERT(ring.stats.duplicate == 1);
+
+	/* still too late after the underrun */
+	OSMO_ASSERT(put_frame(&ring, 105, 1140) == -ETIME);
+	OSMO_ASSERT(ring.stats.late == 2);
+	OSMO_ASSERT(put_frame(&ring, 107, 1140) == 0);
+	OSMO_ASSERT(put_frame(&ring, 108, 1160) == 0);
+	expect_frame(&ring, 106);
+	/* the sender is ahead, 107 and 108 are skipped */
+	OSMO_ASSERT(put_frame(&ring, 112, 1180) == 0);
+	OSMO_ASSERT(ring.stats.skipped == 2);
+	expect_frame(&ring, -1);
+	expect_frame(&ring, -1);
+	expect_frame(&ring, -1);
+	expect_frame(&ring, 112);
+	OSMO_ASSERT(ring.stats.concealed == 4);
+	/* a sequence number jump starts over, from any frame */
+	OSMO_ASSERT(put_frame(&ring, 2000, 1200) == 0);
+	OSMO_ASSERT(put_frame(&ring, 1999, 1201) == 0);
+	OSMO_ASSERT(put_frame(&ring, 2001, 1220) == 0);
+	expect_frame(&ring, 1999);
+	expect_frame(&ring, 2000);
+	expect_frame(&ring, 2001);
+	OSMO_ASSERT(ring.stats.resync == 1);
+	/* as does a jump back, rather than dropping the frames as late */
+	OSMO_ASSERT(put_frame(&ring, 500, 1240) == 0);
+	OSMO_ASSERT(put_frame(&ring, 501, 1260) == 0);
+	OSMO_ASSERT(put_frame(&ring, 502, 1280) == 0);
+	OSMO_ASSERT(ring.stats.resync == 2);
+	expect_frame(&ring, 500);
+	expect_frame(&ring, 501);
+	/* frames just behind the playout are still late */
+	OSMO_ASSERT(put_frame(&ring, 500, 1290) == -ETIME);
+	expect_frame(&ring, 502);
+	/* a new talkspurt behind the playout starts over */
+	OSMO_ASSERT(put_rtp(&ring, TEST_SSRC, 498, true, 1300) == 0);
+	OSMO_ASSERT(put_frame(&ring, 499, 1320) == 0);
+	OSMO_ASSERT(put_frame(&ring, 500, 1340) == 0);
+	OSMO_ASSERT(ring.stats.resync == 3);
+	expect_frame(&ring, 498);
+	expect_frame(&ring, 499);
+	expect_frame(&ring, 500);
+	/* and so does another sender */
+	OSMO_ASSERT(put_rtp(&ring, TEST_SSRC + 1, 499, false, 1360) == 0);
+	OSMO_ASSERT(put_rtp(&ring, TEST_SSRC + 1, 500, false, 1380) == 0);
+	OSMO_ASSERT(put_rtp(&ring, TEST_SSRC + 1, 501, false, 1400) == 0);
+	OSMO_ASSERT(ring.stats.resync == 4);
+	expect_frame(&ring, 499);
+	expect_frame(&ring, 500);
+	expect_frame(&ring, 501);
+	/* a new connection (MDCX) starts over with any frame */
+	dl_tch_ring_resync(&ring);
+	OSMO_ASSERT(put_frame(&ring, 300, 1420) == 0);
+	OSMO_ASSERT(put_frame(&ring, 301, 1440) == 0);
+	OSMO_ASSERT(put_frame(&ring, 302, 1460) == 0);
+	expect_frame(&ring, 300);
+	OSMO_ASSERT(ring.stats.resync == 4);
+
+	/* adaptive: the depth follows the jitter */
+	dl_tch_ring_init(&ring, 10, true);
+	OSMO_ASSERT(ring.depth == 1);
+	OSMO_ASSERT(put_frame(&ring, 100, 1000) == 0);
+	OSMO_ASSERT(put_frame(&ring, 101, 1020) == 0);
+	OSMO_ASSERT(ring.stats.jitter == 0 && ring.depth == 1);
+	/* 100 ms late */
+	OSMO_ASSERT(put_frame(&ring, 102, 1140) == 0);
+	OSMO_ASSERT(ring.stats.delay_hist[5] == 1);
+	OSMO_ASSERT(ring.depth == 2);
+
+	/* the maximum is bounded by the ring, the depth follows it down */
+	dl_tch_ring_set_max_depth(&ring, 100);
+	OSMO_ASSERT(ring.max_depth == DL_TCH_RING_LEN - 2 && ring.depth == 2);
+	dl_tch_ring_set_max_depth(&ring, 0);
+	OSMO_ASSERT(ring.max_depth == 1 && ring.depth == 1);
+
+	/* a flush keeps the statistics and takes any frame next */
+	dl_tch_ring_init(&ring, 2, false);
+	OSMO_ASSERT(put_frame(&ring, 100, 1000) == 0);
+	OSMO_ASSERT(put_frame(&ring, 101, 1020) == 0);
+	expect_frame(&ring, 100);
+	dl_tch_ring_flush(&ring);
+	expect_frame(&ring, -1);
+	OSMO_ASSERT(ring.stats.received == 2 && ring.stats.played == 1);
+	OSMO_ASSERT(put_frame(&ring, 50, 1040) == 0);
+	OSMO_ASSERT(put_frame(&ring, 51, 1060) == 0);
+	expect_frame(&ring, 50);
+	expect_frame(&ring, 51);
+
+	/* frames that do not fit are refused, not counted */
+	OSMO_ASSERT(dl_tch_ring_put(&ring, NULL, DL_TCH_FRAME_MAXLEN + 1, TEST_SSRC,
+				    52, 0, false, NULL) == -EMSGSIZE);
+	OSMO_ASSERT(ring.stats.received == 4);
+
+	/* a msgb freed by the PHY is used for the next frame */
+	OSMO_ASSERT(put_frame(&ring, 52, 1080) == 0);
+	OSMO_ASSERT(put_frame(&ring, 53, 1100) == 0);
+	msg = dl_tch_ring_get(&ring);
+	msg2 = dl_tch_ring_get(&ring);
+	OSMO_ASSERT(msg && msg2 && msg != msg2);
+	msgb_free(msg);
+	OSMO_ASSERT(put_frame(&ring, 54, 1120) == 0);
+	OSMO_ASSERT(dl_tch_ring_get(&ring) == msg);
+	OSMO_ASSERT(rtpmsg_seq(msg) == 54 && msg->len == 33 && msg->data[0] == 54);
+	OSMO_ASSERT(msgb_headroom(msg) >= sizeof(struct osmo_phsap_prim));
+	msgb_free(msg);
+	msgb_free(msg2);
+}
+
+int main(int argc, char **argv)
+{
+	tall_bts_ctx = talloc_named_const(NULL, 1, "OsmoBTS context");
+	msgb_talloc_ctx_init(tall_bts_ctx, 0);
+
+	bts_log_init(NULL);
+
+	test_dl_tch_ring();
+	printf("Success\n");
+
+	return 0;
+}
@@ -0,0 +1,80 @@
+/* testing the binary trace */
+
+/* All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/msgb.h>
+
+#include <osmo-bts/bts.h>
+#include <osmo-bts/logging.h>
+#include <osmo-bts/trace.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+static void test_bts_trace(void)
+{
+	char path[] = "/tmp/bts_trace_XXXXXX";
+	struct bts_trace_file_hdr fh;
+	struct bts_trace_ring_hdr rh;
+	struct bts_trace_rec rec;
+	unsigned int i;
+	FILE *f;
+	int fd;
+
+	printf("Testing binary trace\n");
+
+	for (i = 0; i < 10; i++)
+		bts_trace(BTS_TRACE_EV_PH_RTS_IND, 1000 + i, 0, i % 8, 0x08, i);
+
+	fd = mkstemp(path);
+	OSMO_ASSERT(fd >= 0);
+	close(fd);
+	OSMO_ASSERT(bts_trace_dump(path) == 0);
+
+	f = fopen(path, "r");
+	OSMO_ASSERT(f);
+	OSMO_ASSERT(fread(&fh, sizeof(fh), 1, f) == 1);
+	OSMO_ASSERT(fh.magic == BTS_TRACE_FILE_MAGIC);
+	OSMO_ASSERT(fh.rec_size == sizeof(rec));
+	OSMO_ASSERT(fh.num_rings == 1);
+	OSMO_ASSERT(fread(&rh, sizeof(rh), 1, f) == 1);
+	OSMO_ASSERT(rh.magic == BTS_TRACE_RING_MAGIC);
+	OSMO_ASSERT(rh.num_recs == 10 && rh.overwritten == 0);
+	for (i = 0; i < 10; i++) {
+		OSMO_ASSERT(fread(&rec, sizeof(rec), 1, f) == 1);
+		OSMO_ASSERT(rec.event == BTS_TRACE_EV_PH_RTS_IND);
+		OSMO_ASSERT(rec.fn == 1000 + i && rec.tn == i % 8 && rec.arg == i);
+	}
+	OSMO_ASSERT(fread(&rec, sizeof(rec), 1, f) == 0);
+	fclose(f);
+	unlink(path);
+}
+
+int main(int argc, char **argv)
+{
+	tall_bts_ctx = talloc_named_const(NULL, 1, "OsmoBTS context");
+	msgb_talloc_ctx_init(tall_bts_ctx, 0);
+
+	bts_log_init(NULL);
+
+	test_bts_trace();
+	printf("Success\n");
+
+	return 0;
+}
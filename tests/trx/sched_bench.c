@@ -0,0 +1,441 @@
+/* Offline benchmark of the common scheduler plus the osmo-bts-trx channel
+ * coders, driving trx_sched_fn() and trx_sched_ul_burst() without a timer
+ * and without a transceiver.
+ *
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/gsm/protocol/gsm_04_08.h>
+#include <osmocom/gsm/protocol/gsm_08_58.h>
+
+#include <osmo-bts/bts.h>
+#include <osmo-bts/gsm_data.h>
+#include <osmo-bts/logging.h>
+#include <osmo-bts/l1sap.h>
+#include <osmo-bts/phy_link.h>
+#include <osmo-bts/scheduler.h>
+#include <osmo-bts/scheduler_backend.h>
+
+#include "l1_if.h"
+#include "trx_if.h"
+#include "sbits.h"
+
+/*
+ * allocation counter
+ */
+
+static unsigned long num_allocs;
+
+#ifdef __GLIBC__
+/* count every heap allocation, including those of talloc and msgb */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+	num_allocs++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	num_allocs++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	num_allocs++;
+	return __libc_realloc(ptr, size);
+}
+#define HAVE_ALLOC_COUNT 1
+#endif
+
+/*
+ * what main.c and trx_vty.c provide in the real osmo-bts-trx
+ */
+
+int quit = 0;
+
+uint32_t trx_get_hlayer1(struct gsm_bts_trx *trx)
+{ return 0; }
+void bts_model_print_help()
+{ }
+int bts_model_handle_options(int argc, char **argv)
+{ return 0; }
+int bts_model_init(struct gsm_bts *bts)
+{
+	bts->variant = BTS_OSMO_TRX;
+	trx_sbits_init();
+	return 0;
+}
+int bts_model_vty_init(struct gsm_bts *bts)
+{ return 0; }
+int bts_model_ctrl_cmds_install(struct gsm_bts *bts)
+{ return 0; }
+void bts_model_config_write_phy(struct vty *vty, struct phy_link *plink)
+{ }
+void bts_model_config_write_phy_inst(struct vty *vty, struct phy_instance *pinst)
+{ }
+void bts_model_config_write_bts(struct vty *vty, struct gsm_bts *bts)
+{ }
+void bts_model_config_write_trx(struct vty *vty, struct gsm_bts_trx *trx)
+{ }
+
+void bts_model_phy_link_set_defaults(struct phy_link *plink)
+{
+	plink->u.osmotrx.clock_advance = 20;
+	plink->u.osmotrx.rts_advance = 5;
+	plink->u.osmotrx.trx_ta_loop = true;
+	plink->u.osmotrx.trx_ms_power_loop = false;
+	plink->u.osmotrx.trx_target_rssi = -10;
+	plink->u.osmotrx.burst_batching = true;
+	plink->u.osmotrx.rx_batch_max = 16;
+}
+
+void bts_model_phy_instance_set_defaults(struct phy_instance *pinst)
+{
+	struct trx_l1h *l1h;
+	l1h = talloc_zero(tall_bts_ctx, struct trx_l1h);
+	l1h->phy_inst = pinst;
+	pinst->u.osmotrx.hdl = l1h;
+
+	l1h->config.power_oml = 1;
+}
+
+/*
+ * setup
+ */
+
+/* channel combinations of C0 and of all other TRX */
+static const enum gsm_phys_chan_config layout_c0[TRX_NR_TS] = {
+	GSM_PCHAN_CCCH_SDCCH4, GSM_PCHAN_SDCCH8_SACCH8C,
+	GSM_PCHAN_TCH_F, GSM_PCHAN_TCH_F,
+	GSM_PCHAN_TCH_H, GSM_PCHAN_TCH_H,
+	GSM_PCHAN_PDCH, GSM_PCHAN_PDCH,
+};
+static const enum gsm_phys_chan_config layout_cn[TRX_NR_TS] = {
+	GSM_PCHAN_SDCCH8_SACCH8C, GSM_PCHAN_TCH_F,
+	GSM_PCHAN_TCH_F, GSM_PCHAN_TCH_F,
+	GSM_PCHAN_TCH_H, GSM_PCHAN_TCH_H,
+	GSM_PCHAN_PDCH, GSM_PCHAN_PDCH,
+};
+
+static struct gsm_bts *bts;
+
+/* the data socket only needs to swallow bursts, UDP never blocks the
+ * sender if nobody reads */
+static int open_sink(void)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	int rx, tx;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	rx = socket(AF_INET, SOCK_DGRAM, 0);
+	tx = socket(AF_INET, SOCK_DGRAM, 0);
+	if (rx < 0 || tx < 0)
+		return -1;
+	if (bind(rx, (struct sockaddr *) &addr, sizeof(addr)) < 0
+	 || getsockname(rx, (struct sockaddr *) &addr, &len) < 0
+	 || connect(tx, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+		return -1;
+
+	return tx;
+}
+
+/* activate all dedicated channels of a timeslot, as RSL would */
+static void setup_ts(struct gsm_bts_trx *trx, struct l1sched_trx *l1t,
+		     uint8_t tn, enum gsm_phys_chan_config pchan)
+{
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
+	struct gsm_bts_trx_ts *ts = &trx->ts[tn];
+	int c;
+
+	ts->pchan = pchan;
+	if (trx_sched_set_pchan(l1t, tn, pchan) < 0) {
+		fprintf(stderr, "Cannot set pchan on TS %u\n", tn);
+		exit(1);
+	}
+
+	for (c = 0; c < _TRX_CHAN_MAX; c++) {
+		const struct trx_chan_desc *desc = &trx_chan_desc[c];
+		uint8_t chan_nr = desc->chan_nr | tn;
+		struct gsm_lchan *lchan;
+
+		/* only channels of this multiframe that need activation */
+		if (desc->auto_active || !l1ts->chan_state[c].burst_buf_len)
+			continue;
+
+		trx_sched_set_lchan(l1t, chan_nr, desc->link_id, 1);
+		if (c == TRXC_TCHF || c == TRXC_TCHH_0 || c == TRXC_TCHH_1)
+			trx_sched_set_mode(l1t, chan_nr, RSL_CMOD_SPD_SPEECH,
+					   GSM48_CMODE_SPEECH_V1, 0, 0, 0, 0,
+					   0, 0, 0);
+
+		if (desc->pdch || L1SAP_IS_LINK_SACCH(desc->link_id))
+			continue;
+		lchan = &ts->lchan[l1sap_chan2ss(chan_nr)];
+		lchan_init_lapdm(lchan);
+		lchan_set_state(lchan, LCHAN_S_ACTIVE);
+	}
+}
+
+static void setup_bts(unsigned int num_trx)
+{
+	struct phy_link *plink;
+	unsigned int i;
+	uint8_t tn;
+
+	bts = gsm_bts_alloc(tall_bts_ctx, 0);
+	if (!bts || bts_init(bts) < 0) {
+		fprintf(stderr, "unable to open bts\n");
+		exit(1);
+	}
+	for (i = 1; i < num_trx; i++)
+		gsm_bts_trx_alloc(bts);
+
+	plink = phy_link_create(tall_bts_ctx, 0);
+	transceiver_available = 1;
+
+	for (i = 0; i < num_trx; i++) {
+		struct gsm_bts_trx *trx = gsm_bts_trx_num(bts, i);
+		struct phy_instance *pinst = phy_instance_create(plink, i);
+		struct trx_l1h *l1h = pinst->u.osmotrx.hdl;
+
+		phy_instance_link_to_trx(pinst, trx);
+		INIT_LLIST_HEAD(&l1h->trx_ctrl_list);
+		l1h->trx_ofd_data.fd = open_sink();
+		if (l1h->trx_ofd_data.fd < 0) {
+			fprintf(stderr, "unable to open data socket\n");
+			exit(1);
+		}
+		l1h->config.poweron = 1;
+		trx_sched_init(&l1h->l1s, trx);
+
+		for (tn = 0; tn < TRX_NR_TS; tn++)
+			setup_ts(trx, &l1h->l1s, tn, i ? layout_cn[tn] : layout_c0[tn]);
+	}
+}
+
+/*
+ * measurement
+ */
+
+#define NUM_UL_BURSTS	64
+
+static sbit_t ul_bursts[NUM_UL_BURSTS][GSM_BURST_LEN];
+
+struct chan_stats {
+	unsigned long	dl_bursts;
+	uint64_t	dl_ns;
+	unsigned long	ul_bursts;
+	uint64_t	ul_ns;
+};
+
+static struct chan_stats chan_stats[_TRX_CHAN_MAX];
+
+static inline uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* noise bursts, so that the decoders do the full work */
+static void gen_ul_bursts(void)
+{
+	unsigned int i, j;
+
+	srand(1234);
+	for (i = 0; i < NUM_UL_BURSTS; i++)
+		for (j = 0; j < GSM_BURST_LEN; j++)
+			ul_bursts[i][j] = (rand() % 255) - 127;
+}
+
+/* feed one UL burst of the given FN to every TS of every TRX */
+static void inject_ul(uint32_t fn, int timed)
+{
+	struct gsm_bts_trx *trx;
+	sbit_t bits[GSM_BURST_LEN];
+	uint8_t tn;
+
+	llist_for_each_entry(trx, &bts->trx_list, list) {
+		struct l1sched_trx *l1t = trx_l1sched_hdl(trx);
+
+		for (tn = 0; tn < TRX_NR_TS; tn++) {
+			struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
+			enum trx_chan_type chan;
+			uint64_t start;
+
+			memcpy(bits, ul_bursts[(fn + tn) % NUM_UL_BURSTS], sizeof(bits));
+			if (!timed) {
+				trx_sched_ul_burst(l1t, tn, fn, bits, GSM_BURST_LEN, -60, 0);
+				continue;
+			}
+
+			chan = l1ts->mf_table[fn % l1ts->mf_period].ul_chan;
+			start = now_ns();
+			trx_sched_ul_burst(l1t, tn, fn, bits, GSM_BURST_LEN, -60, 0);
+			chan_stats[chan].ul_ns += now_ns() - start;
+			chan_stats[chan].ul_bursts++;
+		}
+	}
+}
+
+/* per TS equivalent of trx_sched_fn(), without the transport */
+static void timed_dl(uint32_t fn)
+{
+	struct gsm_bts_trx *trx;
+	uint16_t nbits;
+	uint8_t tn;
+
+	llist_for_each_entry(trx, &bts->trx_list, list) {
+		struct phy_link *plink = trx_phy_instance(trx)->phy_link;
+		struct l1sched_trx *l1t = trx_l1sched_hdl(trx);
+		uint32_t dl_fn = (fn + plink->u.osmotrx.clock_advance) % GSM_HYPERFRAME;
+		uint32_t rts_fn = (dl_fn + plink->u.osmotrx.rts_advance) % GSM_HYPERFRAME;
+
+		for (tn = 0; tn < TRX_NR_TS; tn++) {
+			struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
+			enum trx_chan_type chan;
+			uint64_t start;
+
+			chan = l1ts->mf_table[dl_fn % l1ts->mf_period].dl_chan;
+			start = now_ns();
+			_sched_rts(l1t, tn, rts_fn);
+			_sched_dl_burst(l1t, tn, dl_fn, &nbits);
+			chan_stats[chan].dl_ns += now_ns() - start;
+			chan_stats[chan].dl_bursts++;
+		}
+	}
+}
+
+static void print_chan_stats(void)
+{
+	int c;
+
+	printf("%-12s %10s %10s %10s %10s\n", "channel", "DL bursts",
+	       "DL ns", "UL bursts", "UL ns");
+	for (c = 0; c < _TRX_CHAN_MAX; c++) {
+		struct chan_stats *cs = &chan_stats[c];
+
+		if (!cs->dl_bursts && !cs->ul_bursts)
+			continue;
+		printf("%-12s %10lu %10.0f %10lu %10.0f\n", trx_chan_desc[c].name,
+		       cs->dl_bursts, cs->dl_bursts ? (double) cs->dl_ns / cs->dl_bursts : 0,
+		       cs->ul_bursts, cs->ul_bursts ? (double) cs->ul_ns / cs->ul_bursts : 0);
+	}
+}
+
+static void print_help(const char *prog)
+{
+	printf("Usage: %s [-t num_trx] [-f frames]\n"
+	       "  -t  number of TRX (default 1)\n"
+	       "  -f  number of TDMA frames per run (default 13260)\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int num_trx = 1, num_frames = 51 * 26 * 10;
+	unsigned long allocs;
+	uint64_t start, elapsed;
+	uint32_t fn = 1;
+	unsigned int i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:f:h")) != -1) {
+		switch (opt) {
+		case 't':
+			num_trx = atoi(optarg);
+			break;
+		case 'f':
+			num_frames = atoi(optarg);
+			break;
+		default:
+			print_help(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (num_trx < 1 || num_frames < 1) {
+		print_help(argv[0]);
+		return 1;
+	}
+
+	tall_bts_ctx = talloc_named_const(NULL, 1, "OsmoBTS context");
+	msgb_talloc_ctx_init(tall_bts_ctx, 0);
+	bts_log_init(NULL);
+	log_set_log_level(osmo_stderr_target, LOGL_FATAL);
+
+	setup_bts(num_trx);
+	gen_ul_bursts();
+
+	/* warm up, so that the first blocks of all channels are set up */
+	for (i = 0; i < 104; i++, fn++) {
+		trx_sched_fn(bts, fn);
+		inject_ul(fn, 0);
+	}
+
+	/* end-to-end: as driven by the frame clock */
+	allocs = num_allocs;
+	start = now_ns();
+	for (i = 0; i < num_frames; i++, fn = (fn + 1) % GSM_HYPERFRAME) {
+		trx_sched_fn(bts, fn);
+		inject_ul(fn, 0);
+	}
+	elapsed = now_ns() - start;
+	allocs = num_allocs - allocs;
+
+	printf("TRX: %u, frames: %u, soft-bits: %s\n", num_trx, num_frames,
+	       trx_sbits_impl_name);
+	printf("frames/sec: %.0f (%.1f x real time)\n",
+	       num_frames * 1e9 / elapsed,
+	       num_frames * 4615384.0 / elapsed);
+#ifdef HAVE_ALLOC_COUNT
+	printf("allocations: %lu (%.2f per frame)\n", allocs,
+	       (double) allocs / num_frames);
+#else
+	printf("allocations: n/a\n");
+#endif
+
+	/* per channel type, each burst timed on its own */
+	for (i = 0; i < num_frames; i++, fn = (fn + 1) % GSM_HYPERFRAME) {
+		timed_dl(fn);
+		inject_ul(fn, 1);
+	}
+	print_chan_stats();
+
+	return 0;
+}
@@ -0,0 +1,259 @@
+/*
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include <osmocom/core/bits.h>
+#include <osmocom/core/utils.h>
+
+#include "sbits.h"
+#include "spsc.h"
+
+#define ASSERT_TRUE(rc) \
+	if (!(rc)) { \
+		printf("Assert failed in %s:%d.\n",  \
+		       __FILE__, __LINE__);          \
+		abort();			     \
+	}
+
+/* the conversion loop as it was used in trx_data_read_cb() */
+static void ref_conv(sbit_t *bits, const uint8_t *buf, int burst_len)
+{
+	int i;
+
+	for (i = 0; i < burst_len; i++) {
+		if (buf[i] == 255)
+			bits[i] = -127;
+		else
+			bits[i] = 127 - buf[i];
+	}
+}
+
+struct sbits_impl {
+	const char *name;
+	trx_sbits_conv_func *func;
+	int (*avail)(void);
+};
+
+static int always(void)
+{
+	return 1;
+}
+
+static const struct sbits_impl impls[] = {
+	{ "scalar",	trx_sbits_conv_scalar,	always },
+#if defined(__x86_64__) || defined(__i386__)
+	{ "sse2",	trx_sbits_conv_sse2,	trx_sbits_have_sse2 },
+	{ "avx2",	trx_sbits_conv_avx2,	trx_sbits_have_avx2 },
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+	{ "neon",	trx_sbits_conv_neon,	trx_sbits_have_neon },
+#endif
+};
+
+/* check one implementation against the reference for a given input,
+ * including unaligned start and odd lengths */
+static void check_impl(const struct sbits_impl *impl, const uint8_t *in,
+		       unsigned int len)
+{
+	sbit_t ref[512 + 32], out[512 + 32];
+	unsigned int offs;
+
+	for (offs = 0; offs < 4; offs++) {
+		ref_conv(ref, in + offs, len);
+		memset(out, 0x55, sizeof(out));
+		impl->func(out + offs, in + offs, len);
+		ASSERT_TRUE(memcmp(ref, out + offs, len) == 0);
+		/* must not write past the end */
+		ASSERT_TRUE(out[offs + len] == 0x55);
+	}
+}
+
+static void test_sbits_conv(void)
+{
+	static const unsigned int lens[] = { 0, 1, 15, 16, 17, 31, 32, 33, 148, 444 };
+	uint8_t in[512 + 4];
+	unsigned int i, j, n;
+
+	printf("Testing soft-bit conversion\n");
+
+	for (i = 0; i < ARRAY_SIZE(impls); i++) {
+		if (!impls[i].avail())
+			continue;
+
+		/* all possible values */
+		for (j = 0; j < sizeof(in); j++)
+			in[j] = j & 0xff;
+		for (n = 0; n < ARRAY_SIZE(lens); n++)
+			check_impl(&impls[i], in, lens[n]);
+
+		/* pseudo-random bursts */
+		srand(1234);
+		for (n = 0; n < 1000; n++) {
+			for (j = 0; j < sizeof(in); j++)
+				in[j] = rand() & 0xff;
+			check_impl(&impls[i], in, lens[n % ARRAY_SIZE(lens)]);
+		}
+	}
+
+	/* whatever gets selected at runtime must match as well */
+	trx_sbits_init();
+	for (j = 0; j < sizeof(in); j++)
+		in[j] = j & 0xff;
+	for (n = 0; n < ARRAY_SIZE(lens); n++) {
+		struct sbits_impl sel = { trx_sbits_impl_name, trx_sbits_conv, always };
+		check_impl(&sel, in, lens[n]);
+	}
+}
+
+static void test_spsc_ring_basic(void)
+{
+	struct spsc_ring r;
+	uint32_t buf[8];
+	uint32_t *e;
+	unsigned int i, round;
+
+	ASSERT_TRUE(spsc_ring_init(&r, buf, sizeof(buf[0]), 6) < 0);
+	ASSERT_TRUE(spsc_ring_init(&r, buf, sizeof(buf[0]), 8) == 0);
+	ASSERT_TRUE(spsc_ring_peek(&r) == NULL);
+
+	/* fill and drain a few times, so that the indices wrap */
+	for (round = 0; round < 5; round++) {
+		for (i = 0; i < 8; i++) {
+			e = spsc_ring_claim(&r);
+			ASSERT_TRUE(e != NULL);
+			*e = round * 100 + i;
+			spsc_ring_commit(&r);
+		}
+		ASSERT_TRUE(spsc_ring_claim(&r) == NULL);
+		ASSERT_TRUE(spsc_ring_count(&r) == 8);
+
+		for (i = 0; i < 8; i++) {
+			e = spsc_ring_peek(&r);
+			ASSERT_TRUE(e != NULL);
+			ASSERT_TRUE(*e == round * 100 + i);
+			spsc_ring_release(&r);
+		}
+		ASSERT_TRUE(spsc_ring_peek(&r) == NULL);
+		ASSERT_TRUE(spsc_ring_count(&r) == 0);
+	}
+}
+
+#define SPSC_ITEMS	(1 << 20)
+
+static void *spsc_producer(void *arg)
+{
+	struct spsc_ring *r = arg;
+	uint32_t *e;
+	uint32_t i;
+
+	for (i = 0; i < SPSC_ITEMS; i++) {
+		while (!(e = spsc_ring_claim(r)))
+			sched_yield();
+		*e = i;
+		spsc_ring_commit(r);
+	}
+
+	return NULL;
+}
+
+/* one producer thread, consumer must see every item once and in order */
+static void test_spsc_ring_threads(void)
+{
+	struct spsc_ring r;
+	uint32_t buf[64];
+	pthread_t producer;
+	uint32_t *e;
+	uint32_t expect = 0;
+
+	ASSERT_TRUE(spsc_ring_init(&r, buf, sizeof(buf[0]), 64) == 0);
+	ASSERT_TRUE(pthread_create(&producer, NULL, spsc_producer, &r) == 0);
+
+	while (expect < SPSC_ITEMS) {
+		e = spsc_ring_peek(&r);
+		if (!e) {
+			sched_yield();
+			continue;
+		}
+		ASSERT_TRUE(*e == expect);
+		spsc_ring_release(&r);
+		expect++;
+	}
+
+	pthread_join(producer, NULL);
+	ASSERT_TRUE(spsc_ring_peek(&r) == NULL);
+}
+
+static void test_spsc_ring(void)
+{
+	printf("Testing SPSC ring\n");
+
+	test_spsc_ring_basic();
+	test_spsc_ring_threads();
+}
+
+/* size of an 8PSK (EGPRS) burst, the worst case */
+#define BENCH_BURST_LEN	444
+
+/* micro-benchmark, only run if requested as it has no stable output */
+static void bench_sbits_conv(unsigned int rounds)
+{
+	uint8_t in[BENCH_BURST_LEN];
+	sbit_t out[BENCH_BURST_LEN];
+	struct timespec start, end;
+	unsigned int i, r;
+
+	for (i = 0; i < sizeof(in); i++)
+		in[i] = rand() & 0xff;
+
+	for (i = 0; i < ARRAY_SIZE(impls); i++) {
+		double ns;
+
+		if (!impls[i].avail())
+			continue;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (r = 0; r < rounds; r++) {
+			impls[i].func(out, in, sizeof(in));
+			/* don't let the compiler drop the loop */
+			__asm__ __volatile__("" : : "r" (out) : "memory");
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+		fprintf(stderr, "%-8s %8.1f ns/burst (%u bursts of %u sbits)\n",
+			impls[i].name, ns / rounds, rounds, (unsigned int) sizeof(in));
+	}
+}
+
+int main(int argc, char **argv)
+{
+	test_sbits_conv();
+	test_spsc_ring();
+
+	if (argc > 1 && !strcmp(argv[1], "-b"))
+		bench_sbits_conv(argc > 2 ? atoi(argv[2]) : 1000000);
+
+	printf("Success\n");
+
+	return 0;
+}